@@ -0,0 +1,125 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Graphics/Animation.h>
+#include <Urho3D/IO/Log.h>
+#include <Urho3D/Resource/ResourceCache.h>
+#include <Urho3D/Resource/XMLFile.h>
+
+#include "AnimationSet.h"
+
+#include <Urho3D/DebugNew.h>
+//=============================================================================
+//=============================================================================
+AnimationSet::AnimationSet(Context* context) :
+    Resource(context)
+{
+}
+
+AnimationSet::~AnimationSet()
+{
+}
+
+void AnimationSet::RegisterObject(Context* context)
+{
+    context->RegisterFactory<AnimationSet>();
+}
+
+bool AnimationSet::BeginLoad(Deserializer& source)
+{
+    SharedPtr<XMLFile> xmlFile(new XMLFile(context_));
+
+    if (!xmlFile->Load(source) || !ParseXML(xmlFile))
+    {
+        return false;
+    }
+
+    // queue the clips when loading in the background
+    if (GetAsyncLoadState() == ASYNC_LOADING)
+    {
+        ResourceCache* cache = GetSubsystem<ResourceCache>();
+
+        for (unsigned i = 0; i < loadAnimations_.Size(); ++i)
+        {
+            cache->BackgroundLoadResource<Animation>(loadAnimations_[i], true, this);
+        }
+    }
+
+    return true;
+}
+
+bool AnimationSet::ParseXML(XMLFile *xmlFile)
+{
+    XMLElement rootElem = xmlFile->GetRoot("animationset");
+
+    names_.Clear();
+    loadAnimations_.Clear();
+
+    for (XMLElement clipElem = rootElem.GetChild("clip"); clipElem; clipElem = clipElem.GetNext("clip"))
+    {
+        const String name = clipElem.GetAttribute("name");
+
+        if (name.Empty() || names_.Contains(name))
+        {
+            URHO3D_LOGERROR("AnimationSet: missing or duplicate clip name \"" + name + "\" in " + GetName());
+            return false;
+        }
+
+        names_.Push(name);
+        loadAnimations_.Push(clipElem.GetAttribute("animation"));
+    }
+
+    return true;
+}
+
+bool AnimationSet::EndLoad()
+{
+    ResourceCache* cache = GetSubsystem<ResourceCache>();
+
+    animations_.Clear();
+
+    for (unsigned i = 0; i < loadAnimations_.Size(); ++i)
+    {
+        Animation *animation = cache->GetResource<Animation>(loadAnimations_[i]);
+
+        if (!animation)
+        {
+            return false;
+        }
+
+        animations_.Push(SharedPtr<Animation>(animation));
+    }
+
+    loadAnimations_.Clear();
+
+    SetMemoryUse(sizeof(AnimationSet) + names_.Size() * (sizeof(String) + sizeof(SharedPtr<Animation>)));
+
+    return true;
+}
+
+unsigned AnimationSet::GetHandle(const String& name) const
+{
+    Vector<String>::ConstIterator itr = names_.Find(name);
+
+    return itr != names_.End() ? (unsigned)(itr - names_.Begin()) : INVALID_ANIM_HANDLE;
+}
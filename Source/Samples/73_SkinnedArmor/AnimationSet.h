@@ -0,0 +1,82 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#pragma once
+
+#include <Urho3D/Resource/Resource.h>
+
+using namespace Urho3D;
+namespace Urho3D
+{
+class Animation;
+class XMLFile;
+}
+
+/// Handle of a clip that is not in the set.
+const unsigned INVALID_ANIM_HANDLE = M_MAX_UNSIGNED;
+
+//=============================================================================
+// animation set resource: a character's clips by short name.
+//
+// <animationset>
+//     <clip name="Run" animation="...ani" />
+// </animationset>
+//
+// Loading resolves every clip once. A clip's handle is its index in the set,
+// and AnimationSetController takes handles instead of resource names.
+//=============================================================================
+class AnimationSet : public Resource
+{
+    URHO3D_OBJECT(AnimationSet, Resource);
+
+public:
+    /// Construct.
+    AnimationSet(Context* context);
+    virtual ~AnimationSet();
+
+    /// Register object factory.
+    static void RegisterObject(Context* context);
+
+    /// Load resource from stream. May be called from a worker thread. Return true if successful.
+    virtual bool BeginLoad(Deserializer& source);
+    /// Finish resource loading. Always called from the main thread. Return true if successful.
+    virtual bool EndLoad();
+
+    /// Return handle of a clip by name, or INVALID_ANIM_HANDLE.
+    unsigned GetHandle(const String& name) const;
+    /// Return number of clips.
+    unsigned GetNumAnimations() const { return animations_.Size(); }
+    /// Return clip animation by handle.
+    Animation* GetAnimation(unsigned handle) const { return handle < animations_.Size() ? animations_[handle] : NULL; }
+    /// Return clip name by handle.
+    const String& GetClipName(unsigned handle) const { return handle < names_.Size() ? names_[handle] : String::EMPTY; }
+
+private:
+    bool ParseXML(XMLFile *xmlFile);
+
+    // resolved clips, indexed by handle
+    Vector<String>               names_;
+    Vector<SharedPtr<Animation> > animations_;
+
+    // load-time clip resource names, released in EndLoad()
+    Vector<String>               loadAnimations_;
+};
@@ -0,0 +1,267 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Graphics/AnimatedModel.h>
+#include <Urho3D/Graphics/Animation.h>
+#include <Urho3D/Graphics/AnimationState.h>
+#include <Urho3D/IO/Log.h>
+#include <Urho3D/Scene/Scene.h>
+#include <Urho3D/Scene/SceneEvents.h>
+
+#include "AnimationSetController.h"
+
+#include <Urho3D/DebugNew.h>
+//=============================================================================
+//=============================================================================
+AnimationSetController::AnimationSetController(Context* context) :
+    Component(context)
+{
+}
+
+AnimationSetController::~AnimationSetController()
+{
+}
+
+void AnimationSetController::RegisterObject(Context* context)
+{
+    context->RegisterFactory<AnimationSetController>();
+}
+
+void AnimationSetController::OnSetEnabled()
+{
+    Scene* scene = GetScene();
+
+    if (scene)
+    {
+        if (IsEnabledEffective())
+            SubscribeToEvent(scene, E_SCENEPOSTUPDATE, URHO3D_HANDLER(AnimationSetController, HandleScenePostUpdate));
+        else
+            UnsubscribeFromEvent(scene, E_SCENEPOSTUPDATE);
+    }
+}
+
+void AnimationSetController::OnSceneSet(Scene* scene)
+{
+    if (scene && IsEnabledEffective())
+        SubscribeToEvent(scene, E_SCENEPOSTUPDATE, URHO3D_HANDLER(AnimationSetController, HandleScenePostUpdate));
+    else if (!scene)
+        UnsubscribeFromEvent(E_SCENEPOSTUPDATE);
+}
+
+bool AnimationSetController::SetAnimationSet(AnimationSet *animationSet)
+{
+    AnimatedModel *model = node_ ? node_->GetComponent<AnimatedModel>() : NULL;
+
+    if (!model)
+    {
+        URHO3D_LOGERROR("AnimationSetController: no AnimatedModel on the node");
+        return false;
+    }
+
+    for (unsigned i = 0; i < controls_.Size(); ++i)
+    {
+        model->RemoveAnimationState(controls_[i].state_);
+    }
+
+    animationSet_ = animationSet;
+    controls_.Clear();
+
+    if (!animationSet_)
+    {
+        return true;
+    }
+
+    controls_.Resize(animationSet_->GetNumAnimations());
+
+    for (unsigned i = 0; i < controls_.Size(); ++i)
+    {
+        AnimationState *state = model->AddAnimationState(animationSet_->GetAnimation(i));
+
+        if (!state)
+        {
+            return false;
+        }
+
+        state->SetWeight(0.0f);
+        controls_[i].state_ = state;
+    }
+
+    return true;
+}
+
+void AnimationSetController::Update(float timeStep)
+{
+    for (unsigned i = 0; i < controls_.Size(); ++i)
+    {
+        ClipControl &ctrl = controls_[i];
+
+        if (!ctrl.playing_)
+            continue;
+
+        AnimationState *state = ctrl.state_;
+
+        // Advance the animation
+        if (ctrl.speed_ != 0.0f)
+            state->AddTime(ctrl.speed_ * timeStep);
+
+        // Process weight fade
+        float currentWeight = state->GetWeight();
+
+        if (currentWeight != ctrl.targetWeight_)
+        {
+            if (ctrl.fadeTime_ > 0.0f)
+            {
+                float weightDelta = 1.0f / ctrl.fadeTime_ * timeStep;
+
+                if (currentWeight < ctrl.targetWeight_)
+                    currentWeight = Min(currentWeight + weightDelta, ctrl.targetWeight_);
+                else
+                    currentWeight = Max(currentWeight - weightDelta, ctrl.targetWeight_);
+
+                state->SetWeight(currentWeight);
+            }
+            else
+                state->SetWeight(ctrl.targetWeight_);
+        }
+
+        // Faded out: where AnimationController removes the state, keep it at zero weight
+        if (state->GetWeight() == 0.0f && (ctrl.targetWeight_ == 0.0f || ctrl.fadeTime_ == 0.0f))
+            ctrl.playing_ = false;
+    }
+}
+
+bool AnimationSetController::Play(unsigned handle, unsigned char layer, bool looped, float fadeInTime)
+{
+    // not a clip of this controller's model
+    if (handle >= controls_.Size() || !controls_[handle].state_)
+        return false;
+
+    ClipControl &ctrl = controls_[handle];
+    AnimationState *state = ctrl.state_;
+
+    // a clip that faded out restarts like a newly added one. As with AnimationController, the layer
+    // only applies to a newly added clip, a playing one stays on its layer
+    if (!ctrl.playing_)
+    {
+        state->SetTime(0.0f);
+        state->SetWeight(0.0f);
+        state->SetLayer(layer);
+        ctrl.speed_ = 1.0f;
+        ctrl.playing_ = true;
+    }
+
+    state->SetLooped(looped);
+    ctrl.targetWeight_ = 1.0f;
+    ctrl.fadeTime_ = fadeInTime;
+
+    return true;
+}
+
+bool AnimationSetController::PlayExclusive(unsigned handle, unsigned char layer, bool looped, float fadeTime)
+{
+    // fade the others only if the clip started, on the layer its state ended up on
+    if (!Play(handle, layer, looped, fadeTime))
+        return false;
+
+    const unsigned char stateLayer = controls_[handle].state_->GetLayer();
+
+    for (unsigned i = 0; i < controls_.Size(); ++i)
+    {
+        ClipControl &ctrl = controls_[i];
+
+        if (i != handle && ctrl.playing_ && ctrl.state_->GetLayer() == stateLayer)
+        {
+            ctrl.targetWeight_ = 0.0f;
+            ctrl.fadeTime_ = fadeTime;
+        }
+    }
+
+    return true;
+}
+
+bool AnimationSetController::Stop(unsigned handle, float fadeOutTime)
+{
+    if (!IsPlaying(handle))
+        return false;
+
+    controls_[handle].targetWeight_ = 0.0f;
+    controls_[handle].fadeTime_ = fadeOutTime;
+
+    return true;
+}
+
+void AnimationSetController::StopLayer(unsigned char layer, float fadeOutTime)
+{
+    for (unsigned i = 0; i < controls_.Size(); ++i)
+    {
+        ClipControl &ctrl = controls_[i];
+
+        if (ctrl.playing_ && ctrl.state_->GetLayer() == layer)
+        {
+            ctrl.targetWeight_ = 0.0f;
+            ctrl.fadeTime_ = fadeOutTime;
+        }
+    }
+}
+
+bool AnimationSetController::SetTime(unsigned handle, float time)
+{
+    if (!IsPlaying(handle))
+        return false;
+
+    controls_[handle].state_->SetTime(time);
+
+    return true;
+}
+
+bool AnimationSetController::SetSpeed(unsigned handle, float speed)
+{
+    if (!IsPlaying(handle))
+        return false;
+
+    controls_[handle].speed_ = speed;
+
+    return true;
+}
+
+bool AnimationSetController::IsAtEnd(unsigned handle) const
+{
+    if (!IsPlaying(handle))
+        return false;
+
+    const AnimationState *state = controls_[handle].state_;
+
+    return state->GetTime() >= state->GetLength();
+}
+
+AnimationState* AnimationSetController::GetAnimationState(unsigned handle) const
+{
+    return handle < controls_.Size() ? controls_[handle].state_.Get() : NULL;
+}
+
+void AnimationSetController::HandleScenePostUpdate(StringHash eventType, VariantMap& eventData)
+{
+    using namespace ScenePostUpdate;
+
+    Update(eventData[P_TIMESTEP].GetFloat());
+}
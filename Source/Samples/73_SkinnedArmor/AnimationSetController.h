@@ -0,0 +1,112 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#pragma once
+
+#include <Urho3D/Scene/Component.h>
+
+#include "AnimationSet.h"
+
+using namespace Urho3D;
+namespace Urho3D
+{
+class AnimatedModel;
+class AnimationState;
+}
+
+//=============================================================================
+// AnimationController counterpart driven by AnimationSet handles. Every clip
+// of the set gets its animation state on the node's AnimatedModel up front,
+// so play, fade, time and speed calls index an array instead of hashing a
+// resource name and looking up the resource and state on every call.
+//
+// Follows AnimationController semantics: a clip starts from time 0 with speed
+// 1 on the requested layer when played after it has faded out, a playing clip
+// keeps its layer, PlayExclusive fades the others on the clip's own layer
+// once it has started, and time, speed and end queries only apply to playing
+// clips. Faded out states stay on the model at zero weight.
+//=============================================================================
+class AnimationSetController : public Component
+{
+    URHO3D_OBJECT(AnimationSetController, Component);
+
+public:
+    /// Construct.
+    AnimationSetController(Context* context);
+    virtual ~AnimationSetController();
+
+    /// Register object factory.
+    static void RegisterObject(Context* context);
+
+    /// Handle enabled/disabled state change.
+    virtual void OnSetEnabled();
+
+    /// Set the animation set and create the clips' animation states on the node's AnimatedModel.
+    bool SetAnimationSet(AnimationSet *animationSet);
+    /// Update the animations. Called on scene post-update.
+    void Update(float timeStep);
+
+    /// Play a clip and fade it in.
+    bool Play(unsigned handle, unsigned char layer, bool looped, float fadeInTime = 0.0f);
+    /// Play a clip and fade out the others on its layer. Return false, fading nothing, if the clip can't be played.
+    bool PlayExclusive(unsigned handle, unsigned char layer, bool looped, float fadeTime = 0.0f);
+    /// Fade out a clip.
+    bool Stop(unsigned handle, float fadeOutTime = 0.0f);
+    /// Fade out all clips on a layer.
+    void StopLayer(unsigned char layer, float fadeOutTime = 0.0f);
+    /// Set time position of a playing clip.
+    bool SetTime(unsigned handle, float time);
+    /// Set playback speed of a playing clip.
+    bool SetSpeed(unsigned handle, float speed);
+
+    /// Return the animation set.
+    AnimationSet* GetAnimationSet() const { return animationSet_; }
+    /// Return handle of a clip by name. Resolve once, not per call.
+    unsigned GetHandle(const String& name) const { return animationSet_ ? animationSet_->GetHandle(name) : INVALID_ANIM_HANDLE; }
+    /// Return whether a clip is playing.
+    bool IsPlaying(unsigned handle) const { return handle < controls_.Size() && controls_[handle].playing_; }
+    /// Return whether a playing clip is at its end.
+    bool IsAtEnd(unsigned handle) const;
+    /// Return animation state of a clip.
+    AnimationState* GetAnimationState(unsigned handle) const;
+
+protected:
+    /// Handle scene being assigned.
+    virtual void OnSceneSet(Scene* scene);
+
+private:
+    struct ClipControl
+    {
+        ClipControl() : targetWeight_(0.0f), fadeTime_(0.0f), speed_(1.0f), playing_(false) {}
+
+        SharedPtr<AnimationState> state_;
+        float                     targetWeight_;
+        float                     fadeTime_;
+        float                     speed_;
+        bool                      playing_;
+    };
+
+    void HandleScenePostUpdate(StringHash eventType, VariantMap& eventData);
+
+    SharedPtr<AnimationSet> animationSet_;
+    Vector<ClipControl>     controls_;
+};
@@ -0,0 +1,372 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#include <Urho3D/Core/CoreEvents.h>
+#include <Urho3D/Core/ProcessUtils.h>
+#include <Urho3D/Core/WorkQueue.h>
+#include <Urho3D/Engine/Engine.h>
+#include <Urho3D/Physics/PhysicsEvents.h>
+#include <Urho3D/Physics/PhysicsWorld.h>
+#include <Urho3D/Scene/Scene.h>
+#include <Urho3D/Scene/SceneEvents.h>
+
+#include <Bullet/BulletDynamics/Dynamics/btDiscreteDynamicsWorld.h>
+#include <Bullet/LinearMath/btQuickprof.h>
+
+#include "ArenaHost.h"
+#include "Character.h"
+#include "CrowdStress.h"
+#include "HitRegistry.h"
+
+#include <Urho3D/DebugNew.h>
+//=============================================================================
+//=============================================================================
+const unsigned HOST_WARMUP_FRAMES = 60;
+/// Most ticks a scene runs in one frame when its physics world sets no limit.
+const unsigned HOST_MAX_TICKS_PER_FRAME = 8;
+/// Input script offset between scenes, so the arenas don't act in lockstep.
+const unsigned HOST_SCRIPT_OFFSET = 17;
+/// Whether the Bullet steps may run on the worker threads. Bullet's profiler writes a global tree on every step: from Bullet 2.85 the host
+/// swaps its profile zone functions for no-ops while the steps run, older Bullet must be built with BT_NO_PROFILE.
+#if defined(BT_NO_PROFILE)
+const bool HOST_PARALLEL_STEPS = true;
+#elif BT_BULLET_VERSION >= 285
+#define HOST_SWAP_PROFILE_ZONES
+const bool HOST_PARALLEL_STEPS = true;
+#else
+const bool HOST_PARALLEL_STEPS = false;
+#endif
+
+#ifdef HOST_SWAP_PROFILE_ZONES
+static void EnterNoProfileZone(const char*)
+{
+}
+
+static void LeaveNoProfileZone()
+{
+}
+#endif
+
+//=============================================================================
+//=============================================================================
+ArenaHost::ArenaHost(Context* context) :
+    Object(context),
+    frame_(0),
+    numFrames_(0),
+    fixedTimeStep_(0.0f),
+    measuring_(false),
+    measureBegin_(0),
+    measuredTicks_(0),
+    weaponHits_(0)
+{
+    // ahead of the scenes' own update handlers
+    SubscribeToEvent(E_UPDATE, URHO3D_HANDLER(ArenaHost, HandleUpdate));
+}
+
+ArenaHost::~ArenaHost()
+{
+}
+
+void ArenaHost::AddScene(Scene *scene, const Vector<WeakPtr<Character> > &characters, float tickBudget)
+{
+    PhysicsWorld *physicsWorld = scene ? scene->GetComponent<PhysicsWorld>() : NULL;
+
+    if (!physicsWorld || !physicsWorld->GetWorld())
+    {
+        return;
+    }
+
+    // the host steps the world: no step from the scene update, and no Urho tick callbacks, which would send events from a worker thread
+    physicsWorld->UnsubscribeFromEvent(scene, E_SCENESUBSYSTEMUPDATE);
+
+    // setting a tick callback also sets the world user info, which PhysicsWorld points at itself, so keep it
+    btDiscreteDynamicsWorld *world = physicsWorld->GetWorld();
+    void *worldUserInfo = world->getWorldUserInfo();
+    world->setInternalTickCallback(NULL, worldUserInfo, true);
+    world->setInternalTickCallback(NULL, worldUserInfo, false);
+    world->setWorldUserInfo(worldUserInfo);
+
+    Arena arena;
+    arena.scene_ = scene;
+    arena.physicsWorld_ = physicsWorld;
+    arena.characters_ = characters;
+    arena.timeStep_ = 1.0f / (float)Max(physicsWorld->GetFps(), 1);
+    arena.timeAcc_ = 0.0f;
+    arena.pendingTicks_ = 0;
+    // by default a tick has to finish within its own timestep
+    arena.tickBudget_ = (long long)((tickBudget > 0.0f ? tickBudget : arena.timeStep_ * 1000.0f) * 1000.0f);
+    arena.mainTime_ = 0;
+    arena.stepTime_ = 0;
+    arena.lastTickTime_ = 0;
+    arena.numTicks_ = 0;
+    arena.numOverruns_ = 0;
+    arena.totalTickTime_ = 0;
+    arena.maxTickTime_ = 0;
+    arenas_.Push(arena);
+}
+
+void ArenaHost::Start(unsigned frames, float fixedTimeStep)
+{
+    numFrames_ = Max(frames, 1U);
+    fixedTimeStep_ = fixedTimeStep;
+
+    SubscribeToEvent(E_BEGINFRAME, URHO3D_HANDLER(ArenaHost, HandleBeginFrame));
+    SubscribeToEvent(E_ENDFRAME, URHO3D_HANDLER(ArenaHost, HandleEndFrame));
+    SubscribeToEvent(E_WEAPONHITS, URHO3D_HANDLER(ArenaHost, HandleWeaponHits));
+
+    // run unthrottled with a fixed timestep
+    Engine *engine = GetSubsystem<Engine>();
+    engine->SetMaxFps(0);
+    engine->SetNextTimeStep(fixedTimeStep_);
+
+    WorkQueue *queue = GetSubsystem<WorkQueue>();
+    PrintLine("arena host: " + String(arenas_.Size()) + " scenes, " + String(queue ? queue->GetNumThreads() + 1 : 1) + " threads, " +
+              String(numFrames_) + " frames");
+
+    if (!HOST_PARALLEL_STEPS)
+        PrintLine("arena host: Bullet older than 2.85 built without BT_NO_PROFILE, physics steps run on the main thread");
+}
+
+void ArenaHost::HandleBeginFrame(StringHash eventType, VariantMap& eventData)
+{
+    for (unsigned i = 0; i < arenas_.Size(); ++i)
+    {
+        ApplyCrowdScript(arenas_[i].characters_, frame_ + i * HOST_SCRIPT_OFFSET);
+    }
+}
+
+void ArenaHost::HandleUpdate(StringHash eventType, VariantMap& eventData)
+{
+    using namespace Update;
+
+    const float timeStep = eventData[P_TIMESTEP].GetFloat();
+
+    // each scene's own fixed-step accumulator
+    for (unsigned i = 0; i < arenas_.Size(); ++i)
+    {
+        Arena &arena = arenas_[i];
+        PhysicsWorld *physicsWorld = arena.physicsWorld_;
+
+        if (!physicsWorld || !arena.scene_->IsUpdateEnabled())
+        {
+            arena.pendingTicks_ = 0;
+            continue;
+        }
+
+        const unsigned maxTicks = physicsWorld->GetMaxSubSteps() > 0 ? (unsigned)physicsWorld->GetMaxSubSteps() : HOST_MAX_TICKS_PER_FRAME;
+
+        arena.timeAcc_ += timeStep;
+        arena.pendingTicks_ = Min((unsigned)(arena.timeAcc_ / arena.timeStep_), maxTicks);
+        arena.timeAcc_ -= arena.pendingTicks_ * arena.timeStep_;
+
+        // behind by more than the tick limit: drop the time instead of spiraling
+        if (arena.timeAcc_ >= arena.timeStep_)
+        {
+            arena.timeAcc_ = 0.0f;
+        }
+    }
+
+    RunTicks();
+}
+
+void ArenaHost::RunTicks()
+{
+    WorkQueue *queue = GetSubsystem<WorkQueue>();
+
+    for (;;)
+    {
+        // scenes with a tick left this frame, longest step first
+        order_.Clear();
+
+        for (unsigned i = 0; i < arenas_.Size(); ++i)
+        {
+            if (!arenas_[i].pendingTicks_)
+                continue;
+
+            unsigned j = order_.Size();
+            order_.Push(i);
+
+            for (; j > 0 && arenas_[order_[j - 1]].lastTickTime_ < arenas_[i].lastTickTime_; --j)
+                order_[j] = order_[j - 1];
+
+            order_[j] = i;
+        }
+
+        if (order_.Empty())
+        {
+            break;
+        }
+
+        const unsigned numArenas = order_.Size();
+
+        // character logic and the other pre-step handlers, main thread
+        for (unsigned i = 0; i < numArenas; ++i)
+        {
+            Arena &arena = arenas_[order_[i]];
+            long long begin = timer_.GetUSec(false);
+
+            using namespace PhysicsPreStep;
+
+            VariantMap& stepData = GetEventDataMap();
+            stepData[P_WORLD] = arena.physicsWorld_.Get();
+            stepData[P_TIMESTEP] = arena.timeStep_;
+            arena.physicsWorld_->SendEvent(E_PHYSICSPRESTEP, stepData);
+
+            arena.mainTime_ = timer_.GetUSec(false) - begin;
+        }
+
+        // the Bullet steps, one work item per scene
+        if (!HOST_PARALLEL_STEPS || !queue || !queue->GetNumThreads() || numArenas == 1)
+        {
+            for (unsigned i = 0; i < numArenas; ++i)
+            {
+                StepArena(arenas_[order_[i]]);
+            }
+        }
+        else
+        {
+#ifdef HOST_SWAP_PROFILE_ZONES
+            // no Bullet call runs on the main thread meanwhile, so the zone functions can be swapped around the whole phase
+            btEnterProfileZoneFunc *enterZone = btGetCurrentEnterProfileZoneFunc();
+            btLeaveProfileZoneFunc *leaveZone = btGetCurrentLeaveProfileZoneFunc();
+            btSetCustomEnterProfileZoneFunc(EnterNoProfileZone);
+            btSetCustomLeaveProfileZoneFunc(LeaveNoProfileZone);
+#endif
+
+            for (unsigned i = 0; i < numArenas; ++i)
+            {
+                SharedPtr<WorkItem> item = queue->GetFreeItem();
+                item->priority_ = M_MAX_UNSIGNED;
+                item->workFunction_ = StepWork;
+                item->aux_ = this;
+                item->start_ = &arenas_[order_[i]];
+                queue->AddWorkItem(item);
+            }
+
+            queue->Complete(M_MAX_UNSIGNED);
+
+#ifdef HOST_SWAP_PROFILE_ZONES
+            btSetCustomEnterProfileZoneFunc(enterZone);
+            btSetCustomLeaveProfileZoneFunc(leaveZone);
+#endif
+        }
+
+        // ground contacts and the other post-step handlers, main thread
+        for (unsigned i = 0; i < numArenas; ++i)
+        {
+            Arena &arena = arenas_[order_[i]];
+            long long begin = timer_.GetUSec(false);
+
+            using namespace PhysicsPostStep;
+
+            VariantMap& stepData = GetEventDataMap();
+            stepData[P_WORLD] = arena.physicsWorld_.Get();
+            stepData[P_TIMESTEP] = arena.timeStep_;
+            arena.physicsWorld_->SendEvent(E_PHYSICSPOSTSTEP, stepData);
+
+            arena.mainTime_ += timer_.GetUSec(false) - begin;
+            arena.lastTickTime_ = arena.mainTime_ + arena.stepTime_;
+            --arena.pendingTicks_;
+
+            if (measuring_)
+            {
+                ++arena.numTicks_;
+                ++measuredTicks_;
+                arena.totalTickTime_ += arena.lastTickTime_;
+                arena.maxTickTime_ = Max(arena.maxTickTime_, arena.lastTickTime_);
+
+                if (arena.tickBudget_ > 0 && arena.lastTickTime_ > arena.tickBudget_)
+                    ++arena.numOverruns_;
+            }
+        }
+    }
+}
+
+void ArenaHost::StepArena(Arena &arena)
+{
+    HiresTimer timer;
+
+    // a single step of the scene's fixed timestep, the node transforms it writes belong to this scene only
+    arena.physicsWorld_->GetWorld()->stepSimulation(arena.timeStep_, 0);
+
+    arena.stepTime_ = timer.GetUSec(false);
+}
+
+void ArenaHost::StepWork(const WorkItem* item, unsigned threadIndex)
+{
+    StepArena(*static_cast<Arena*>(item->start_));
+}
+
+void ArenaHost::HandleEndFrame(StringHash eventType, VariantMap& eventData)
+{
+    // the engine has already computed the next timestep from the elapsed time, replace it
+    GetSubsystem<Engine>()->SetNextTimeStep(fixedTimeStep_);
+
+    if (++frame_ == HOST_WARMUP_FRAMES)
+    {
+        measuring_ = true;
+        measureBegin_ = timer_.GetUSec(false);
+        weaponHits_ = 0;
+    }
+
+    if (measuring_ && frame_ >= HOST_WARMUP_FRAMES + numFrames_)
+    {
+        Report();
+        UnsubscribeFromAllEvents();
+        GetSubsystem<Engine>()->Exit();
+    }
+}
+
+void ArenaHost::HandleWeaponHits(StringHash eventType, VariantMap& eventData)
+{
+    using namespace WeaponHits;
+
+    weaponHits_ += eventData[P_NUMHITS].GetUInt();
+}
+
+void ArenaHost::Report()
+{
+    WorkQueue *queue = GetSubsystem<WorkQueue>();
+    const unsigned numThreads = queue ? queue->GetNumThreads() + 1 : 1;
+    const double seconds = Max(timer_.GetUSec(false) - measureBegin_, 1LL) / 1000000.0;
+
+    unsigned numCharacters = 0;
+    for (unsigned i = 0; i < arenas_.Size(); ++i)
+        numCharacters += arenas_[i].characters_.Size();
+
+    // throughput, compare runs with -threads 1 up to the core count
+    PrintLine("scenes,threads,characters,frames,scene_ticks,seconds,scene_ticks_per_sec,weapon_hits");
+    PrintLine(String(arenas_.Size()) + "," + String(numThreads) + "," + String(numCharacters) + "," + String(numFrames_) + "," +
+              String((unsigned)measuredTicks_) + "," + String((float)seconds) + "," + String((float)(measuredTicks_ / seconds)) + "," +
+              String(weaponHits_));
+
+    PrintLine("scene,ticks,tick_budget_ms,tick_ms_avg,tick_ms_max,overruns");
+    for (unsigned i = 0; i < arenas_.Size(); ++i)
+    {
+        const Arena &arena = arenas_[i];
+
+        PrintLine(String(i) + "," + String(arena.numTicks_) + "," + String(arena.tickBudget_ / 1000.0f) + "," +
+                  String(arena.numTicks_ ? (float)(arena.totalTickTime_ / 1000.0 / arena.numTicks_) : 0.0f) + "," +
+                  String(arena.maxTickTime_ / 1000.0f) + "," + String(arena.numOverruns_));
+    }
+}
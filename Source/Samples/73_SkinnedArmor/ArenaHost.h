@@ -0,0 +1,124 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#pragma once
+
+#include <Urho3D/Core/Object.h>
+#include <Urho3D/Core/Timer.h>
+
+using namespace Urho3D;
+namespace Urho3D
+{
+class PhysicsWorld;
+class Scene;
+struct WorkItem;
+}
+
+class Character;
+
+//=============================================================================
+// dedicated server host for many independent arena scenes, headless. Every
+// scene keeps its own PhysicsWorld and fixed-step accumulator, but the host
+// steps them instead of the scenes' own update. Each tick round runs in
+// three phases:
+//   1. main thread, per scene: physics pre-step event (character logic)
+//   2. work queue: one Bullet step per scene, on any free worker thread
+//   3. main thread, per scene: physics post-step event (ground contacts etc.)
+// Urho only sends events from the main thread, so only the Bullet steps run
+// in parallel, longest-first by their last step time to balance the threads.
+// They are not fully isolated: Bullet's profiler is a global tree, so the
+// host swaps Bullet's profile zone functions for no-ops during the parallel
+// phase (Bullet 2.85 and later). Older Bullet steps in parallel only when
+// built with BT_NO_PROFILE, on the main thread otherwise. Bullet's
+// gOverlappingPairs, gAddedPairs and gNumClampedCcdMotions statistics
+// counters are still shared and unreliable while hosting. The raw step also
+// skips the delayed world transforms PhysicsWorld::Update applies, so the
+// scenes must not have rigid bodies parented to other rigid bodies.
+//
+// A scene's tick time is the sum of its three phases. Ticks over the scene's
+// budget are counted as overruns. Bullet collision events are not sent:
+// characters detect ground with GroundContactQuery and weapon hits with
+// MeleeSweepSystem. The host subscribes to the update event before any
+// scene exists, so it steps physics ahead of the scenes' own updates.
+//=============================================================================
+class ArenaHost : public Object
+{
+    URHO3D_OBJECT(ArenaHost, Object);
+
+public:
+    /// Construct. Must be created before the scenes.
+    ArenaHost(Context* context);
+    virtual ~ArenaHost();
+
+    /// Add a scene with the characters to drive with the crowd input script, and its tick budget in msec, 0 for its physics timestep. The host steps its physics from then on.
+    void AddScene(Scene *scene, const Vector<WeakPtr<Character> > &characters, float tickBudget);
+    /// Start the run: a number of measured frames at a fixed timestep, unthrottled. Prints a CSV report and exits the engine at the end.
+    void Start(unsigned frames, float fixedTimeStep);
+
+    /// Return number of scenes.
+    unsigned GetNumScenes() const { return arenas_.Size(); }
+
+private:
+    struct Arena
+    {
+        SharedPtr<Scene> scene_;
+        WeakPtr<PhysicsWorld> physicsWorld_;
+        Vector<WeakPtr<Character> > characters_;
+        float timeStep_;
+        float timeAcc_;
+        /// Ticks left in the current frame.
+        unsigned pendingTicks_;
+        /// Tick budget and phase times of the current tick, usec.
+        long long tickBudget_;
+        long long mainTime_;
+        long long stepTime_;
+        long long lastTickTime_;
+        /// Measured ticks.
+        unsigned numTicks_;
+        unsigned numOverruns_;
+        long long totalTickTime_;
+        long long maxTickTime_;
+    };
+
+    void HandleBeginFrame(StringHash eventType, VariantMap& eventData);
+    void HandleUpdate(StringHash eventType, VariantMap& eventData);
+    void HandleEndFrame(StringHash eventType, VariantMap& eventData);
+    void HandleWeaponHits(StringHash eventType, VariantMap& eventData);
+    void RunTicks();
+    void Report();
+    static void StepArena(Arena &arena);
+    static void StepWork(const WorkItem* item, unsigned threadIndex);
+
+    Vector<Arena> arenas_;
+    /// Arena indices of the current tick round, longest step first.
+    PODVector<unsigned> order_;
+
+    HiresTimer timer_;
+    unsigned frame_;
+    unsigned numFrames_;
+    float fixedTimeStep_;
+    bool measuring_;
+    long long measureBegin_;
+    unsigned long long measuredTicks_;
+    unsigned weaponHits_;
+};
@@ -0,0 +1,620 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#include <Urho3D/Container/Sort.h>
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Graphics/Geometry.h>
+#include <Urho3D/Graphics/Graphics.h>
+#include <Urho3D/Graphics/IndexBuffer.h>
+#include <Urho3D/Graphics/Material.h>
+#include <Urho3D/Graphics/VertexBuffer.h>
+
+#include "ArmorGeometryMerger.h"
+#include "GeometryUtils.h"
+
+#include <Urho3D/DebugNew.h>
+//=============================================================================
+//=============================================================================
+struct MergedGeometry
+{
+    Vector<SharedPtr<Geometry> > lods_;
+    PODVector<unsigned>          boneMapping_;
+    Vector3                      center_;
+    SharedPtr<Material>          material_;
+};
+
+static bool CompareIndexStart(Geometry *lhs, Geometry *rhs)
+{
+    return lhs->GetIndexStart() < rhs->GetIndexStart();
+}
+
+static inline void CombineHash(unsigned &hash, unsigned value)
+{
+    hash ^= value + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+}
+
+static inline unsigned FloatBits(float value)
+{
+    unsigned bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+//=============================================================================
+// geometries in the same buffers with back to back index ranges only need a
+// wider draw range
+//=============================================================================
+static SharedPtr<Geometry> MergeDrawRanges(Context *context, const PODVector<Geometry*> &geometries)
+{
+    Geometry *first = geometries[0];
+
+    for (unsigned i = 0; i < geometries.Size(); ++i)
+    {
+        Geometry *geometry = geometries[i];
+
+        if (geometry->GetNumVertexBuffers() != 1 || geometry->GetPrimitiveType() != TRIANGLE_LIST ||
+            geometry->GetVertexBuffer(0) != first->GetVertexBuffer(0) || geometry->GetIndexBuffer() != first->GetIndexBuffer())
+        {
+            return SharedPtr<Geometry>();
+        }
+    }
+
+    PODVector<Geometry*> sorted = geometries;
+    Sort(sorted.Begin(), sorted.End(), CompareIndexStart);
+
+    for (unsigned i = 1; i < sorted.Size(); ++i)
+    {
+        if (sorted[i]->GetIndexStart() != sorted[i - 1]->GetIndexStart() + sorted[i - 1]->GetIndexCount())
+        {
+            return SharedPtr<Geometry>();
+        }
+    }
+
+    const unsigned indexStart = sorted[0]->GetIndexStart();
+    const unsigned indexEnd   = sorted.Back()->GetIndexStart() + sorted.Back()->GetIndexCount();
+
+    SharedPtr<Geometry> merged(new Geometry(context));
+    merged->SetVertexBuffer(0, first->GetVertexBuffer(0));
+    merged->SetIndexBuffer(first->GetIndexBuffer());
+    merged->SetDrawRange(TRIANGLE_LIST, indexStart, indexEnd - indexStart);
+    merged->SetLodDistance(first->GetLodDistance());
+
+    return merged;
+}
+
+//=============================================================================
+// rewrite blend indices from the geometry's own bone space into the merged
+// bone space; unweighted influences point at local bone 0
+//=============================================================================
+static bool RemapBlendIndices(GeometryData &data, const PODVector<unsigned> &globalToLocal)
+{
+    const unsigned weightsOffset = data.GetElementOffset(SEM_BLENDWEIGHTS);
+    const VertexElementType weightsType = data.GetElementType(SEM_BLENDWEIGHTS);
+    const unsigned indicesOffset = data.GetElementOffset(SEM_BLENDINDICES);
+
+    if (weightsOffset == M_MAX_UNSIGNED || indicesOffset == M_MAX_UNSIGNED)
+    {
+        return true;
+    }
+
+    for (unsigned i = 0; i < data.vertexCount_; ++i)
+    {
+        unsigned char *vertex = data.GetVertex(i);
+        float weights[4];
+        ReadBlendWeights(vertex + weightsOffset, weightsType, weights);
+        unsigned char *blendIndices = vertex + indicesOffset;
+
+        for (unsigned j = 0; j < 4; ++j)
+        {
+            if (weights[j] <= 0.0f)
+            {
+                blendIndices[j] = 0;
+                continue;
+            }
+
+            if (!data.boneMapping_.Empty() && blendIndices[j] >= data.boneMapping_.Size())
+            {
+                return false;
+            }
+
+            const unsigned globalBone = data.GetGlobalBone(blendIndices[j]);
+
+            if (globalBone >= globalToLocal.Size() || globalToLocal[globalBone] == M_MAX_UNSIGNED)
+            {
+                return false;
+            }
+            blendIndices[j] = (unsigned char)globalToLocal[globalBone];
+        }
+    }
+
+    return true;
+}
+
+static SharedPtr<Geometry> MergeCopies(Context *context, const PODVector<Geometry*> &geometries, const Vector<PODVector<unsigned> > &mappings,
+                                       const PODVector<unsigned> &globalToLocal, unsigned &copiedVertices)
+{
+    GeometryData merged;
+
+    for (unsigned i = 0; i < geometries.Size(); ++i)
+    {
+        GeometryData data;
+
+        if (!ExtractGeometryData(geometries[i], mappings[i], data) || data.primitiveType_ != TRIANGLE_LIST)
+        {
+            return SharedPtr<Geometry>();
+        }
+
+        if (i == 0)
+        {
+            merged.elements_      = data.elements_;
+            merged.vertexSize_    = data.vertexSize_;
+            merged.primitiveType_ = data.primitiveType_;
+            merged.lodDistance_   = data.lodDistance_;
+        }
+        else if (!merged.HasSameLayout(data))
+        {
+            return SharedPtr<Geometry>();
+        }
+
+        if (!RemapBlendIndices(data, globalToLocal))
+        {
+            return SharedPtr<Geometry>();
+        }
+
+        const unsigned vertexOffset = merged.vertexCount_;
+
+        merged.vertexData_.Push(data.vertexData_);
+        merged.vertexCount_ += data.vertexCount_;
+
+        for (unsigned j = 0; j < data.indices_.Size(); ++j)
+        {
+            merged.indices_.Push(data.indices_[j] + vertexOffset);
+        }
+    }
+
+    copiedVertices += merged.vertexCount_;
+
+    return CreateGeometry(context, merged);
+}
+
+//=============================================================================
+//=============================================================================
+static bool MergeChunk(Context *context, Model *model, const PODVector<unsigned> &members, const PODVector<unsigned> &boneMapping,
+                       MergedGeometry &output, unsigned &copiedVertices)
+{
+    const Vector<PODVector<unsigned> > &boneMappings = model->GetGeometryBoneMappings();
+    const unsigned numBones = model->GetSkeleton().GetNumBones();
+
+    unsigned numLods = M_MAX_UNSIGNED;
+    bool sameMapping = true;
+    Vector<PODVector<unsigned> > memberMappings;
+
+    for (unsigned i = 0; i < members.Size(); ++i)
+    {
+        numLods = Min(numLods, model->GetNumGeometryLodLevels(members[i]));
+        memberMappings.Push(members[i] < boneMappings.Size() ? boneMappings[members[i]] : PODVector<unsigned>());
+        sameMapping &= memberMappings.Back() == boneMapping;
+    }
+
+    // global bone -> merged blend index
+    PODVector<unsigned> globalToLocal(numBones);
+
+    for (unsigned i = 0; i < numBones; ++i)
+    {
+        globalToLocal[i] = boneMapping.Empty() ? i : M_MAX_UNSIGNED;
+    }
+    for (unsigned i = 0; i < boneMapping.Size(); ++i)
+    {
+        globalToLocal[boneMapping[i]] = i;
+    }
+
+    for (unsigned lod = 0; lod < numLods; ++lod)
+    {
+        PODVector<Geometry*> geometries;
+
+        for (unsigned i = 0; i < members.Size(); ++i)
+        {
+            geometries.Push(model->GetGeometry(members[i], lod));
+        }
+
+        SharedPtr<Geometry> merged;
+
+        if (sameMapping)
+        {
+            merged = MergeDrawRanges(context, geometries);
+        }
+        if (!merged)
+        {
+            merged = MergeCopies(context, geometries, memberMappings, globalToLocal, copiedVertices);
+        }
+        if (!merged)
+        {
+            return false;
+        }
+
+        output.lods_.Push(merged);
+    }
+
+    // center weighted by the members' index counts
+    float totalIndices = 0.0f;
+    output.center_ = Vector3::ZERO;
+
+    for (unsigned i = 0; i < members.Size(); ++i)
+    {
+        const float indexCount = (float)model->GetGeometry(members[i], 0)->GetIndexCount();
+        output.center_ += model->GetGeometryCenter(members[i]) * indexCount;
+        totalIndices += indexCount;
+    }
+    if (totalIndices > 0.0f)
+    {
+        output.center_ /= totalIndices;
+    }
+
+    output.boneMapping_ = boneMapping;
+
+    return true;
+}
+
+static void PushUnmerged(Model *model, unsigned index, Material *material, Vector<MergedGeometry> &outputs)
+{
+    const Vector<PODVector<unsigned> > &boneMappings = model->GetGeometryBoneMappings();
+    MergedGeometry output;
+
+    for (unsigned i = 0; i < model->GetNumGeometryLodLevels(index); ++i)
+    {
+        output.lods_.Push(SharedPtr<Geometry>(model->GetGeometry(index, i)));
+    }
+
+    if (index < boneMappings.Size())
+    {
+        output.boneMapping_ = boneMappings[index];
+    }
+    output.center_   = model->GetGeometryCenter(index);
+    output.material_ = material;
+
+    outputs.Push(output);
+}
+
+//=============================================================================
+//=============================================================================
+SharedPtr<Model> ArmorGeometryMerger::MergeByMaterial(Context *context, Model *model, const Vector<SharedPtr<Material> > &materials,
+                                                      Vector<SharedPtr<Material> > &mergedMaterials, GeometryMergeStats &stats)
+{
+    const unsigned numGeometries = model->GetNumGeometries();
+    const unsigned numBones = model->GetSkeleton().GetNumBones();
+    const unsigned maxBones = Graphics::GetMaxBones();
+    const Vector<PODVector<unsigned> > &boneMappings = model->GetGeometryBoneMappings();
+
+    stats = GeometryMergeStats();
+    stats.batchesBefore_ = numGeometries;
+
+    // morph ranges index the source vertex buffers, leave morphing models alone
+    if (model->GetNumMorphs())
+    {
+        mergedMaterials = materials;
+        mergedMaterials.Resize(numGeometries);
+        stats.batchesAfter_ = numGeometries;
+        return SharedPtr<Model>(model);
+    }
+
+    // group by material in slot order, slots without a material stay on their own
+    Vector<PODVector<unsigned> > groups;
+
+    for (unsigned i = 0; i < numGeometries; ++i)
+    {
+        Material *material = i < materials.Size() ? materials[i].Get() : NULL;
+        unsigned group = M_MAX_UNSIGNED;
+
+        for (unsigned j = 0; material && j < groups.Size(); ++j)
+        {
+            if (materials[groups[j][0]] == material)
+            {
+                group = j;
+                break;
+            }
+        }
+
+        if (group == M_MAX_UNSIGNED)
+        {
+            groups.Push(PODVector<unsigned>());
+            group = groups.Size() - 1;
+        }
+        groups[group].Push(i);
+    }
+
+    Vector<MergedGeometry> outputs;
+
+    for (unsigned i = 0; i < groups.Size(); ++i)
+    {
+        const PODVector<unsigned> &members = groups[i];
+        Material *material = members[0] < materials.Size() ? materials[members[0]].Get() : NULL;
+
+        if (members.Size() == 1)
+        {
+            PushUnmerged(model, members[0], material, outputs);
+            continue;
+        }
+
+        bool globalBones = numBones <= maxBones;
+
+        for (unsigned j = 0; j < members.Size(); ++j)
+        {
+            globalBones &= members[j] >= boneMappings.Size() || boneMappings[members[j]].Empty();
+        }
+
+        // split into chunks that fit the bone limit
+        Vector<PODVector<unsigned> > chunks;
+        Vector<PODVector<unsigned> > chunkBones;
+
+        if (globalBones)
+        {
+            chunks.Push(members);
+            chunkBones.Push(PODVector<unsigned>());
+        }
+        else
+        {
+            for (unsigned j = 0; j < members.Size(); ++j)
+            {
+                PODVector<unsigned> bones;
+                const PODVector<unsigned> &mapping = members[j] < boneMappings.Size() ? boneMappings[members[j]] : PODVector<unsigned>();
+
+                for (unsigned lod = 0; lod < model->GetNumGeometryLodLevels(members[j]); ++lod)
+                {
+                    GeometryData data;
+
+                    if (ExtractGeometryData(model->GetGeometry(members[j], lod), mapping, data))
+                    {
+                        CollectUsedBones(data, bones);
+                    }
+                }
+
+                PODVector<unsigned> unionBones = chunks.Empty() ? PODVector<unsigned>() : chunkBones.Back();
+
+                for (unsigned k = 0; k < bones.Size(); ++k)
+                {
+                    if (!unionBones.Contains(bones[k]))
+                    {
+                        unionBones.Push(bones[k]);
+                    }
+                }
+
+                if (!chunks.Empty() && unionBones.Size() <= maxBones)
+                {
+                    chunks.Back().Push(members[j]);
+                    chunkBones.Back() = unionBones;
+                }
+                else
+                {
+                    chunks.Push(PODVector<unsigned>());
+                    chunks.Back().Push(members[j]);
+                    chunkBones.Push(bones);
+                }
+            }
+
+            for (unsigned j = 0; j < chunkBones.Size(); ++j)
+            {
+                Sort(chunkBones[j].Begin(), chunkBones[j].End());
+            }
+        }
+
+        for (unsigned j = 0; j < chunks.Size(); ++j)
+        {
+            MergedGeometry output;
+            output.material_ = material;
+
+            if (chunks[j].Size() > 1 && chunkBones[j].Size() <= maxBones &&
+                MergeChunk(context, model, chunks[j], chunkBones[j], output, stats.copiedVertices_))
+            {
+                outputs.Push(output);
+                ++stats.mergedGroups_;
+            }
+            else
+            {
+                for (unsigned k = 0; k < chunks[j].Size(); ++k)
+                {
+                    PushUnmerged(model, chunks[j][k], material, outputs);
+                }
+            }
+        }
+    }
+
+    // build the merged model
+    SharedPtr<Model> merged(new Model(context));
+    Vector<PODVector<unsigned> > mergedMappings;
+
+    merged->SetSkeleton(model->GetSkeleton());
+    merged->SetNumGeometries(outputs.Size());
+    mergedMaterials.Clear();
+
+    for (unsigned i = 0; i < outputs.Size(); ++i)
+    {
+        const MergedGeometry &output = outputs[i];
+
+        merged->SetNumGeometryLodLevels(i, output.lods_.Size());
+
+        for (unsigned j = 0; j < output.lods_.Size(); ++j)
+        {
+            merged->SetGeometry(i, j, output.lods_[j]);
+        }
+
+        merged->SetGeometryCenter(i, output.center_);
+        mergedMappings.Push(output.boneMapping_);
+        mergedMaterials.Push(output.material_);
+    }
+
+    merged->SetGeometryBoneMappings(mergedMappings);
+    merged->SetBoundingBox(model->GetBoundingBox());
+    SetModelBuffers(merged);
+
+    // approximate memory: the model plus buffers it doesn't share with the source
+    unsigned memoryUse = sizeof(Model);
+    const Vector<SharedPtr<VertexBuffer> > &vertexBuffers = merged->GetVertexBuffers();
+    const Vector<SharedPtr<IndexBuffer> > &indexBuffers = merged->GetIndexBuffers();
+
+    for (unsigned i = 0; i < vertexBuffers.Size(); ++i)
+    {
+        if (!model->GetVertexBuffers().Contains(vertexBuffers[i]))
+        {
+            memoryUse += vertexBuffers[i]->GetVertexCount() * vertexBuffers[i]->GetVertexSize();
+        }
+    }
+    for (unsigned i = 0; i < indexBuffers.Size(); ++i)
+    {
+        if (!model->GetIndexBuffers().Contains(indexBuffers[i]))
+        {
+            memoryUse += indexBuffers[i]->GetIndexCount() * indexBuffers[i]->GetIndexSize();
+        }
+    }
+    merged->SetMemoryUse(memoryUse);
+
+    stats.batchesAfter_ = outputs.Size();
+
+    return merged;
+}
+
+//=============================================================================
+// signature of every referenced vertex: position plus its weighted global
+// bones. Merging must preserve the multiset of signatures.
+//=============================================================================
+static bool CollectVertexSignatures(Model *model, PODVector<unsigned> &signatures, String &error)
+{
+    const Vector<PODVector<unsigned> > &boneMappings = model->GetGeometryBoneMappings();
+    const unsigned numBones = model->GetSkeleton().GetNumBones();
+    const unsigned maxBones = Graphics::GetMaxBones();
+
+    for (unsigned i = 0; i < model->GetNumGeometries(); ++i)
+    {
+        const PODVector<unsigned> &mapping = i < boneMappings.Size() ? boneMappings[i] : PODVector<unsigned>();
+        GeometryData data;
+
+        if (mapping.Size() > maxBones || (mapping.Empty() && numBones > maxBones))
+        {
+            error = "geometry " + String(i) + " exceeds the bone limit of " + String(maxBones);
+            return false;
+        }
+
+        if (!ExtractGeometryData(model->GetGeometry(i, 0), mapping, data))
+        {
+            error = "geometry " + String(i) + " has no CPU-side data";
+            return false;
+        }
+
+        const unsigned weightsOffset = data.GetElementOffset(SEM_BLENDWEIGHTS);
+        const VertexElementType weightsType = data.GetElementType(SEM_BLENDWEIGHTS);
+        const unsigned indicesOffset = data.GetElementOffset(SEM_BLENDINDICES);
+        PODVector<bool> visited(data.vertexCount_);
+
+        for (unsigned j = 0; j < data.vertexCount_; ++j)
+        {
+            visited[j] = false;
+        }
+
+        for (unsigned j = 0; j < data.indices_.Size(); ++j)
+        {
+            const unsigned vertex = data.indices_[j];
+
+            if (visited[vertex])
+            {
+                continue;
+            }
+            visited[vertex] = true;
+
+            const Vector3 &position = data.GetPosition(vertex);
+            unsigned hash = 0;
+
+            CombineHash(hash, FloatBits(position.x_));
+            CombineHash(hash, FloatBits(position.y_));
+            CombineHash(hash, FloatBits(position.z_));
+
+            if (weightsOffset != M_MAX_UNSIGNED && indicesOffset != M_MAX_UNSIGNED)
+            {
+                float weights[4];
+                ReadBlendWeights(data.GetVertex(vertex) + weightsOffset, weightsType, weights);
+                const unsigned char *blendIndices = data.GetVertex(vertex) + indicesOffset;
+                unsigned influences[4] = { 0, 0, 0, 0 };
+
+                for (unsigned k = 0; k < 4; ++k)
+                {
+                    if (weights[k] <= 0.0f)
+                    {
+                        continue;
+                    }
+
+                    if ((!mapping.Empty() && blendIndices[k] >= mapping.Size()) || data.GetGlobalBone(blendIndices[k]) >= numBones)
+                    {
+                        error = "geometry " + String(i) + " vertex " + String(vertex) + " has an unmapped blend index";
+                        return false;
+                    }
+
+                    // order independent combine of (bone, weight)
+                    unsigned influence = 0;
+                    CombineHash(influence, data.GetGlobalBone(blendIndices[k]));
+                    CombineHash(influence, FloatBits(weights[k]));
+                    influences[k] = influence;
+                }
+
+                // insertion sort of the four influences
+                for (unsigned k = 1; k < 4; ++k)
+                {
+                    for (unsigned m = k; m > 0 && influences[m - 1] > influences[m]; --m)
+                    {
+                        Swap(influences[m - 1], influences[m]);
+                    }
+                }
+
+                for (unsigned k = 0; k < 4; ++k)
+                {
+                    CombineHash(hash, influences[k]);
+                }
+            }
+
+            signatures.Push(hash);
+        }
+    }
+
+    Sort(signatures.Begin(), signatures.End());
+
+    return true;
+}
+
+bool ArmorGeometryMerger::ValidateMerge(Model *source, Model *merged, String &error)
+{
+    PODVector<unsigned> sourceSignatures;
+    PODVector<unsigned> mergedSignatures;
+
+    if (!CollectVertexSignatures(source, sourceSignatures, error) ||
+        !CollectVertexSignatures(merged, mergedSignatures, error))
+    {
+        return false;
+    }
+
+    if (sourceSignatures != mergedSignatures)
+    {
+        error = "vertex positions or bone weights differ after merge (" + String(sourceSignatures.Size()) +
+                " source vertices, " + String(mergedSignatures.Size()) + " merged)";
+        return false;
+    }
+
+    return true;
+}
+
@@ -0,0 +1,66 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#pragma once
+
+#include <Urho3D/Graphics/Model.h>
+
+using namespace Urho3D;
+namespace Urho3D
+{
+class Material;
+}
+
+//=============================================================================
+//=============================================================================
+struct GeometryMergeStats
+{
+    GeometryMergeStats() : batchesBefore_(0), batchesAfter_(0), mergedGroups_(0), copiedVertices_(0) {}
+
+    /// Geometries (draw batches, and as many shadow batches) before merging.
+    unsigned batchesBefore_;
+    /// Geometries after merging.
+    unsigned batchesAfter_;
+    /// Material groups that were merged.
+    unsigned mergedGroups_;
+    /// Vertices copied into new buffers. Zero when every merge only widened a draw range.
+    unsigned copiedVertices_;
+};
+
+//=============================================================================
+// merges geometries that share a material into one geometry. Geometries that
+// sit back to back in the same vertex and index buffer (as the geometries of
+// an exported .mdl do) merge into a wider draw range without copying, others
+// are copied into new buffers with a rebuilt bone mapping. Groups that would
+// exceed the skinning bone limit are split.
+//=============================================================================
+class ArmorGeometryMerger
+{
+public:
+    /// Return a model with same-material geometries merged and fill the material per merged geometry.
+    static SharedPtr<Model> MergeByMaterial(Context *context, Model *model, const Vector<SharedPtr<Material> > &materials,
+                                            Vector<SharedPtr<Material> > &mergedMaterials, GeometryMergeStats &stats);
+    /// Check bone mapping limits and that every vertex keeps its position and global bone weights. Fills error on failure.
+    static bool ValidateMerge(Model *source, Model *merged, String &error);
+};
+
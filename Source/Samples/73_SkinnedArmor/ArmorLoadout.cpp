@@ -0,0 +1,263 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Graphics/AnimatedModel.h>
+#include <Urho3D/Graphics/Material.h>
+#include <Urho3D/IO/Log.h>
+#include <Urho3D/Resource/ResourceCache.h>
+#include <Urho3D/Resource/XMLFile.h>
+
+#include "ArmorLoadout.h"
+#include "QuantizedModel.h"
+
+#include <Urho3D/DebugNew.h>
+//=============================================================================
+//=============================================================================
+ArmorLoadout::ArmorLoadout(Context* context) :
+    Resource(context),
+    mergeByMaterial_(false)
+{
+}
+
+ArmorLoadout::~ArmorLoadout()
+{
+}
+
+void ArmorLoadout::RegisterObject(Context* context)
+{
+    context->RegisterFactory<ArmorLoadout>();
+}
+
+bool ArmorLoadout::BeginLoad(Deserializer& source)
+{
+    SharedPtr<XMLFile> xmlFile(new XMLFile(context_));
+
+    if (!xmlFile->Load(source) || !ParseXML(xmlFile))
+    {
+        return false;
+    }
+
+    // queue the dependencies when loading in the background
+    if (GetAsyncLoadState() == ASYNC_LOADING)
+    {
+        ResourceCache* cache = GetSubsystem<ResourceCache>();
+
+        cache->BackgroundLoadResource(GetModelResourceType(loadBaseModel_), loadBaseModel_, true, this);
+
+        for (unsigned i = 0; i < loadBaseMaterials_.Size(); ++i)
+        {
+            cache->BackgroundLoadResource<Material>(loadBaseMaterials_[i].material_, true, this);
+        }
+        for (unsigned i = 0; i < loadPieces_.Size(); ++i)
+        {
+            cache->BackgroundLoadResource(GetModelResourceType(loadPieces_[i].model_), loadPieces_[i].model_, true, this);
+            cache->BackgroundLoadResource<Material>(loadPieces_[i].material_, true, this);
+        }
+    }
+
+    return true;
+}
+
+bool ArmorLoadout::ParseXML(XMLFile *xmlFile)
+{
+    XMLElement rootElem = xmlFile->GetRoot("loadout");
+    XMLElement baseElem = rootElem.GetChild("base");
+
+    if (!baseElem || baseElem.GetAttribute("model").Empty())
+    {
+        URHO3D_LOGERROR("ArmorLoadout: missing base model in " + GetName());
+        return false;
+    }
+
+    loadBaseModel_ = baseElem.GetAttribute("model");
+    mergeByMaterial_ = rootElem.HasAttribute("mergeByMaterial") && rootElem.GetBool("mergeByMaterial");
+    loadBaseMaterials_.Clear();
+    loadPieces_.Clear();
+
+    for (XMLElement matElem = baseElem.GetChild("material"); matElem; matElem = matElem.GetNext("material"))
+    {
+        LoadPiece entry;
+        entry.geometryIndex_ = M_MAX_UNSIGNED;
+        entry.slot_          = matElem.GetUInt("slot");
+        entry.material_      = matElem.GetAttribute("name");
+        loadBaseMaterials_.Push(entry);
+    }
+
+    for (XMLElement armorElem = rootElem.GetChild("armor"); armorElem; armorElem = armorElem.GetNext("armor"))
+    {
+        const String armorModel = armorElem.GetAttribute("model");
+        const String armorMaterial = armorElem.GetAttribute("material");
+
+        for (XMLElement pieceElem = armorElem.GetChild("piece"); pieceElem; pieceElem = pieceElem.GetNext("piece"))
+        {
+            LoadPiece entry;
+            entry.model_         = armorModel;
+            entry.geometryIndex_ = pieceElem.GetUInt("geometry");
+            entry.slot_          = pieceElem.GetUInt("slot");
+            entry.material_      = pieceElem.HasAttribute("material") ? pieceElem.GetAttribute("material") : armorMaterial;
+            loadPieces_.Push(entry);
+        }
+    }
+
+    return true;
+}
+
+bool ArmorLoadout::EndLoad()
+{
+    ResourceCache* cache = GetSubsystem<ResourceCache>();
+    ArmorModelCache* armorCache = GetSubsystem<ArmorModelCache>();
+
+    pieces_.Clear();
+    armorModels_.Clear();
+    slotMaterials_.Clear();
+    materials_.Clear();
+    model_.Reset();
+
+    if (!armorCache)
+    {
+        URHO3D_LOGERROR("ArmorLoadout: ArmorModelCache subsystem is not registered");
+        return false;
+    }
+
+    baseModel_ = static_cast<Model*>(cache->GetResource(GetModelResourceType(loadBaseModel_), loadBaseModel_));
+
+    if (!baseModel_)
+    {
+        return false;
+    }
+
+    const unsigned numSlots = baseModel_->GetNumGeometries();
+    HashMap<StringHash, SharedPtr<Material> > resolvedMaterials;
+    PODVector<bool> slotUsed;
+
+    slotMaterials_.Resize(numSlots);
+    slotUsed.Resize(numSlots);
+
+    for (unsigned i = 0; i < numSlots; ++i)
+    {
+        slotUsed[i] = false;
+    }
+
+    for (unsigned i = 0; i < loadBaseMaterials_.Size(); ++i)
+    {
+        const LoadPiece &entry = loadBaseMaterials_[i];
+
+        if (entry.slot_ >= numSlots)
+        {
+            URHO3D_LOGERROR("ArmorLoadout: material slot " + String(entry.slot_) + " out of range in " + GetName());
+            return false;
+        }
+        slotMaterials_[entry.slot_] = ResolveMaterial(entry.material_, resolvedMaterials);
+    }
+
+    for (unsigned i = 0; i < loadPieces_.Size(); ++i)
+    {
+        const LoadPiece &entry = loadPieces_[i];
+        Model *armorModel = static_cast<Model*>(cache->GetResource(GetModelResourceType(entry.model_), entry.model_));
+
+        if (!armorModel)
+        {
+            return false;
+        }
+        if (entry.slot_ >= numSlots || slotUsed[entry.slot_])
+        {
+            URHO3D_LOGERROR("ArmorLoadout: invalid or duplicate slot " + String(entry.slot_) + " in " + GetName());
+            return false;
+        }
+        if (entry.geometryIndex_ >= armorModel->GetNumGeometries())
+        {
+            URHO3D_LOGERROR("ArmorLoadout: " + entry.model_ + " has no geometry " + String(entry.geometryIndex_));
+            return false;
+        }
+
+        if (!armorModels_.Contains(SharedPtr<Model>(armorModel)))
+        {
+            armorModels_.Push(SharedPtr<Model>(armorModel));
+        }
+
+        slotUsed[entry.slot_] = true;
+        pieces_.Push(ArmorPiece(entry.slot_, armorModel, entry.geometryIndex_));
+        slotMaterials_[entry.slot_] = ResolveMaterial(entry.material_, resolvedMaterials);
+    }
+
+    if (mergeByMaterial_)
+    {
+        model_ = armorCache->GetMergedModel(baseModel_, pieces_, slotMaterials_, materials_);
+    }
+    else
+    {
+        model_ = armorCache->GetComposedModel(baseModel_, pieces_);
+        materials_ = slotMaterials_;
+    }
+
+    // load description is no longer needed
+    loadBaseModel_.Clear();
+    loadBaseMaterials_.Clear();
+    loadPieces_.Clear();
+
+    SetMemoryUse(sizeof(ArmorLoadout) + pieces_.Size() * sizeof(ArmorPiece) +
+                 (slotMaterials_.Size() + materials_.Size()) * sizeof(SharedPtr<Material>));
+
+    return model_.NotNull();
+}
+
+Material* ArmorLoadout::ResolveMaterial(const String &name, HashMap<StringHash, SharedPtr<Material> > &resolved) const
+{
+    if (name.Empty())
+    {
+        return NULL;
+    }
+
+    StringHash nameHash(name);
+    HashMap<StringHash, SharedPtr<Material> >::Iterator itr = resolved.Find(nameHash);
+
+    if (itr != resolved.End())
+    {
+        return itr->second_;
+    }
+
+    Material *material = GetSubsystem<ResourceCache>()->GetResource<Material>(name);
+    resolved[nameHash] = material;
+
+    return material;
+}
+
+bool ArmorLoadout::Apply(AnimatedModel *animModel) const
+{
+    if (!animModel || !model_)
+    {
+        return false;
+    }
+
+    // same skeleton across loadouts, bone nodes are retained on model change
+    animModel->SetModel(model_);
+
+    for (unsigned i = 0; i < materials_.Size(); ++i)
+    {
+        animModel->SetMaterial(i, materials_[i]);
+    }
+
+    return true;
+}
+
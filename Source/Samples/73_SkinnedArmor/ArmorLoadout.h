@@ -0,0 +1,116 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#pragma once
+
+#include <Urho3D/Resource/Resource.h>
+
+#include "ArmorModelCache.h"
+
+using namespace Urho3D;
+namespace Urho3D
+{
+class AnimatedModel;
+class Material;
+class XMLFile;
+}
+
+//=============================================================================
+// armor loadout resource: maps armor pieces to base model geometry slots.
+//
+// <loadout [mergeByMaterial="true"]>
+//     <base model="...mdl">
+//         <material slot="0" name="...xml" />
+//     </base>
+//     <armor model="...mdl" material="...xml">
+//         <piece geometry="0" slot="4" [material="...xml"] />
+//     </armor>
+// </loadout>
+//
+// Models named .qmdl load as QuantizedModel.
+//
+// Loading resolves and validates every model and material once into a slot
+// table, so applying the loadout is a pointer swap per slot. With
+// mergeByMaterial the model's same-material geometries are merged and the
+// material table follows the merged geometries.
+//=============================================================================
+class ArmorLoadout : public Resource
+{
+    URHO3D_OBJECT(ArmorLoadout, Resource);
+
+public:
+    /// Construct.
+    ArmorLoadout(Context* context);
+    virtual ~ArmorLoadout();
+
+    /// Register object factory.
+    static void RegisterObject(Context* context);
+
+    /// Load resource from stream. May be called from a worker thread. Return true if successful.
+    virtual bool BeginLoad(Deserializer& source);
+    /// Finish resource loading. Always called from the main thread. Return true if successful.
+    virtual bool EndLoad();
+
+    /// Set the composed model and slot materials on the animated model.
+    bool Apply(AnimatedModel *animModel) const;
+
+    /// Return base model.
+    Model* GetBaseModel() const { return baseModel_; }
+    /// Return the composed model shared by all users of this loadout.
+    Model* GetModel() const { return model_; }
+    /// Return armor pieces.
+    const PODVector<ArmorPiece>& GetPieces() const { return pieces_; }
+    /// Return material per base model geometry slot, null for unassigned slots.
+    const Vector<SharedPtr<Material> >& GetSlotMaterials() const { return slotMaterials_; }
+    /// Return material per geometry of the model. Same as the slot materials unless merged.
+    const Vector<SharedPtr<Material> >& GetMaterials() const { return materials_; }
+    /// Return whether same-material geometries are merged.
+    bool GetMergeByMaterial() const { return mergeByMaterial_; }
+
+private:
+    struct LoadPiece
+    {
+        String   model_;
+        unsigned geometryIndex_;
+        unsigned slot_;
+        String   material_;
+    };
+
+    bool ParseXML(XMLFile *xmlFile);
+    Material* ResolveMaterial(const String &name, HashMap<StringHash, SharedPtr<Material> > &resolved) const;
+
+    // resolved table
+    SharedPtr<Model>              baseModel_;
+    Vector<SharedPtr<Model> >     armorModels_;
+    PODVector<ArmorPiece>         pieces_;
+    Vector<SharedPtr<Material> >  slotMaterials_;
+    Vector<SharedPtr<Material> >  materials_;
+    SharedPtr<Model>              model_;
+    bool                          mergeByMaterial_;
+
+    // load-time description, released in EndLoad()
+    String                        loadBaseModel_;
+    Vector<LoadPiece>             loadBaseMaterials_;
+    Vector<LoadPiece>             loadPieces_;
+};
+
@@ -0,0 +1,378 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#include <Urho3D/Container/Sort.h>
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Graphics/Geometry.h>
+#include <Urho3D/Graphics/Material.h>
+#include <Urho3D/IO/Log.h>
+#include <Urho3D/Resource/ResourceEvents.h>
+
+#include "ArmorGeometryMerger.h"
+#include "ArmorModelCache.h"
+#include "GeometryUtils.h"
+
+#include <Urho3D/DebugNew.h>
+//=============================================================================
+//=============================================================================
+static bool CompareSlot(const ArmorSetKey::Slot &lhs, const ArmorSetKey::Slot &rhs)
+{
+    return lhs.slot_ < rhs.slot_;
+}
+
+static inline void CombineHash(unsigned &hash, unsigned value)
+{
+    hash ^= value + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+}
+
+//=============================================================================
+//=============================================================================
+ArmorSetKey::ArmorSetKey(Model *baseModel, const PODVector<ArmorPiece> &pieces, const Vector<SharedPtr<Material> > *mergeMaterials)
+    : baseModel_(baseModel),
+      merged_(mergeMaterials != NULL)
+{
+    slots_.Resize(pieces.Size());
+
+    for (unsigned i = 0; i < pieces.Size(); ++i)
+    {
+        slots_[i].slot_          = pieces[i].slot_;
+        slots_[i].model_         = pieces[i].model_;
+        slots_[i].geometryIndex_ = pieces[i].geometryIndex_;
+    }
+
+    // same loadout listed in a different order is the same set
+    Sort(slots_.Begin(), slots_.End(), CompareSlot);
+
+    if (mergeMaterials)
+    {
+        materials_.Resize(mergeMaterials->Size());
+
+        for (unsigned i = 0; i < mergeMaterials->Size(); ++i)
+        {
+            materials_[i] = mergeMaterials->At(i);
+        }
+    }
+}
+
+bool ArmorSetKey::operator ==(const ArmorSetKey &rhs) const
+{
+    if (baseModel_ != rhs.baseModel_ || slots_.Size() != rhs.slots_.Size() ||
+        merged_ != rhs.merged_ || materials_ != rhs.materials_)
+    {
+        return false;
+    }
+
+    for (unsigned i = 0; i < slots_.Size(); ++i)
+    {
+        if (slots_[i].slot_ != rhs.slots_[i].slot_ ||
+            slots_[i].model_ != rhs.slots_[i].model_ ||
+            slots_[i].geometryIndex_ != rhs.slots_[i].geometryIndex_)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+unsigned ArmorSetKey::ToHash() const
+{
+    unsigned hash = MakeHash(baseModel_);
+
+    for (unsigned i = 0; i < slots_.Size(); ++i)
+    {
+        CombineHash(hash, slots_[i].slot_);
+        CombineHash(hash, MakeHash(slots_[i].model_));
+        CombineHash(hash, slots_[i].geometryIndex_);
+    }
+
+    CombineHash(hash, merged_ ? 1 : 0);
+
+    for (unsigned i = 0; i < materials_.Size(); ++i)
+    {
+        CombineHash(hash, MakeHash(materials_[i]));
+    }
+
+    return hash;
+}
+
+bool ArmorSetKey::References(Model *model) const
+{
+    if (baseModel_ == model)
+    {
+        return true;
+    }
+
+    for (unsigned i = 0; i < slots_.Size(); ++i)
+    {
+        if (slots_[i].model_ == model)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+//=============================================================================
+//=============================================================================
+ArmorModelCache::ArmorModelCache(Context* context) :
+    Object(context)
+{
+}
+
+ArmorModelCache::~ArmorModelCache()
+{
+}
+
+Model* ArmorModelCache::GetComposedModel(Model *baseModel, const PODVector<ArmorPiece> &pieces)
+{
+    const CacheEntry *entry = GetEntry(baseModel, pieces, NULL);
+
+    return entry ? entry->model_.Get() : NULL;
+}
+
+Model* ArmorModelCache::GetMergedModel(Model *baseModel, const PODVector<ArmorPiece> &pieces, const Vector<SharedPtr<Material> > &materials,
+                                       Vector<SharedPtr<Material> > &mergedMaterials)
+{
+    const CacheEntry *entry = GetEntry(baseModel, pieces, &materials);
+
+    if (!entry)
+    {
+        return NULL;
+    }
+
+    mergedMaterials = entry->materials_;
+
+    return entry->model_;
+}
+
+const ArmorModelCache::CacheEntry* ArmorModelCache::GetEntry(Model *baseModel, const PODVector<ArmorPiece> &pieces,
+                                                             const Vector<SharedPtr<Material> > *mergeMaterials)
+{
+    if (!baseModel)
+    {
+        return NULL;
+    }
+
+    for (unsigned i = 0; i < pieces.Size(); ++i)
+    {
+        const ArmorPiece &piece = pieces[i];
+
+        if (!piece.model_ || piece.slot_ >= baseModel->GetNumGeometries() ||
+            piece.geometryIndex_ >= piece.model_->GetNumGeometries())
+        {
+            URHO3D_LOGERROR("ArmorModelCache: invalid armor piece for slot " + String(piece.slot_) +
+                            " of " + baseModel->GetName());
+            return NULL;
+        }
+    }
+
+    ArmorSetKey key(baseModel, pieces, mergeMaterials);
+
+    // every request stands in for a clone of the base model
+    stats_.savedMemory_ += (int)baseModel->GetMemoryUse();
+
+    HashMap<ArmorSetKey, CacheEntry>::Iterator itr = composedModels_.Find(key);
+
+    if (itr != composedModels_.End())
+    {
+        ++stats_.hits_;
+        return &itr->second_;
+    }
+
+    ++stats_.misses_;
+
+    CacheEntry entry;
+    entry.model_ = ComposeModel(baseModel, pieces);
+
+    // the composed model shares the source geometries, which a reload replaces
+    entry.sources_.Push(SharedPtr<Resource>(baseModel));
+    SubscribeToEvent(baseModel, E_RELOADFINISHED, URHO3D_HANDLER(ArmorModelCache, HandleReloadFinished));
+
+    for (unsigned i = 0; i < pieces.Size(); ++i)
+    {
+        entry.sources_.Push(SharedPtr<Resource>(pieces[i].model_));
+        SubscribeToEvent(pieces[i].model_, E_RELOADFINISHED, URHO3D_HANDLER(ArmorModelCache, HandleReloadFinished));
+    }
+
+    if (mergeMaterials)
+    {
+        for (unsigned i = 0; i < mergeMaterials->Size(); ++i)
+        {
+            if (mergeMaterials->At(i))
+                entry.sources_.Push(SharedPtr<Resource>(mergeMaterials->At(i)));
+        }
+    }
+
+    if (mergeMaterials)
+    {
+        GeometryMergeStats mergeStats;
+        SharedPtr<Model> composed = entry.model_;
+
+        entry.model_ = ArmorGeometryMerger::MergeByMaterial(context_, composed, *mergeMaterials, entry.materials_, mergeStats);
+
+        URHO3D_LOGINFO("ArmorModelCache: merged " + baseModel->GetName() + " loadout from " + String(mergeStats.batchesBefore_) +
+                       " to " + String(mergeStats.batchesAfter_) + " batches, " + String(mergeStats.copiedVertices_) + " vertices copied");
+    }
+
+    stats_.composedMemory_ += entry.model_->GetMemoryUse();
+    stats_.savedMemory_ -= (int)entry.model_->GetMemoryUse();
+
+    return &(composedModels_[key] = entry);
+}
+
+SharedPtr<Model> ArmorModelCache::ComposeModel(Model *baseModel, const PODVector<ArmorPiece> &pieces) const
+{
+    SharedPtr<Model> model(new Model(context_));
+    const unsigned numGeometries = baseModel->GetNumGeometries();
+
+    model->SetSkeleton(baseModel->GetSkeleton());
+    model->SetNumGeometries(numGeometries);
+
+    Vector<PODVector<unsigned> > boneMappings = baseModel->GetGeometryBoneMappings();
+    boneMappings.Resize(numGeometries);
+
+    // share the base geometries
+    for (unsigned i = 0; i < numGeometries; ++i)
+    {
+        const unsigned numLods = baseModel->GetNumGeometryLodLevels(i);
+        model->SetNumGeometryLodLevels(i, numLods);
+
+        for (unsigned j = 0; j < numLods; ++j)
+        {
+            model->SetGeometry(i, j, baseModel->GetGeometry(i, j));
+        }
+        model->SetGeometryCenter(i, baseModel->GetGeometryCenter(i));
+    }
+
+    // splice in the armor geometries with their lods. The slots keep the base model's bone mappings,
+    // as a Clone() of the base model with the armor geometries set into it did
+    BoundingBox boundingBox = baseModel->GetBoundingBox();
+
+    for (unsigned i = 0; i < pieces.Size(); ++i)
+    {
+        const ArmorPiece &piece = pieces[i];
+        Model *armor = piece.model_;
+        const unsigned numLods = armor->GetNumGeometryLodLevels(piece.geometryIndex_);
+
+        model->SetNumGeometryLodLevels(piece.slot_, numLods);
+
+        for (unsigned j = 0; j < numLods; ++j)
+        {
+            model->SetGeometry(piece.slot_, j, armor->GetGeometry(piece.geometryIndex_, j));
+        }
+        model->SetGeometryCenter(piece.slot_, armor->GetGeometryCenter(piece.geometryIndex_));
+
+        boundingBox.Merge(armor->GetBoundingBox());
+    }
+
+    model->SetGeometryBoneMappings(boneMappings);
+    model->SetBoundingBox(boundingBox);
+    model->SetMorphs(baseModel->GetMorphs());
+
+    // buffer lists are only walked for morph cloning and saving
+    SetModelBuffers(model, baseModel);
+    model->SetMemoryUse(EstimateComposedMemory(model));
+
+    return model;
+}
+
+unsigned ArmorModelCache::EstimateComposedMemory(Model *model) const
+{
+    unsigned memoryUse = sizeof(Model);
+
+    memoryUse += model->GetSkeleton().GetNumBones() * sizeof(Bone);
+
+    const Vector<PODVector<unsigned> > &boneMappings = model->GetGeometryBoneMappings();
+
+    for (unsigned i = 0; i < model->GetNumGeometries(); ++i)
+    {
+        memoryUse += model->GetNumGeometryLodLevels(i) * sizeof(SharedPtr<Geometry>) + sizeof(Vector3);
+
+        if (i < boneMappings.Size())
+        {
+            memoryUse += boneMappings[i].Size() * sizeof(unsigned);
+        }
+    }
+
+    return memoryUse;
+}
+
+unsigned ArmorModelCache::ReleaseUnused()
+{
+    unsigned numReleased = 0;
+
+    for (HashMap<ArmorSetKey, CacheEntry>::Iterator itr = composedModels_.Begin(); itr != composedModels_.End();)
+    {
+        // only referenced by the cache
+        if (itr->second_.model_.Refs() == 1)
+        {
+            stats_.composedMemory_ -= itr->second_.model_->GetMemoryUse();
+            itr = composedModels_.Erase(itr);
+            ++numReleased;
+        }
+        else
+        {
+            ++itr;
+        }
+    }
+
+    return numReleased;
+}
+
+void ArmorModelCache::HandleReloadFinished(StringHash eventType, VariantMap& eventData)
+{
+    Model *model = static_cast<Model*>(GetEventSender());
+
+    // drawables keep their composed model until they request the set again
+    for (HashMap<ArmorSetKey, CacheEntry>::Iterator itr = composedModels_.Begin(); itr != composedModels_.End();)
+    {
+        if (itr->first_.References(model))
+        {
+            stats_.composedMemory_ -= itr->second_.model_->GetMemoryUse();
+            itr = composedModels_.Erase(itr);
+        }
+        else
+        {
+            ++itr;
+        }
+    }
+}
+
+void ArmorModelCache::Clear()
+{
+    composedModels_.Clear();
+    stats_ = ArmorCacheStats();
+}
+
+void ArmorModelCache::LogStats() const
+{
+    URHO3D_LOGINFO("ArmorModelCache: requests=" + String(stats_.hits_ + stats_.misses_) +
+                   " hits=" + String(stats_.hits_) +
+                   " misses=" + String(stats_.misses_) +
+                   " models=" + String(composedModels_.Size()) +
+                   " composedBytes=" + String(stats_.composedMemory_) +
+                   " savedBytes=" + String(stats_.savedMemory_));
+}
+
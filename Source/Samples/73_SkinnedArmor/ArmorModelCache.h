@@ -0,0 +1,149 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#pragma once
+
+#include <Urho3D/Core/Object.h>
+#include <Urho3D/Graphics/Model.h>
+
+using namespace Urho3D;
+namespace Urho3D
+{
+class Material;
+}
+
+//=============================================================================
+// armor piece: a geometry from an armor model that replaces a base model slot
+//=============================================================================
+struct ArmorPiece
+{
+    ArmorPiece() : slot_(0), model_(NULL), geometryIndex_(0) {}
+    ArmorPiece(unsigned slot, Model *model, unsigned geometryIndex)
+        : slot_(slot), model_(model), geometryIndex_(geometryIndex) {}
+
+    /// Base model geometry slot to replace.
+    unsigned slot_;
+    /// Armor model that holds the geometry.
+    Model    *model_;
+    /// Geometry index within the armor model.
+    unsigned geometryIndex_;
+};
+
+//=============================================================================
+// cache key: identifies a base model + armor set by the resource pointers.
+// The cache entry holds the keyed resources, so their addresses can't be
+// reused while the entry exists, and a resource reloaded in place drops the
+// entries built from it. Material-merged models also key on the slot materials.
+//=============================================================================
+struct ArmorSetKey
+{
+    struct Slot
+    {
+        unsigned slot_;
+        Model    *model_;
+        unsigned geometryIndex_;
+    };
+
+    ArmorSetKey() : merged_(false) {}
+    ArmorSetKey(Model *baseModel, const PODVector<ArmorPiece> &pieces, const Vector<SharedPtr<Material> > *mergeMaterials = NULL);
+
+    bool operator ==(const ArmorSetKey &rhs) const;
+    bool operator !=(const ArmorSetKey &rhs) const { return !(*this == rhs); }
+
+    unsigned ToHash() const;
+
+    /// Return whether the set is built from the model.
+    bool References(Model *model) const;
+
+    Model                *baseModel_;
+    PODVector<Slot>       slots_;
+    bool                  merged_;
+    PODVector<Material*>  materials_;
+};
+
+//=============================================================================
+//=============================================================================
+struct ArmorCacheStats
+{
+    ArmorCacheStats() : hits_(0), misses_(0), composedMemory_(0), savedMemory_(0) {}
+
+    /// Requests served by an existing composed model.
+    unsigned hits_;
+    /// Requests that had to compose a new model.
+    unsigned misses_;
+    /// Bytes held by the composed models.
+    unsigned composedMemory_;
+    /// Bytes a per-character Model::Clone() would have cost, less the composed memory.
+    int      savedMemory_;
+};
+
+//=============================================================================
+// shares one composed Model per (base model, armor set). Composed models are
+// shallow: they reference the base and armor Geometry objects instead of
+// deep-copying vertex and index data as Model::Clone() does.
+//=============================================================================
+class ArmorModelCache : public Object
+{
+    URHO3D_OBJECT(ArmorModelCache, Object);
+
+public:
+    /// Construct.
+    ArmorModelCache(Context* context);
+    virtual ~ArmorModelCache();
+
+    /// Return the composed model for the base model and armor set. Built on the first request for the set.
+    Model* GetComposedModel(Model *baseModel, const PODVector<ArmorPiece> &pieces);
+    /// Return the composed model with same-material geometries merged, and the material per merged geometry.
+    Model* GetMergedModel(Model *baseModel, const PODVector<ArmorPiece> &pieces, const Vector<SharedPtr<Material> > &materials,
+                          Vector<SharedPtr<Material> > &mergedMaterials);
+    /// Release composed models that are no longer used by any drawable.
+    unsigned ReleaseUnused();
+    /// Release all composed models and reset the counters.
+    void Clear();
+
+    /// Return number of composed models.
+    unsigned GetNumComposedModels() const { return composedModels_.Size(); }
+    /// Return hit/miss and memory counters.
+    const ArmorCacheStats& GetStats() const { return stats_; }
+    /// Write the counters to the log.
+    void LogStats() const;
+
+private:
+    struct CacheEntry
+    {
+        SharedPtr<Model>             model_;
+        Vector<SharedPtr<Material> > materials_;
+        /// Source resources of the key, held so their addresses stay unique.
+        Vector<SharedPtr<Resource> > sources_;
+    };
+
+    void HandleReloadFinished(StringHash eventType, VariantMap& eventData);
+
+    const CacheEntry* GetEntry(Model *baseModel, const PODVector<ArmorPiece> &pieces, const Vector<SharedPtr<Material> > *mergeMaterials);
+    SharedPtr<Model> ComposeModel(Model *baseModel, const PODVector<ArmorPiece> &pieces) const;
+    unsigned EstimateComposedMemory(Model *model) const;
+
+    HashMap<ArmorSetKey, CacheEntry> composedModels_;
+    ArmorCacheStats stats_;
+};
+
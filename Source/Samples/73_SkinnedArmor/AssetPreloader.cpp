@@ -0,0 +1,192 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/IO/Log.h>
+#include <Urho3D/Resource/ResourceCache.h>
+#include <Urho3D/Resource/ResourceEvents.h>
+#include <Urho3D/Resource/XMLFile.h>
+
+#include "AssetPreloader.h"
+
+#include <Urho3D/DebugNew.h>
+//=============================================================================
+//=============================================================================
+AssetPreloader::AssetPreloader(Context* context) :
+    Object(context)
+{
+}
+
+bool AssetPreloader::Preload(XMLFile *manifest, const String &archetype)
+{
+    XMLElement archetypeElem = manifest ? manifest->GetRoot("manifest").GetChild("archetype") : XMLElement();
+
+    while (archetypeElem && archetypeElem.GetAttribute("name") != archetype)
+    {
+        archetypeElem = archetypeElem.GetNext("archetype");
+    }
+
+    if (!archetypeElem)
+    {
+        URHO3D_LOGERROR("AssetPreloader: no archetype " + archetype + " in the manifest");
+        return false;
+    }
+
+    ResourceCache* cache = GetSubsystem<ResourceCache>();
+    PendingArchetype pending;
+    pending.name_ = archetype;
+    pending.success_ = true;
+
+    if (pending_.Empty())
+    {
+        timer_.Reset();
+        SubscribeToEvent(E_RESOURCEBACKGROUNDLOADED, URHO3D_HANDLER(AssetPreloader, HandleResourceBackgroundLoaded));
+    }
+
+    for (XMLElement resourceElem = archetypeElem.GetChild("resource"); resourceElem; resourceElem = resourceElem.GetNext("resource"))
+    {
+        const String typeName = resourceElem.GetAttribute("type");
+        const String name = resourceElem.GetAttribute("name");
+        const StringHash type(typeName);
+
+        if (!context_->GetFactories().Contains(type))
+        {
+            URHO3D_LOGERROR("AssetPreloader: unknown resource type " + typeName + " in archetype " + archetype);
+            pending.success_ = false;
+            continue;
+        }
+
+        // without threading support the resource is loaded right here
+        const bool queued = cache->BackgroundLoadResource(type, name, true);
+
+        if (cache->GetExistingResource(type, name))
+        {
+            AddRecord(name, typeName, true, true);
+        }
+        else if (queued || cache->Exists(name))
+        {
+            // queued now, or earlier by someone else
+            pending.resources_.Push(name);
+        }
+        else
+        {
+            AddRecord(name, typeName, true, false);
+            pending.success_ = false;
+        }
+    }
+
+    if (pending.resources_.Empty())
+    {
+        if (pending_.Empty())
+        {
+            UnsubscribeFromEvent(E_RESOURCEBACKGROUNDLOADED);
+        }
+        SendPreloaded(archetype, pending.success_);
+    }
+    else
+    {
+        pending_.Push(pending);
+    }
+
+    return true;
+}
+
+void AssetPreloader::AddRecord(const String &name, const String &typeName, bool listed, bool success)
+{
+    PreloadRecord record;
+    record.name_ = name;
+    record.typeName_ = typeName;
+    record.readyTime_ = timer_.GetUSec(false) / 1000.0f;
+    record.listed_ = listed;
+    record.success_ = success;
+
+    records_.Push(record);
+}
+
+void AssetPreloader::SendPreloaded(const String &archetype, bool success)
+{
+    using namespace AssetsPreloaded;
+
+    VariantMap& eventData = GetEventDataMap();
+    eventData[P_ARCHETYPE] = archetype;
+    eventData[P_SUCCESS] = success;
+    SendEvent(E_ASSETSPRELOADED, eventData);
+}
+
+void AssetPreloader::HandleResourceBackgroundLoaded(StringHash eventType, VariantMap& eventData)
+{
+    using namespace ResourceBackgroundLoaded;
+
+    const String name = eventData[P_RESOURCENAME].GetString();
+    const bool success = eventData[P_SUCCESS].GetBool();
+    Resource *resource = static_cast<Resource*>(eventData[P_RESOURCE].GetPtr());
+    bool listed = false;
+
+    for (unsigned i = 0; i < pending_.Size(); ++i)
+    {
+        if (pending_[i].resources_.Remove(name))
+        {
+            listed = true;
+            pending_[i].success_ &= success;
+        }
+    }
+
+    AddRecord(name, resource ? resource->GetTypeName() : String::EMPTY, listed, success);
+
+    // finished archetypes leave the list before their event, whose handlers may preload again
+    Vector<PendingArchetype> finished;
+
+    for (unsigned i = 0; i < pending_.Size();)
+    {
+        if (pending_[i].resources_.Empty())
+        {
+            finished.Push(pending_[i]);
+            pending_.Erase(i);
+        }
+        else
+        {
+            ++i;
+        }
+    }
+
+    if (pending_.Empty())
+    {
+        UnsubscribeFromEvent(E_RESOURCEBACKGROUNDLOADED);
+    }
+
+    for (unsigned i = 0; i < finished.Size(); ++i)
+    {
+        SendPreloaded(finished[i].name_, finished[i].success_);
+    }
+}
+
+void AssetPreloader::LogRecords() const
+{
+    for (unsigned i = 0; i < records_.Size(); ++i)
+    {
+        const PreloadRecord &record = records_[i];
+
+        URHO3D_LOGINFO("AssetPreloader: " + String(record.readyTime_) + " ms " + record.typeName_ + " " + record.name_ +
+                       (record.listed_ ? "" : " (dependency)") + (record.success_ ? "" : " FAILED"));
+    }
+}
@@ -0,0 +1,109 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#pragma once
+
+#include <Urho3D/Core/Object.h>
+#include <Urho3D/Core/Timer.h>
+
+using namespace Urho3D;
+
+namespace Urho3D
+{
+class XMLFile;
+}
+
+//=============================================================================
+// all resources of a preloaded archetype have finished loading, sent by the
+// AssetPreloader
+//=============================================================================
+URHO3D_EVENT(E_ASSETSPRELOADED, AssetsPreloaded)
+{
+    URHO3D_PARAM(P_ARCHETYPE, Archetype);   // String
+    URHO3D_PARAM(P_SUCCESS, Success);       // bool
+}
+
+//=============================================================================
+//=============================================================================
+struct PreloadRecord
+{
+    String name_;
+    String typeName_;
+    /// Milliseconds from the preload start until the resource was loaded.
+    float  readyTime_;
+    /// Listed in the manifest, otherwise loaded as a dependency of a listed resource.
+    bool   listed_;
+    bool   success_;
+};
+
+//=============================================================================
+// loads the resources a character archetype needs in the background, as
+// listed in a manifest:
+//
+// <manifest>
+//     <archetype name="Maria">
+//         <resource type="ArmorLoadout" name="...xml" />
+//     </archetype>
+// </manifest>
+//
+// Listed resources queue their own dependencies, e.g. a loadout's models and
+// materials, the materials' textures and an animation set's clips, so
+// everything is loaded on the background loader thread and only finished on
+// the main thread. E_ASSETSPRELOADED is sent when the whole archetype is
+// loaded, and every loaded resource is recorded with its ready time.
+//=============================================================================
+class AssetPreloader : public Object
+{
+    URHO3D_OBJECT(AssetPreloader, Object);
+
+public:
+    /// Construct.
+    AssetPreloader(Context* context);
+
+    /// Queue an archetype's resources. E_ASSETSPRELOADED is sent when they are loaded, from this call if they already are. Return false if the archetype is not in the manifest.
+    bool Preload(XMLFile *manifest, const String &archetype);
+    /// Return whether no archetype is loading.
+    bool IsReady() const { return pending_.Empty(); }
+    /// Return the loaded resources in load order.
+    const Vector<PreloadRecord>& GetRecords() const { return records_; }
+    /// Write the records to the log.
+    void LogRecords() const;
+
+private:
+    struct PendingArchetype
+    {
+        String         name_;
+        /// Listed resources still loading.
+        Vector<String> resources_;
+        bool           success_;
+    };
+
+    void AddRecord(const String &name, const String &typeName, bool listed, bool success);
+    void SendPreloaded(const String &archetype, bool success);
+    void HandleResourceBackgroundLoaded(StringHash eventType, VariantMap& eventData);
+
+    Vector<PendingArchetype> pending_;
+    Vector<PreloadRecord>    records_;
+    /// Started by a preload when nothing else is loading.
+    HiresTimer               timer_;
+};
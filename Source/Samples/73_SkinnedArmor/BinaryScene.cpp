@@ -0,0 +1,441 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/IO/File.h>
+#include <Urho3D/IO/FileSystem.h>
+#include <Urho3D/IO/Log.h>
+#include <Urho3D/IO/MemoryBuffer.h>
+#include <Urho3D/IO/VectorBuffer.h>
+#include <Urho3D/Scene/Scene.h>
+#include <Urho3D/Scene/SceneResolver.h>
+
+#include "BinaryScene.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <Urho3D/DebugNew.h>
+//=============================================================================
+// read-only memory mapping of a whole file
+//=============================================================================
+class MappedFile
+{
+public:
+    MappedFile() : data_(0), size_(0) {}
+    ~MappedFile() { Close(); }
+
+    bool Open(const String &fileName)
+    {
+        Close();
+
+#ifdef _WIN32
+        HANDLE file = CreateFileW(GetWideNativePath(fileName).CString(), GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING,
+                                  FILE_ATTRIBUTE_NORMAL, 0);
+
+        if (file == INVALID_HANDLE_VALUE)
+        {
+            return false;
+        }
+
+        LARGE_INTEGER fileSize;
+
+        if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0 && fileSize.QuadPart <= M_MAX_INT)
+        {
+            // the view keeps the mapping open, and the mapping the file
+            HANDLE mapping = CreateFileMappingW(file, 0, PAGE_READONLY, 0, 0, 0);
+
+            if (mapping)
+            {
+                data_ = (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+                size_ = data_ ? (unsigned)fileSize.QuadPart : 0;
+                CloseHandle(mapping);
+            }
+        }
+
+        CloseHandle(file);
+#else
+        const int file = open(GetNativePath(fileName).CString(), O_RDONLY);
+
+        if (file == -1)
+        {
+            return false;
+        }
+
+        struct stat fileStat;
+
+        if (fstat(file, &fileStat) == 0 && fileStat.st_size > 0 && fileStat.st_size <= M_MAX_INT)
+        {
+            // the mapping stays valid after the descriptor is closed
+            void *data = mmap(0, (size_t)fileStat.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+
+            if (data != MAP_FAILED)
+            {
+                data_ = (const unsigned char*)data;
+                size_ = (unsigned)fileStat.st_size;
+            }
+        }
+
+        close(file);
+#endif
+
+        return data_ != 0;
+    }
+
+    void Close()
+    {
+        if (data_)
+        {
+#ifdef _WIN32
+            UnmapViewOfFile(data_);
+#else
+            munmap((void*)data_, size_);
+#endif
+            data_ = 0;
+            size_ = 0;
+        }
+    }
+
+    const unsigned char* GetData() const { return data_; }
+    unsigned GetSize() const { return size_; }
+
+private:
+    const unsigned char *data_;
+    unsigned size_;
+};
+
+//=============================================================================
+// records of a scene being written
+//=============================================================================
+struct BinarySceneWriter
+{
+    PODVector<BinarySceneNode>      nodes_;
+    PODVector<BinarySceneComponent> components_;
+    PODVector<BinarySceneAttribute> attributes_;
+    VectorBuffer                    values_;
+
+    /// Write an object's file attributes, skipping default values unless the object saves them, as SaveXML() does.
+    void WriteAttributes(Serializable *serializable, unsigned &firstAttribute, unsigned &numAttributes)
+    {
+        const Vector<AttributeInfo> *attributes = serializable->GetAttributes();
+
+        firstAttribute = attributes_.Size();
+
+        for (unsigned i = 0; attributes && i < attributes->Size(); ++i)
+        {
+            const AttributeInfo &attr = attributes->At(i);
+
+            if (!(attr.mode_ & AM_FILE))
+            {
+                continue;
+            }
+
+            const Variant value = serializable->GetAttribute(i);
+
+            // pointers have no binary encoding
+            if (value.GetType() == VAR_VOIDPTR || value.GetType() == VAR_PTR)
+            {
+                continue;
+            }
+
+            if (!serializable->SaveDefaultAttributes() && value == serializable->GetAttributeDefault(i))
+            {
+                continue;
+            }
+
+            BinarySceneAttribute record;
+            record.name_ = StringHash(attr.name_).Value();
+            record.type_ = value.GetType();
+            record.offset_ = values_.GetSize();
+            values_.WriteVariantData(value);
+            record.size_ = values_.GetSize() - record.offset_;
+
+            attributes_.Push(record);
+        }
+
+        numAttributes = attributes_.Size() - firstAttribute;
+    }
+
+    /// Write a node, its components and its children depth first.
+    void WriteNode(Node *node, unsigned parent)
+    {
+        const Vector<SharedPtr<Component> > &components = node->GetComponents();
+        const Vector<SharedPtr<Node> > &children = node->GetChildren();
+        BinarySceneNode record;
+
+        record.id_ = node->GetID();
+        record.parent_ = parent;
+        record.firstComponent_ = components_.Size();
+        WriteAttributes(node, record.firstAttribute_, record.numAttributes_);
+
+        for (unsigned i = 0; i < components.Size(); ++i)
+        {
+            Component *component = components[i];
+
+            if (component->IsTemporary())
+            {
+                continue;
+            }
+
+            BinarySceneComponent componentRecord;
+            componentRecord.type_ = component->GetType().Value();
+            componentRecord.id_ = component->GetID();
+            WriteAttributes(component, componentRecord.firstAttribute_, componentRecord.numAttributes_);
+
+            components_.Push(componentRecord);
+        }
+
+        record.numComponents_ = components_.Size() - record.firstComponent_;
+
+        const unsigned index = nodes_.Size();
+        nodes_.Push(record);
+
+        for (unsigned i = 0; i < children.Size(); ++i)
+        {
+            if (!children[i]->IsTemporary())
+            {
+                WriteNode(children[i], index);
+            }
+        }
+    }
+};
+
+//=============================================================================
+//=============================================================================
+BinaryScene::BinaryScene(Context* context) :
+    Object(context)
+{
+}
+
+bool BinaryScene::Save(Scene *scene, Serializer &dest)
+{
+    BinarySceneWriter writer;
+    writer.WriteNode(scene, M_MAX_UNSIGNED);
+
+    BinarySceneHeader header;
+    memcpy(header.id_, BINARY_SCENE_ID, sizeof(header.id_));
+    header.version_ = BINARY_SCENE_VERSION;
+    header.numNodes_ = writer.nodes_.Size();
+    header.numComponents_ = writer.components_.Size();
+    header.numAttributes_ = writer.attributes_.Size();
+    header.valueSize_ = writer.values_.GetSize();
+
+    bool success = dest.Write(&header, sizeof(header)) == sizeof(header);
+
+    success &= dest.Write(writer.nodes_.Buffer(), writer.nodes_.Size() * sizeof(BinarySceneNode)) ==
+               writer.nodes_.Size() * sizeof(BinarySceneNode);
+    success &= dest.Write(writer.components_.Buffer(), writer.components_.Size() * sizeof(BinarySceneComponent)) ==
+               writer.components_.Size() * sizeof(BinarySceneComponent);
+    success &= dest.Write(writer.attributes_.Buffer(), writer.attributes_.Size() * sizeof(BinarySceneAttribute)) ==
+               writer.attributes_.Size() * sizeof(BinarySceneAttribute);
+    success &= dest.Write(writer.values_.GetData(), writer.values_.GetSize()) == writer.values_.GetSize();
+
+    return success;
+}
+
+bool BinaryScene::Load(Scene *scene, const String &fileName)
+{
+    MappedFile mappedFile;
+
+    if (mappedFile.Open(fileName))
+    {
+        return Load(scene, mappedFile.GetData(), mappedFile.GetSize());
+    }
+
+    // files that can't be mapped are read whole
+    File file(context_, fileName);
+
+    if (!file.IsOpen() || !file.GetSize())
+    {
+        URHO3D_LOGERROR("Could not open binary scene " + fileName);
+        return false;
+    }
+
+    PODVector<unsigned char> data(file.GetSize());
+
+    if (file.Read(&data[0], data.Size()) != data.Size())
+    {
+        return false;
+    }
+
+    return Load(scene, &data[0], data.Size());
+}
+
+bool BinaryScene::Load(Scene *scene, const unsigned char *data, unsigned size)
+{
+    if (size < sizeof(BinarySceneHeader))
+    {
+        URHO3D_LOGERROR("Binary scene data is truncated");
+        return false;
+    }
+
+    const BinarySceneHeader *header = reinterpret_cast<const BinarySceneHeader*>(data);
+
+    if (memcmp(header->id_, BINARY_SCENE_ID, sizeof(header->id_)) != 0 || header->version_ != BINARY_SCENE_VERSION)
+    {
+        URHO3D_LOGERROR("Not a binary scene of version " + String(BINARY_SCENE_VERSION));
+        return false;
+    }
+
+    const unsigned long long expectedSize = sizeof(BinarySceneHeader) +
+                                            (unsigned long long)header->numNodes_ * sizeof(BinarySceneNode) +
+                                            (unsigned long long)header->numComponents_ * sizeof(BinarySceneComponent) +
+                                            (unsigned long long)header->numAttributes_ * sizeof(BinarySceneAttribute) +
+                                            header->valueSize_;
+
+    if (expectedSize != size || !header->numNodes_)
+    {
+        URHO3D_LOGERROR("Binary scene data is truncated");
+        return false;
+    }
+
+    const BinarySceneNode *nodes = reinterpret_cast<const BinarySceneNode*>(header + 1);
+    const BinarySceneComponent *components = reinterpret_cast<const BinarySceneComponent*>(nodes + header->numNodes_);
+    const BinarySceneAttribute *attributes = reinterpret_cast<const BinarySceneAttribute*>(components + header->numComponents_);
+    const unsigned char *values = reinterpret_cast<const unsigned char*>(attributes + header->numAttributes_);
+
+    // validate every index once so the loop below can trust them
+    for (unsigned i = 0; i < header->numNodes_; ++i)
+    {
+        const BinarySceneNode &node = nodes[i];
+        bool valid = (i == 0) == (node.parent_ == M_MAX_UNSIGNED) && (i == 0 || node.parent_ < i) &&
+                     (unsigned long long)node.firstComponent_ + node.numComponents_ <= header->numComponents_ &&
+                     (unsigned long long)node.firstAttribute_ + node.numAttributes_ <= header->numAttributes_;
+
+        for (unsigned j = 0; valid && j < node.numComponents_; ++j)
+        {
+            const BinarySceneComponent &component = components[node.firstComponent_ + j];
+            valid = (unsigned long long)component.firstAttribute_ + component.numAttributes_ <= header->numAttributes_;
+        }
+
+        if (!valid)
+        {
+            URHO3D_LOGERROR("Binary scene node record " + String(i) + " is invalid");
+            return false;
+        }
+    }
+
+    for (unsigned i = 0; i < header->numAttributes_; ++i)
+    {
+        if ((unsigned long long)attributes[i].offset_ + attributes[i].size_ > header->valueSize_ ||
+            attributes[i].type_ >= MAX_VAR_TYPES)
+        {
+            URHO3D_LOGERROR("Binary scene attribute record " + String(i) + " is invalid");
+            return false;
+        }
+    }
+
+    scene->StopAsyncLoading();
+    scene->Clear();
+
+    SceneResolver resolver;
+    PODVector<Node*> createdNodes(header->numNodes_);
+
+    for (unsigned i = 0; i < header->numNodes_; ++i)
+    {
+        const BinarySceneNode &record = nodes[i];
+        Node *node = scene;
+
+        if (i > 0)
+        {
+            node = createdNodes[record.parent_]->CreateChild(String::EMPTY, record.id_ < FIRST_LOCAL_ID ? REPLICATED : LOCAL,
+                                                             record.id_);
+        }
+
+        createdNodes[i] = node;
+        resolver.AddNode(record.id_, node);
+        SetAttributes(node, attributes + record.firstAttribute_, record.numAttributes_, values);
+
+        for (unsigned j = 0; j < record.numComponents_; ++j)
+        {
+            const BinarySceneComponent &componentRecord = components[record.firstComponent_ + j];
+            Component *component = node->CreateComponent(StringHash(componentRecord.type_),
+                                                         componentRecord.id_ < FIRST_LOCAL_ID ? REPLICATED : LOCAL,
+                                                         componentRecord.id_);
+
+            // unknown types were logged by CreateComponent()
+            if (component)
+            {
+                resolver.AddComponent(componentRecord.id_, component);
+                SetAttributes(component, attributes + componentRecord.firstAttribute_, componentRecord.numAttributes_, values);
+            }
+        }
+    }
+
+    // same finish as Scene::LoadXML()
+    resolver.Resolve();
+    scene->ApplyAttributes();
+
+    return true;
+}
+
+void BinaryScene::SetAttributes(Serializable *serializable, const BinarySceneAttribute *attributes, unsigned numAttributes,
+                                const unsigned char *values)
+{
+    const HashMap<StringHash, unsigned> &indices = GetAttributeIndices(serializable);
+
+    for (unsigned i = 0; i < numAttributes; ++i)
+    {
+        const BinarySceneAttribute &attr = attributes[i];
+        HashMap<StringHash, unsigned>::ConstIterator it = indices.Find(StringHash(attr.name_));
+
+        if (it == indices.End())
+        {
+            URHO3D_LOGWARNING("Unknown attribute hash " + StringHash(attr.name_).ToString() + " in binary scene for " +
+                              serializable->GetTypeName());
+            continue;
+        }
+
+        MemoryBuffer buffer(values + attr.offset_, attr.size_);
+        serializable->SetAttribute(it->second_, buffer.ReadVariant((VariantType)attr.type_));
+    }
+}
+
+const HashMap<StringHash, unsigned>& BinaryScene::GetAttributeIndices(Serializable *serializable)
+{
+    HashMap<StringHash, HashMap<StringHash, unsigned> >::Iterator it = attributeIndices_.Find(serializable->GetType());
+
+    if (it != attributeIndices_.End())
+    {
+        return it->second_;
+    }
+
+    HashMap<StringHash, unsigned> &indices = attributeIndices_[serializable->GetType()];
+    const Vector<AttributeInfo> *attributes = serializable->GetAttributes();
+
+    for (unsigned i = 0; attributes && i < attributes->Size(); ++i)
+    {
+        if (attributes->At(i).mode_ & AM_FILE)
+        {
+            indices[StringHash(attributes->At(i).name_)] = i;
+        }
+    }
+
+    return indices;
+}
@@ -0,0 +1,120 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#pragma once
+
+#include <Urho3D/Core/Object.h>
+
+using namespace Urho3D;
+
+namespace Urho3D
+{
+class Scene;
+class Serializable;
+class Serializer;
+}
+
+/// Binary scene file id and format version.
+const char* const BINARY_SCENE_ID = "BSCN";
+const unsigned BINARY_SCENE_VERSION = 1;
+
+//=============================================================================
+// binary scene file layout, little-endian, every record 4-byte aligned:
+//   header
+//   node records, depth first, the scene itself first
+//   component records, each node's components contiguous
+//   attribute records, each object's attributes contiguous
+//   attribute values in Urho's binary Variant encoding
+//=============================================================================
+struct BinarySceneHeader
+{
+    char     id_[4];
+    unsigned version_;
+    unsigned numNodes_;
+    unsigned numComponents_;
+    unsigned numAttributes_;
+    unsigned valueSize_;
+};
+
+struct BinarySceneNode
+{
+    unsigned id_;
+    /// Index of the parent node record, always lower than the node's own. M_MAX_UNSIGNED for the scene.
+    unsigned parent_;
+    unsigned firstComponent_;
+    unsigned numComponents_;
+    unsigned firstAttribute_;
+    unsigned numAttributes_;
+};
+
+struct BinarySceneComponent
+{
+    /// Component type hash.
+    unsigned type_;
+    unsigned id_;
+    unsigned firstAttribute_;
+    unsigned numAttributes_;
+};
+
+struct BinarySceneAttribute
+{
+    /// Attribute name hash.
+    unsigned name_;
+    /// Variant type of the value.
+    unsigned type_;
+    /// Value position and size in the value block.
+    unsigned offset_;
+    unsigned size_;
+};
+
+//=============================================================================
+// writes scenes in the binary scene format and loads them back. Loading
+// memory-maps the file and sets the attributes straight from their binary
+// values, matched by name hash, so nothing is parsed from text. Scenes load
+// with their node and component IDs, like Scene::LoadXML().
+//=============================================================================
+class BinaryScene : public Object
+{
+    URHO3D_OBJECT(BinaryScene, Object);
+
+public:
+    /// Construct.
+    BinaryScene(Context* context);
+
+    /// Write a scene with the file attributes Scene::SaveXML() would write. Temporary nodes and components are skipped.
+    bool Save(Scene *scene, Serializer &dest);
+    /// Load a binary scene file, replacing the scene's content. Return true if successful.
+    bool Load(Scene *scene, const String &fileName);
+    /// Load binary scene data from memory, replacing the scene's content. The data must be 4-byte aligned. Return true if successful.
+    bool Load(Scene *scene, const unsigned char *data, unsigned size);
+
+private:
+    /// Set an object's attributes from its attribute records.
+    void SetAttributes(Serializable *serializable, const BinarySceneAttribute *attributes, unsigned numAttributes,
+                       const unsigned char *values);
+    /// Return attribute indices by name hash for an object's type.
+    const HashMap<StringHash, unsigned>& GetAttributeIndices(Serializable *serializable);
+
+    /// Attribute indices by name hash, per object type.
+    HashMap<StringHash, HashMap<StringHash, unsigned> > attributeIndices_;
+};
@@ -21,8 +21,8 @@
 //
 
 #include <Urho3D/Core/Context.h>
-#include <Urho3D/Graphics/AnimationController.h>
 #include <Urho3D/IO/MemoryBuffer.h>
+#include <Urho3D/Physics/CollisionShape.h>
 #include <Urho3D/Physics/PhysicsEvents.h>
 #include <Urho3D/Physics/PhysicsWorld.h>
 #include <Urho3D/Physics/RigidBody.h>
@@ -31,30 +31,57 @@
 #include <Urho3D/Graphics/DrawableEvents.h>
 #include <Urho3D/Math/Ray.h>
 
+#include "AnimationSetController.h"
 #include "Character.h"
+#include "CharacterSystem.h"
 #include "CollisionLayer.h"
+#include "GroundContacts.h"
+#include "HitRegistry.h"
+#include "KinematicCapsule.h"
+#include "MeleeSweep.h"
+#include "PoseHistory.h"
 
 #include <Urho3D/DebugNew.h>
 //=============================================================================
 //=============================================================================
 #define MAX_STEPDOWN_HEIGHT     0.5f
+#define KINEMATIC_SLOPE_LIMIT   45.0f
 
 //=============================================================================
 //=============================================================================
 Character::Character(Context* context) :
     LogicComponent(context),
     onGround_(false),
+    groundNormal_(Vector3::UP),
     okToJump_(true),
     inAirTimer_(0.0f),
     jumpStarted_(false),
+    kinematicController_(false),
+    animIdle_(INVALID_ANIM_HANDLE),
+    animRun_(INVALID_ANIM_HANDLE),
+    animJumpStart_(INVALID_ANIM_HANDLE),
+    animJumpLoop_(INVALID_ANIM_HANDLE),
+    animEquipIdle_(INVALID_ANIM_HANDLE),
+    animSheath_(INVALID_ANIM_HANDLE),
+    animUnSheath_(INVALID_ANIM_HANDLE),
     weaponActionState_(Weapon_Invalid),
+    weaponActionAnim_(INVALID_ANIM_HANDLE),
     comboAnimsIdx_(0),
-    weaponDmgState_(WeaponDmg_OFF)
+    weaponDmgState_(WeaponDmg_OFF),
+    hitAttacker_(0)
 {
     // Only the physics update event is needed: unsubscribe from the rest for optimization
     SetUpdateEventMask(USE_FIXEDUPDATE);
 }
 
+Character::~Character()
+{
+    if (hitRegistry_)
+    {
+        hitRegistry_->RemoveAttacker(hitAttacker_);
+    }
+}
+
 void Character::RegisterObject(Context* context)
 {
     context->RegisterFactory<Character>();
@@ -66,11 +93,14 @@ void Character::RegisterObject(Context* context)
     URHO3D_ATTRIBUTE("On Ground", bool, onGround_, false, AM_DEFAULT);
     URHO3D_ATTRIBUTE("OK To Jump", bool, okToJump_, true, AM_DEFAULT);
     URHO3D_ATTRIBUTE("In Air Timer", float, inAirTimer_, 0.0f, AM_DEFAULT);
+    URHO3D_ACCESSOR_ATTRIBUTE("Kinematic Controller", IsKinematicController, SetKinematicController, bool, false, AM_DEFAULT);
 }
 
 void Character::DelayedStart()
 {
-    animCtrl_             = node_->GetComponent<AnimationController>(true);
+    body_                 = GetComponent<RigidBody>();
+    shape_                = GetComponent<CollisionShape>();
+    animCtrl_             = node_->GetComponent<AnimationSetController>(true);
     backLocatorNode_      = node_->GetChild("GreatswordLocator", true);
     rightHandLocatorNode_ = node_->GetChild("RighthandLocator", true);
     weaponNode_           = node_->GetChild("Weapon", true);
@@ -84,20 +114,217 @@ void Character::DelayedStart()
     // anim trigger event
     SubscribeToEvent(animCtrl_->GetNode(), E_ANIMATIONTRIGGER, URHO3D_HANDLER(Character, HandleAnimationTrigger));
 
+    // clip handles: the only name lookups, ticks use the handles
+    animIdle_      = animCtrl_->GetHandle("Idle");
+    animRun_       = animCtrl_->GetHandle("Run");
+    animJumpStart_ = animCtrl_->GetHandle("JumpStart");
+    animJumpLoop_  = animCtrl_->GetHandle("JumpLoop");
+    animEquipIdle_ = animCtrl_->GetHandle("EquipIdle");
+    animSheath_    = animCtrl_->GetHandle("Sheath");
+    animUnSheath_  = animCtrl_->GetHandle("UnSheath");
+
     // combo anims
-    weaponComboAnim_.Push("SkinnedArmor/Girlbot/Girlbot_SlashCombo1.ani");
-    weaponComboAnim_.Push("SkinnedArmor/Girlbot/Girlbot_SlashCombo2.ani");
-    weaponComboAnim_.Push("SkinnedArmor/Girlbot/Girlbot_SlashCombo3.ani");
+    weaponComboAnim_.Push(animCtrl_->GetHandle("SlashCombo1"));
+    weaponComboAnim_.Push(animCtrl_->GetHandle("SlashCombo2"));
+    weaponComboAnim_.Push(animCtrl_->GetHandle("SlashCombo3"));
 
-    // weapon collision
+    // weapon collision: swept by the scene's MeleeSweepSystem if there is one, otherwise the trigger body's contacts
     if (weaponActionState_ == Weapon_Unequipped)
     {
-        if (weaponNode_->GetComponent<RigidBody>())
+        // hits are deduplicated and delivered by the scene-wide registry
+        hitRegistry_ = GetScene()->GetOrCreateComponent<HitRegistry>(LOCAL);
+        hitAttacker_ = hitRegistry_->AddAttacker(node_);
+
+        RigidBody *weaponBody = weaponNode_->GetComponent<RigidBody>();
+        MeleeSweepSystem *meleeSweepSystem = GetScene()->GetComponent<MeleeSweepSystem>();
+
+        if (meleeSweepSystem && weaponNode_->GetComponent<CollisionShape>())
+        {
+            if (weaponBody)
+            {
+                weaponBody->SetCollisionEventMode(COLLISION_NEVER);
+            }
+            meleeSweepSystem->AddCharacter(this);
+        }
+        else if (weaponBody)
         {
-            weaponNode_->GetComponent<RigidBody>()->SetCollisionEventMode(COLLISION_ALWAYS);
+            weaponBody->SetCollisionEventMode(COLLISION_ALWAYS);
             SubscribeToEvent(weaponNode_, E_NODECOLLISION, URHO3D_HANDLER(Character, HandleWeaponCollision));
         }
     }
+
+    // the scene's CharacterSystem steps all characters' locomotion in one pass
+    CharacterSystem *characterSystem = GetScene()->GetComponent<CharacterSystem>();
+
+    if (characterSystem && body_)
+    {
+        characterSystem->AddCharacter(this);
+    }
+
+    // and its GroundContactQuery reads the ground contacts from the physics world instead of collision events,
+    // unless the kinematic controller detects the ground itself
+    GroundContactQuery *groundContactQuery = GetScene()->GetComponent<GroundContactQuery>();
+
+    if (kinematicController_)
+    {
+        ApplyControllerMode();
+    }
+    else if (groundContactQuery && body_)
+    {
+        groundContactQuery->AddCharacter(this);
+    }
+
+    // hitbox poses are recorded for lag-compensated hit tests if the scene keeps a pose history
+    PoseHistorySystem *poseHistorySystem = GetScene()->GetComponent<PoseHistorySystem>();
+
+    if (poseHistorySystem)
+    {
+        poseHistorySystem->AddCharacter(this);
+    }
+}
+
+void Character::OnSetEnabled()
+{
+    CharacterSystem *characterSystem = IsDelayedStartCalled() && body_ && GetScene() ? GetScene()->GetComponent<CharacterSystem>() : NULL;
+
+    // join the system before the base class updates the event subscription, so the fixed update is never subscribed in between
+    if (characterSystem && IsEnabledEffective())
+    {
+        characterSystem->AddCharacter(this);
+    }
+
+    LogicComponent::OnSetEnabled();
+
+    if (characterSystem && !IsEnabledEffective())
+    {
+        characterSystem->RemoveCharacter(this);
+    }
+}
+
+void Character::ResetState()
+{
+    controls_.Reset();
+    onGround_ = false;
+    groundNormal_ = Vector3::UP;
+    okToJump_ = true;
+    inAirTimer_ = 0.0f;
+    jumpStarted_ = false;
+    velocity_ = Vector3::ZERO;
+
+    if (body_)
+    {
+        body_->SetLinearVelocity(Vector3::ZERO);
+        body_->SetAngularVelocity(Vector3::ZERO);
+    }
+
+    // sheath at once, the clips' states stay on the model at zero weight
+    if (weaponActionState_ != Weapon_Invalid)
+    {
+        if (weaponNode_->GetParent() != backLocatorNode_)
+        {
+            backLocatorNode_->AddChild(weaponNode_);
+        }
+        weaponActionState_ = Weapon_Unequipped;
+    }
+
+    weaponActionAnim_ = INVALID_ANIM_HANDLE;
+    comboAnimsIdx_ = 0;
+    queInput_.Reset();
+    weaponDmgState_ = WeaponDmg_OFF;
+
+    if (animCtrl_)
+    {
+        animCtrl_->StopLayer(NormalLayer);
+        animCtrl_->StopLayer(WeaponLayer);
+    }
+
+    if (hitRegistry_)
+    {
+        hitRegistry_->BeginSwing(hitAttacker_);
+    }
+}
+
+void Character::SetKinematicController(bool enable)
+{
+    if (enable == kinematicController_)
+    {
+        return;
+    }
+
+    kinematicController_ = enable;
+
+    // before the delayed start the mode is applied there
+    if (body_)
+    {
+        ApplyControllerMode();
+    }
+}
+
+void Character::ApplyControllerMode()
+{
+    GroundContactQuery *groundContactQuery = GetScene()->GetComponent<GroundContactQuery>();
+
+    if (kinematicController_)
+    {
+        velocity_ = body_->GetLinearVelocity();
+
+        if (groundContactQuery)
+        {
+            groundContactQuery->RemoveCharacter(this);
+        }
+
+        // moved by sweeps, no solver response and no contact events
+        UnsubscribeFromEvent(GetNode(), E_NODECOLLISION);
+        body_->SetKinematic(true);
+        body_->SetCollisionEventMode(COLLISION_NEVER);
+    }
+    else
+    {
+        body_->SetKinematic(false);
+        body_->SetLinearVelocity(velocity_);
+
+        if (groundContactQuery)
+        {
+            groundContactQuery->AddCharacter(this);
+        }
+        else
+        {
+            SetGroundContactQuery(NULL);
+        }
+    }
+}
+
+void Character::SetCharacterSystem(CharacterSystem *system)
+{
+    characterSystem_ = system;
+    SetUpdateEventMask(system ? 0 : USE_FIXEDUPDATE);
+}
+
+void Character::SetGroundContactQuery(GroundContactQuery *query)
+{
+    groundContactQuery_ = query;
+
+    if (query)
+    {
+        // nothing else listens to the character's own collisions
+        UnsubscribeFromEvent(GetNode(), E_NODECOLLISION);
+        body_->SetCollisionEventMode(COLLISION_NEVER);
+    }
+    else
+    {
+        SubscribeToEvent(GetNode(), E_NODECOLLISION, URHO3D_HANDLER(Character, HandleNodeCollision));
+
+        if (body_)
+        {
+            body_->SetCollisionEventMode(COLLISION_ALWAYS);
+        }
+    }
+}
+
+void Character::SetGroundContact(const Vector3 &normal)
+{
+    onGround_ = true;
+    groundNormal_ = normal;
 }
 
 void Character::Start()
@@ -108,34 +335,43 @@ void Character::Start()
 
 void Character::FixedUpdate(float timeStep)
 {
-    /// \todo Could cache the components for faster access instead of finding them each frame
-    RigidBody* body = GetComponent<RigidBody>();
-    AnimationController* animCtrl = node_->GetComponent<AnimationController>(true);
+    if (characterSystem_ || !body_)
+        return;
 
-    // Update the in air timer. Reset if grounded
-    if (!onGround_)
-        inAirTimer_ += timeStep;
-    else
-        inAirTimer_ = 0.0f;
-    // When character has been in air less than 1/10 second, it's still interpreted as being on ground
-    bool softGrounded = inAirTimer_ < INAIR_THRESHOLD_TIME;
-
-    // Update movement & animation
-    const Quaternion& rot = node_->GetRotation();
-    Vector3 moveDir = Vector3::ZERO;
-    const Vector3& velocity = body->GetLinearVelocity();
-    // Velocity on the XZ plane
-    Vector3 planeVelocity(velocity.x_, 0.0f, velocity.z_);
-
-    if (controls_.IsDown(CTRL_FORWARD))
-        moveDir += Vector3::FORWARD;
-    if (controls_.IsDown(CTRL_BACK))
-        moveDir += Vector3::BACK;
-    if (controls_.IsDown(CTRL_LEFT))
-        moveDir += Vector3::LEFT;
-    if (controls_.IsDown(CTRL_RIGHT))
-        moveDir += Vector3::RIGHT;
+    // a batch of one through the stages CharacterSystem runs for all characters
+    unsigned char flags = StepWeapon(timeStep);
+    Quaternion rotation = node_->GetRotation();
+    Vector3 velocity = GetVelocity();
+    Vector3 moveImpulse;
+    Vector3 brakeImpulse;
+    float runSpeed = 0.0f;
+
+    LocomotionLanes lanes;
+    lanes.buttons_       = &controls_.buttons_;
+    lanes.rotations_     = &rotation;
+    lanes.velocities_    = &velocity;
+    lanes.onGround_      = &onGround_;
+    lanes.flags_         = &flags;
+    lanes.inAirTimers_   = &inAirTimer_;
+    lanes.okToJump_      = &okToJump_;
+    lanes.moveImpulses_  = &moveImpulse;
+    lanes.brakeImpulses_ = &brakeImpulse;
+    lanes.runSpeeds_     = &runSpeed;
+
+    CharacterSystem::ComputeLocomotion(lanes, 0, 1, timeStep);
+
+    PhysicsRaycastResult groundProbe;
+
+    if (NeedsGroundProbe(flags))
+    {
+        GetScene()->GetComponent<PhysicsWorld>()->RaycastSingle(groundProbe, Ray(node_->GetPosition(), Vector3::DOWN), GROUND_PROBE_DISTANCE, 0xff);
+    }
 
+    ApplyLocomotion(moveImpulse, brakeImpulse, flags, runSpeed, groundProbe, timeStep);
+}
+
+unsigned char Character::StepWeapon(float timeStep)
+{
     //=========================
     // weapon start
     //=========================
@@ -144,70 +380,93 @@ void Character::FixedUpdate(float timeStep)
     controls_.Set(CTRL_EQUIP | CTRL_LMB, false);
     unsigned prevState = weaponActionState_;
 
-    ProcessWeaponAction(equipWeapon, lMouseB?CTRL_LMB:0);
+    ProcessWeaponAction(equipWeapon, lMouseB?CTRL_LMB:0, timeStep);
 
     if (weaponActionState_ == Weapon_AttackAnim)
     {
-        if (prevState == Weapon_Equipped)
+        return LOCO_ATTACKING | (prevState == Weapon_Equipped ? LOCO_STOP : 0);
+    }
+
+    return 0;
+}
+
+bool Character::NeedsGroundProbe(unsigned char flags) const
+{
+    // airborne without a jump animation running or starting: the fall animation depends on the ground below
+    return !(flags & (LOCO_ATTACKING | LOCO_JUMP)) && !onGround_ && !jumpStarted_;
+}
+
+Vector3 Character::GetVelocity() const
+{
+    return kinematicController_ ? velocity_ : body_->GetLinearVelocity();
+}
+
+void Character::ApplyImpulse(const Vector3 &impulse)
+{
+    if (kinematicController_)
+    {
+        const float mass = body_->GetMass();
+        velocity_ += mass > 0.0f ? impulse / mass : impulse;
+    }
+    else
+    {
+        body_->ApplyImpulse(impulse);
+    }
+}
+
+void Character::ApplyLocomotion(const Vector3 &moveImpulse, const Vector3 &brakeImpulse, unsigned char flags, float runSpeed,
+                                const PhysicsRaycastResult &groundProbe, float timeStep)
+{
+    if (flags & LOCO_ATTACKING)
+    {
+        if (flags & LOCO_STOP)
         {
-            body->SetLinearVelocity(Vector3::ZERO);
+            if (kinematicController_)
+                velocity_ = Vector3::ZERO;
+            else
+                body_->SetLinearVelocity(Vector3::ZERO);
         }
-        onGround_ = false;
+        EndLocomotion(timeStep);
         return;
     }
 
-    // Normalize move vector so that diagonal strafing is not faster
-    if (moveDir.LengthSquared() > 0.0f)
-        moveDir.Normalize();
-
     // If in air, allow control, but slower than when on ground
-    body->ApplyImpulse(rot * moveDir * (softGrounded ? MOVE_FORCE : INAIR_MOVE_FORCE));
+    ApplyImpulse(moveImpulse);
 
-    if (softGrounded)
+    if (flags & LOCO_SOFTGROUNDED)
     {
         // When on ground, apply a braking force to limit maximum ground velocity
-        Vector3 brakeForce = -planeVelocity * BRAKE_FORCE;
-        body->ApplyImpulse(brakeForce);
+        ApplyImpulse(brakeImpulse);
 
         // Jump. Must release jump control between jumps
-        if (controls_.IsDown(CTRL_JUMP))
+        if (flags & LOCO_JUMP)
         {
-            if (okToJump_)
-            {
-                body->ApplyImpulse(Vector3::UP * JUMP_FORCE);
-                jumpStarted_ = true;
-                okToJump_ = false;
-                animCtrl_->StopLayer(0);
-                animCtrl_->PlayExclusive("SkinnedArmor/Girlbot/Girlbot_JumpStart.ani", 0, false, 0.2f);
-                animCtrl_->SetTime("SkinnedArmor/Girlbot/Girlbot_JumpStart.ani", 0);
-            }
+            ApplyImpulse(Vector3::UP * JUMP_FORCE);
+            jumpStarted_ = true;
+            animCtrl_->StopLayer(0);
+            animCtrl_->PlayExclusive(animJumpStart_, 0, false, 0.2f);
+            animCtrl_->SetTime(animJumpStart_, 0);
         }
-        else
-            okToJump_ = true;
     }
 
     if (!onGround_ || jumpStarted_)
     {
         if (jumpStarted_)
         {
-            if (animCtrl_->IsAtEnd("SkinnedArmor/Girlbot/Girlbot_JumpStart.ani"))
+            if (animCtrl_->IsAtEnd(animJumpStart_))
             {
-                animCtrl_->PlayExclusive("SkinnedArmor/Girlbot/Girlbot_JumpLoop.ani", 0, true, 0.3f);
-                animCtrl_->SetTime("SkinnedArmor/Girlbot/Girlbot_JumpLoop.ani", 0);
+                animCtrl_->PlayExclusive(animJumpLoop_, 0, true, 0.3f);
+                animCtrl_->SetTime(animJumpLoop_, 0);
                 jumpStarted_ = false;
             }
         }
         else
         {
-            float rayDistance = 50.0f;
-            PhysicsRaycastResult result;
-            GetScene()->GetComponent<PhysicsWorld>()->RaycastSingle(result, Ray(node_->GetPosition(), Vector3::DOWN), rayDistance, 0xff);
-
-            if (result.body_ && result.distance_ > MAX_STEPDOWN_HEIGHT )
+            if (groundProbe.body_ && groundProbe.distance_ > MAX_STEPDOWN_HEIGHT )
             {
-                animCtrl_->PlayExclusive("SkinnedArmor/Girlbot/Girlbot_JumpLoop.ani", 0, true, 0.2f);
+                animCtrl_->PlayExclusive(animJumpLoop_, 0, true, 0.2f);
             }
-            else if (result.body_ == NULL)
+            else if (groundProbe.body_ == NULL)
             {
                 // fall to death animation
             }
@@ -216,24 +475,47 @@ void Character::FixedUpdate(float timeStep)
     else
     {
         // Play walk animation if moving on ground, otherwise fade it out
-        if (softGrounded && !moveDir.Equals(Vector3::ZERO))
-            animCtrl_->PlayExclusive("SkinnedArmor/Girlbot/Girlbot_Run.ani", 0, true, 0.2f);
+        if ((flags & LOCO_SOFTGROUNDED) && (flags & LOCO_MOVING))
+            animCtrl_->PlayExclusive(animRun_, 0, true, 0.2f);
         else
-            animCtrl_->PlayExclusive("SkinnedArmor/Girlbot/Girlbot_Idle.ani", 0, true, 0.2f);
+            animCtrl_->PlayExclusive(animIdle_, 0, true, 0.2f);
 
         // Set walk animation speed proportional to velocity
-        float spd = Clamp(planeVelocity.Length() * 0.3f, 0.5f, 2.0f);
-        animCtrl_->SetSpeed("SkinnedArmor/Girlbot/Girlbot_Run.ani", spd);
+        animCtrl_->SetSpeed(animRun_, runSpeed);
     }
 
+    EndLocomotion(timeStep);
+}
+
+void Character::EndLocomotion(float timeStep)
+{
     // Reset grounded flag for next frame
+    const bool wasOnGround = onGround_;
     onGround_ = false;
+
+    // the kinematic controller moves itself now and finds its own ground
+    if (kinematicController_ && shape_)
+    {
+        KinematicCapsuleState state;
+        state.position_ = node_->GetWorldPosition();
+        state.velocity_ = velocity_;
+        state.groundNormal_ = groundNormal_;
+        state.onGround_ = wasOnGround;
+
+        KinematicCapsule capsule(GetScene()->GetComponent<PhysicsWorld>(), body_, shape_);
+        capsule.Move(state, timeStep, MAX_STEPDOWN_HEIGHT, KINEMATIC_SLOPE_LIMIT);
+
+        node_->SetWorldPosition(state.position_);
+        velocity_ = state.velocity_;
+        groundNormal_ = state.groundNormal_;
+        onGround_ = state.onGround_;
+    }
 }
 
-void Character::ProcessWeaponAction(bool equip, unsigned lMouseB)
+void Character::ProcessWeaponAction(bool equip, unsigned lMouseB, float timeStep)
 {
     // update queue timer
-    queInput_.Update();
+    queInput_.Update(timeStep);
 
     // eval state
     switch (weaponActionState_)
@@ -241,7 +523,7 @@ void Character::ProcessWeaponAction(bool equip, unsigned lMouseB)
     case Weapon_Unequipped:
         if (equip)
         {
-            weaponActionAnim_ = "SkinnedArmor/Girlbot/Girlbot_UnSheathLY.ani";
+            weaponActionAnim_ = animUnSheath_;
             animCtrl_->Play(weaponActionAnim_, WeaponLayer, false, 0.0f);
             animCtrl_->SetTime(weaponActionAnim_, 0.0f);
             rightHandLocatorNode_->AddChild(weaponNode_);
@@ -261,7 +543,7 @@ void Character::ProcessWeaponAction(bool equip, unsigned lMouseB)
         {
             if (queInput_.Empty())
             {
-                animCtrl_->PlayExclusive("SkinnedArmor/Girlbot/Girlbot_EquipIdleLY.ani", WeaponLayer, true, 0.1f);
+                animCtrl_->PlayExclusive(animEquipIdle_, WeaponLayer, true, 0.1f);
             }
             weaponActionState_ = Weapon_Equipped;
         }
@@ -270,7 +552,7 @@ void Character::ProcessWeaponAction(bool equip, unsigned lMouseB)
     case Weapon_Equipped:
         if (equip)
         {
-            weaponActionAnim_ = "SkinnedArmor/Girlbot/Girlbot_SheathLY.ani";
+            weaponActionAnim_ = animSheath_;
             animCtrl_->Play(weaponActionAnim_, WeaponLayer, false, 0.1f);
             animCtrl_->SetTime(weaponActionAnim_, 0.0f);
             weaponActionState_ = Weapon_UnEquipping;
@@ -325,7 +607,7 @@ void Character::ProcessWeaponAction(bool equip, unsigned lMouseB)
             if (queInput_.Empty())
             {
                 comboAnimsIdx_ = 0;
-                animCtrl_->PlayExclusive("SkinnedArmor/Girlbot/Girlbot_EquipIdleLY.ani", WeaponLayer, true, 0.1f);
+                animCtrl_->PlayExclusive(animEquipIdle_, WeaponLayer, true, 0.1f);
             }
             else
             {
@@ -355,7 +637,12 @@ void Character::HandleNodeCollision(StringHash eventType, VariantMap& eventData)
         {
             float level = contactNormal.y_;
             if (level > 0.75f)
+            {
+                // keep the most upward normal of the step
+                if (!onGround_ || level > groundNormal_.y_)
+                    groundNormal_ = contactNormal;
                 onGround_ = true;
+            }
         }
     }
 }
@@ -377,16 +664,8 @@ void Character::HandleWeaponCollision(StringHash eventType, VariantMap& eventDat
         return;
     }
 
-    Node *hitNode = (Node *)eventData[P_OTHERNODE].GetVoidPtr();
-
-    // only one entry per node
-    Vector<Node*>::ConstIterator itr = weaponDmgRecipientList_.Find(hitNode);
-    if (itr == weaponDmgRecipientList_.End())
-    {
-        SendWeaponDmgEvent(hitNode);
-
-        weaponDmgRecipientList_.Push(hitNode);
-    }
+    // contacts only tell where, not how the blade moved
+    RegisterWeaponHit((Node *)eventData[P_OTHERNODE].GetVoidPtr(), weaponNode_->GetWorldPosition(), Vector3::ZERO);
 
     // for this demo, pos and normal are not gathered
 #ifdef GATHER_HIT_POS_N_NORMAL
@@ -402,14 +681,13 @@ void Character::HandleWeaponCollision(StringHash eventType, VariantMap& eventDat
 #endif
 }
 
-void Character::SendWeaponDmgEvent(Node *node)
+void Character::RegisterWeaponHit(Node *hitNode, const Vector3 &position, const Vector3 &direction)
 {
-    using namespace WeaponDmgEvent;
-
-    VariantMap& eventData = GetEventDataMap();
-    eventData[P_NODE] = node;
-
-    SendEvent(E_WEAPONDMG, eventData);
+    // the registry keeps one hit per node and swing
+    if (hitRegistry_)
+    {
+        hitRegistry_->RegisterHit(hitAttacker_, hitNode, position, direction);
+    }
 }
 
 void Character::HandleAnimationTrigger(StringHash eventType, VariantMap& eventData)
@@ -417,7 +695,7 @@ void Character::HandleAnimationTrigger(StringHash eventType, VariantMap& eventDa
     using namespace AnimationTrigger;
 
     //Animation *animation = (Animation*)eventData[P_ANIMATION].GetVoidPtr();
-    String strAction = eventData[P_DATA].GetString();
+    const String &strAction = eventData[P_DATA].GetString();
 
     // we want to know when the weapon collision is valid
     if (strAction.StartsWith("weaponDmg"))
@@ -425,7 +703,11 @@ void Character::HandleAnimationTrigger(StringHash eventType, VariantMap& eventDa
         if (strAction.EndsWith("ON"))
         {
             weaponDmgState_ = WeaponDmg_ON;
-            weaponDmgRecipientList_.Clear();
+
+            if (hitRegistry_)
+            {
+                hitRegistry_->BeginSwing(hitAttacker_);
+            }
         }
         else
         {
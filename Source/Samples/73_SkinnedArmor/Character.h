@@ -26,11 +26,22 @@
 #include <Urho3D/Scene/LogicComponent.h>
 
 using namespace Urho3D;
+
 namespace Urho3D
 {
-class AnimationController;
+class CollisionShape;
+class RigidBody;
+struct PhysicsRaycastResult;
 }
 
+class AnimationSetController;
+struct CharacterSnapshot;
+class CharacterSystem;
+class GroundContactQuery;
+class HitRegistry;
+class MeleeSweepSystem;
+class PoseHistorySystem;
+
 //=============================================================================
 //=============================================================================
 const int CTRL_FORWARD = (1 << 0);
@@ -49,28 +60,21 @@ const float BRAKE_FORCE = 0.2f;
 const float JUMP_FORCE = 7.0f;
 const float YAW_SENSITIVITY = 0.1f;
 const float INAIR_THRESHOLD_TIME = 0.1f;
+const float GROUND_PROBE_DISTANCE = 50.0f;
 
 //=============================================================================
-//=============================================================================
-URHO3D_EVENT(E_WEAPONDMG, WeaponDmgEvent)
-{
-	URHO3D_PARAM(P_NODE, Node);
-	URHO3D_PARAM(P_POS, Pos);
-	URHO3D_PARAM(P_DIR, Dir);
-}
-
-//=============================================================================
-// simple single key input queue
+// simple single key input queue. Hold time runs on the simulation timestep,
+// not the wall clock, so recorded input replays the same at any speed.
 //=============================================================================
 class QueInput
 {
 public:
-    QueInput() : input_(M_MAX_UNSIGNED), holdTime_(1200) {}
+    QueInput() : input_(M_MAX_UNSIGNED), holdTime_(1.2f), queTime_(0.0f) {}
 
     void SetInput(unsigned input)
     {
         input_ = input;
-        queTimer_.Reset();
+        queTime_ = 0.0f;
     }
 
     unsigned GetInput() const
@@ -78,9 +82,11 @@ public:
         return input_;
     }
 
-    void Update()
+    void Update(float timeStep)
     {
-        if (queTimer_.GetMSec(false) >= holdTime_)
+        queTime_ += timeStep;
+
+        if (queTime_ >= holdTime_)
         {
             input_ = M_MAX_UNSIGNED;
         }
@@ -99,8 +105,8 @@ public:
 protected:
     unsigned input_;
 
-    unsigned holdTime_;
-    Timer queTimer_;
+    float holdTime_;
+    float queTime_;
 };
 
 //=============================================================================
@@ -112,35 +118,95 @@ class Character : public LogicComponent
 public:
     /// Construct.
     Character(Context* context);
+    virtual ~Character();
     
     /// Register object factory and attributes.
     static void RegisterObject(Context* context);
     
     virtual void DelayedStart();
     virtual void Start();
-    /// Handle physics world update. Called by LogicComponent base class.
+    /// Handle enabled/disabled state change: a disabled character leaves the CharacterSystem until enabled again.
+    virtual void OnSetEnabled();
+    /// Handle physics world update. Called by LogicComponent base class, unless a CharacterSystem steps the character.
     virtual void FixedUpdate(float timeStep);
-    
+
+    /// Set the system that steps the character instead of its own fixed update. Called by CharacterSystem.
+    void SetCharacterSystem(CharacterSystem *system);
+    /// Set the query that detects ground from the physics contacts instead of collision events. Called by GroundContactQuery.
+    void SetGroundContactQuery(GroundContactQuery *query);
+
+    /// Reset locomotion, controls and weapon state to a new character's, with the sword on the back. Used when a pooled character is reused.
+    void ResetState();
+
+    /// Set kinematic controller mode: the capsule is moved by sweeps instead of the physics solver.
+    void SetKinematicController(bool enable);
+    /// Return whether the kinematic controller mode is used.
+    bool IsKinematicController() const { return kinematicController_; }
+
+    /// Return whether the last physics step found ground contact.
+    bool IsOnGround() const { return onGround_; }
+    /// Return the most upward ground contact normal of the last physics step. Valid when on ground.
+    const Vector3& GetGroundNormal() const { return groundNormal_; }
+
     /// Movement controls. Assigned by the main program each frame.
     Controls controls_;
     
 private:
-    void ProcessWeaponAction(bool equip, unsigned lMouseB);
+    friend struct CharacterSnapshot;
+    friend class CharacterSystem;
+    friend class GroundContactQuery;
+    friend class MeleeSweepSystem;
+    friend class PoseHistorySystem;
+
+    /// Locomotion step stages, shared with CharacterSystem: weapon state first, then the computed locomotion is applied.
+    /// A ground probe straight down is needed for the fall animation when NeedsGroundProbe() returns true.
+    unsigned char StepWeapon(float timeStep);
+    bool NeedsGroundProbe(unsigned char flags) const;
+    void ApplyLocomotion(const Vector3 &moveImpulse, const Vector3 &brakeImpulse, unsigned char flags, float runSpeed,
+                         const PhysicsRaycastResult &groundProbe, float timeStep);
+    void EndLocomotion(float timeStep);
+    /// Velocity and impulses of the body, or of the kinematic controller.
+    Vector3 GetVelocity() const;
+    void ApplyImpulse(const Vector3 &impulse);
+    void ApplyControllerMode();
+    void ProcessWeaponAction(bool equip, unsigned lMouseB, float timeStep);
+    /// Record a ground contact with the given normal.
+    void SetGroundContact(const Vector3 &normal);
     void HandleNodeCollision(StringHash eventType, VariantMap& eventData);
     void HandleWeaponCollision(StringHash eventType, VariantMap& eventData);
     void HandleAnimationTrigger(StringHash eventType, VariantMap& eventData);
-    void SendWeaponDmgEvent(Node *node);
+    /// Report a weapon hit on a node to the scene's HitRegistry.
+    void RegisterWeaponHit(Node *hitNode, const Vector3 &position, const Vector3 &direction);
 
     /// Grounded flag for movement.
     bool onGround_;
+    /// Best ground normal found with the grounded flag.
+    Vector3 groundNormal_;
     /// Jump flag.
     bool okToJump_;
     /// In air timer. Due to possible physics inaccuracy, character can be off ground for max. 1/10 second and still be allowed to move.
     float inAirTimer_;
     bool jumpStarted_;
+    /// Kinematic controller mode and its velocity.
+    bool kinematicController_;
+    Vector3 velocity_;
+
+    WeakPtr<RigidBody> body_;
+    WeakPtr<CollisionShape> shape_;
+    WeakPtr<CharacterSystem> characterSystem_;
+    WeakPtr<GroundContactQuery> groundContactQuery_;
 
     // anim ctrl
-    WeakPtr<AnimationController> animCtrl_;
+    WeakPtr<AnimationSetController> animCtrl_;
+
+    // clip handles, resolved once from the controller's animation set
+    unsigned animIdle_;
+    unsigned animRun_;
+    unsigned animJumpStart_;
+    unsigned animJumpLoop_;
+    unsigned animEquipIdle_;
+    unsigned animSheath_;
+    unsigned animUnSheath_;
 
     WeakPtr<Node> backLocatorNode_;
     WeakPtr<Node> rightHandLocatorNode_;
@@ -148,15 +214,16 @@ private:
 
     // weapon state
     unsigned weaponActionState_;
-    String weaponActionAnim_;
+    unsigned weaponActionAnim_;
 
     unsigned comboAnimsIdx_;
-    Vector<String> weaponComboAnim_;
+    PODVector<unsigned> weaponComboAnim_;
     QueInput queInput_;
 
     // weapon damage
-    unsigned      weaponDmgState_;
-    Vector<Node*> weaponDmgRecipientList_;
+    unsigned             weaponDmgState_;
+    WeakPtr<HitRegistry> hitRegistry_;
+    unsigned             hitAttacker_;
 
 
 private:
@@ -22,9 +22,10 @@
 
 #include <Urho3D/Core/CoreEvents.h>
 #include <Urho3D/Core/ProcessUtils.h>
+#include <Urho3D/Core/Timer.h>
+#include <Urho3D/Core/WorkQueue.h>
 #include <Urho3D/Engine/Engine.h>
 #include <Urho3D/Graphics/AnimatedModel.h>
-#include <Urho3D/Graphics/AnimationController.h>
 #include <Urho3D/Graphics/RenderPath.h>
 #include <Urho3D/Graphics/Camera.h>
 #include <Urho3D/Graphics/Light.h>
@@ -47,6 +48,24 @@
 
 #include "CharacterDemo.h"
 #include "Character.h"
+#include "CharacterPool.h"
+#include "CharacterSystem.h"
+#include "AnimationSet.h"
+#include "ArenaHost.h"
+#include "AnimationSetController.h"
+#include "ArmorLoadout.h"
+#include "AssetPreloader.h"
+#include "ArmorModelCache.h"
+#include "BinaryScene.h"
+#include "ControlsRecorder.h"
+#include "CrowdStress.h"
+#include "FrameTiming.h"
+#include "GroundContacts.h"
+#include "HitRegistry.h"
+#include "MeleeSweep.h"
+#include "NodePrefab.h"
+#include "PoseHistory.h"
+#include "QuantizedModel.h"
 #include "CollisionLayer.h"
 
 #include <Urho3D/DebugNew.h>
@@ -65,10 +84,38 @@ URHO3D_DEFINE_APPLICATION_MAIN(CharacterDemo)
 CharacterDemo::CharacterDemo(Context* context) :
     Sample(context),
     firstPerson_(false),
-    drawDebug_(false)
+    drawDebug_(false),
+    useCharacterSystem_(true),
+    useMeleeSweep_(true),
+    physicsFps_(0),
+    kinematicCharacters_(false),
+    recordPoseHistory_(false),
+    snapshotLoopback_(false),
+    stressCharacters_(0),
+    stressDummies_(0),
+    stressFrames_(600),
+    arenaScenes_(0),
+    numThreads_(0),
+    tickBudget_(0.0f),
+    usePrefabs_(true),
+    spawnBenchCharacters_(0)
 {
     // Register factory and attributes for the Character component so it can be created via CreateComponent, and loaded / saved
     Character::RegisterObject(context);
+    CharacterSystem::RegisterObject(context);
+    MeleeSweepSystem::RegisterObject(context);
+    HitRegistry::RegisterObject(context);
+    GroundContactQuery::RegisterObject(context);
+    PoseHistorySystem::RegisterObject(context);
+    AnimationSet::RegisterObject(context);
+    AnimationSetController::RegisterObject(context);
+    ArmorLoadout::RegisterObject(context);
+    QuantizedModel::RegisterObject(context);
+    NodePrefab::RegisterObject(context);
+    CharacterPool::RegisterObject(context);
+
+    // composed armor models are shared between characters with the same loadout
+    context->RegisterSubsystem(new ArmorModelCache(context));
 }
 
 CharacterDemo::~CharacterDemo()
@@ -83,10 +130,145 @@ void CharacterDemo::Setup()
     engineParameters_["Headless"]     = false;
     engineParameters_["WindowWidth"]  = 1280; 
     engineParameters_["WindowHeight"] = 720;
+
+    // -stress <characters> [-dummies <count>] [-frames <count>] runs the headless crowd stress mode,
+    // -record <file> records the player's controls, -replay <file> replays them headless,
+    // -nocharactersystem steps every character in its own fixed update,
+    // -nomeleesweep detects weapon hits with the trigger bodies, -physicsfps <fps> sets the physics rate,
+    // -kinematic moves the characters with the kinematic capsule controller,
+    // -posehistory records the characters' hitbox poses for lag-compensated hit tests,
+    // -snapshots replicates the crowd stress characters through a loopback connection,
+    // -arenas <count> [-tickbudget <msec>] hosts that many crowd stress scenes stepped in parallel,
+    // -threads <count> sets the number of threads including the main thread,
+    // -spawnbench <characters> times spawning that many armed characters with and without the weapon prefab
+    const Vector<String> &arguments = GetArguments();
+    bool dummiesSet = false;
+
+    for (unsigned i = 0; i < arguments.Size(); ++i)
+    {
+        String argument = arguments[i].ToLower();
+        const bool hasValue = i + 1 < arguments.Size();
+
+        if (argument == "-nocharactersystem")
+        {
+            useCharacterSystem_ = false;
+        }
+        else if (argument == "-nomeleesweep")
+        {
+            useMeleeSweep_ = false;
+        }
+        else if (argument == "-kinematic")
+        {
+            kinematicCharacters_ = true;
+        }
+        else if (argument == "-posehistory")
+        {
+            recordPoseHistory_ = true;
+        }
+        else if (argument == "-snapshots")
+        {
+            snapshotLoopback_ = true;
+        }
+        else if (!hasValue)
+        {
+            continue;
+        }
+        else if (argument == "-stress")
+        {
+            stressCharacters_ = ToUInt(arguments[++i]);
+        }
+        else if (argument == "-dummies")
+        {
+            stressDummies_ = ToUInt(arguments[++i]);
+            dummiesSet = true;
+        }
+        else if (argument == "-frames")
+        {
+            stressFrames_ = ToUInt(arguments[++i]);
+        }
+        else if (argument == "-physicsfps")
+        {
+            physicsFps_ = ToUInt(arguments[++i]);
+        }
+        else if (argument == "-arenas")
+        {
+            arenaScenes_ = ToUInt(arguments[++i]);
+        }
+        else if (argument == "-threads")
+        {
+            numThreads_ = ToUInt(arguments[++i]);
+        }
+        else if (argument == "-tickbudget")
+        {
+            tickBudget_ = ToFloat(arguments[++i]);
+        }
+        else if (argument == "-spawnbench")
+        {
+            spawnBenchCharacters_ = ToUInt(arguments[++i]);
+        }
+        else if (argument == "-record")
+        {
+            recordFile_ = arguments[++i];
+        }
+        else if (argument == "-replay")
+        {
+            replayFile_ = arguments[++i];
+        }
+    }
+
+    // arenas without -stress get a small crowd each, and no collision events: weapon hits need the melee sweep
+    if (arenaScenes_)
+    {
+        if (!stressCharacters_)
+            stressCharacters_ = 20;
+        useMeleeSweep_ = true;
+    }
+
+    if (stressCharacters_ && !dummiesSet)
+        stressDummies_ = stressCharacters_ / 4;
+
+    // stress, arena, spawn benchmark and replay runs are headless
+    if (stressCharacters_ || spawnBenchCharacters_ || !replayFile_.Empty())
+    {
+        engineParameters_["Headless"] = true;
+        engineParameters_["Sound"]    = false;
+    }
+
+    // the worker threads are created in Start
+    if (numThreads_)
+    {
+        engineParameters_["WorkerThreads"] = false;
+    }
 }
 
 void CharacterDemo::Start()
 {
+    if (numThreads_ > 1)
+    {
+        GetSubsystem<WorkQueue>()->CreateThreads(numThreads_ - 1);
+    }
+
+    if (arenaScenes_)
+    {
+        StartArenaHost();
+        return;
+    }
+    if (spawnBenchCharacters_)
+    {
+        RunSpawnBench();
+        return;
+    }
+    if (stressCharacters_)
+    {
+        StartCrowdStress();
+        return;
+    }
+    if (!replayFile_.Empty())
+    {
+        StartReplay();
+        return;
+    }
+
     // Execute base class startup
     Sample::Start();
 
@@ -95,8 +277,9 @@ void CharacterDemo::Start()
     // Create static scene content
     CreateScene();
 
-    // Create the controllable character
-    CreateCharacter();
+    // the recorder handles the physics pre-step ahead of the character
+    if (!recordFile_.Empty())
+        controlsRecorder_ = new ControlsRecorder(context_, scene_);
 
     // Create the UI content
     CreateInstructions();
@@ -106,6 +289,37 @@ void CharacterDemo::Start()
 
     // Set the mouse mode to use in the sample
     Sample::InitMouseMode(MM_RELATIVE);
+
+    // the controllable character spawns once its assets are loaded in the background
+    assetPreloader_ = new AssetPreloader(context_);
+    SubscribeToEvent(assetPreloader_, E_ASSETSPRELOADED, URHO3D_HANDLER(CharacterDemo, HandleAssetsPreloaded));
+
+    XMLFile *manifest = GetSubsystem<ResourceCache>()->GetResource<XMLFile>("SkinnedArmor/XMLData/CharacterManifest.xml");
+
+    if (!assetPreloader_->Preload(manifest, "Maria"))
+    {
+        SpawnPlayer();
+    }
+}
+
+void CharacterDemo::HandleAssetsPreloaded(StringHash eventType, VariantMap& eventData)
+{
+    assetPreloader_->LogRecords();
+    SpawnPlayer();
+}
+
+void CharacterDemo::SpawnPlayer()
+{
+    // Create the controllable character
+    character_ = CreateCharacter("Player", scene_->GetChild("playerSpawn")->GetPosition());
+    greatswordNode_ = character_->GetNode()->GetChild("Weapon", true);
+
+    if (controlsRecorder_)
+        controlsRecorder_->Start(character_, recordFile_);
+
+    CreateCharacterSystems();
+
+    GetSubsystem<ArmorModelCache>()->LogStats();
 }
 
 void CharacterDemo::ChangeDebugHudText()
@@ -143,56 +357,63 @@ void CharacterDemo::CreateScene()
     Camera* camera = cameraNode_->CreateComponent<Camera>();
     camera->SetFarClip(350.0f);
 
-    SharedPtr<Viewport> viewport(new Viewport(context_, scene_, camera));
-    GetSubsystem<Renderer>()->SetViewport(0, viewport);
+    // no renderer when headless
+    if (GetSubsystem<Renderer>())
+    {
+        SharedPtr<Viewport> viewport(new Viewport(context_, scene_, camera));
+        GetSubsystem<Renderer>()->SetViewport(0, viewport);
+    }
 
-    // load scene
-    XMLFile *xmlLevel = cache->GetResource<XMLFile>("SkinnedArmor/Scene/LevelScene.xml");
-    scene_->LoadXML(xmlLevel->GetRoot());
+    // load scene, from the binary conversion when it is up to date
+    FileSystem *fileSystem = GetSubsystem<FileSystem>();
+    const String xmlFileName = cache->GetResourceFileName("SkinnedArmor/Scene/LevelScene.xml");
+    const String binaryFileName = cache->GetResourceFileName("SkinnedArmor/Scene/LevelScene.bscn");
+    bool loaded = false;
+
+    if (!binaryFileName.Empty() &&
+        (xmlFileName.Empty() || fileSystem->GetLastModifiedTime(binaryFileName) >= fileSystem->GetLastModifiedTime(xmlFileName)))
+    {
+        SharedPtr<BinaryScene> binaryScene(new BinaryScene(context_));
+        loaded = binaryScene->Load(scene_, binaryFileName);
+    }
+
+    if (!loaded)
+    {
+        XMLFile *xmlLevel = cache->GetResource<XMLFile>("SkinnedArmor/Scene/LevelScene.xml");
+        scene_->LoadXML(xmlLevel->GetRoot());
+    }
+
+    if (physicsFps_)
+        scene_->GetComponent<PhysicsWorld>()->SetFps(physicsFps_);
 
     dummyNode_ = scene_->GetChild("Dummy", true);
+
+    // characters and dummies are spawned through the pool, see SpawnCharacter()
+    scene_->CreateComponent<CharacterPool>(LOCAL);
 }
 
-void CharacterDemo::CreateCharacter()
+Character* CharacterDemo::CreateCharacter(const String& name, const Vector3& position)
 {
     ResourceCache* cache = GetSubsystem<ResourceCache>();
 
     // spin node
-    Node *spawnNode = scene_->GetChild("playerSpawn");
-    Node* objectNode = scene_->CreateChild("Player");
-    objectNode->SetPosition(spawnNode->GetPosition());
+    Node* objectNode = scene_->CreateChild(name);
+    objectNode->SetPosition(position);
 
     Node* adjustNode = objectNode->CreateChild("AdjNode");
     adjustNode->SetRotation(Quaternion(180, Vector3(0,1,0)));
 
     // model
     AnimatedModel* object = adjustNode->CreateComponent<AnimatedModel>();
-    SharedPtr<Model> model(cache->GetResource<Model>("SkinnedArmor/Girlbot/Girlbot.mdl")->Clone());
-    Model *modelArmor = cache->GetResource<Model>("SkinnedArmor/Maria/Armor.mdl");
-    model->SetGeometry(4, 0, modelArmor->GetGeometry(0, 0));
-    model->SetGeometry(5, 0, modelArmor->GetGeometry(1, 0));
-    model->SetGeometry(6, 0, modelArmor->GetGeometry(2, 0));
-    model->SetGeometry(7, 0, modelArmor->GetGeometry(3, 0));
-    model->SetGeometry(8, 0, modelArmor->GetGeometry(4, 0));
-
-    // set model
-    object->SetModel(model);
-
-    object->SetMaterial(0, cache->GetResource<Material>("SkinnedArmor/Girlbot/Materials/BetaBodyMat1.xml"));
-    object->SetMaterial(1, cache->GetResource<Material>("SkinnedArmor/Girlbot/Materials/BetaBodyMat1.xml"));
-    object->SetMaterial(2, cache->GetResource<Material>("SkinnedArmor/Girlbot/Materials/BetaBodyMat1.xml"));
-    object->SetMaterial(3, cache->GetResource<Material>("SkinnedArmor/Girlbot/Materials/BetaJointsMAT1.xml"));
-
-    object->SetMaterial(4, cache->GetResource<Material>("SkinnedArmor/Maria/Materials/MariaMat1.xml"));
-    object->SetMaterial(5, cache->GetResource<Material>("SkinnedArmor/Maria/Materials/MariaMat1.xml"));
-    object->SetMaterial(6, cache->GetResource<Material>("SkinnedArmor/Maria/Materials/MariaMat1.xml"));
-    object->SetMaterial(7, cache->GetResource<Material>("SkinnedArmor/Maria/Materials/MariaMat1.xml"));
-    object->SetMaterial(8, cache->GetResource<Material>("SkinnedArmor/Maria/Materials/MariaMat1.xml"));
+    // base model, armor pieces and slot materials are resolved once by the loadout
+    ArmorLoadout *loadout = cache->GetResource<ArmorLoadout>("SkinnedArmor/XMLData/MariaLoadout.xml");
+    loadout->Apply(object);
 
     object->SetCastShadows(true);
 
-    // anim ctrl
-    adjustNode->CreateComponent<AnimationController>();
+    // anim ctrl: clips resolved once into handles by the animation set
+    AnimationSetController *animCtrl = adjustNode->CreateComponent<AnimationSetController>();
+    animCtrl->SetAnimationSet(cache->GetResource<AnimationSet>("SkinnedArmor/XMLData/GirlbotAnimations.xml"));
 
     // Set the head bone for manual control
     object->GetSkeleton().GetBone("Head")->animated_ = false;
@@ -207,24 +428,282 @@ void CharacterDemo::CreateCharacter()
 
     CollisionShape* shape = objectNode->CreateComponent<CollisionShape>();
     shape->SetCapsule(0.7f, 1.8f, Vector3(0.0f, 0.9f, 0.0f));
-    character_ = objectNode->CreateComponent<Character>();
+    Character* character = objectNode->CreateComponent<Character>();
+    character->SetKinematicController(kinematicCharacters_);
+
+    // back locator: the sword hierarchy is created under the skeleton's bone of the same name
+    if (usePrefabs_)
+    {
+        NodePrefab *backLocator = cache->GetResource<NodePrefab>("SkinnedArmor/XMLData/BackLocator.xml");
+        Node *mntNode = backLocator ? adjustNode->GetChild(backLocator->GetRootName(), true) : NULL;
+
+        if (mntNode)
+        {
+            backLocator->Instantiate(mntNode);
+        }
+    }
+    else
+    {
+        XMLFile *xmlDat = cache->GetResource<XMLFile>("SkinnedArmor/XMLData/BackLocator.xml");
+        Node *loadNode = scene_->InstantiateXML(xmlDat->GetRoot(), Vector3::ZERO, Quaternion::IDENTITY);
+        Node *mntNode = adjustNode->GetChild(loadNode->GetName(), true);
+
+        if (mntNode)
+        {
+            Node *gsLocator = loadNode->GetChild("GreatswordLocator");
+            if (gsLocator)
+            {
+                mntNode->AddChild(gsLocator);
+            }
+        }
+        scene_->RemoveChild(loadNode);
+    }
+
+    return character;
+}
+
+void CharacterDemo::SpawnCrowd(Vector<WeakPtr<Character> > &characters, Vector<WeakPtr<Node> > &dummies)
+{
+    // interleave dummies with the characters so attacks have something to hit
+    unsigned numSlots = stressCharacters_ + stressDummies_;
+    unsigned numCharacters = 0;
+    unsigned numDummies = 0;
+
+    for (unsigned i = 0; i < numSlots; ++i)
+    {
+        Vector3 position = GetCrowdSpawnPosition(scene_, i, numSlots);
+
+        if (numDummies < stressDummies_ && (numCharacters == stressCharacters_ || numDummies * stressCharacters_ < numCharacters * stressDummies_))
+        {
+            dummies.Push(WeakPtr<Node>(SpawnDummy(position)));
+            ++numDummies;
+        }
+        else
+        {
+            characters.Push(WeakPtr<Character>(SpawnCharacter("Character" + String(numCharacters), position)));
+            ++numCharacters;
+        }
+    }
+}
+
+void CharacterDemo::StartCrowdStress()
+{
+    // no window, console or viewport: only the scene and the crowd
+    CreateScene();
+
+    crowdStress_ = new CrowdStress(context_, scene_);
+
+    Vector<WeakPtr<Character> > characters;
+    Vector<WeakPtr<Node> > dummies;
+    SpawnCrowd(characters, dummies);
+
+    for (unsigned i = 0; i < characters.Size(); ++i)
+        crowdStress_->AddCharacter(characters[i]);
+    for (unsigned i = 0; i < dummies.Size(); ++i)
+        crowdStress_->AddDummy(dummies[i]);
+
+    // the receiving side's copy, below the level and out of the crowd's way until the loopback parks it
+    Character *replica = snapshotLoopback_ ? CreateCharacter("Replica", Vector3(0.0f, -100.0f, 0.0f)) : NULL;
+
+    GetSubsystem<ArmorModelCache>()->LogStats();
+
+    CreateCharacterSystems();
+
+    if (snapshotLoopback_)
+    {
+        crowdStress_->EnableSnapshotLoopback(replica);
+    }
+    crowdStress_->Start(stressFrames_);
+}
+
+void CharacterDemo::StartArenaHost()
+{
+    // ahead of the scenes, so it steps their physics before their own update
+    arenaHost_ = new ArenaHost(context_);
+
+    for (unsigned i = 0; i < arenaScenes_; ++i)
+    {
+        CreateScene();
+
+        Vector<WeakPtr<Character> > characters;
+        Vector<WeakPtr<Node> > dummies;
+        SpawnCrowd(characters, dummies);
+        CreateCharacterSystems();
+
+        arenaHost_->AddScene(scene_, characters, tickBudget_);
+    }
+
+    GetSubsystem<ArmorModelCache>()->LogStats();
+
+    arenaHost_->Start(stressFrames_, 1.0f / 60.0f);
+}
+
+void CharacterDemo::RunSpawnBench()
+{
+    CreateScene();
+
+    // the floor raycasts are not part of spawning
+    PODVector<Vector3> positions(spawnBenchCharacters_);
+
+    for (unsigned i = 0; i < spawnBenchCharacters_; ++i)
+    {
+        positions[i] = GetCrowdSpawnPosition(scene_, i, spawnBenchCharacters_);
+    }
+
+    CharacterPool *pool = scene_->GetComponent<CharacterPool>();
+    PODVector<Character*> characters(spawnBenchCharacters_);
+    HiresTimer timer;
 
-    // back locator
-    XMLFile *xmlDat = cache->GetResource<XMLFile>("SkinnedArmor/XMLData/BackLocator.xml");
-    Node *loadNode = scene_->InstantiateXML(xmlDat->GetRoot(), Vector3::ZERO, Quaternion::IDENTITY);
-    Node *mntNode = adjustNode->GetChild(loadNode->GetName(), true);
+    PrintLine("spawn,characters,total_ms,us_per_character,scene_nodes");
 
-    if (mntNode)
+    // assembled from scratch: back locator from XML, then from the prefab
+    for (unsigned prefab = 0; prefab < 2; ++prefab)
     {
-        Node *gsLocator = loadNode->GetChild("GreatswordLocator");
-        if (gsLocator)
+        usePrefabs_ = prefab != 0;
+
+        // the first character loads the resources, which neither path should time
+        CreateCharacter("Warmup", Vector3::ZERO)->GetNode()->Remove();
+
+        timer.Reset();
+
+        for (unsigned i = 0; i < spawnBenchCharacters_; ++i)
         {
-            mntNode->AddChild(gsLocator);
-            greatswordNode_ = mntNode->GetChild("Weapon", true);
+            characters[i] = CreateCharacter("Character" + String(i), positions[i]);
+        }
+
+        PrintSpawnBenchRow(usePrefabs_ ? "prefab" : "xml", timer.GetUSec(false));
+
+        for (unsigned i = 0; i < characters.Size(); ++i)
+        {
+            // the prefab characters fill the pool for the reuse wave, outside the timed loop
+            if (usePrefabs_)
+                pool->AddCharacter(characters[i]);
+            else
+                characters[i]->GetNode()->Remove();
         }
     }
-    scene_->RemoveChild(loadNode);
 
+    // a wave despawned into the pool and spawned again
+    timer.Reset();
+
+    for (unsigned i = 0; i < spawnBenchCharacters_; ++i)
+    {
+        pool->ReleaseCharacter(characters[i]);
+    }
+
+    PrintSpawnBenchRow("pool_release", timer.GetUSec(false));
+    timer.Reset();
+
+    for (unsigned i = 0; i < spawnBenchCharacters_; ++i)
+    {
+        characters[i] = SpawnCharacter("Character" + String(i), positions[spawnBenchCharacters_ - 1 - i]);
+    }
+
+    PrintSpawnBenchRow("pool_acquire", timer.GetUSec(false));
+    pool->LogStats();
+
+    engine_->Exit();
+}
+
+void CharacterDemo::PrintSpawnBenchRow(const String& spawn, long long usec)
+{
+    PrintLine(spawn + "," + String(spawnBenchCharacters_) + "," + String(usec / 1000.0) + "," +
+              String((double)usec / spawnBenchCharacters_) + "," + String(scene_->GetNumChildren(true)));
+}
+
+Character* CharacterDemo::SpawnCharacter(const String& name, const Vector3& position)
+{
+    CharacterPool *pool = scene_->GetComponent<CharacterPool>();
+    Character *character = pool->AcquireCharacter(position);
+
+    // a reused character keeps its node name
+    if (!character)
+    {
+        character = CreateCharacter(name, position);
+        pool->AddCharacter(character);
+    }
+
+    return character;
+}
+
+Node* CharacterDemo::SpawnDummy(const Vector3& position)
+{
+    CharacterPool *pool = scene_->GetComponent<CharacterPool>();
+    Node *dummy = pool->AcquireDummy(position, dummyNode_->GetWorldRotation());
+
+    if (!dummy)
+    {
+        dummy = dummyNode_->Clone();
+        dummy->SetPosition(position);
+        pool->AddDummy(dummy);
+    }
+
+    return dummy;
+}
+
+void CharacterDemo::StartReplay()
+{
+    CreateScene();
+
+    // timing and player handle the physics pre-step ahead of the character
+    replayTiming_ = new FrameTiming(context_, scene_);
+    controlsPlayer_ = new ControlsPlayer(context_, scene_);
+
+    character_ = CreateCharacter("Player", scene_->GetChild("playerSpawn")->GetPosition());
+
+    if (!controlsPlayer_->Start(character_, replayFile_))
+    {
+        ErrorExit("Could not replay " + replayFile_);
+        return;
+    }
+
+    CreateCharacterSystems();
+
+    // one recorded step per frame, as fast as possible
+    replayTiming_->Start(0, controlsPlayer_->GetTimeStep());
+
+    SubscribeToEvent(E_ENDFRAME, URHO3D_HANDLER(CharacterDemo, HandleReplayEndFrame));
+}
+
+void CharacterDemo::HandleReplayEndFrame(StringHash eventType, VariantMap& eventData)
+{
+    if (!controlsPlayer_->IsFinished())
+        return;
+
+    // the final position tells whether two runs replayed the same session
+    const Vector3 &position = character_->GetNode()->GetWorldPosition();
+
+    PrintLine(String("steps,frames,") + FrameTiming::GetCsvHeader() + ",final_x,final_y,final_z");
+    PrintLine(String(controlsPlayer_->GetNumSteps()) + "," + String(replayTiming_->GetNumMeasuredFrames()) + "," +
+              replayTiming_->GetCsvValues() + "," + String(position.x_) + "," + String(position.y_) + "," + String(position.z_));
+
+    replayTiming_->Stop();
+    UnsubscribeFromEvent(E_ENDFRAME);
+    engine_->Exit();
+}
+
+void CharacterDemo::CreateCharacterSystems()
+{
+    // after the characters and input drivers, so it steps the characters after their controls are set
+    if (useCharacterSystem_)
+    {
+        scene_->CreateComponent<CharacterSystem>(LOCAL);
+    }
+
+    // before the characters' delayed start, where they register as attackers, for ground contacts and their blades,
+    // and the hit registry before the crowd stress end frame handler, so each frame's hits are delivered first
+    scene_->GetOrCreateComponent<HitRegistry>(LOCAL);
+    scene_->CreateComponent<GroundContactQuery>(LOCAL);
+
+    if (useMeleeSweep_)
+    {
+        scene_->CreateComponent<MeleeSweepSystem>(LOCAL);
+    }
+
+    if (recordPoseHistory_)
+    {
+        scene_->CreateComponent<PoseHistorySystem>(LOCAL);
+    }
 }
 
 void CharacterDemo::CreateInstructions()
@@ -260,27 +739,38 @@ void CharacterDemo::SubscribeToEvents()
     UnsubscribeFromEvent(E_SCENEUPDATE);
 
     // weapon dmg
-    SubscribeToEvent(E_WEAPONDMG, URHO3D_HANDLER(CharacterDemo, HandleWeaponDmgEvent));
+    SubscribeToEvent(E_WEAPONHITS, URHO3D_HANDLER(CharacterDemo, HandleWeaponHits));
 }
 
-void CharacterDemo::HandleWeaponDmgEvent(StringHash eventType, VariantMap& eventData)
+void CharacterDemo::HandleWeaponHits(StringHash eventType, VariantMap& eventData)
 {
-    using namespace WeaponDmgEvent;
+    using namespace WeaponHits;
 
-    Node *node = (Node*)eventData[P_NODE].GetVoidPtr();
+    const HitRecord *hits = (const HitRecord*)eventData[P_HITS].GetVoidPtr();
+    const unsigned numHits = eventData[P_NUMHITS].GetUInt();
 
-    DmgRecipient dmgRecipientData;
-    dmgRecipientList_.Push(dmgRecipientData);
-    DmgRecipient &dmgRecipient = dmgRecipientList_[dmgRecipientList_.Size()-1];
+    for (unsigned i = 0; i < numHits; ++i)
+    {
+        Node *node = scene_->GetNode(hits[i].targetId_);
+
+        // for this demo, we only look for staticModel type
+        if (!node || !node->GetComponent<StaticModel>())
+        {
+            continue;
+        }
+
+        DmgRecipient dmgRecipientData;
+        dmgRecipientList_.Push(dmgRecipientData);
+        DmgRecipient &dmgRecipient = dmgRecipientList_[dmgRecipientList_.Size()-1];
 
-    // for this demo, we only look for staticModel type
-    dmgRecipient.node_ = node;
-    Material *mat = node->GetComponent<StaticModel>()->GetMaterial();
-    dmgRecipient.dmgColor_ = Color::RED;
-    dmgRecipient.origColor_ = mat->GetShaderParameter("MatDiffColor").GetColor();
-    mat->SetShaderParameter("MatDiffColor", dmgRecipient.dmgColor_);
+        dmgRecipient.node_ = node;
+        Material *mat = node->GetComponent<StaticModel>()->GetMaterial();
+        dmgRecipient.dmgColor_ = Color::RED;
+        dmgRecipient.origColor_ = mat->GetShaderParameter("MatDiffColor").GetColor();
+        mat->SetShaderParameter("MatDiffColor", dmgRecipient.dmgColor_);
 
-    dmgRecipient.flashTimer_.Reset();
+        dmgRecipient.flashTimer_.Reset();
+    }
 }
 
 void CharacterDemo::HandleUpdate(StringHash eventType, VariantMap& eventData)
@@ -32,7 +32,13 @@ class Scene;
 
 }
 
+class ArenaHost;
+class AssetPreloader;
 class Character;
+class ControlsPlayer;
+class ControlsRecorder;
+class CrowdStress;
+class FrameTiming;
 //=============================================================================
 //=============================================================================
 struct DmgRecipient
@@ -59,18 +65,45 @@ public:
 private:
     void ChangeDebugHudText();
     void CreateScene();
-    void CreateCharacter();
+    Character* CreateCharacter(const String& name, const Vector3& position);
+    /// Spawn a character or dummy, reusing a released one from the scene's CharacterPool if there is one.
+    Character* SpawnCharacter(const String& name, const Vector3& position);
+    Node* SpawnDummy(const Vector3& position);
+    void CreateCharacterSystems();
+    void SpawnCrowd(Vector<WeakPtr<Character> > &characters, Vector<WeakPtr<Node> > &dummies);
+    void StartCrowdStress();
+    void StartArenaHost();
+    void RunSpawnBench();
+    void PrintSpawnBenchRow(const String& spawn, long long usec);
+    void StartReplay();
+    void SpawnPlayer();
     void CreateInstructions();
     void SubscribeToEvents();
     void HandleUpdate(StringHash eventType, VariantMap& eventData);
     void HandlePostUpdate(StringHash eventType, VariantMap& eventData);
-    void HandleWeaponDmgEvent(StringHash eventType, VariantMap& eventData);
+    void HandleWeaponHits(StringHash eventType, VariantMap& eventData);
+    void HandleReplayEndFrame(StringHash eventType, VariantMap& eventData);
+    void HandleAssetsPreloaded(StringHash eventType, VariantMap& eventData);
 
     /// The controllable character component.
     WeakPtr<Character> character_;
+    /// Loads the controllable character's assets in the background.
+    SharedPtr<AssetPreloader> assetPreloader_;
     /// First person camera flag.
     bool firstPerson_;
     bool drawDebug_;
+    /// Step the characters with a CharacterSystem instead of each in its own fixed update.
+    bool useCharacterSystem_;
+    /// Detect weapon hits with a MeleeSweepSystem instead of the weapon trigger bodies.
+    bool useMeleeSweep_;
+    /// Physics steps per second, 0 keeps the scene's.
+    unsigned physicsFps_;
+    /// Move the characters with the kinematic capsule controller.
+    bool kinematicCharacters_;
+    /// Record the characters' hitbox poses for lag-compensated hit tests.
+    bool recordPoseHistory_;
+    /// Replicate the crowd stress characters through a loopback connection.
+    bool snapshotLoopback_;
     Timer debounceTimer_;
 
     // collision
@@ -79,4 +112,30 @@ private:
 
     // dmg recipient
     PODVector<DmgRecipient> dmgRecipientList_;
+
+    // headless crowd stress mode, enabled by -stress <characters>
+    unsigned stressCharacters_;
+    unsigned stressDummies_;
+    unsigned stressFrames_;
+    SharedPtr<CrowdStress> crowdStress_;
+
+    // headless dedicated server mode, enabled by -arenas <count>: that many crowd stress scenes stepped in parallel
+    unsigned arenaScenes_;
+    /// Worker threads plus the main thread, 0 for one per logical CPU.
+    unsigned numThreads_;
+    /// Tick budget per scene in msec, 0 for the physics timestep.
+    float tickBudget_;
+    SharedPtr<ArenaHost> arenaHost_;
+
+    /// Create the characters' sword hierarchy from the BackLocator prefab instead of instantiating its XML.
+    bool usePrefabs_;
+    // headless spawn benchmark, enabled by -spawnbench <characters>
+    unsigned spawnBenchCharacters_;
+
+    // controls recording, -record <file>, and headless replay, -replay <file>
+    String recordFile_;
+    String replayFile_;
+    SharedPtr<ControlsRecorder> controlsRecorder_;
+    SharedPtr<ControlsPlayer> controlsPlayer_;
+    SharedPtr<FrameTiming> replayTiming_;
 };
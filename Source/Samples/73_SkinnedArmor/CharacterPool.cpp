@@ -0,0 +1,197 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/IO/Log.h>
+#include <Urho3D/Physics/RigidBody.h>
+#include <Urho3D/Scene/Node.h>
+
+#include "CharacterPool.h"
+#include "Character.h"
+
+#include <Urho3D/DebugNew.h>
+//=============================================================================
+//=============================================================================
+template <class T> static void ReserveFreeList(Vector<WeakPtr<T> > &freeList, unsigned size)
+{
+    // grow geometrically, a release must never allocate
+    if (freeList.Capacity() < size)
+    {
+        freeList.Reserve(Max(size, freeList.Capacity() * 2));
+    }
+}
+
+static void CountInUse(PoolStats &stats)
+{
+    stats.peakInUse_ = Max(stats.peakInUse_, stats.size_ - stats.free_);
+}
+
+//=============================================================================
+//=============================================================================
+CharacterPool::CharacterPool(Context* context) :
+    Component(context)
+{
+}
+
+void CharacterPool::RegisterObject(Context* context)
+{
+    context->RegisterFactory<CharacterPool>();
+}
+
+void CharacterPool::AddCharacter(Character *character)
+{
+    if (!character)
+    {
+        return;
+    }
+
+    ++characterStats_.size_;
+    ReserveFreeList(freeCharacters_, characterStats_.size_);
+    CountInUse(characterStats_);
+}
+
+Character* CharacterPool::AcquireCharacter(const Vector3 &position, const Quaternion &rotation)
+{
+    while (!freeCharacters_.Empty())
+    {
+        Character *character = freeCharacters_.Back();
+        freeCharacters_.Pop();
+        --characterStats_.free_;
+
+        // removed from the scene while parked
+        if (!character)
+        {
+            --characterStats_.size_;
+            continue;
+        }
+
+        Unpark(character->GetNode(), position, rotation);
+        character->ResetState();
+
+        ++characterStats_.acquires_;
+        CountInUse(characterStats_);
+        return character;
+    }
+
+    ++characterStats_.misses_;
+    return NULL;
+}
+
+void CharacterPool::ReleaseCharacter(Character *character)
+{
+    // parked characters are disabled, which also rules out a second release
+    if (!character || !character->GetNode()->IsEnabled())
+    {
+        return;
+    }
+
+    // sheath the sword before the disable removes the character from the scene systems
+    character->ResetState();
+    character->GetNode()->SetDeepEnabled(false);
+
+    freeCharacters_.Push(WeakPtr<Character>(character));
+    ++characterStats_.free_;
+    ++characterStats_.releases_;
+}
+
+void CharacterPool::AddDummy(Node *dummy)
+{
+    if (!dummy)
+    {
+        return;
+    }
+
+    ++dummyStats_.size_;
+    ReserveFreeList(freeDummies_, dummyStats_.size_);
+    CountInUse(dummyStats_);
+}
+
+Node* CharacterPool::AcquireDummy(const Vector3 &position, const Quaternion &rotation)
+{
+    while (!freeDummies_.Empty())
+    {
+        Node *dummy = freeDummies_.Back();
+        freeDummies_.Pop();
+        --dummyStats_.free_;
+
+        if (!dummy)
+        {
+            --dummyStats_.size_;
+            continue;
+        }
+
+        Unpark(dummy, position, rotation);
+
+        ++dummyStats_.acquires_;
+        CountInUse(dummyStats_);
+        return dummy;
+    }
+
+    ++dummyStats_.misses_;
+    return NULL;
+}
+
+void CharacterPool::ReleaseDummy(Node *dummy)
+{
+    if (!dummy || !dummy->IsEnabled())
+    {
+        return;
+    }
+
+    dummy->SetDeepEnabled(false);
+
+    freeDummies_.Push(WeakPtr<Node>(dummy));
+    ++dummyStats_.free_;
+    ++dummyStats_.releases_;
+}
+
+void CharacterPool::Unpark(Node *node, const Vector3 &position, const Quaternion &rotation)
+{
+    // the bodies rejoin the physics world where the node was parked, then follow it to the spawn point
+    node->ResetDeepEnabled();
+    node->SetWorldTransform(position, rotation);
+
+    RigidBody *body = node->GetComponent<RigidBody>();
+
+    if (body)
+    {
+        body->SetLinearVelocity(Vector3::ZERO);
+        body->SetAngularVelocity(Vector3::ZERO);
+    }
+}
+
+void CharacterPool::LogStats() const
+{
+    URHO3D_LOGINFO("CharacterPool: characters=" + String(characterStats_.size_) +
+                   " free=" + String(characterStats_.free_) +
+                   " acquires=" + String(characterStats_.acquires_) +
+                   " misses=" + String(characterStats_.misses_) +
+                   " releases=" + String(characterStats_.releases_) +
+                   " peakInUse=" + String(characterStats_.peakInUse_));
+    URHO3D_LOGINFO("CharacterPool: dummies=" + String(dummyStats_.size_) +
+                   " free=" + String(dummyStats_.free_) +
+                   " acquires=" + String(dummyStats_.acquires_) +
+                   " misses=" + String(dummyStats_.misses_) +
+                   " releases=" + String(dummyStats_.releases_) +
+                   " peakInUse=" + String(dummyStats_.peakInUse_));
+}
@@ -0,0 +1,98 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#pragma once
+
+#include <Urho3D/Scene/Component.h>
+
+using namespace Urho3D;
+
+class Character;
+
+//=============================================================================
+//=============================================================================
+struct PoolStats
+{
+    PoolStats() : size_(0), free_(0), acquires_(0), misses_(0), releases_(0), peakInUse_(0) {}
+
+    /// Entities owned by the pool, in use and free.
+    unsigned size_;
+    /// Released entities waiting to be reused.
+    unsigned free_;
+    /// Acquires served with a released entity.
+    unsigned acquires_;
+    /// Acquires that found the pool empty, the caller assembles a new entity.
+    unsigned misses_;
+    unsigned releases_;
+    unsigned peakInUse_;
+};
+
+//=============================================================================
+// scene-wide pool of fully assembled characters and training dummies, for
+// modes that spawn and despawn in waves. A released entity keeps all its
+// nodes, components and resources: its node is disabled, which takes the
+// bodies out of the physics world, and the character state is reset.
+// Acquiring enables it again at the spawn position. Release and acquire do
+// not allocate: the free lists are reserved when entities are added.
+//=============================================================================
+class CharacterPool : public Component
+{
+    URHO3D_OBJECT(CharacterPool, Component);
+
+public:
+    /// Construct.
+    CharacterPool(Context* context);
+
+    /// Register object factory.
+    static void RegisterObject(Context* context);
+
+    /// Add a newly assembled character, in use.
+    void AddCharacter(Character *character);
+    /// Return a released character placed at a position, or NULL if there is none.
+    Character* AcquireCharacter(const Vector3 &position, const Quaternion &rotation = Quaternion::IDENTITY);
+    /// Reset and park a character added to the pool until it is acquired again.
+    void ReleaseCharacter(Character *character);
+
+    /// Add a newly created dummy node, in use.
+    void AddDummy(Node *dummy);
+    /// Return a released dummy placed at a position, or NULL if there is none.
+    Node* AcquireDummy(const Vector3 &position, const Quaternion &rotation = Quaternion::IDENTITY);
+    /// Park a dummy added to the pool until it is acquired again.
+    void ReleaseDummy(Node *dummy);
+
+    /// Return character pool counters.
+    const PoolStats& GetCharacterStats() const { return characterStats_; }
+    /// Return dummy pool counters.
+    const PoolStats& GetDummyStats() const { return dummyStats_; }
+    /// Write the counters to the log.
+    void LogStats() const;
+
+private:
+    /// Enable a parked node at a position with its bodies at rest.
+    static void Unpark(Node *node, const Vector3 &position, const Quaternion &rotation);
+
+    Vector<WeakPtr<Character> > freeCharacters_;
+    Vector<WeakPtr<Node> >      freeDummies_;
+    PoolStats                   characterStats_;
+    PoolStats                   dummyStats_;
+};
@@ -0,0 +1,587 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#include <Urho3D/Graphics/AnimationState.h>
+#include <Urho3D/Physics/RigidBody.h>
+#include <Urho3D/Scene/Node.h>
+
+#include "CharacterSnapshot.h"
+#include "AnimationSetController.h"
+#include "Character.h"
+
+#include <Urho3D/DebugNew.h>
+//=============================================================================
+//=============================================================================
+const float SNAPSHOT_POSITION_SCALE = 1024.0f;
+const float SNAPSHOT_VELOCITY_SCALE = 256.0f;
+const float SNAPSHOT_YAW_SCALE = 65536.0f / 360.0f;
+const float SNAPSHOT_PITCH_SCALE = 100.0f;
+const float SNAPSHOT_TIME_SCALE = 1000.0f;
+const unsigned char SNAPSHOT_NONE = 255;
+
+/// Field groups of a changed entry.
+enum SnapshotGroup
+{
+    SG_POSITION = 0,
+    SG_VELOCITY,
+    SG_LOOK,
+    SG_CONTROLS,
+    SG_INAIRTIMER,
+    SG_WEAPON,
+    NUM_SNAPSHOT_GROUPS
+};
+
+/// Largest quantized position, about a million meters.
+const int SNAPSHOT_MAX_POSITION = 1 << 30;
+
+static int Quantize(float value, float scale, int minValue, int maxValue)
+{
+    // clamped before the conversion, out of range floats don't convert to int
+    return (int)Clamp(floorf(value * scale + 0.5f), (float)minValue, (float)maxValue);
+}
+
+//=============================================================================
+// little-endian bit stream, least significant bits first
+//=============================================================================
+class SnapshotBitWriter
+{
+public:
+    SnapshotBitWriter(PODVector<unsigned char> &dest) :
+        dest_(dest),
+        scratch_(0),
+        scratchBits_(0)
+    {
+        dest_.Clear();
+    }
+
+    void Write(unsigned value, unsigned bits)
+    {
+        if (bits < 32)
+            value &= (1u << bits) - 1;
+
+        scratch_ |= (unsigned long long)value << scratchBits_;
+        scratchBits_ += bits;
+
+        while (scratchBits_ >= 8)
+        {
+            dest_.Push((unsigned char)scratch_);
+            scratch_ >>= 8;
+            scratchBits_ -= 8;
+        }
+    }
+
+    void WriteBit(bool value)
+    {
+        Write(value ? 1 : 0, 1);
+    }
+
+    /// Write in the smallest of the 4, 8, 16 and 32 bit size classes.
+    void WriteUnsigned(unsigned value)
+    {
+        const unsigned sizeClass = value < 0x10 ? 0 : value < 0x100 ? 1 : value < 0x10000 ? 2 : 3;
+
+        Write(sizeClass, 2);
+        Write(value, 4 << sizeClass);
+    }
+
+    /// Write a difference zigzag coded, so small negative ones stay small.
+    void WriteDelta(int delta)
+    {
+        WriteUnsigned(((unsigned)delta << 1) ^ (unsigned)(delta >> 31));
+    }
+
+    void Flush()
+    {
+        if (scratchBits_)
+        {
+            dest_.Push((unsigned char)scratch_);
+            scratch_ = 0;
+            scratchBits_ = 0;
+        }
+    }
+
+private:
+    PODVector<unsigned char> &dest_;
+    unsigned long long scratch_;
+    unsigned scratchBits_;
+};
+
+//=============================================================================
+//=============================================================================
+class SnapshotBitReader
+{
+public:
+    SnapshotBitReader(const PODVector<unsigned char> &source) :
+        source_(source),
+        position_(0),
+        scratch_(0),
+        scratchBits_(0),
+        overflow_(false)
+    {
+    }
+
+    unsigned Read(unsigned bits)
+    {
+        while (scratchBits_ < bits)
+        {
+            if (position_ < source_.Size())
+                scratch_ |= (unsigned long long)source_[position_++] << scratchBits_;
+            else
+                overflow_ = true;
+
+            scratchBits_ += 8;
+        }
+
+        const unsigned value = (unsigned)(scratch_ & ((1ull << bits) - 1));
+        scratch_ >>= bits;
+        scratchBits_ -= bits;
+
+        return value;
+    }
+
+    bool ReadBit()
+    {
+        return Read(1) != 0;
+    }
+
+    unsigned ReadUnsigned()
+    {
+        const unsigned sizeClass = Read(2);
+
+        return Read(4 << sizeClass);
+    }
+
+    int ReadDelta()
+    {
+        const unsigned value = ReadUnsigned();
+
+        return (int)(value >> 1) ^ -(int)(value & 1);
+    }
+
+    /// Return whether more bits were read than the packet holds.
+    bool IsOverflow() const { return overflow_; }
+
+private:
+    const PODVector<unsigned char> &source_;
+    unsigned position_;
+    unsigned long long scratch_;
+    unsigned scratchBits_;
+    bool overflow_;
+};
+
+//=============================================================================
+//=============================================================================
+CharacterSnapshot::CharacterSnapshot() :
+    yaw_(0),
+    pitch_(0),
+    buttons_(0),
+    flags_(0),
+    inAirTimer_(0),
+    weaponState_(0),
+    weaponDmgState_(0),
+    comboIndex_(0),
+    weaponAnim_(SNAPSHOT_NONE),
+    queuedInput_(SNAPSHOT_NONE),
+    animTime_(0)
+{
+    for (unsigned i = 0; i < 3; ++i)
+    {
+        position_[i] = 0;
+        velocity_[i] = 0;
+    }
+}
+
+void CharacterSnapshot::Capture(Character *character)
+{
+    const Vector3 position = character->GetNode()->GetWorldPosition();
+    const Vector3 velocity = character->GetVelocity();
+    const Controls &controls = character->controls_;
+
+    for (unsigned i = 0; i < 3; ++i)
+    {
+        position_[i] = Quantize(position.Data()[i], SNAPSHOT_POSITION_SCALE, -SNAPSHOT_MAX_POSITION, SNAPSHOT_MAX_POSITION);
+        velocity_[i] = (short)Quantize(velocity.Data()[i], SNAPSHOT_VELOCITY_SCALE, -32767, 32767);
+    }
+
+    // yaw accumulates without bounds, only its angle is sent
+    float yaw = fmodf(controls.yaw_, 360.0f);
+    if (yaw < 0.0f)
+        yaw += 360.0f;
+
+    yaw_ = (unsigned short)(Quantize(yaw, SNAPSHOT_YAW_SCALE, 0, 65536) & 0xffff);
+    pitch_ = (short)Quantize(controls.pitch_, SNAPSHOT_PITCH_SCALE, -32767, 32767);
+    buttons_ = (unsigned char)(controls.buttons_ & 0xff);
+
+    flags_ = 0;
+    if (character->onGround_)
+        flags_ |= CSF_ONGROUND;
+    if (character->okToJump_)
+        flags_ |= CSF_OKTOJUMP;
+    if (character->jumpStarted_)
+        flags_ |= CSF_JUMPSTARTED;
+
+    inAirTimer_ = (unsigned short)Quantize(character->inAirTimer_, SNAPSHOT_TIME_SCALE, 0, 65535);
+
+    weaponState_ = (unsigned char)character->weaponActionState_;
+    weaponDmgState_ = (unsigned char)character->weaponDmgState_;
+    comboIndex_ = (unsigned char)character->comboAnimsIdx_;
+    weaponAnim_ = character->weaponActionAnim_ < SNAPSHOT_NONE ? (unsigned char)character->weaponActionAnim_ : SNAPSHOT_NONE;
+    queuedInput_ = character->queInput_.Empty() ? SNAPSHOT_NONE : (unsigned char)Min(character->queInput_.GetInput(), 254u);
+
+    AnimationSetController *animCtrl = character->animCtrl_;
+    AnimationState *state = animCtrl && animCtrl->IsPlaying(character->weaponActionAnim_) ? animCtrl->GetAnimationState(character->weaponActionAnim_) : NULL;
+
+    animTime_ = state ? (unsigned short)Quantize(state->GetTime(), SNAPSHOT_TIME_SCALE, 0, 65535) : 0;
+}
+
+void CharacterSnapshot::Apply(Character *character) const
+{
+    Node *node = character->GetNode();
+    Controls &controls = character->controls_;
+
+    controls.yaw_ = yaw_ / SNAPSHOT_YAW_SCALE;
+    controls.pitch_ = pitch_ / SNAPSHOT_PITCH_SCALE;
+    controls.buttons_ = (controls.buttons_ & ~0xffu) | buttons_;
+
+    node->SetWorldPosition(GetPosition());
+    node->SetRotation(Quaternion(controls.yaw_, Vector3::UP));
+
+    if (character->kinematicController_)
+        character->velocity_ = GetVelocity();
+    else if (character->body_)
+        character->body_->SetLinearVelocity(GetVelocity());
+
+    character->onGround_ = (flags_ & CSF_ONGROUND) != 0;
+    character->okToJump_ = (flags_ & CSF_OKTOJUMP) != 0;
+    character->jumpStarted_ = (flags_ & CSF_JUMPSTARTED) != 0;
+    character->inAirTimer_ = inAirTimer_ / SNAPSHOT_TIME_SCALE;
+
+    // characters without a weapon stay in the invalid state
+    if (character->weaponActionState_ == Character::Weapon_Invalid || weaponState_ == Character::Weapon_Invalid)
+    {
+        return;
+    }
+
+    character->weaponActionState_ = weaponState_;
+    character->weaponDmgState_ = weaponDmgState_;
+    character->comboAnimsIdx_ = comboIndex_ < character->weaponComboAnim_.Size() ? comboIndex_ : 0;
+    character->weaponActionAnim_ = weaponAnim_ != SNAPSHOT_NONE ? weaponAnim_ : INVALID_ANIM_HANDLE;
+
+    // setting the input restarts its hold time, so only a newly queued input may, or it would never expire
+    if (queuedInput_ == SNAPSHOT_NONE)
+        character->queInput_.Reset();
+    else if (character->queInput_.GetInput() != queuedInput_)
+        character->queInput_.SetInput(queuedInput_);
+
+    // the sword is on the back only when unequipped
+    Node *weaponParent = weaponState_ == Character::Weapon_Unequipped ? character->backLocatorNode_ : character->rightHandLocatorNode_;
+
+    if (weaponParent && character->weaponNode_ && character->weaponNode_->GetParent() != weaponParent)
+    {
+        weaponParent->AddChild(character->weaponNode_);
+    }
+
+    // catch up the weapon action clip: attacks play on the normal layer, sheath and unsheath on the weapon layer
+    AnimationSetController *animCtrl = character->animCtrl_;
+    const unsigned anim = character->weaponActionAnim_;
+
+    if (animCtrl && anim != INVALID_ANIM_HANDLE && weaponState_ != Character::Weapon_Equipped)
+    {
+        if (!animCtrl->IsPlaying(anim))
+        {
+            if (weaponState_ == Character::Weapon_AttackAnim)
+                animCtrl->PlayExclusive(anim, Character::NormalLayer, false, 0.1f);
+            else
+                animCtrl->Play(anim, Character::WeaponLayer, false, 0.1f);
+        }
+
+        animCtrl->SetTime(anim, animTime_ / SNAPSHOT_TIME_SCALE);
+    }
+}
+
+bool CharacterSnapshot::IsReplicatedBy(const CharacterSnapshot &replica) const
+{
+    // with the weapon equipped Apply() leaves the replica's clips alone
+    if (weaponState_ == Character::Weapon_Equipped && replica.animTime_ != animTime_)
+    {
+        CharacterSnapshot caughtUp = replica;
+        caughtUp.animTime_ = animTime_;
+
+        return *this == caughtUp;
+    }
+
+    return *this == replica;
+}
+
+Vector3 CharacterSnapshot::GetPosition() const
+{
+    return Vector3((float)position_[0], (float)position_[1], (float)position_[2]) / SNAPSHOT_POSITION_SCALE;
+}
+
+Vector3 CharacterSnapshot::GetVelocity() const
+{
+    return Vector3((float)velocity_[0], (float)velocity_[1], (float)velocity_[2]) / SNAPSHOT_VELOCITY_SCALE;
+}
+
+bool CharacterSnapshot::operator ==(const CharacterSnapshot &rhs) const
+{
+    for (unsigned i = 0; i < 3; ++i)
+    {
+        if (position_[i] != rhs.position_[i] || velocity_[i] != rhs.velocity_[i])
+            return false;
+    }
+
+    return yaw_ == rhs.yaw_ && pitch_ == rhs.pitch_ && buttons_ == rhs.buttons_ && flags_ == rhs.flags_ &&
+           inAirTimer_ == rhs.inAirTimer_ && weaponState_ == rhs.weaponState_ && weaponDmgState_ == rhs.weaponDmgState_ &&
+           comboIndex_ == rhs.comboIndex_ && weaponAnim_ == rhs.weaponAnim_ && queuedInput_ == rhs.queuedInput_ &&
+           animTime_ == rhs.animTime_;
+}
+
+//=============================================================================
+// field groups against the baseline state
+//=============================================================================
+static void WriteEntry(SnapshotBitWriter &writer, const CharacterSnapshot &state, const CharacterSnapshot &base)
+{
+    bool changed[NUM_SNAPSHOT_GROUPS];
+
+    changed[SG_POSITION] = state.position_[0] != base.position_[0] || state.position_[1] != base.position_[1] || state.position_[2] != base.position_[2];
+    changed[SG_VELOCITY] = state.velocity_[0] != base.velocity_[0] || state.velocity_[1] != base.velocity_[1] || state.velocity_[2] != base.velocity_[2];
+    changed[SG_LOOK] = state.yaw_ != base.yaw_ || state.pitch_ != base.pitch_;
+    changed[SG_CONTROLS] = state.buttons_ != base.buttons_ || state.flags_ != base.flags_;
+    changed[SG_INAIRTIMER] = state.inAirTimer_ != base.inAirTimer_;
+    changed[SG_WEAPON] = state.weaponState_ != base.weaponState_ || state.weaponDmgState_ != base.weaponDmgState_ ||
+                         state.comboIndex_ != base.comboIndex_ || state.weaponAnim_ != base.weaponAnim_ ||
+                         state.queuedInput_ != base.queuedInput_ || state.animTime_ != base.animTime_;
+
+    bool anyChanged = false;
+    for (unsigned i = 0; i < NUM_SNAPSHOT_GROUPS; ++i)
+        anyChanged |= changed[i];
+
+    writer.WriteBit(anyChanged);
+
+    if (!anyChanged)
+        return;
+
+    for (unsigned i = 0; i < NUM_SNAPSHOT_GROUPS; ++i)
+        writer.WriteBit(changed[i]);
+
+    if (changed[SG_POSITION])
+    {
+        for (unsigned i = 0; i < 3; ++i)
+            writer.WriteDelta(state.position_[i] - base.position_[i]);
+    }
+    if (changed[SG_VELOCITY])
+    {
+        for (unsigned i = 0; i < 3; ++i)
+            writer.WriteDelta(state.velocity_[i] - base.velocity_[i]);
+    }
+    if (changed[SG_LOOK])
+    {
+        // 16-bit wrap, so yaw crossing zero stays a small difference
+        writer.WriteDelta((short)(state.yaw_ - base.yaw_));
+        writer.WriteDelta((short)(state.pitch_ - base.pitch_));
+    }
+    if (changed[SG_CONTROLS])
+    {
+        writer.Write(state.buttons_, 8);
+        writer.Write(state.flags_, 3);
+    }
+    if (changed[SG_INAIRTIMER])
+    {
+        writer.WriteDelta((short)(state.inAirTimer_ - base.inAirTimer_));
+    }
+    if (changed[SG_WEAPON])
+    {
+        writer.Write(state.weaponState_, 3);
+        writer.Write(state.weaponDmgState_, 1);
+        writer.Write(state.comboIndex_, 2);
+        writer.Write(state.weaponAnim_, 8);
+        writer.Write(state.queuedInput_, 8);
+        writer.WriteDelta((short)(state.animTime_ - base.animTime_));
+    }
+}
+
+static void ReadEntry(SnapshotBitReader &reader, CharacterSnapshot &state, const CharacterSnapshot &base)
+{
+    state = base;
+
+    if (!reader.ReadBit())
+        return;
+
+    bool changed[NUM_SNAPSHOT_GROUPS];
+    for (unsigned i = 0; i < NUM_SNAPSHOT_GROUPS; ++i)
+        changed[i] = reader.ReadBit();
+
+    if (changed[SG_POSITION])
+    {
+        for (unsigned i = 0; i < 3; ++i)
+            state.position_[i] = base.position_[i] + reader.ReadDelta();
+    }
+    if (changed[SG_VELOCITY])
+    {
+        for (unsigned i = 0; i < 3; ++i)
+            state.velocity_[i] = (short)(base.velocity_[i] + reader.ReadDelta());
+    }
+    if (changed[SG_LOOK])
+    {
+        state.yaw_ = (unsigned short)(base.yaw_ + reader.ReadDelta());
+        state.pitch_ = (short)(base.pitch_ + reader.ReadDelta());
+    }
+    if (changed[SG_CONTROLS])
+    {
+        state.buttons_ = (unsigned char)reader.Read(8);
+        state.flags_ = (unsigned char)reader.Read(3);
+    }
+    if (changed[SG_INAIRTIMER])
+    {
+        state.inAirTimer_ = (unsigned short)(base.inAirTimer_ + reader.ReadDelta());
+    }
+    if (changed[SG_WEAPON])
+    {
+        state.weaponState_ = (unsigned char)reader.Read(3);
+        state.weaponDmgState_ = (unsigned char)reader.Read(1);
+        state.comboIndex_ = (unsigned char)reader.Read(2);
+        state.weaponAnim_ = (unsigned char)reader.Read(8);
+        state.queuedInput_ = (unsigned char)reader.Read(8);
+        state.animTime_ = (unsigned short)(base.animTime_ + reader.ReadDelta());
+    }
+}
+
+//=============================================================================
+//=============================================================================
+SnapshotEncoder::SnapshotEncoder() :
+    ackedTick_(0),
+    baselineTick_(0)
+{
+    frames_.Resize(SNAPSHOT_HISTORY_SIZE);
+}
+
+void SnapshotEncoder::Encode(unsigned tick, const PODVector<CharacterSnapshotEntry> &entries, PODVector<unsigned char> &dest, bool useBaseline)
+{
+    // the acknowledged tick is a baseline while its frame is still in the history
+    const SnapshotFrame &acked = frames_[ackedTick_ % SNAPSHOT_HISTORY_SIZE];
+    const SnapshotFrame *baseline = useBaseline && ackedTick_ && acked.tick_ == ackedTick_ && tick > ackedTick_ ? &acked : NULL;
+    const CharacterSnapshot zero;
+
+    baselineTick_ = baseline ? ackedTick_ : 0;
+
+    SnapshotBitWriter writer(dest);
+    writer.Write(tick, 32);
+    writer.WriteBit(baseline != NULL);
+    if (baseline)
+        writer.Write(tick - baselineTick_, 8);
+    writer.Write(entries.Size(), 16);
+
+    unsigned baseIndex = 0;
+    unsigned previousId = 0;
+
+    for (unsigned i = 0; i < entries.Size(); ++i)
+    {
+        const CharacterSnapshotEntry &entry = entries[i];
+
+        // both lists are sorted by node ID
+        while (baseline && baseIndex < baseline->entries_.Size() && baseline->entries_[baseIndex].nodeId_ < entry.nodeId_)
+            ++baseIndex;
+
+        const bool hasBase = baseline && baseIndex < baseline->entries_.Size() && baseline->entries_[baseIndex].nodeId_ == entry.nodeId_;
+
+        writer.WriteUnsigned(entry.nodeId_ - previousId);
+        WriteEntry(writer, entry.state_, hasBase ? baseline->entries_[baseIndex].state_ : zero);
+        previousId = entry.nodeId_;
+    }
+
+    writer.Flush();
+
+    SnapshotFrame &frame = frames_[tick % SNAPSHOT_HISTORY_SIZE];
+    frame.tick_ = tick;
+    frame.entries_ = entries;
+}
+
+void SnapshotEncoder::Acknowledge(unsigned tick)
+{
+    // acknowledgements can arrive out of order
+    if (tick > ackedTick_)
+        ackedTick_ = tick;
+}
+
+//=============================================================================
+//=============================================================================
+SnapshotDecoder::SnapshotDecoder() :
+    latestTick_(0)
+{
+    frames_.Resize(SNAPSHOT_HISTORY_SIZE);
+}
+
+bool SnapshotDecoder::Decode(const PODVector<unsigned char> &packet, unsigned &tick, PODVector<CharacterSnapshotEntry> &dest)
+{
+    SnapshotBitReader reader(packet);
+
+    tick = reader.Read(32);
+
+    if (!tick || tick <= latestTick_)
+        return false;
+
+    const SnapshotFrame *baseline = NULL;
+
+    if (reader.ReadBit())
+    {
+        const unsigned baselineTick = tick - reader.Read(8);
+        const SnapshotFrame &frame = frames_[baselineTick % SNAPSHOT_HISTORY_SIZE];
+
+        if (frame.tick_ != baselineTick)
+            return false;
+
+        baseline = &frame;
+    }
+
+    const unsigned numEntries = reader.Read(16);
+    const CharacterSnapshot zero;
+    unsigned baseIndex = 0;
+    unsigned previousId = 0;
+
+    dest.Resize(numEntries);
+
+    for (unsigned i = 0; i < numEntries && !reader.IsOverflow(); ++i)
+    {
+        CharacterSnapshotEntry &entry = dest[i];
+        entry.nodeId_ = previousId + reader.ReadUnsigned();
+
+        while (baseline && baseIndex < baseline->entries_.Size() && baseline->entries_[baseIndex].nodeId_ < entry.nodeId_)
+            ++baseIndex;
+
+        const bool hasBase = baseline && baseIndex < baseline->entries_.Size() && baseline->entries_[baseIndex].nodeId_ == entry.nodeId_;
+
+        ReadEntry(reader, entry.state_, hasBase ? baseline->entries_[baseIndex].state_ : zero);
+        previousId = entry.nodeId_;
+    }
+
+    if (reader.IsOverflow())
+        return false;
+
+    SnapshotFrame &frame = frames_[tick % SNAPSHOT_HISTORY_SIZE];
+    frame.tick_ = tick;
+    frame.entries_ = dest;
+    latestTick_ = tick;
+
+    return true;
+}
@@ -0,0 +1,162 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#pragma once
+
+#include <Urho3D/Container/RefCounted.h>
+#include <Urho3D/Container/Vector.h>
+#include <Urho3D/Math/Vector3.h>
+
+using namespace Urho3D;
+
+class Character;
+
+/// Sent frames an encoder keeps as baselines, and decoded frames a decoder keeps. At most 255.
+const unsigned SNAPSHOT_HISTORY_SIZE = 32;
+
+//=============================================================================
+// quantized locomotion and combat state of a character:
+//   position 1/1024 m, velocity 1/256 m/s, yaw 360/65536 degrees, pitch 1/100
+//   degree, in air timer and animation time in milliseconds
+//=============================================================================
+struct CharacterSnapshot
+{
+    /// Construct zeroed, the baseline of characters new to the receiver.
+    CharacterSnapshot();
+
+    /// Quantize a character's state.
+    void Capture(Character *character);
+    /// Apply the state to a character, e.g. a replica on the receiving side.
+    void Apply(Character *character) const;
+    /// Return whether a replica's captured state matches this state after Apply(). The weapon action clip time is only replicated while the clip drives the weapon state.
+    bool IsReplicatedBy(const CharacterSnapshot &replica) const;
+
+    /// Return dequantized position.
+    Vector3 GetPosition() const;
+    /// Return dequantized velocity.
+    Vector3 GetVelocity() const;
+
+    /// Test for equality.
+    bool operator ==(const CharacterSnapshot &rhs) const;
+    /// Test for inequality.
+    bool operator !=(const CharacterSnapshot &rhs) const { return !(*this == rhs); }
+
+    int            position_[3];
+    short          velocity_[3];
+    unsigned short yaw_;
+    short          pitch_;
+    /// Low eight control buttons.
+    unsigned char  buttons_;
+    /// CSF_ flags.
+    unsigned char  flags_;
+    unsigned short inAirTimer_;
+
+    unsigned char  weaponState_;
+    unsigned char  weaponDmgState_;
+    unsigned char  comboIndex_;
+    /// Weapon action clip handle, 255 for none.
+    unsigned char  weaponAnim_;
+    /// Queued attack button, 255 for none.
+    unsigned char  queuedInput_;
+    /// Time position of the weapon action clip.
+    unsigned short animTime_;
+};
+
+enum CharacterSnapshotFlags
+{
+    CSF_ONGROUND    = (1<<0),
+    CSF_OKTOJUMP    = (1<<1),
+    CSF_JUMPSTARTED = (1<<2)
+};
+
+//=============================================================================
+//=============================================================================
+struct CharacterSnapshotEntry
+{
+    unsigned nodeId_;
+    CharacterSnapshot state_;
+};
+
+//=============================================================================
+// a tick's entries, kept by the encoder and decoder as baselines
+//=============================================================================
+struct SnapshotFrame
+{
+    SnapshotFrame() : tick_(0) {}
+
+    unsigned tick_;
+    PODVector<CharacterSnapshotEntry> entries_;
+};
+
+//=============================================================================
+// snapshot packet, bit-packed:
+//   tick (32 bits), baseline flag (1) and tick distance to it (8),
+//   entry count (16), then per entry sorted by node ID:
+//     node ID distance to the previous entry, changed flag (1), and if changed
+//     six group flags (position, velocity, look, controls, in air timer,
+//     weapon) each followed by the group's fields.
+//   Numbers are sent as the difference to the baseline entry with the same
+//   node ID, or to a zeroed state, zigzag coded in a 2-bit size class of 4,
+//   8, 16 or 32 bits. A character that didn't change takes about one byte.
+//
+// The encoder codes each tick against the newest tick the receiver has
+// acknowledged that is still in its history, and the decoder keeps the frames
+// it decoded so it has the baseline. Lost packets only cost the ticks until
+// the next acknowledgement arrives.
+//=============================================================================
+class SnapshotEncoder : public RefCounted
+{
+public:
+    SnapshotEncoder();
+
+    /// Encode a tick's entries, sorted by node ID, and keep them as a possible baseline. Ticks start at 1.
+    void Encode(unsigned tick, const PODVector<CharacterSnapshotEntry> &entries, PODVector<unsigned char> &dest, bool useBaseline = true);
+    /// Acknowledge a tick the receiver has decoded.
+    void Acknowledge(unsigned tick);
+
+    /// Return the baseline tick of the last encode, 0 if none.
+    unsigned GetBaselineTick() const { return baselineTick_; }
+
+private:
+    Vector<SnapshotFrame> frames_;
+    unsigned ackedTick_;
+    unsigned baselineTick_;
+};
+
+//=============================================================================
+//=============================================================================
+class SnapshotDecoder : public RefCounted
+{
+public:
+    SnapshotDecoder();
+
+    /// Decode a packet. Return false if it is malformed, older than the latest decoded tick or its baseline is gone.
+    bool Decode(const PODVector<unsigned char> &packet, unsigned &tick, PODVector<CharacterSnapshotEntry> &dest);
+
+    /// Return the latest decoded tick, the one to acknowledge. 0 if none.
+    unsigned GetLatestTick() const { return latestTick_; }
+
+private:
+    Vector<SnapshotFrame> frames_;
+    unsigned latestTick_;
+};
@@ -0,0 +1,410 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Core/WorkQueue.h>
+#include <Urho3D/Physics/PhysicsEvents.h>
+#include <Urho3D/Physics/PhysicsWorld.h>
+#include <Urho3D/Physics/RigidBody.h>
+#include <Urho3D/Scene/Scene.h>
+
+#include "CharacterSystem.h"
+#include "Character.h"
+#include "GroundProbe.h"
+
+#ifdef URHO3D_SSE
+#include <xmmintrin.h>
+#endif
+
+#include <Urho3D/DebugNew.h>
+//=============================================================================
+//=============================================================================
+/// Agents per work item. Smaller crowds are stepped on the main thread.
+const unsigned LOCOMOTION_WORK_BATCH = 128;
+
+//=============================================================================
+//=============================================================================
+CharacterSystem::CharacterSystem(Context* context) :
+    Component(context),
+    groundProbes_(new GroundProbeBatch(context)),
+    timeStep_(0.0f)
+{
+    Resize(0);
+}
+
+CharacterSystem::~CharacterSystem()
+{
+    // hand the characters back to their own fixed update
+    for (unsigned i = 0; i < characters_.Size(); ++i)
+    {
+        if (characters_[i])
+        {
+            characters_[i]->SetCharacterSystem(NULL);
+        }
+    }
+}
+
+void CharacterSystem::RegisterObject(Context* context)
+{
+    context->RegisterFactory<CharacterSystem>();
+}
+
+void CharacterSystem::OnSceneSet(Scene* scene)
+{
+    PhysicsWorld *physicsWorld = scene ? scene->GetComponent<PhysicsWorld>() : NULL;
+
+    physicsWorld_ = physicsWorld;
+
+    if (physicsWorld)
+        SubscribeToEvent(physicsWorld, E_PHYSICSPRESTEP, URHO3D_HANDLER(CharacterSystem, HandlePhysicsPreStep));
+    else
+        UnsubscribeFromEvent(E_PHYSICSPRESTEP);
+}
+
+void CharacterSystem::AddCharacter(Character *character)
+{
+    if (!character || character->characterSystem_ == this)
+    {
+        return;
+    }
+
+    characters_.Push(WeakPtr<Character>(character));
+    character->SetCharacterSystem(this);
+}
+
+void CharacterSystem::RemoveCharacter(Character *character)
+{
+    if (characters_.Remove(WeakPtr<Character>(character)))
+    {
+        character->SetCharacterSystem(NULL);
+
+        // the agent slots after it moved down
+        groundProbes_->InvalidateCache();
+    }
+}
+
+void CharacterSystem::Resize(unsigned size)
+{
+    buttons_.Resize(size);
+    rotations_.Resize(size);
+    velocities_.Resize(size);
+    onGround_.Resize(size);
+    flags_.Resize(size);
+    inAirTimers_.Resize(size);
+    okToJump_.Resize(size);
+    moveImpulses_.Resize(size);
+    brakeImpulses_.Resize(size);
+    runSpeeds_.Resize(size);
+
+    lanes_.buttons_       = buttons_.Buffer();
+    lanes_.rotations_     = rotations_.Buffer();
+    lanes_.velocities_    = velocities_.Buffer();
+    lanes_.onGround_      = onGround_.Buffer();
+    lanes_.flags_         = flags_.Buffer();
+    lanes_.inAirTimers_   = inAirTimers_.Buffer();
+    lanes_.okToJump_      = okToJump_.Buffer();
+    lanes_.moveImpulses_  = moveImpulses_.Buffer();
+    lanes_.brakeImpulses_ = brakeImpulses_.Buffer();
+    lanes_.runSpeeds_     = runSpeeds_.Buffer();
+}
+
+#ifdef URHO3D_SSE
+void CharacterSystem::ComputeLocomotion(const LocomotionLanes &lanes, unsigned begin, unsigned end, float timeStep)
+{
+    // four agents per block, every path runs the same lanes, so a batch of one gives the same results as a full one
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 two = _mm_set1_ps(2.0f);
+    const __m128 signBit = _mm_set1_ps(-0.0f);
+
+    for (unsigned block = begin; block < end; block += 4)
+    {
+        const unsigned count = Min(end - block, 4u);
+
+        // transpose the block into lanes, a partial block repeats its last agent
+        float onGround[4], inAirTimers[4], moveX[4], moveZ[4], jumpDown[4], okToJump[4];
+        float rotW[4], rotX[4], rotY[4], rotZ[4], velX[4], velZ[4];
+
+        for (unsigned k = 0; k < 4; ++k)
+        {
+            const unsigned i = block + Min(k, count - 1);
+            const unsigned buttons = lanes.buttons_[i];
+            const Quaternion &rotation = lanes.rotations_[i];
+
+            onGround[k]    = lanes.onGround_[i] ? 1.0f : 0.0f;
+            inAirTimers[k] = lanes.inAirTimers_[i];
+            moveX[k]       = (float)((buttons & CTRL_RIGHT) != 0) - (float)((buttons & CTRL_LEFT) != 0);
+            moveZ[k]       = (float)((buttons & CTRL_FORWARD) != 0) - (float)((buttons & CTRL_BACK) != 0);
+            jumpDown[k]    = (buttons & CTRL_JUMP) ? 1.0f : 0.0f;
+            okToJump[k]    = lanes.okToJump_[i] ? 1.0f : 0.0f;
+            rotW[k]        = rotation.w_;
+            rotX[k]        = rotation.x_;
+            rotY[k]        = rotation.y_;
+            rotZ[k]        = rotation.z_;
+            velX[k]        = lanes.velocities_[i].x_;
+            velZ[k]        = lanes.velocities_[i].z_;
+        }
+
+        // in air timer, reset if grounded. When character has been in air less than 1/10 second, it's still interpreted as being on ground
+        const __m128 inAirTimer = _mm_andnot_ps(_mm_cmpgt_ps(_mm_loadu_ps(onGround), zero), _mm_add_ps(_mm_loadu_ps(inAirTimers), _mm_set1_ps(timeStep)));
+        const __m128 softGrounded = _mm_cmplt_ps(inAirTimer, _mm_set1_ps(INAIR_THRESHOLD_TIME));
+
+        // normalize the move vector so that diagonal strafing is not faster: its length squared is 0, 1 or 2
+        __m128 moveDirX = _mm_loadu_ps(moveX);
+        __m128 moveDirZ = _mm_loadu_ps(moveZ);
+        const __m128 lengthSquared = _mm_add_ps(_mm_mul_ps(moveDirX, moveDirX), _mm_mul_ps(moveDirZ, moveDirZ));
+        const __m128 diagonal = _mm_cmpgt_ps(lengthSquared, one);
+        const __m128 invLength = _mm_or_ps(_mm_and_ps(diagonal, _mm_div_ps(one, _mm_sqrt_ps(lengthSquared))), _mm_andnot_ps(diagonal, one));
+        moveDirX = _mm_mul_ps(moveDirX, invLength);
+        moveDirZ = _mm_mul_ps(moveDirZ, invLength);
+        const __m128 moving = _mm_cmpgt_ps(lengthSquared, zero);
+
+        // rotate (x, 0, z) by the agent's rotation: v + 2 * (q x v * w + q x (q x v)). If in air, allow control, but slower than when on ground
+        const __m128 qw = _mm_loadu_ps(rotW);
+        const __m128 qx = _mm_loadu_ps(rotX);
+        const __m128 qy = _mm_loadu_ps(rotY);
+        const __m128 qz = _mm_loadu_ps(rotZ);
+        const __m128 cross1X = _mm_mul_ps(qy, moveDirZ);
+        const __m128 cross1Y = _mm_sub_ps(_mm_mul_ps(qz, moveDirX), _mm_mul_ps(qx, moveDirZ));
+        const __m128 cross1Z = _mm_sub_ps(zero, _mm_mul_ps(qy, moveDirX));
+        const __m128 cross2X = _mm_sub_ps(_mm_mul_ps(qy, cross1Z), _mm_mul_ps(qz, cross1Y));
+        const __m128 cross2Y = _mm_sub_ps(_mm_mul_ps(qz, cross1X), _mm_mul_ps(qx, cross1Z));
+        const __m128 cross2Z = _mm_sub_ps(_mm_mul_ps(qx, cross1Y), _mm_mul_ps(qy, cross1X));
+        const __m128 force = _mm_or_ps(_mm_and_ps(softGrounded, _mm_set1_ps(MOVE_FORCE)), _mm_andnot_ps(softGrounded, _mm_set1_ps(INAIR_MOVE_FORCE)));
+        const __m128 moveImpulseX = _mm_mul_ps(_mm_add_ps(moveDirX, _mm_mul_ps(two, _mm_add_ps(_mm_mul_ps(cross1X, qw), cross2X))), force);
+        const __m128 moveImpulseY = _mm_mul_ps(_mm_add_ps(zero, _mm_mul_ps(two, _mm_add_ps(_mm_mul_ps(cross1Y, qw), cross2Y))), force);
+        const __m128 moveImpulseZ = _mm_mul_ps(_mm_add_ps(moveDirZ, _mm_mul_ps(two, _mm_add_ps(_mm_mul_ps(cross1Z, qw), cross2Z))), force);
+
+        // velocity on the XZ plane: braking force and run animation speed
+        const __m128 planeVelocityX = _mm_loadu_ps(velX);
+        const __m128 planeVelocityZ = _mm_loadu_ps(velZ);
+        const __m128 brakeForce = _mm_set1_ps(BRAKE_FORCE);
+        const __m128 brakeImpulseX = _mm_mul_ps(_mm_xor_ps(planeVelocityX, signBit), brakeForce);
+        const __m128 brakeImpulseZ = _mm_mul_ps(_mm_xor_ps(planeVelocityZ, signBit), brakeForce);
+        const __m128 planeSpeed = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(planeVelocityX, planeVelocityX), _mm_mul_ps(planeVelocityZ, planeVelocityZ)));
+        const __m128 runSpeed = _mm_min_ps(_mm_max_ps(_mm_mul_ps(planeSpeed, _mm_set1_ps(0.3f)), _mm_set1_ps(0.5f)), two);
+
+        // jump. Must release jump control between jumps
+        const __m128 jumpPressed = _mm_cmpgt_ps(_mm_loadu_ps(jumpDown), zero);
+        const __m128 jumpAllowed = _mm_cmpgt_ps(_mm_loadu_ps(okToJump), zero);
+        const __m128 jump = _mm_and_ps(softGrounded, _mm_and_ps(jumpPressed, jumpAllowed));
+        const __m128 okToJumpAfter = _mm_or_ps(_mm_andnot_ps(softGrounded, jumpAllowed), _mm_andnot_ps(jumpPressed, softGrounded));
+
+        float results[7][4];
+        _mm_storeu_ps(results[0], inAirTimer);
+        _mm_storeu_ps(results[1], moveImpulseX);
+        _mm_storeu_ps(results[2], moveImpulseY);
+        _mm_storeu_ps(results[3], moveImpulseZ);
+        _mm_storeu_ps(results[4], brakeImpulseX);
+        _mm_storeu_ps(results[5], brakeImpulseZ);
+        _mm_storeu_ps(results[6], runSpeed);
+
+        const int softGroundedMask = _mm_movemask_ps(softGrounded);
+        const int movingMask = _mm_movemask_ps(moving);
+        const int jumpMask = _mm_movemask_ps(jump);
+        const int okToJumpMask = _mm_movemask_ps(okToJumpAfter);
+
+        // transpose back. The attack animation owns an attacking agent's body, it only keeps its in air timer
+        for (unsigned k = 0; k < count; ++k)
+        {
+            const unsigned i = block + k;
+
+            lanes.inAirTimers_[i] = results[0][k];
+
+            if (lanes.flags_[i] & LOCO_ATTACKING)
+                continue;
+
+            lanes.moveImpulses_[i]  = Vector3(results[1][k], results[2][k], results[3][k]);
+            lanes.brakeImpulses_[i] = Vector3(results[4][k], -0.0f, results[5][k]);
+            lanes.runSpeeds_[i]     = results[6][k];
+            lanes.okToJump_[i]      = (okToJumpMask >> k) & 1;
+            lanes.flags_[i]         = (unsigned char)(((movingMask >> k) & 1 ? LOCO_MOVING : 0) |
+                                                      ((softGroundedMask >> k) & 1 ? LOCO_SOFTGROUNDED : 0) |
+                                                      ((jumpMask >> k) & 1 ? LOCO_JUMP : 0));
+        }
+    }
+}
+#else
+void CharacterSystem::ComputeLocomotion(const LocomotionLanes &lanes, unsigned begin, unsigned end, float timeStep)
+{
+    // same operations in the same order as the per-character code this replaced, so the results are identical
+    for (unsigned i = begin; i < end; ++i)
+    {
+        // Update the in air timer. Reset if grounded
+        const float inAirTimer = lanes.onGround_[i] ? 0.0f : lanes.inAirTimers_[i] + timeStep;
+        lanes.inAirTimers_[i] = inAirTimer;
+
+        if (lanes.flags_[i] & LOCO_ATTACKING)
+            continue;
+
+        // When character has been in air less than 1/10 second, it's still interpreted as being on ground
+        const bool softGrounded = inAirTimer < INAIR_THRESHOLD_TIME;
+        const unsigned buttons = lanes.buttons_[i];
+        Vector3 moveDir = Vector3::ZERO;
+
+        if (buttons & CTRL_FORWARD)
+            moveDir += Vector3::FORWARD;
+        if (buttons & CTRL_BACK)
+            moveDir += Vector3::BACK;
+        if (buttons & CTRL_LEFT)
+            moveDir += Vector3::LEFT;
+        if (buttons & CTRL_RIGHT)
+            moveDir += Vector3::RIGHT;
+
+        // Normalize move vector so that diagonal strafing is not faster
+        if (moveDir.LengthSquared() > 0.0f)
+            moveDir.Normalize();
+
+        // If in air, allow control, but slower than when on ground
+        lanes.moveImpulses_[i] = lanes.rotations_[i] * moveDir * (softGrounded ? MOVE_FORCE : INAIR_MOVE_FORCE);
+
+        // Velocity on the XZ plane: braking force and run animation speed
+        const Vector3 &velocity = lanes.velocities_[i];
+        Vector3 planeVelocity(velocity.x_, 0.0f, velocity.z_);
+        lanes.brakeImpulses_[i] = -planeVelocity * BRAKE_FORCE;
+        lanes.runSpeeds_[i] = Clamp(planeVelocity.Length() * 0.3f, 0.5f, 2.0f);
+
+        unsigned char flags = 0;
+
+        if (!moveDir.Equals(Vector3::ZERO))
+            flags |= LOCO_MOVING;
+
+        if (softGrounded)
+        {
+            flags |= LOCO_SOFTGROUNDED;
+
+            // Jump. Must release jump control between jumps
+            if (buttons & CTRL_JUMP)
+            {
+                if (lanes.okToJump_[i])
+                {
+                    flags |= LOCO_JUMP;
+                    lanes.okToJump_[i] = false;
+                }
+            }
+            else
+                lanes.okToJump_[i] = true;
+        }
+
+        lanes.flags_[i] = flags;
+    }
+}
+#endif
+
+void CharacterSystem::ComputeLocomotionWork(const WorkItem* item, unsigned threadIndex)
+{
+    CharacterSystem *system = static_cast<CharacterSystem*>(item->aux_);
+
+    ComputeLocomotion(system->lanes_, (unsigned)(size_t)item->start_, (unsigned)(size_t)item->end_, system->timeStep_);
+}
+
+void CharacterSystem::HandlePhysicsPreStep(StringHash eventType, VariantMap& eventData)
+{
+    using namespace PhysicsPreStep;
+
+    const float timeStep = eventData[P_TIMESTEP].GetFloat();
+
+    // drop destroyed characters
+    for (unsigned i = 0; i < characters_.Size();)
+    {
+        if (characters_[i])
+            ++i;
+        else
+        {
+            characters_.Erase(i);
+            groundProbes_->InvalidateCache();
+        }
+    }
+
+    const unsigned numAgents = characters_.Size();
+
+    if (!numAgents)
+    {
+        return;
+    }
+
+    Resize(numAgents);
+
+    // gather: the weapon state machine drives animations and nodes, it stays on the main thread
+    for (unsigned i = 0; i < numAgents; ++i)
+    {
+        Character *character = characters_[i];
+
+        flags_[i]       = character->StepWeapon(timeStep);
+        buttons_[i]     = character->controls_.buttons_;
+        rotations_[i]   = character->GetNode()->GetRotation();
+        velocities_[i]  = character->GetVelocity();
+        onGround_[i]    = character->onGround_;
+        inAirTimers_[i] = character->inAirTimer_;
+        okToJump_[i]    = character->okToJump_;
+    }
+
+    // compute: every agent's move, brake and jump in parallel
+    WorkQueue *queue = GetSubsystem<WorkQueue>();
+
+    if (!queue || !queue->GetNumThreads() || numAgents <= LOCOMOTION_WORK_BATCH)
+    {
+        ComputeLocomotion(lanes_, 0, numAgents, timeStep);
+    }
+    else
+    {
+        timeStep_ = timeStep;
+
+        for (unsigned begin = 0; begin < numAgents; begin += LOCOMOTION_WORK_BATCH)
+        {
+            SharedPtr<WorkItem> item = queue->GetFreeItem();
+            item->priority_ = M_MAX_UNSIGNED;
+            item->workFunction_ = ComputeLocomotionWork;
+            item->aux_ = this;
+            item->start_ = (void*)(size_t)begin;
+            item->end_ = (void*)(size_t)Min(begin + LOCOMOTION_WORK_BATCH, numAgents);
+            queue->AddWorkItem(item);
+        }
+
+        queue->Complete(M_MAX_UNSIGNED);
+    }
+
+    // probe: the airborne agents' ground probes for the fall animation, cast together before any physics writes
+    groundProbes_->Begin(numAgents);
+
+    for (unsigned i = 0; i < numAgents; ++i)
+    {
+        Character *character = characters_[i];
+
+        if (character->NeedsGroundProbe(flags_[i]))
+        {
+            groundProbes_->Submit(i, character->GetNode()->GetPosition());
+        }
+    }
+
+    groundProbes_->Resolve(physicsWorld_, GROUND_PROBE_DISTANCE, 0xff);
+
+    // scatter: physics and animation writes, serialized in agent order
+    for (unsigned i = 0; i < numAgents; ++i)
+    {
+        Character *character = characters_[i];
+
+        character->inAirTimer_ = inAirTimers_[i];
+        character->okToJump_ = okToJump_[i];
+        character->ApplyLocomotion(moveImpulses_[i], brakeImpulses_[i], flags_[i], runSpeeds_[i], groundProbes_->GetResult(i), timeStep);
+    }
+}
@@ -0,0 +1,132 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#pragma once
+
+#include <Urho3D/Scene/Component.h>
+
+using namespace Urho3D;
+namespace Urho3D
+{
+class PhysicsWorld;
+class RigidBody;
+struct WorkItem;
+}
+
+class Character;
+class GroundProbeBatch;
+
+//=============================================================================
+// locomotion step results, per agent
+//=============================================================================
+enum LocomotionFlags
+{
+    LOCO_ATTACKING     = (1<<0),   // in: attack animation owns the body, no locomotion
+    LOCO_STOP          = (1<<1),   // in: attack started this step, stop the body
+    LOCO_SOFTGROUNDED  = (1<<2),
+    LOCO_MOVING        = (1<<3),
+    LOCO_JUMP          = (1<<4)
+};
+
+//=============================================================================
+// structure-of-arrays view of the locomotion state, one element per agent.
+// Character::FixedUpdate runs a batch of one through the same kernel.
+//=============================================================================
+struct LocomotionLanes
+{
+    // in
+    const unsigned   *buttons_;
+    const Quaternion *rotations_;
+    const Vector3    *velocities_;
+    const bool       *onGround_;
+    // in/out
+    unsigned char    *flags_;
+    float            *inAirTimers_;
+    bool             *okToJump_;
+    // out
+    Vector3          *moveImpulses_;
+    Vector3          *brakeImpulses_;
+    float            *runSpeeds_;
+};
+
+//=============================================================================
+// scene component that steps the locomotion of every Character in the scene.
+// Per physics step it gathers the agents' state into arrays, runs the
+// move/brake/jump computation over all of them on the work queue, casts the
+// airborne agents' ground probes as one batch, then applies the physics and
+// animation writes on the main thread in agent order. With URHO3D_SSE the
+// move/brake/jump math runs four agents at a time, one per SSE lane.
+// Gives the same results as the characters' own FixedUpdate, apart from
+// ground probes reused by agents that have not moved, see GroundProbeBatch.
+//
+// Create it after the characters and any input drivers, so its physics
+// pre-step handler runs after the ones that set the characters' controls.
+//=============================================================================
+class CharacterSystem : public Component
+{
+    URHO3D_OBJECT(CharacterSystem, Component);
+
+public:
+    /// Construct.
+    CharacterSystem(Context* context);
+    virtual ~CharacterSystem();
+
+    /// Register object factory.
+    static void RegisterObject(Context* context);
+
+    /// Add a character. Its own fixed update is disabled while the system drives it.
+    void AddCharacter(Character *character);
+    /// Remove a character.
+    void RemoveCharacter(Character *character);
+    /// Return number of characters.
+    unsigned GetNumCharacters() const { return characters_.Size(); }
+
+    /// Compute one locomotion step for agents [begin, end).
+    static void ComputeLocomotion(const LocomotionLanes &lanes, unsigned begin, unsigned end, float timeStep);
+
+protected:
+    /// Handle scene being assigned.
+    virtual void OnSceneSet(Scene* scene);
+
+private:
+    void HandlePhysicsPreStep(StringHash eventType, VariantMap& eventData);
+    void Resize(unsigned size);
+    static void ComputeLocomotionWork(const WorkItem* item, unsigned threadIndex);
+
+    Vector<WeakPtr<Character> > characters_;
+    WeakPtr<PhysicsWorld> physicsWorld_;
+    SharedPtr<GroundProbeBatch> groundProbes_;
+
+    // lanes, sized to the character count and reused every step
+    PODVector<unsigned>      buttons_;
+    PODVector<Quaternion>    rotations_;
+    PODVector<Vector3>       velocities_;
+    PODVector<bool>          onGround_;
+    PODVector<unsigned char> flags_;
+    PODVector<float>         inAirTimers_;
+    PODVector<bool>          okToJump_;
+    PODVector<Vector3>       moveImpulses_;
+    PODVector<Vector3>       brakeImpulses_;
+    PODVector<float>         runSpeeds_;
+    LocomotionLanes          lanes_;
+    float                    timeStep_;
+};
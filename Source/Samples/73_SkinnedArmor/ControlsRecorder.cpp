@@ -0,0 +1,176 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include <Urho3D/IO/File.h>
+#include <Urho3D/IO/Log.h>
+#include <Urho3D/Physics/PhysicsEvents.h>
+#include <Urho3D/Physics/PhysicsWorld.h>
+#include <Urho3D/Scene/Scene.h>
+
+#include "ControlsRecorder.h"
+#include "Character.h"
+
+#include <Urho3D/DebugNew.h>
+//=============================================================================
+//=============================================================================
+ControlsRecorder::ControlsRecorder(Context* context, Scene *scene) :
+    Object(context),
+    scene_(scene),
+    numSteps_(0)
+{
+    SubscribeToEvent(scene->GetComponent<PhysicsWorld>(), E_PHYSICSPRESTEP, URHO3D_HANDLER(ControlsRecorder, HandlePhysicsPreStep));
+}
+
+ControlsRecorder::~ControlsRecorder()
+{
+    Stop();
+}
+
+bool ControlsRecorder::Start(Character *character, const String& fileName)
+{
+    Stop();
+
+    file_ = new File(context_, fileName, FILE_WRITE);
+    if (!file_->IsOpen())
+    {
+        URHO3D_LOGERROR("Could not open controls recording " + fileName);
+        file_.Reset();
+        return false;
+    }
+
+    file_->WriteFileID("CREC");
+    file_->WriteUInt((unsigned)scene_->GetComponent<PhysicsWorld>()->GetFps());
+
+    character_ = character;
+    lastControls_ = Controls();
+    numSteps_ = 0;
+
+    return true;
+}
+
+void ControlsRecorder::Stop()
+{
+    if (file_)
+    {
+        URHO3D_LOGINFO("Recorded " + String(numSteps_) + " steps to " + file_->GetName());
+        file_->Close();
+        file_.Reset();
+    }
+}
+
+void ControlsRecorder::HandlePhysicsPreStep(StringHash eventType, VariantMap& eventData)
+{
+    if (!file_ || !character_)
+        return;
+
+    const Controls &controls = character_->controls_;
+    unsigned char flags = 0;
+
+    if (controls.buttons_ != lastControls_.buttons_)
+        flags |= CREC_BUTTONS;
+    if (controls.yaw_ != lastControls_.yaw_)
+        flags |= CREC_YAW;
+    if (controls.pitch_ != lastControls_.pitch_)
+        flags |= CREC_PITCH;
+
+    file_->WriteUByte(flags);
+
+    if (flags & CREC_BUTTONS)
+        file_->WriteVLE(controls.buttons_);
+    if (flags & CREC_YAW)
+        file_->WriteFloat(controls.yaw_);
+    if (flags & CREC_PITCH)
+        file_->WriteFloat(controls.pitch_);
+
+    lastControls_ = controls;
+    ++numSteps_;
+}
+
+//=============================================================================
+//=============================================================================
+ControlsPlayer::ControlsPlayer(Context* context, Scene *scene) :
+    Object(context),
+    scene_(scene),
+    fps_(0),
+    numSteps_(0),
+    finished_(true)
+{
+    SubscribeToEvent(scene->GetComponent<PhysicsWorld>(), E_PHYSICSPRESTEP, URHO3D_HANDLER(ControlsPlayer, HandlePhysicsPreStep));
+}
+
+ControlsPlayer::~ControlsPlayer()
+{
+}
+
+bool ControlsPlayer::Start(Character *character, const String& fileName)
+{
+    File file(context_, fileName, FILE_READ);
+    if (!file.IsOpen() || file.ReadFileID() != "CREC")
+    {
+        URHO3D_LOGERROR("Could not read controls recording " + fileName);
+        return false;
+    }
+
+    fps_ = file.ReadUInt();
+    if (!fps_)
+    {
+        URHO3D_LOGERROR("Invalid physics fps in controls recording " + fileName);
+        return false;
+    }
+
+    // the whole session is read up front, replay does no file access
+    buffer_.SetData(file, file.GetSize() - file.GetPosition());
+
+    scene_->GetComponent<PhysicsWorld>()->SetFps((int)fps_);
+
+    character_ = character;
+    controls_ = Controls();
+    numSteps_ = 0;
+    finished_ = false;
+
+    return true;
+}
+
+void ControlsPlayer::HandlePhysicsPreStep(StringHash eventType, VariantMap& eventData)
+{
+    if (finished_ || !character_)
+        return;
+
+    if (buffer_.IsEof())
+    {
+        finished_ = true;
+        return;
+    }
+
+    unsigned char flags = buffer_.ReadUByte();
+
+    if (flags & CREC_BUTTONS)
+        controls_.buttons_ = buffer_.ReadVLE();
+    if (flags & CREC_YAW)
+        controls_.yaw_ = buffer_.ReadFloat();
+    if (flags & CREC_PITCH)
+        controls_.pitch_ = buffer_.ReadFloat();
+
+    character_->controls_ = controls_;
+    character_->GetNode()->SetRotation(Quaternion(controls_.yaw_, Vector3::UP));
+    ++numSteps_;
+}
@@ -0,0 +1,115 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#pragma once
+
+#include <Urho3D/Core/Object.h>
+#include <Urho3D/Input/Controls.h>
+#include <Urho3D/IO/VectorBuffer.h>
+
+using namespace Urho3D;
+namespace Urho3D
+{
+class File;
+class Scene;
+}
+
+class Character;
+
+//=============================================================================
+// controls recording file:
+//   "CREC" file id, physics fps (uint), then per fixed step a flags byte
+//   followed by only the changed values: buttons (VLE), yaw (float), pitch (float).
+//   A step with unchanged controls takes one byte.
+//
+// Both the recorder and the player handle the physics pre-step, which is where
+// Character::FixedUpdate consumes its controls. Urho calls the receivers of a
+// sender in subscription order, so they must be created before the character.
+//=============================================================================
+enum ControlsRecordFlags
+{
+    CREC_BUTTONS = (1<<0),
+    CREC_YAW     = (1<<1),
+    CREC_PITCH   = (1<<2)
+};
+
+//=============================================================================
+//=============================================================================
+class ControlsRecorder : public Object
+{
+    URHO3D_OBJECT(ControlsRecorder, Object);
+
+public:
+    /// Construct. Must be created before the recorded character.
+    ControlsRecorder(Context* context, Scene *scene);
+    virtual ~ControlsRecorder();
+
+    /// Start recording the character's controls to a file.
+    bool Start(Character *character, const String& fileName);
+    /// Stop recording and close the file.
+    void Stop();
+
+    /// Return number of recorded fixed steps.
+    unsigned GetNumSteps() const { return numSteps_; }
+
+private:
+    void HandlePhysicsPreStep(StringHash eventType, VariantMap& eventData);
+
+    WeakPtr<Scene>     scene_;
+    WeakPtr<Character> character_;
+    SharedPtr<File>    file_;
+    Controls           lastControls_;
+    unsigned           numSteps_;
+};
+
+//=============================================================================
+//=============================================================================
+class ControlsPlayer : public Object
+{
+    URHO3D_OBJECT(ControlsPlayer, Object);
+
+public:
+    /// Construct. Must be created before the replayed character.
+    ControlsPlayer(Context* context, Scene *scene);
+    virtual ~ControlsPlayer();
+
+    /// Load a recording and start feeding it to the character, one recorded step per fixed step. Sets the physics fps of the recording.
+    bool Start(Character *character, const String& fileName);
+
+    /// Return physics timestep of the recording.
+    float GetTimeStep() const { return fps_ ? 1.0f / fps_ : 0.0f; }
+    /// Return number of replayed fixed steps.
+    unsigned GetNumSteps() const { return numSteps_; }
+    /// Return whether all recorded steps have been replayed.
+    bool IsFinished() const { return finished_; }
+
+private:
+    void HandlePhysicsPreStep(StringHash eventType, VariantMap& eventData);
+
+    WeakPtr<Scene>     scene_;
+    WeakPtr<Character> character_;
+    VectorBuffer       buffer_;
+    Controls           controls_;
+    unsigned           fps_;
+    unsigned           numSteps_;
+    bool               finished_;
+};
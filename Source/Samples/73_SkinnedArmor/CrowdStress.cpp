@@ -0,0 +1,306 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include <Urho3D/Core/CoreEvents.h>
+#include <Urho3D/Core/ProcessUtils.h>
+#include <Urho3D/Engine/Engine.h>
+#include <Urho3D/Math/Ray.h>
+#include <Urho3D/Physics/PhysicsWorld.h>
+#include <Urho3D/Scene/Scene.h>
+
+#include "CrowdStress.h"
+#include "Character.h"
+#include "CollisionLayer.h"
+#include "FrameTiming.h"
+#include "HitRegistry.h"
+#include "SnapshotLoopback.h"
+
+#include <Urho3D/DebugNew.h>
+//=============================================================================
+//=============================================================================
+const float CROWD_TIMESTEP = 1.0f / 60.0f;
+const unsigned CROWD_WARMUP_FRAMES = 60;
+const float CROWD_AREA_SIZE = 40.0f;
+const float CROWD_MAX_SPACING = 2.0f;
+const float CROWD_DROP_HEIGHT = 30.0f;
+/// How far back the live hits are validated against the pose history, a typical client latency.
+const float CROWD_REWIND_DELAY = 0.1f;
+
+// one loop of the input script, offset per character so the crowd doesn't act in lockstep
+const unsigned CROWD_SCRIPT_LENGTH = 480;
+const CrowdScriptStep CROWD_SCRIPT[] =
+{
+    {   0,   1, CTRL_EQUIP,                0.0f },  // draw sword
+    {  40, 160, CTRL_FORWARD,              1.5f },  // run in an arc
+    { 170, 171, CTRL_LMB,                  0.0f },  // three hit combo, later hits queued
+    { 190, 191, CTRL_LMB,                  0.0f },
+    { 210, 211, CTRL_LMB,                  0.0f },
+    { 280, 290, CTRL_JUMP,                 0.0f },
+    { 320, 321, CTRL_EQUIP,                0.0f },  // sheath
+    { 340, 440, CTRL_FORWARD | CTRL_LEFT, -1.0f },
+    { 400, 410, CTRL_JUMP,                 0.0f },  // running jump
+};
+const unsigned NUM_CROWD_SCRIPT_STEPS = sizeof(CROWD_SCRIPT) / sizeof(CROWD_SCRIPT[0]);
+
+//=============================================================================
+//=============================================================================
+Vector3 GetCrowdSpawnPosition(Scene *scene, unsigned index, unsigned numSlots)
+{
+    // square grid centered on the level, spaced to fit the level floor
+    unsigned side = Max((unsigned)ceilf(sqrtf((float)numSlots)), 1U);
+    float spacing = Min(CROWD_AREA_SIZE / side, CROWD_MAX_SPACING);
+    float offset = 0.5f * (side - 1) * spacing;
+    Vector3 position((index % side) * spacing - offset, CROWD_DROP_HEIGHT, (index / side) * spacing - offset);
+
+    // drop onto the floor
+    PhysicsRaycastResult result;
+    scene->GetComponent<PhysicsWorld>()->RaycastSingle(result, Ray(position, Vector3::DOWN), 2.0f * CROWD_DROP_HEIGHT, ColLayer_Static);
+
+    if (result.body_)
+        position.y_ = result.position_.y_ + 0.1f;
+    else
+        position.y_ = 0.5f;
+
+    return position;
+}
+
+void ApplyCrowdScript(const Vector<WeakPtr<Character> > &characters, unsigned frame)
+{
+    for (unsigned i = 0; i < characters.Size(); ++i)
+    {
+        Character *character = characters[i];
+        if (!character)
+            continue;
+
+        unsigned scriptFrame = (frame + i * 53) % CROWD_SCRIPT_LENGTH;
+        unsigned buttons = 0;
+        float yawRate = 0.0f;
+
+        for (unsigned j = 0; j < NUM_CROWD_SCRIPT_STEPS; ++j)
+        {
+            const CrowdScriptStep &step = CROWD_SCRIPT[j];
+            if (scriptFrame >= step.beginFrame_ && scriptFrame < step.endFrame_)
+            {
+                buttons |= step.buttons_;
+                yawRate += step.yawRate_;
+            }
+        }
+
+        // same as the player input: held buttons are cleared every frame, equip and attack are consumed by the character
+        Controls &controls = character->controls_;
+        controls.Set(CTRL_FORWARD | CTRL_BACK | CTRL_LEFT | CTRL_RIGHT | CTRL_JUMP, false);
+        controls.Set(buttons, true);
+        controls.yaw_ += yawRate;
+        character->GetNode()->SetRotation(Quaternion(controls.yaw_, Vector3::UP));
+    }
+}
+
+//=============================================================================
+//=============================================================================
+CrowdStress::CrowdStress(Context* context, Scene *scene) :
+    Object(context),
+    scene_(scene),
+    useSnapshotLoopback_(false),
+    frame_(0),
+    numFrames_(0),
+    weaponHits_(0),
+    rewindSweeps_(0),
+    rewindLiveHits_(0),
+    rewindConfirmedHits_(0)
+{
+    timing_ = new FrameTiming(context, scene);
+}
+
+CrowdStress::~CrowdStress()
+{
+}
+
+void CrowdStress::AddCharacter(Character *character)
+{
+    characters_.Push(WeakPtr<Character>(character));
+}
+
+void CrowdStress::EnableSnapshotLoopback(Character *replica)
+{
+    useSnapshotLoopback_ = true;
+    snapshotReplica_ = replica;
+}
+
+void CrowdStress::Start(unsigned frames)
+{
+    numFrames_ = Max(frames, 1U);
+
+    timing_->Start(CROWD_WARMUP_FRAMES, CROWD_TIMESTEP);
+
+    // after the ground contact query, so the snapshots see this step's ground state
+    if (useSnapshotLoopback_)
+    {
+        snapshotLoopback_ = new SnapshotLoopback(context_, scene_, snapshotReplica_);
+    }
+
+    SubscribeToEvent(E_BEGINFRAME, URHO3D_HANDLER(CrowdStress, HandleBeginFrame));
+    SubscribeToEvent(E_ENDFRAME, URHO3D_HANDLER(CrowdStress, HandleEndFrame));
+    SubscribeToEvent(E_WEAPONHITS, URHO3D_HANDLER(CrowdStress, HandleWeaponHits));
+
+    poseHistory_ = scene_->GetComponent<PoseHistorySystem>();
+
+    PrintLine("crowd stress: " + String(characters_.Size()) + " characters, " + String(dummies_.Size()) + " dummies, " +
+              String(numFrames_) + " frames");
+}
+
+void CrowdStress::HandleBeginFrame(StringHash eventType, VariantMap& eventData)
+{
+    ApplyCrowdScript(characters_, frame_);
+}
+
+void CrowdStress::HandleEndFrame(StringHash eventType, VariantMap& eventData)
+{
+    ++frame_;
+
+    if (poseHistory_)
+    {
+        RunRewindChecks();
+    }
+
+    if (timing_->GetNumMeasuredFrames() >= numFrames_)
+    {
+        Report();
+        timing_->Stop();
+        UnsubscribeFromAllEvents();
+        GetSubsystem<Engine>()->Exit();
+    }
+}
+
+void CrowdStress::HandleWeaponHits(StringHash eventType, VariantMap& eventData)
+{
+    using namespace WeaponHits;
+
+    const HitRecord *hits = static_cast<const HitRecord*>(eventData[P_HITS].GetVoidPtr());
+    const unsigned numHits = eventData[P_NUMHITS].GetUInt();
+
+    weaponHits_ += numHits;
+
+    if (!poseHistory_ || poseHistory_->GetTimeStep() <= 0.0f)
+    {
+        return;
+    }
+
+    // the frame's animated poses are recorded at the next physics step
+    const float time = poseHistory_->GetTime() + poseHistory_->GetTimeStep();
+    const unsigned firstCheck = rewindChecks_.Size();
+
+    for (unsigned i = 0; i < numHits; ++i)
+    {
+        Node *target = scene_->GetNode(hits[i].targetId_);
+        Character *character = target ? target->GetComponent<Character>() : NULL;
+
+        // dummies have no pose history
+        if (!character || !poseHistory_->GetHistory(character))
+            continue;
+
+        unsigned j = firstCheck;
+
+        while (j < rewindChecks_.Size() && rewindChecks_[j].attackerId_ != hits[i].attackerId_)
+            ++j;
+
+        if (j == rewindChecks_.Size())
+        {
+            RewindCheck check;
+            check.attackerId_ = hits[i].attackerId_;
+            check.time_ = time;
+            rewindChecks_.Push(check);
+        }
+
+        rewindChecks_[j].targetIds_.Push(hits[i].targetId_);
+    }
+}
+
+void CrowdStress::RunRewindChecks()
+{
+    const float timeStep = poseHistory_->GetTimeStep();
+    unsigned numChecks = 0;
+
+    // oldest first, once the history is the delay past them
+    for (; numChecks < rewindChecks_.Size(); ++numChecks)
+    {
+        const RewindCheck &check = rewindChecks_[numChecks];
+
+        if (check.time_ + CROWD_REWIND_DELAY > poseHistory_->GetTime())
+            break;
+
+        Node *attackerNode = scene_->GetNode(check.attackerId_);
+        Character *attacker = attackerNode ? attackerNode->GetComponent<Character>() : NULL;
+        Vector3 fromPosition, toPosition;
+        Quaternion fromRotation, toRotation;
+
+        if (!attacker || !poseHistory_->GetBladePose(attacker, check.time_ - timeStep, fromPosition, fromRotation) ||
+            !poseHistory_->GetBladePose(attacker, check.time_, toPosition, toRotation))
+        {
+            continue;
+        }
+
+        rewindHits_.Clear();
+        poseHistory_->SweepAtTime(attacker, fromPosition, fromRotation, toPosition, toRotation, check.time_, rewindHits_);
+        ++rewindSweeps_;
+
+        for (unsigned i = 0; i < check.targetIds_.Size(); ++i)
+        {
+            ++rewindLiveHits_;
+
+            for (unsigned j = 0; j < rewindHits_.Size(); ++j)
+            {
+                if (rewindHits_[j].node_->GetID() == check.targetIds_[i])
+                {
+                    ++rewindConfirmedHits_;
+                    break;
+                }
+            }
+        }
+    }
+
+    if (numChecks)
+    {
+        rewindChecks_.Erase(0, numChecks);
+    }
+}
+
+void CrowdStress::Report()
+{
+    // the crowd uses one controller mode, compare the physics time of runs with and without -kinematic
+    const bool kinematic = characters_.Size() && characters_[0] && characters_[0]->IsKinematicController();
+
+    PrintLine(String("controller,characters,dummies,frames,") + FrameTiming::GetCsvHeader() + ",weapon_hits");
+    PrintLine(String(kinematic ? "kinematic" : "dynamic") + "," + String(characters_.Size()) + "," + String(dummies_.Size()) + "," +
+              String(timing_->GetNumMeasuredFrames()) + "," + timing_->GetCsvValues() + "," + String(weaponHits_));
+
+    if (snapshotLoopback_)
+    {
+        PrintLine(String("characters,") + SnapshotLoopback::GetCsvHeader());
+        PrintLine(String(characters_.Size()) + "," + snapshotLoopback_->GetCsvValues());
+    }
+
+    if (poseHistory_)
+    {
+        PrintLine("rewind_sweeps,live_character_hits,rewind_confirmed_hits");
+        PrintLine(String(rewindSweeps_) + "," + String(rewindLiveHits_) + "," + String(rewindConfirmedHits_));
+    }
+}
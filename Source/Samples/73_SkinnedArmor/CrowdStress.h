@@ -0,0 +1,121 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#pragma once
+
+#include <Urho3D/Core/Object.h>
+
+#include "PoseHistory.h"
+
+using namespace Urho3D;
+namespace Urho3D
+{
+class Node;
+class Scene;
+}
+
+class Character;
+class FrameTiming;
+class SnapshotLoopback;
+
+//=============================================================================
+// scripted input: buttons held and yaw turn rate between two script frames
+//=============================================================================
+struct CrowdScriptStep
+{
+    unsigned beginFrame_;
+    unsigned endFrame_;
+    unsigned buttons_;
+    float    yawRate_;
+};
+
+/// Return spawn position of grid slot index out of numSlots on a scene's level, dropped onto the floor.
+Vector3 GetCrowdSpawnPosition(Scene *scene, unsigned index, unsigned numSlots);
+/// Set the characters' controls to the input script at a frame.
+void ApplyCrowdScript(const Vector<WeakPtr<Character> > &characters, unsigned frame);
+
+//=============================================================================
+// headless crowd stress run: drives the spawned characters with a looping
+// input script, runs a fixed number of fixed-timestep frames and prints frame
+// time percentiles plus the time spent in Character::FixedUpdate, physics and
+// animation as CSV, then exits the engine.
+//
+// With a PoseHistorySystem in the scene, the character hits of every frame
+// are checked again about 100 ms later against the history: the attacker's
+// blade pose of that frame and the one before are rewound, swept against
+// the rewound hitboxes, and the live hits the rewound sweep confirms are
+// counted. Live hits are against the characters' capsules and rewound ones
+// against their bone boxes, so a few percent are expected to differ.
+//=============================================================================
+class CrowdStress : public Object
+{
+    URHO3D_OBJECT(CrowdStress, Object);
+
+public:
+    /// Construct. Must be created before the crowd is spawned, see FrameTimingProbe.
+    CrowdStress(Context* context, Scene *scene);
+    virtual ~CrowdStress();
+
+    /// Return spawn position of grid slot index out of numSlots, dropped onto the level.
+    Vector3 GetSpawnPosition(unsigned index, unsigned numSlots) const { return GetCrowdSpawnPosition(scene_, index, numSlots); }
+    /// Add a character to drive.
+    void AddCharacter(Character *character);
+    /// Add a dummy, only counted for the report.
+    void AddDummy(Node *dummy) { dummies_.Push(WeakPtr<Node>(dummy)); }
+    /// Replicate the crowd through a loopback connection during the run, applying the snapshots to the replica character, and report the snapshot sizes. Call before Start.
+    void EnableSnapshotLoopback(Character *replica);
+    /// Start the run after the crowd has been spawned.
+    void Start(unsigned frames);
+
+private:
+    /// Character hits of one attacker in a frame, to validate against the pose history.
+    struct RewindCheck
+    {
+        unsigned attackerId_;
+        float time_;
+        PODVector<unsigned> targetIds_;
+    };
+
+    void HandleBeginFrame(StringHash eventType, VariantMap& eventData);
+    void HandleEndFrame(StringHash eventType, VariantMap& eventData);
+    void HandleWeaponHits(StringHash eventType, VariantMap& eventData);
+    void RunRewindChecks();
+    void Report();
+
+    WeakPtr<Scene>              scene_;
+    Vector<WeakPtr<Character> > characters_;
+    Vector<WeakPtr<Node> >      dummies_;
+    SharedPtr<FrameTiming>      timing_;
+    SharedPtr<SnapshotLoopback> snapshotLoopback_;
+    WeakPtr<Character>          snapshotReplica_;
+    bool                        useSnapshotLoopback_;
+    WeakPtr<PoseHistorySystem>  poseHistory_;
+    Vector<RewindCheck>         rewindChecks_;
+    PODVector<PoseHit>          rewindHits_;
+
+    unsigned frame_;
+    unsigned numFrames_;
+    unsigned weaponHits_;
+    unsigned rewindSweeps_;
+    unsigned rewindLiveHits_;
+    unsigned rewindConfirmedHits_;
+};
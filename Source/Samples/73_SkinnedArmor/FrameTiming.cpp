@@ -0,0 +1,209 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include <Urho3D/Core/CoreEvents.h>
+#include <Urho3D/Engine/Engine.h>
+#include <Urho3D/Physics/PhysicsEvents.h>
+#include <Urho3D/Physics/PhysicsWorld.h>
+#include <Urho3D/Scene/Scene.h>
+#include <Urho3D/Scene/SceneEvents.h>
+
+#include "FrameTiming.h"
+
+#include <Urho3D/DebugNew.h>
+//=============================================================================
+//=============================================================================
+static float GetPercentile(const PODVector<float> &sorted, float percentile)
+{
+    if (sorted.Empty())
+        return 0.0f;
+
+    return sorted[Min((unsigned)(percentile * sorted.Size()), sorted.Size() - 1)];
+}
+
+//=============================================================================
+//=============================================================================
+FrameTimingProbe::FrameTimingProbe(Context* context, FrameTiming *owner) :
+    Object(context),
+    owner_(owner)
+{
+}
+
+void FrameTimingProbe::Subscribe(Scene *scene)
+{
+    SubscribeToEvent(scene->GetComponent<PhysicsWorld>(), E_PHYSICSPRESTEP, URHO3D_HANDLER(FrameTimingProbe, HandleFixedUpdateEnd));
+    SubscribeToEvent(scene, E_SCENEPOSTUPDATE, URHO3D_HANDLER(FrameTimingProbe, HandleAnimationEnd));
+}
+
+void FrameTimingProbe::HandleFixedUpdateEnd(StringHash eventType, VariantMap& eventData)
+{
+    owner_->MarkFixedUpdateEnd();
+}
+
+void FrameTimingProbe::HandleAnimationEnd(StringHash eventType, VariantMap& eventData)
+{
+    owner_->MarkAnimationEnd();
+}
+
+//=============================================================================
+//=============================================================================
+FrameTiming::FrameTiming(Context* context, Scene *scene) :
+    Object(context),
+    scene_(scene),
+    frame_(0),
+    warmupFrames_(0),
+    fixedTimeStep_(0.0f),
+    frameBegin_(0),
+    fixedUpdateBegin_(0),
+    physicsBegin_(0),
+    animationBegin_(0),
+    fixedUpdateTime_(0),
+    physicsTime_(0),
+    animationTime_(0),
+    fixedUpdateTotal_(0.0),
+    physicsTotal_(0.0),
+    animationTotal_(0.0)
+{
+    // begin marks go ahead of the characters' physics pre-step and animation controllers' scene post-update handlers
+    SubscribeToEvent(scene->GetComponent<PhysicsWorld>(), E_PHYSICSPRESTEP, URHO3D_HANDLER(FrameTiming, HandleFixedUpdateBegin));
+    SubscribeToEvent(scene, E_SCENEPOSTUPDATE, URHO3D_HANDLER(FrameTiming, HandleAnimationBegin));
+}
+
+FrameTiming::~FrameTiming()
+{
+}
+
+void FrameTiming::Start(unsigned warmupFrames, float fixedTimeStep)
+{
+    warmupFrames_ = warmupFrames;
+    fixedTimeStep_ = fixedTimeStep;
+
+    // end marks go after every character
+    probe_ = new FrameTimingProbe(context_, this);
+    probe_->Subscribe(scene_);
+
+    SubscribeToEvent(scene_->GetComponent<PhysicsWorld>(), E_PHYSICSPOSTSTEP, URHO3D_HANDLER(FrameTiming, HandlePhysicsPostStep));
+    SubscribeToEvent(E_BEGINFRAME, URHO3D_HANDLER(FrameTiming, HandleBeginFrame));
+    SubscribeToEvent(E_POSTUPDATE, URHO3D_HANDLER(FrameTiming, HandlePostUpdate));
+    SubscribeToEvent(E_POSTRENDERUPDATE, URHO3D_HANDLER(FrameTiming, HandlePostRenderUpdate));
+    SubscribeToEvent(E_ENDFRAME, URHO3D_HANDLER(FrameTiming, HandleEndFrame));
+
+    // run unthrottled with a fixed timestep
+    if (fixedTimeStep_ > 0.0f)
+    {
+        Engine *engine = GetSubsystem<Engine>();
+        engine->SetMaxFps(0);
+        engine->SetNextTimeStep(fixedTimeStep_);
+    }
+}
+
+void FrameTiming::Stop()
+{
+    UnsubscribeFromAllEvents();
+
+    if (probe_)
+    {
+        probe_->UnsubscribeFromAllEvents();
+        probe_.Reset();
+    }
+}
+
+const char* FrameTiming::GetCsvHeader()
+{
+    return "frame_ms_p50,frame_ms_p90,frame_ms_p99,frame_ms_max,"
+           "fixed_update_ms_per_frame,physics_ms_per_frame,animation_ms_per_frame";
+}
+
+String FrameTiming::GetCsvValues() const
+{
+    PODVector<float> sorted = frameTimes_;
+    Sort(sorted.Begin(), sorted.End());
+
+    float numFrames = (float)Max(frameTimes_.Size(), 1U);
+
+    return String(GetPercentile(sorted, 0.5f)) + "," + String(GetPercentile(sorted, 0.9f)) + "," +
+           String(GetPercentile(sorted, 0.99f)) + "," + String(GetPercentile(sorted, 1.0f)) + "," +
+           String((float)(fixedUpdateTotal_ / numFrames)) + "," + String((float)(physicsTotal_ / numFrames)) + "," +
+           String((float)(animationTotal_ / numFrames));
+}
+
+void FrameTiming::MarkFixedUpdateEnd()
+{
+    long long now = timer_.GetUSec(false);
+    fixedUpdateTime_ += now - fixedUpdateBegin_;
+    physicsBegin_ = now;
+}
+
+void FrameTiming::MarkAnimationEnd()
+{
+    animationTime_ += timer_.GetUSec(false) - animationBegin_;
+}
+
+void FrameTiming::HandleBeginFrame(StringHash eventType, VariantMap& eventData)
+{
+    frameBegin_ = timer_.GetUSec(false);
+    fixedUpdateTime_ = 0;
+    physicsTime_ = 0;
+    animationTime_ = 0;
+}
+
+void FrameTiming::HandleFixedUpdateBegin(StringHash eventType, VariantMap& eventData)
+{
+    fixedUpdateBegin_ = timer_.GetUSec(false);
+}
+
+void FrameTiming::HandlePhysicsPostStep(StringHash eventType, VariantMap& eventData)
+{
+    // bullet step plus collision event handling
+    physicsTime_ += timer_.GetUSec(false) - physicsBegin_;
+}
+
+void FrameTiming::HandleAnimationBegin(StringHash eventType, VariantMap& eventData)
+{
+    animationBegin_ = timer_.GetUSec(false);
+}
+
+void FrameTiming::HandlePostUpdate(StringHash eventType, VariantMap& eventData)
+{
+    // headless, the render update only runs the octree drawable update, which applies the animations to the skeletons
+    animationBegin_ = timer_.GetUSec(false);
+}
+
+void FrameTiming::HandlePostRenderUpdate(StringHash eventType, VariantMap& eventData)
+{
+    MarkAnimationEnd();
+}
+
+void FrameTiming::HandleEndFrame(StringHash eventType, VariantMap& eventData)
+{
+    // the engine has already computed the next timestep from the elapsed time, replace it
+    if (fixedTimeStep_ > 0.0f)
+        GetSubsystem<Engine>()->SetNextTimeStep(fixedTimeStep_);
+
+    if (frame_++ < warmupFrames_)
+        return;
+
+    frameTimes_.Push((timer_.GetUSec(false) - frameBegin_) / 1000.0f);
+    fixedUpdateTotal_ += fixedUpdateTime_ / 1000.0;
+    physicsTotal_ += physicsTime_ / 1000.0;
+    animationTotal_ += animationTime_ / 1000.0;
+}
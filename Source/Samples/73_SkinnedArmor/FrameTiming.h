@@ -0,0 +1,122 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#pragma once
+
+#include <Urho3D/Core/Object.h>
+#include <Urho3D/Core/Timer.h>
+
+using namespace Urho3D;
+namespace Urho3D
+{
+class Scene;
+}
+
+class FrameTiming;
+
+//=============================================================================
+// timing probe that has to run after the characters' handlers of an event.
+// Urho calls the receivers of a sender in subscription order, so subscribing
+// it after the characters are spawned places it behind every character.
+//=============================================================================
+class FrameTimingProbe : public Object
+{
+    URHO3D_OBJECT(FrameTimingProbe, Object);
+
+public:
+    /// Construct.
+    FrameTimingProbe(Context* context, FrameTiming *owner);
+
+    /// Subscribe to the end of the fixed update and animation controller passes.
+    void Subscribe(Scene *scene);
+
+private:
+    void HandleFixedUpdateEnd(StringHash eventType, VariantMap& eventData);
+    void HandleAnimationEnd(StringHash eventType, VariantMap& eventData);
+
+    FrameTiming *owner_;
+};
+
+//=============================================================================
+// frame timing of a headless run: frame time percentiles plus the time spent
+// in Character::FixedUpdate, physics and animation. Optionally runs the
+// engine unthrottled at a fixed timestep, so runs are repeatable.
+//=============================================================================
+class FrameTiming : public Object
+{
+    URHO3D_OBJECT(FrameTiming, Object);
+
+public:
+    /// Construct. Must be created before the characters are spawned, see FrameTimingProbe.
+    FrameTiming(Context* context, Scene *scene);
+    virtual ~FrameTiming();
+
+    /// Start timing after the characters have been spawned. The first warmupFrames frames are not measured.
+    void Start(unsigned warmupFrames, float fixedTimeStep = 0.0f);
+    /// Stop timing.
+    void Stop();
+
+    /// Return number of frames run.
+    unsigned GetFrameNumber() const { return frame_; }
+    /// Return number of measured frames.
+    unsigned GetNumMeasuredFrames() const { return frameTimes_.Size(); }
+    /// Return CSV header of the timing columns.
+    static const char* GetCsvHeader();
+    /// Return CSV timing columns: frame time percentiles and per-frame phase times in msec.
+    String GetCsvValues() const;
+
+    /// Timing marks from the probe.
+    void MarkFixedUpdateEnd();
+    void MarkAnimationEnd();
+
+private:
+    void HandleBeginFrame(StringHash eventType, VariantMap& eventData);
+    void HandleFixedUpdateBegin(StringHash eventType, VariantMap& eventData);
+    void HandlePhysicsPostStep(StringHash eventType, VariantMap& eventData);
+    void HandleAnimationBegin(StringHash eventType, VariantMap& eventData);
+    void HandlePostUpdate(StringHash eventType, VariantMap& eventData);
+    void HandlePostRenderUpdate(StringHash eventType, VariantMap& eventData);
+    void HandleEndFrame(StringHash eventType, VariantMap& eventData);
+
+    WeakPtr<Scene>              scene_;
+    SharedPtr<FrameTimingProbe> probe_;
+
+    HiresTimer timer_;
+    unsigned   frame_;
+    unsigned   warmupFrames_;
+    float      fixedTimeStep_;
+
+    // timestamps and per-frame sums, usec
+    long long frameBegin_;
+    long long fixedUpdateBegin_;
+    long long physicsBegin_;
+    long long animationBegin_;
+    long long fixedUpdateTime_;
+    long long physicsTime_;
+    long long animationTime_;
+
+    // measured frames, msec
+    PODVector<float> frameTimes_;
+    double           fixedUpdateTotal_;
+    double           physicsTotal_;
+    double           animationTotal_;
+};
@@ -0,0 +1,454 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Graphics/IndexBuffer.h>
+#include <Urho3D/Graphics/Model.h>
+#include <Urho3D/Graphics/VertexBuffer.h>
+
+#include "GeometryUtils.h"
+
+#include <Urho3D/DebugNew.h>
+//=============================================================================
+//=============================================================================
+unsigned GeometryData::GetElementOffset(VertexElementSemantic semantic, unsigned char index) const
+{
+    for (unsigned i = 0; i < elements_.Size(); ++i)
+    {
+        if (elements_[i].semantic_ == semantic && elements_[i].index_ == index)
+        {
+            return elements_[i].offset_;
+        }
+    }
+
+    return M_MAX_UNSIGNED;
+}
+
+VertexElementType GeometryData::GetElementType(VertexElementSemantic semantic, unsigned char index) const
+{
+    for (unsigned i = 0; i < elements_.Size(); ++i)
+    {
+        if (elements_[i].semantic_ == semantic && elements_[i].index_ == index)
+        {
+            return elements_[i].type_;
+        }
+    }
+
+    return MAX_VERTEX_ELEMENT_TYPES;
+}
+
+bool GeometryData::HasSameLayout(const GeometryData &rhs) const
+{
+    if (vertexSize_ != rhs.vertexSize_ || elements_.Size() != rhs.elements_.Size() || primitiveType_ != rhs.primitiveType_)
+    {
+        return false;
+    }
+
+    for (unsigned i = 0; i < elements_.Size(); ++i)
+    {
+        if (elements_[i] != rhs.elements_[i])
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+//=============================================================================
+//=============================================================================
+bool ExtractGeometryData(Geometry *geometry, const PODVector<unsigned> &boneMapping, GeometryData &dest)
+{
+    if (!geometry || geometry->GetNumVertexBuffers() != 1)
+    {
+        return false;
+    }
+
+    VertexBuffer *vb = geometry->GetVertexBuffer(0);
+    IndexBuffer *ib = geometry->GetIndexBuffer();
+
+    if (!vb || !ib || !vb->GetShadowData() || !ib->GetShadowData())
+    {
+        return false;
+    }
+
+    // everything here reads positions as the leading float3
+    if (vb->GetElements().Empty() || vb->GetElements()[0].semantic_ != SEM_POSITION || vb->GetElements()[0].type_ != TYPE_VECTOR3)
+    {
+        return false;
+    }
+
+    const unsigned vertexStart = geometry->GetVertexStart();
+    const unsigned indexStart  = geometry->GetIndexStart();
+    const unsigned indexCount  = geometry->GetIndexCount();
+
+    dest.elements_      = vb->GetElements();
+    dest.vertexSize_    = vb->GetVertexSize();
+    dest.vertexCount_   = geometry->GetVertexCount();
+    dest.boneMapping_   = boneMapping;
+    dest.primitiveType_ = geometry->GetPrimitiveType();
+    dest.lodDistance_   = geometry->GetLodDistance();
+
+    dest.vertexData_.Resize(dest.vertexCount_ * dest.vertexSize_);
+    memcpy(dest.vertexData_.Buffer(), vb->GetShadowData() + vertexStart * dest.vertexSize_, dest.vertexData_.Size());
+
+    dest.indices_.Resize(indexCount);
+
+    if (ib->GetIndexSize() == sizeof(unsigned))
+    {
+        const unsigned *indices = reinterpret_cast<const unsigned*>(ib->GetShadowData()) + indexStart;
+
+        for (unsigned i = 0; i < indexCount; ++i)
+        {
+            dest.indices_[i] = indices[i] - vertexStart;
+        }
+    }
+    else
+    {
+        const unsigned short *indices = reinterpret_cast<const unsigned short*>(ib->GetShadowData()) + indexStart;
+
+        for (unsigned i = 0; i < indexCount; ++i)
+        {
+            dest.indices_[i] = indices[i] - vertexStart;
+        }
+    }
+
+    return true;
+}
+
+SharedPtr<Geometry> CreateGeometry(Context *context, const GeometryData &src)
+{
+    SharedPtr<VertexBuffer> vb(new VertexBuffer(context));
+    vb->SetShadowed(true);
+    vb->SetSize(src.vertexCount_, src.elements_);
+    vb->SetData(src.vertexData_.Buffer());
+
+    const bool largeIndices = src.vertexCount_ > 0xffff;
+
+    SharedPtr<IndexBuffer> ib(new IndexBuffer(context));
+    ib->SetShadowed(true);
+    ib->SetSize(src.indices_.Size(), largeIndices);
+
+    if (largeIndices)
+    {
+        ib->SetData(src.indices_.Buffer());
+    }
+    else
+    {
+        PODVector<unsigned short> shortIndices(src.indices_.Size());
+
+        for (unsigned i = 0; i < src.indices_.Size(); ++i)
+        {
+            shortIndices[i] = (unsigned short)src.indices_[i];
+        }
+        ib->SetData(shortIndices.Buffer());
+    }
+
+    SharedPtr<Geometry> geometry(new Geometry(context));
+    geometry->SetVertexBuffer(0, vb);
+    geometry->SetIndexBuffer(ib);
+    geometry->SetDrawRange(src.primitiveType_, 0, src.indices_.Size());
+    geometry->SetLodDistance(src.lodDistance_);
+
+    return geometry;
+}
+
+void CreateGeometries(Context *context, const PODVector<const GeometryData*> &datas, Vector<SharedPtr<Geometry> > &dest)
+{
+    dest.Clear();
+
+    if (datas.Empty())
+    {
+        return;
+    }
+
+    bool sameLayout = true;
+    unsigned totalVertices = 0;
+    unsigned totalIndices = 0;
+
+    for (unsigned i = 0; i < datas.Size(); ++i)
+    {
+        sameLayout &= datas[i]->HasSameLayout(*datas[0]);
+        totalVertices += datas[i]->vertexCount_;
+        totalIndices += datas[i]->indices_.Size();
+    }
+
+    if (!sameLayout)
+    {
+        for (unsigned i = 0; i < datas.Size(); ++i)
+        {
+            dest.Push(CreateGeometry(context, *datas[i]));
+        }
+        return;
+    }
+
+    // pack back to back into shared buffers
+    const GeometryData &first = *datas[0];
+    const bool largeIndices = totalVertices > 0xffff;
+    PODVector<unsigned char> vertexData;
+    PODVector<unsigned char> indexData(totalIndices * (largeIndices ? sizeof(unsigned) : sizeof(unsigned short)));
+    unsigned vertexStart = 0;
+    unsigned indexStart = 0;
+
+    vertexData.Reserve(totalVertices * first.vertexSize_);
+
+    SharedPtr<VertexBuffer> vb(new VertexBuffer(context));
+    SharedPtr<IndexBuffer> ib(new IndexBuffer(context));
+
+    for (unsigned i = 0; i < datas.Size(); ++i)
+    {
+        const GeometryData &data = *datas[i];
+
+        vertexData.Push(data.vertexData_);
+
+        for (unsigned j = 0; j < data.indices_.Size(); ++j)
+        {
+            if (largeIndices)
+            {
+                reinterpret_cast<unsigned*>(indexData.Buffer())[indexStart + j] = data.indices_[j] + vertexStart;
+            }
+            else
+            {
+                reinterpret_cast<unsigned short*>(indexData.Buffer())[indexStart + j] = (unsigned short)(data.indices_[j] + vertexStart);
+            }
+        }
+
+        SharedPtr<Geometry> geometry(new Geometry(context));
+        geometry->SetVertexBuffer(0, vb);
+        geometry->SetIndexBuffer(ib);
+        geometry->SetLodDistance(data.lodDistance_);
+        dest.Push(geometry);
+
+        vertexStart += data.vertexCount_;
+        indexStart += data.indices_.Size();
+    }
+
+    vb->SetShadowed(true);
+    vb->SetSize(totalVertices, first.elements_);
+    vb->SetData(vertexData.Buffer());
+
+    ib->SetShadowed(true);
+    ib->SetSize(totalIndices, largeIndices);
+    ib->SetData(indexData.Buffer());
+
+    // draw ranges once the buffers have their size
+    vertexStart = 0;
+    indexStart = 0;
+
+    for (unsigned i = 0; i < datas.Size(); ++i)
+    {
+        dest[i]->SetDrawRange(datas[i]->primitiveType_, indexStart, datas[i]->indices_.Size(), vertexStart, datas[i]->vertexCount_);
+
+        vertexStart += datas[i]->vertexCount_;
+        indexStart += datas[i]->indices_.Size();
+    }
+}
+
+SharedPtr<Model> CreateModel(Context *context, Model *source, const Vector<Vector<GeometryData> > &geometries)
+{
+    SharedPtr<Model> model(new Model(context));
+    PODVector<const GeometryData*> datas;
+    Vector<SharedPtr<Geometry> > created;
+    Vector<PODVector<unsigned> > boneMappings;
+
+    for (unsigned i = 0; i < geometries.Size(); ++i)
+    {
+        for (unsigned j = 0; j < geometries[i].Size(); ++j)
+        {
+            datas.Push(&geometries[i][j]);
+        }
+    }
+
+    CreateGeometries(context, datas, created);
+
+    model->SetSkeleton(source->GetSkeleton());
+    model->SetBoundingBox(source->GetBoundingBox());
+    model->SetNumGeometries(geometries.Size());
+
+    unsigned geometryIndex = 0;
+    unsigned memoryUse = sizeof(Model);
+
+    for (unsigned i = 0; i < geometries.Size(); ++i)
+    {
+        model->SetNumGeometryLodLevels(i, geometries[i].Size());
+
+        for (unsigned j = 0; j < geometries[i].Size(); ++j)
+        {
+            model->SetGeometry(i, j, created[geometryIndex++]);
+            memoryUse += geometries[i][j].vertexData_.Size() + geometries[i][j].indices_.Size() * sizeof(unsigned short);
+        }
+
+        boneMappings.Push(geometries[i].Empty() ? PODVector<unsigned>() : geometries[i][0].boneMapping_);
+
+        if (i < source->GetNumGeometries())
+        {
+            model->SetGeometryCenter(i, source->GetGeometryCenter(i));
+        }
+    }
+
+    model->SetGeometryBoneMappings(boneMappings);
+    SetModelBuffers(model);
+    model->SetMemoryUse(memoryUse);
+
+    return model;
+}
+
+unsigned CompactVertices(GeometryData &data)
+{
+    PODVector<unsigned> remap(data.vertexCount_);
+
+    for (unsigned i = 0; i < data.vertexCount_; ++i)
+    {
+        remap[i] = M_MAX_UNSIGNED;
+    }
+
+    // new order follows first use, which also helps fetch locality
+    PODVector<unsigned char> vertexData;
+    unsigned vertexCount = 0;
+
+    vertexData.Reserve(data.vertexData_.Size());
+
+    for (unsigned i = 0; i < data.indices_.Size(); ++i)
+    {
+        const unsigned vertex = data.indices_[i];
+
+        if (remap[vertex] == M_MAX_UNSIGNED)
+        {
+            remap[vertex] = vertexCount++;
+            vertexData.Resize(vertexCount * data.vertexSize_);
+            memcpy(&vertexData[(vertexCount - 1) * data.vertexSize_], data.GetVertex(vertex), data.vertexSize_);
+        }
+        data.indices_[i] = remap[vertex];
+    }
+
+    const unsigned removed = data.vertexCount_ - vertexCount;
+
+    data.vertexData_ = vertexData;
+    data.vertexCount_ = vertexCount;
+
+    return removed;
+}
+
+void ReadBlendWeights(const unsigned char *src, VertexElementType type, float *weights)
+{
+    if (type == TYPE_UBYTE4_NORM)
+    {
+        for (unsigned i = 0; i < 4; ++i)
+        {
+            weights[i] = src[i] / 255.0f;
+        }
+    }
+    else
+    {
+        memcpy(weights, src, 4 * sizeof(float));
+    }
+}
+
+void CollectUsedBones(const GeometryData &data, PODVector<unsigned> &bones)
+{
+    const unsigned weightsOffset = data.GetElementOffset(SEM_BLENDWEIGHTS);
+    const VertexElementType weightsType = data.GetElementType(SEM_BLENDWEIGHTS);
+    const unsigned indicesOffset = data.GetElementOffset(SEM_BLENDINDICES);
+
+    if (weightsOffset == M_MAX_UNSIGNED || indicesOffset == M_MAX_UNSIGNED)
+    {
+        return;
+    }
+
+    for (unsigned i = 0; i < data.vertexCount_; ++i)
+    {
+        const unsigned char *vertex = data.GetVertex(i);
+        float weights[4];
+        ReadBlendWeights(vertex + weightsOffset, weightsType, weights);
+        const unsigned char *blendIndices = vertex + indicesOffset;
+
+        for (unsigned j = 0; j < 4; ++j)
+        {
+            if (weights[j] > 0.0f)
+            {
+                const unsigned bone = data.GetGlobalBone(blendIndices[j]);
+
+                if (!bones.Contains(bone))
+                {
+                    bones.Push(bone);
+                }
+            }
+        }
+    }
+}
+
+void SetModelBuffers(Model *model, Model *morphSource)
+{
+    Vector<SharedPtr<VertexBuffer> > vertexBuffers;
+    Vector<SharedPtr<IndexBuffer> > indexBuffers;
+    PODVector<unsigned> morphRangeStarts;
+    PODVector<unsigned> morphRangeCounts;
+
+    if (morphSource)
+    {
+        const Vector<SharedPtr<VertexBuffer> > &sourceBuffers = morphSource->GetVertexBuffers();
+
+        for (unsigned i = 0; i < sourceBuffers.Size(); ++i)
+        {
+            vertexBuffers.Push(sourceBuffers[i]);
+            morphRangeStarts.Push(morphSource->GetMorphRangeStart(i));
+            morphRangeCounts.Push(morphSource->GetMorphRangeCount(i));
+        }
+    }
+
+    for (unsigned i = 0; i < model->GetNumGeometries(); ++i)
+    {
+        for (unsigned j = 0; j < model->GetNumGeometryLodLevels(i); ++j)
+        {
+            Geometry *geometry = model->GetGeometry(i, j);
+
+            if (!geometry)
+            {
+                continue;
+            }
+
+            for (unsigned k = 0; k < geometry->GetNumVertexBuffers(); ++k)
+            {
+                SharedPtr<VertexBuffer> vb(geometry->GetVertexBuffer(k));
+
+                if (vb && !vertexBuffers.Contains(vb))
+                {
+                    vertexBuffers.Push(vb);
+                    morphRangeStarts.Push(0);
+                    morphRangeCounts.Push(0);
+                }
+            }
+
+            SharedPtr<IndexBuffer> ib(geometry->GetIndexBuffer());
+
+            if (ib && !indexBuffers.Contains(ib))
+            {
+                indexBuffers.Push(ib);
+            }
+        }
+    }
+
+    model->SetVertexBuffers(vertexBuffers, morphRangeStarts, morphRangeCounts);
+    model->SetIndexBuffers(indexBuffers);
+}
+
@@ -0,0 +1,87 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#pragma once
+
+#include <Urho3D/Graphics/GraphicsDefs.h>
+#include <Urho3D/Graphics/Geometry.h>
+#include <Urho3D/Math/Vector3.h>
+
+using namespace Urho3D;
+namespace Urho3D
+{
+class Model;
+}
+
+//=============================================================================
+// CPU copy of a geometry's used vertex range and its indices, rebased to the
+// start of the range. Tools and load-time passes edit this and build new
+// shadowed buffers from it.
+//=============================================================================
+struct GeometryData
+{
+    GeometryData() : vertexSize_(0), vertexCount_(0), primitiveType_(TRIANGLE_LIST), lodDistance_(0.0f) {}
+
+    /// Return element offset within a vertex, or M_MAX_UNSIGNED if missing.
+    unsigned GetElementOffset(VertexElementSemantic semantic, unsigned char index = 0) const;
+    /// Return element type, or MAX_VERTEX_ELEMENT_TYPES if missing.
+    VertexElementType GetElementType(VertexElementSemantic semantic, unsigned char index = 0) const;
+    /// Return whether the layout matches another geometry's.
+    bool HasSameLayout(const GeometryData &rhs) const;
+
+    /// Return vertex start address.
+    unsigned char* GetVertex(unsigned vertex) { return &vertexData_[vertex * vertexSize_]; }
+    const unsigned char* GetVertex(unsigned vertex) const { return &vertexData_[vertex * vertexSize_]; }
+    /// Return position of a vertex.
+    const Vector3& GetPosition(unsigned vertex) const { return *reinterpret_cast<const Vector3*>(GetVertex(vertex)); }
+
+    /// Return global skeleton bone for a blend index.
+    unsigned GetGlobalBone(unsigned blendIndex) const { return boneMapping_.Empty() ? blendIndex : boneMapping_[blendIndex]; }
+
+    PODVector<VertexElement> elements_;
+    unsigned                 vertexSize_;
+    unsigned                 vertexCount_;
+    PODVector<unsigned char> vertexData_;
+    PODVector<unsigned>      indices_;
+    PODVector<unsigned>      boneMapping_;
+    PrimitiveType            primitiveType_;
+    float                    lodDistance_;
+};
+
+/// Copy a geometry into CPU data. Needs shadowed buffers and a single vertex buffer with position first.
+bool ExtractGeometryData(Geometry *geometry, const PODVector<unsigned> &boneMapping, GeometryData &dest);
+/// Create a geometry with its own shadowed vertex and index buffers.
+SharedPtr<Geometry> CreateGeometry(Context *context, const GeometryData &src);
+/// Create geometries that share one vertex and index buffer when their layouts match, as exported models do.
+void CreateGeometries(Context *context, const PODVector<const GeometryData*> &datas, Vector<SharedPtr<Geometry> > &dest);
+/// Create a model from lod data per geometry, keeping the source model's skeleton, bounds and geometry centers.
+SharedPtr<Model> CreateModel(Context *context, Model *source, const Vector<Vector<GeometryData> > &geometries);
+/// Drop vertices no index refers to. Returns the number of vertices removed.
+unsigned CompactVertices(GeometryData &data);
+/// Read four blend weights stored as floats or normalized bytes.
+void ReadBlendWeights(const unsigned char *src, VertexElementType type, float *weights);
+/// Append global bones referenced by weighted vertices to the list, skipping ones already in it.
+void CollectUsedBones(const GeometryData &data, PODVector<unsigned> &bones);
+/// Register the buffers referenced by the model's geometries. Morph ranges are kept for buffers of the morph source.
+void SetModelBuffers(Model *model, Model *morphSource = NULL);
+
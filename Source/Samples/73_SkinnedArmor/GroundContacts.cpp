@@ -0,0 +1,198 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Physics/PhysicsEvents.h>
+#include <Urho3D/Physics/PhysicsUtils.h>
+#include <Urho3D/Physics/PhysicsWorld.h>
+#include <Urho3D/Physics/RigidBody.h>
+#include <Urho3D/Scene/Scene.h>
+
+#include <Bullet/BulletCollision/BroadphaseCollision/btDispatcher.h>
+#include <Bullet/BulletCollision/NarrowPhaseCollision/btPersistentManifold.h>
+#include <Bullet/BulletDynamics/Dynamics/btDiscreteDynamicsWorld.h>
+
+#include "GroundContacts.h"
+#include "Character.h"
+
+#include <Urho3D/DebugNew.h>
+//=============================================================================
+//=============================================================================
+GroundContactQuery::GroundContactQuery(Context* context) :
+    Component(context)
+{
+}
+
+GroundContactQuery::~GroundContactQuery()
+{
+    for (unsigned i = 0; i < characters_.Size(); ++i)
+    {
+        if (characters_[i])
+        {
+            characters_[i]->SetGroundContactQuery(NULL);
+        }
+    }
+}
+
+void GroundContactQuery::RegisterObject(Context* context)
+{
+    context->RegisterFactory<GroundContactQuery>();
+}
+
+void GroundContactQuery::OnSceneSet(Scene* scene)
+{
+    PhysicsWorld *physicsWorld = scene ? scene->GetComponent<PhysicsWorld>() : NULL;
+
+    physicsWorld_ = physicsWorld;
+
+    if (physicsWorld)
+        SubscribeToEvent(physicsWorld, E_PHYSICSPOSTSTEP, URHO3D_HANDLER(GroundContactQuery, HandlePhysicsPostStep));
+    else
+        UnsubscribeFromEvent(E_PHYSICSPOSTSTEP);
+}
+
+void GroundContactQuery::AddCharacter(Character *character)
+{
+    if (!character || !character->body_ || character->groundContactQuery_ == this)
+    {
+        return;
+    }
+
+    // append a slot; only removals shift the slots and need a full rebuild
+    slots_[character->body_.Get()] = characters_.Size();
+    characters_.Push(WeakPtr<Character>(character));
+    contactHeights_.Push(0.0f);
+    onGround_.Push(false);
+    groundNormals_.Push(Vector3::ZERO);
+
+    character->SetGroundContactQuery(this);
+}
+
+void GroundContactQuery::RemoveCharacter(Character *character)
+{
+    if (characters_.Remove(WeakPtr<Character>(character)))
+    {
+        character->SetGroundContactQuery(NULL);
+        RebuildSlots();
+    }
+}
+
+void GroundContactQuery::RebuildSlots()
+{
+    // drop destroyed characters
+    for (unsigned i = 0; i < characters_.Size();)
+    {
+        if (characters_[i] && characters_[i]->body_)
+            ++i;
+        else
+            characters_.Erase(i);
+    }
+
+    slots_.Clear();
+
+    for (unsigned i = 0; i < characters_.Size(); ++i)
+    {
+        slots_[characters_[i]->body_.Get()] = i;
+    }
+
+    contactHeights_.Resize(characters_.Size());
+    onGround_.Resize(characters_.Size());
+    groundNormals_.Resize(characters_.Size());
+}
+
+void GroundContactQuery::HandlePhysicsPostStep(StringHash eventType, VariantMap& eventData)
+{
+    if (!physicsWorld_ || !physicsWorld_->GetWorld())
+    {
+        return;
+    }
+
+    // reallocates only when a character was destroyed since the last step
+    for (unsigned i = 0; i < characters_.Size(); ++i)
+    {
+        if (!characters_[i] || !characters_[i]->body_)
+        {
+            RebuildSlots();
+            break;
+        }
+    }
+
+    const unsigned numCharacters = characters_.Size();
+
+    for (unsigned i = 0; i < numCharacters; ++i)
+    {
+        // contacts below the node center count, same as the collision event path
+        contactHeights_[i] = characters_[i]->GetNode()->GetPosition().y_ + 1.0f;
+        onGround_[i] = false;
+        groundNormals_[i] = Vector3::ZERO;
+    }
+
+    btDispatcher *dispatcher = physicsWorld_->GetWorld()->getDispatcher();
+    const int numManifolds = dispatcher->getNumManifolds();
+
+    for (int i = 0; i < numManifolds; ++i)
+    {
+        btPersistentManifold *manifold = dispatcher->getManifoldByIndexInternal(i);
+        const int numContacts = manifold->getNumContacts();
+
+        if (!numContacts)
+            continue;
+
+        // Bullet's normal points from B to A: toward the character when it is body A, away from it when it is body B
+        for (unsigned side = 0; side < 2; ++side)
+        {
+            const btCollisionObject *object = side ? manifold->getBody1() : manifold->getBody0();
+            HashMap<RigidBody*, unsigned>::ConstIterator slot = slots_.Find(static_cast<RigidBody*>(object->getUserPointer()));
+
+            if (slot == slots_.End())
+                continue;
+
+            const unsigned index = slot->second_;
+            const float normalSign = side ? -1.0f : 1.0f;
+
+            for (int j = 0; j < numContacts; ++j)
+            {
+                const btManifoldPoint &point = manifold->getContactPoint(j);
+                const Vector3 contactNormal = ToVector3(point.m_normalWorldOnB) * normalSign;
+
+                // If contact is below node center and pointing up, assume it's a ground contact
+                if (point.m_positionWorldOnB.y() < contactHeights_[index] && contactNormal.y_ > 0.75f)
+                {
+                    if (!onGround_[index] || contactNormal.y_ > groundNormals_[index].y_)
+                    {
+                        groundNormals_[index] = contactNormal;
+                    }
+                    onGround_[index] = true;
+                }
+            }
+        }
+    }
+
+    for (unsigned i = 0; i < numCharacters; ++i)
+    {
+        if (onGround_[i])
+        {
+            characters_[i]->SetGroundContact(groundNormals_[i]);
+        }
+    }
+}
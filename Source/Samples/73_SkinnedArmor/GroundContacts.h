@@ -0,0 +1,80 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#pragma once
+
+#include <Urho3D/Container/HashMap.h>
+#include <Urho3D/Scene/Component.h>
+
+using namespace Urho3D;
+namespace Urho3D
+{
+class PhysicsWorld;
+class RigidBody;
+}
+
+class Character;
+
+//=============================================================================
+// ground detection from the Bullet contact manifolds. After every physics
+// step it walks the dispatcher's manifolds once, picks the contacts of the
+// registered characters' bodies, and sets their grounded flag and the best
+// (most upward) ground normal. Same test as the collision event path, but no
+// collision events, VariantMaps or contact buffers are created for the
+// characters, and a step allocates nothing.
+//=============================================================================
+class GroundContactQuery : public Component
+{
+    URHO3D_OBJECT(GroundContactQuery, Component);
+
+public:
+    /// Construct.
+    GroundContactQuery(Context* context);
+    virtual ~GroundContactQuery();
+
+    /// Register object factory.
+    static void RegisterObject(Context* context);
+
+    /// Add a character. Its body then sends no collision events.
+    void AddCharacter(Character *character);
+    /// Remove a character.
+    void RemoveCharacter(Character *character);
+
+protected:
+    /// Handle scene being assigned.
+    virtual void OnSceneSet(Scene* scene);
+
+private:
+    void HandlePhysicsPostStep(StringHash eventType, VariantMap& eventData);
+    void RebuildSlots();
+
+    Vector<WeakPtr<Character> > characters_;
+    /// Character index by body.
+    HashMap<RigidBody*, unsigned> slots_;
+    /// Per character: height below which a contact can be ground, ground found and best normal in the step.
+    PODVector<float> contactHeights_;
+    PODVector<bool> onGround_;
+    PODVector<Vector3> groundNormals_;
+
+    WeakPtr<PhysicsWorld> physicsWorld_;
+};
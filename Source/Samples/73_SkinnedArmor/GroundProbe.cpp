@@ -0,0 +1,296 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Core/WorkQueue.h>
+#include <Urho3D/Physics/PhysicsUtils.h>
+#include <Urho3D/Physics/RigidBody.h>
+
+#include <Bullet/BulletCollision/BroadphaseCollision/btBroadphaseInterface.h>
+#include <Bullet/BulletDynamics/Dynamics/btDiscreteDynamicsWorld.h>
+
+#include "GroundProbe.h"
+
+#include <Urho3D/DebugNew.h>
+//=============================================================================
+//=============================================================================
+/// Probes per work item. Smaller batches are cast on the main thread.
+const unsigned GROUND_PROBE_WORK_BATCH = 32;
+/// Largest XZ distance from the previous probe at which its result is reused.
+const float GROUND_PROBE_REUSE_DISTANCE = 0.05f;
+/// Number of steps a probe result is reused for before it is cast again.
+const unsigned GROUND_PROBE_MAX_REUSE_STEPS = 8;
+
+//=============================================================================
+// narrow phase of a ray cast against the broadphase proxies overlapping the
+// ray's bounding box. Same per-object test as btCollisionWorld::rayTest, but
+// the box query keeps its traversal stack local, where the broadphase ray
+// test shares one, so probes can be cast from several threads at once.
+//=============================================================================
+struct GroundProbeRayTester : public btBroadphaseAabbCallback
+{
+    GroundProbeRayTester(const btVector3 &from, const btVector3 &to, btCollisionWorld::RayResultCallback &resultCallback) :
+        resultCallback_(resultCallback)
+    {
+        rayFromTrans_.setIdentity();
+        rayFromTrans_.setOrigin(from);
+        rayToTrans_.setIdentity();
+        rayToTrans_.setOrigin(to);
+    }
+
+    virtual bool process(const btBroadphaseProxy* proxy)
+    {
+        // terminate further ray tests once the closest hit fraction reached zero
+        if (resultCallback_.m_closestHitFraction == btScalar(0.0f))
+            return false;
+
+        btCollisionObject *collisionObject = (btCollisionObject*)proxy->m_clientObject;
+
+        if (resultCallback_.needsCollision(collisionObject->getBroadphaseHandle()))
+        {
+            btCollisionWorld::rayTestSingle(rayFromTrans_, rayToTrans_, collisionObject, collisionObject->getCollisionShape(),
+                                            collisionObject->getWorldTransform(), resultCallback_);
+        }
+        return true;
+    }
+
+    btTransform rayFromTrans_;
+    btTransform rayToTrans_;
+    btCollisionWorld::RayResultCallback &resultCallback_;
+};
+
+//=============================================================================
+//=============================================================================
+GroundProbeBatch::GroundProbeBatch(Context* context) :
+    Object(context),
+    maxDistance_(0.0f),
+    collisionMask_(0),
+    step_(0),
+    numReused_(0)
+{
+}
+
+void GroundProbeBatch::Begin(unsigned numSlots)
+{
+    const unsigned oldSize = cache_.Size();
+
+    if (numSlots != oldSize)
+    {
+        cache_.Resize(numSlots);
+        results_.Resize(numSlots);
+        resultBodies_.Resize(numSlots);
+
+        for (unsigned i = oldSize; i < numSlots; ++i)
+        {
+            cache_[i].valid_ = false;
+        }
+    }
+
+    requests_.Clear();
+    numReused_ = 0;
+    ++step_;
+}
+
+void GroundProbeBatch::InvalidateCache()
+{
+    for (unsigned i = 0; i < cache_.Size(); ++i)
+    {
+        cache_[i].valid_ = false;
+    }
+}
+
+void GroundProbeBatch::Submit(unsigned slot, const Vector3 &origin)
+{
+    Request request;
+    request.slot_ = slot;
+    request.origin_ = origin;
+    request.body_ = NULL;
+    requests_.Push(request);
+}
+
+void GroundProbeBatch::Resolve(PhysicsWorld *physicsWorld, float maxDistance, unsigned collisionMask)
+{
+    if (physicsWorld != physicsWorld_ || maxDistance != maxDistance_ || collisionMask != collisionMask_)
+    {
+        InvalidateCache();
+        physicsWorld_ = physicsWorld;
+        maxDistance_ = maxDistance;
+        collisionMask_ = collisionMask;
+    }
+
+    if (!physicsWorld || !physicsWorld->GetWorld())
+    {
+        requests_.Clear();
+        return;
+    }
+
+    // keep only the probes that have to be cast
+    unsigned numCast = 0;
+
+    for (unsigned i = 0; i < requests_.Size(); ++i)
+    {
+        if (ReuseCached(requests_[i]))
+            ++numReused_;
+        else
+            requests_[numCast++] = requests_[i];
+    }
+
+    requests_.Resize(numCast);
+
+    if (!numCast)
+    {
+        return;
+    }
+
+    WorkQueue *queue = GetSubsystem<WorkQueue>();
+
+    if (!queue || !queue->GetNumThreads() || numCast <= GROUND_PROBE_WORK_BATCH)
+    {
+        CastProbes(0, numCast);
+    }
+    else
+    {
+        for (unsigned begin = 0; begin < numCast; begin += GROUND_PROBE_WORK_BATCH)
+        {
+            SharedPtr<WorkItem> item = queue->GetFreeItem();
+            item->priority_ = M_MAX_UNSIGNED;
+            item->workFunction_ = CastProbesWork;
+            item->aux_ = this;
+            item->start_ = (void*)(size_t)begin;
+            item->end_ = (void*)(size_t)Min(begin + GROUND_PROBE_WORK_BATCH, numCast);
+            queue->AddWorkItem(item);
+        }
+
+        queue->Complete(M_MAX_UNSIGNED);
+    }
+
+    // store the results, the weak body references are taken on the main thread
+    for (unsigned i = 0; i < numCast; ++i)
+    {
+        const Request &request = requests_[i];
+        PhysicsRaycastResult &result = results_[request.slot_];
+        CachedProbe &cached = cache_[request.slot_];
+
+        result.position_ = request.position_;
+        result.normal_ = request.normal_;
+        result.distance_ = request.distance_;
+        result.body_ = request.body_;
+        resultBodies_[request.slot_] = request.body_;
+
+        // only a hit on something that can't move, or no hit at all, stays valid while the agent hasn't moved
+        cached.origin_ = request.origin_;
+        cached.step_ = step_;
+        cached.valid_ = true;
+        cached.reusable_ = !request.body_ || (request.body_->GetMass() == 0.0f && !request.body_->IsKinematic());
+    }
+}
+
+bool GroundProbeBatch::ReuseCached(const Request &request)
+{
+    const CachedProbe &cached = cache_[request.slot_];
+
+    if (!cached.valid_ || !cached.reusable_ || step_ - cached.step_ > GROUND_PROBE_MAX_REUSE_STEPS)
+    {
+        return false;
+    }
+
+    const float dx = request.origin_.x_ - cached.origin_.x_;
+    const float dz = request.origin_.z_ - cached.origin_.z_;
+
+    if (dx * dx + dz * dz > GROUND_PROBE_REUSE_DISTANCE * GROUND_PROBE_REUSE_DISTANCE)
+    {
+        return false;
+    }
+
+    PhysicsRaycastResult &result = results_[request.slot_];
+
+    if (result.body_)
+    {
+        // the same surface below, only the height above it changed
+        const float distance = request.origin_.y_ - result.position_.y_;
+
+        if (!resultBodies_[request.slot_] || distance < 0.0f || distance > maxDistance_)
+        {
+            return false;
+        }
+
+        result.position_.x_ = request.origin_.x_;
+        result.position_.z_ = request.origin_.z_;
+        result.distance_ = distance;
+    }
+    else if (request.origin_.y_ < cached.origin_.y_)
+    {
+        // nothing was below the old probe, but this one reaches further down
+        return false;
+    }
+
+    return true;
+}
+
+void GroundProbeBatch::CastProbes(unsigned begin, unsigned end)
+{
+    btDiscreteDynamicsWorld *world = physicsWorld_->GetWorld();
+    btBroadphaseInterface *broadphase = world->getBroadphase();
+
+    for (unsigned i = begin; i < end; ++i)
+    {
+        Request &request = requests_[i];
+
+        // same ray setup and filtering as PhysicsWorld::RaycastSingle
+        const btVector3 from = ToBtVector3(request.origin_);
+        const btVector3 to = ToBtVector3(request.origin_ + Vector3::DOWN * maxDistance_);
+        btCollisionWorld::ClosestRayResultCallback rayCallback(from, to);
+        rayCallback.m_collisionFilterGroup = (short)0xffff;
+        rayCallback.m_collisionFilterMask = (short)collisionMask_;
+
+        btVector3 aabbMin = from;
+        btVector3 aabbMax = from;
+        aabbMin.setMin(to);
+        aabbMax.setMax(to);
+
+        GroundProbeRayTester rayTester(from, to, rayCallback);
+        broadphase->aabbTest(aabbMin, aabbMax, rayTester);
+
+        if (rayCallback.hasHit())
+        {
+            request.position_ = ToVector3(rayCallback.m_hitPointWorld);
+            request.normal_ = ToVector3(rayCallback.m_hitNormalWorld);
+            request.distance_ = (request.position_ - request.origin_).Length();
+            request.body_ = static_cast<RigidBody*>(rayCallback.m_collisionObject->getUserPointer());
+        }
+        else
+        {
+            request.position_ = Vector3::ZERO;
+            request.normal_ = Vector3::ZERO;
+            request.distance_ = M_INFINITY;
+            request.body_ = NULL;
+        }
+    }
+}
+
+void GroundProbeBatch::CastProbesWork(const WorkItem* item, unsigned threadIndex)
+{
+    GroundProbeBatch *batch = static_cast<GroundProbeBatch*>(item->aux_);
+
+    batch->CastProbes((unsigned)(size_t)item->start_, (unsigned)(size_t)item->end_);
+}
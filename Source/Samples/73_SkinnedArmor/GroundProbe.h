@@ -0,0 +1,105 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#pragma once
+
+#include <Urho3D/Core/Object.h>
+#include <Urho3D/Physics/PhysicsWorld.h>
+
+using namespace Urho3D;
+namespace Urho3D
+{
+struct WorkItem;
+}
+
+//=============================================================================
+// batched downward ground probes. Agents submit a probe from their position
+// during the fixed step, then Resolve() casts all of them together, spread
+// over the work queue's threads, and the results are read per agent slot.
+// A probe from (nearly) the same XZ position as an agent's previous probe
+// reuses that result for a few steps when it hit static geometry or nothing.
+//
+// The casts read the Bullet world only: resolve them while no bodies are
+// added, removed or moved, e.g. in the physics pre-step before any writes.
+//=============================================================================
+class GroundProbeBatch : public Object
+{
+    URHO3D_OBJECT(GroundProbeBatch, Object);
+
+public:
+    /// Construct.
+    GroundProbeBatch(Context* context);
+
+    /// Start a new batch for numSlots agents. New slots have no cached result.
+    void Begin(unsigned numSlots);
+    /// Drop all cached results, e.g. after agent slots have been reordered.
+    void InvalidateCache();
+    /// Submit a probe down from origin for an agent slot.
+    void Submit(unsigned slot, const Vector3 &origin);
+    /// Cast the submitted probes that could not reuse a cached result.
+    void Resolve(PhysicsWorld *physicsWorld, float maxDistance, unsigned collisionMask);
+
+    /// Return the result of the agent slot's last probe.
+    const PhysicsRaycastResult& GetResult(unsigned slot) const { return results_[slot]; }
+    /// Return number of probes cast in the last batch.
+    unsigned GetNumCast() const { return requests_.Size(); }
+    /// Return number of probes in the last batch that reused a cached result.
+    unsigned GetNumReused() const { return numReused_; }
+
+private:
+    /// Probe cast on a worker thread. Bodies are returned as raw pointers and stored on the main thread.
+    struct Request
+    {
+        unsigned slot_;
+        Vector3 origin_;
+        Vector3 position_;
+        Vector3 normal_;
+        float distance_;
+        RigidBody *body_;
+    };
+
+    /// Cached probe of an agent slot.
+    struct CachedProbe
+    {
+        Vector3 origin_;
+        unsigned step_;
+        bool valid_;
+        bool reusable_;
+    };
+
+    bool ReuseCached(const Request &request);
+    void CastProbes(unsigned begin, unsigned end);
+    static void CastProbesWork(const WorkItem* item, unsigned threadIndex);
+
+    /// Probes of the current batch. After Resolve() only the ones that were cast.
+    PODVector<Request> requests_;
+    PODVector<CachedProbe> cache_;
+    Vector<PhysicsRaycastResult> results_;
+    Vector<WeakPtr<RigidBody> > resultBodies_;
+
+    WeakPtr<PhysicsWorld> physicsWorld_;
+    float maxDistance_;
+    unsigned collisionMask_;
+    unsigned step_;
+    unsigned numReused_;
+};
@@ -0,0 +1,198 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Core/CoreEvents.h>
+#include <Urho3D/Scene/Node.h>
+
+#include "HitRegistry.h"
+
+#include <Urho3D/DebugNew.h>
+//=============================================================================
+//=============================================================================
+/// Initial recipient table size per attacker.
+const unsigned MIN_RECIPIENT_TABLE_SIZE = 16;
+
+static inline unsigned HashNodeID(unsigned nodeId)
+{
+    // Fibonacci hashing, a bijection on the low bits keeps sequential IDs apart
+    return nodeId * 2654435761u;
+}
+
+//=============================================================================
+//=============================================================================
+HitRegistry::HitRegistry(Context* context) :
+    Component(context)
+{
+}
+
+void HitRegistry::RegisterObject(Context* context)
+{
+    context->RegisterFactory<HitRegistry>();
+}
+
+void HitRegistry::OnSceneSet(Scene* scene)
+{
+    if (scene)
+        SubscribeToEvent(E_ENDFRAME, URHO3D_HANDLER(HitRegistry, HandleEndFrame));
+    else
+        UnsubscribeFromEvent(E_ENDFRAME);
+}
+
+unsigned HitRegistry::AddAttacker(Node *attacker)
+{
+    unsigned index;
+
+    if (freeAttackers_.Size())
+    {
+        index = freeAttackers_.Back();
+        freeAttackers_.Pop();
+    }
+    else
+    {
+        index = attackerIds_.Size();
+        attackerIds_.Push(0);
+        recipients_.Resize(index + 1);
+        numRecipients_.Push(0);
+    }
+
+    attackerIds_[index] = attacker ? attacker->GetID() : 0;
+    BeginSwing(index);
+
+    return index;
+}
+
+void HitRegistry::RemoveAttacker(unsigned attacker)
+{
+    if (attacker < attackerIds_.Size() && !freeAttackers_.Contains(attacker))
+    {
+        attackerIds_[attacker] = 0;
+        BeginSwing(attacker);
+        freeAttackers_.Push(attacker);
+    }
+}
+
+void HitRegistry::BeginSwing(unsigned attacker)
+{
+    if (attacker >= numRecipients_.Size() || !numRecipients_[attacker])
+    {
+        return;
+    }
+
+    PODVector<unsigned> &table = recipients_[attacker];
+    memset(table.Buffer(), 0, table.Size() * sizeof(unsigned));
+    numRecipients_[attacker] = 0;
+}
+
+bool HitRegistry::RegisterHit(unsigned attacker, Node *target, const Vector3 &position, const Vector3 &direction)
+{
+    if (!target || attacker >= attackerIds_.Size() || !InsertRecipient(attacker, target->GetID()))
+    {
+        return false;
+    }
+
+    HitRecord hit;
+    hit.attackerId_ = attackerIds_[attacker];
+    hit.targetId_ = target->GetID();
+    hit.position_ = position;
+    hit.direction_ = direction;
+    hits_.Push(hit);
+
+    return true;
+}
+
+void HitRegistry::SendHits()
+{
+    if (hits_.Empty())
+    {
+        return;
+    }
+
+    // hits registered by the receivers go into the next batch
+    sendHits_.Swap(hits_);
+    hits_.Clear();
+
+    using namespace WeaponHits;
+
+    VariantMap& eventData = GetEventDataMap();
+    eventData[P_HITS] = (void*)sendHits_.Buffer();
+    eventData[P_NUMHITS] = sendHits_.Size();
+
+    SendEvent(E_WEAPONHITS, eventData);
+}
+
+void HitRegistry::HandleEndFrame(StringHash eventType, VariantMap& eventData)
+{
+    SendHits();
+}
+
+bool HitRegistry::InsertRecipient(unsigned attacker, unsigned nodeId)
+{
+    PODVector<unsigned> &table = recipients_[attacker];
+
+    if (table.Size())
+    {
+        const unsigned mask = table.Size() - 1;
+
+        for (unsigned i = HashNodeID(nodeId) & mask; table[i]; i = (i + 1) & mask)
+        {
+            if (table[i] == nodeId)
+                return false;
+        }
+    }
+
+    // keep the table at most half full, so probe sequences stay short
+    unsigned &numRecipients = numRecipients_[attacker];
+
+    if ((numRecipients + 1) * 2 > table.Size())
+    {
+        PODVector<unsigned> grown(Max(table.Size() * 2, MIN_RECIPIENT_TABLE_SIZE));
+        memset(grown.Buffer(), 0, grown.Size() * sizeof(unsigned));
+
+        for (unsigned i = 0; i < table.Size(); ++i)
+        {
+            if (table[i])
+                InsertIntoTable(grown, table[i]);
+        }
+
+        table.Swap(grown);
+    }
+
+    InsertIntoTable(table, nodeId);
+    ++numRecipients;
+
+    return true;
+}
+
+void HitRegistry::InsertIntoTable(PODVector<unsigned> &table, unsigned nodeId)
+{
+    const unsigned mask = table.Size() - 1;
+    unsigned i = HashNodeID(nodeId) & mask;
+
+    while (table[i])
+    {
+        i = (i + 1) & mask;
+    }
+
+    table[i] = nodeId;
+}
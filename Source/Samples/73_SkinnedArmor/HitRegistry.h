@@ -0,0 +1,102 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#pragma once
+
+#include <Urho3D/Scene/Component.h>
+
+using namespace Urho3D;
+
+//=============================================================================
+// a registered weapon hit. Nodes are referenced by ID, so a batch can be read
+// even if a node was removed before it was delivered.
+//=============================================================================
+struct HitRecord
+{
+    unsigned attackerId_;
+    unsigned targetId_;
+    /// Weapon position at the hit.
+    Vector3 position_;
+    /// Weapon motion direction at the hit, zero if unknown.
+    Vector3 direction_;
+};
+
+//=============================================================================
+// the frame's weapon hits, sent once per frame by the HitRegistry
+//=============================================================================
+URHO3D_EVENT(E_WEAPONHITS, WeaponHits)
+{
+    URHO3D_PARAM(P_HITS, Hits);             // const HitRecord* as void pointer
+    URHO3D_PARAM(P_NUMHITS, NumHits);       // unsigned
+}
+
+//=============================================================================
+// scene-wide weapon hit registration. Every attacker has a recipient set per
+// swing, a flat open addressing hash of node IDs, so each target is hit once
+// per swing. New hits are collected into one batch of HitRecords that is
+// delivered in a single E_WEAPONHITS event at the end of the frame.
+//=============================================================================
+class HitRegistry : public Component
+{
+    URHO3D_OBJECT(HitRegistry, Component);
+
+public:
+    /// Construct.
+    HitRegistry(Context* context);
+
+    /// Register object factory.
+    static void RegisterObject(Context* context);
+
+    /// Add an attacker and return its index.
+    unsigned AddAttacker(Node *attacker);
+    /// Remove an attacker. Its index is reused by the next attacker added.
+    void RemoveAttacker(unsigned attacker);
+    /// Start a new swing: clear the attacker's recipient set.
+    void BeginSwing(unsigned attacker);
+    /// Register a hit. Return true if it is the first hit on the target in the attacker's swing.
+    bool RegisterHit(unsigned attacker, Node *target, const Vector3 &position, const Vector3 &direction);
+    /// Send the hits registered since the last call in one E_WEAPONHITS event. Called at the end of every frame.
+    void SendHits();
+
+    /// Return the hits registered since the last SendHits().
+    const PODVector<HitRecord>& GetHits() const { return hits_; }
+
+protected:
+    /// Handle scene being assigned.
+    virtual void OnSceneSet(Scene* scene);
+
+private:
+    void HandleEndFrame(StringHash eventType, VariantMap& eventData);
+    bool InsertRecipient(unsigned attacker, unsigned nodeId);
+    static void InsertIntoTable(PODVector<unsigned> &table, unsigned nodeId);
+
+    /// Attacker node IDs, 0 for a free index.
+    PODVector<unsigned> attackerIds_;
+    /// Per attacker the swing's recipient node IDs, a power of two sized table where 0 marks an empty slot.
+    Vector<PODVector<unsigned> > recipients_;
+    PODVector<unsigned> numRecipients_;
+    PODVector<unsigned> freeAttackers_;
+
+    PODVector<HitRecord> hits_;
+    PODVector<HitRecord> sendHits_;
+};
@@ -0,0 +1,191 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#include <Urho3D/Physics/CollisionShape.h>
+#include <Urho3D/Physics/PhysicsUtils.h>
+#include <Urho3D/Physics/PhysicsWorld.h>
+#include <Urho3D/Physics/RigidBody.h>
+#include <Urho3D/Scene/Node.h>
+
+#include <Bullet/BulletCollision/CollisionShapes/btConvexShape.h>
+#include <Bullet/BulletDynamics/Dynamics/btDiscreteDynamicsWorld.h>
+
+#include "KinematicCapsule.h"
+
+#include <Urho3D/DebugNew.h>
+//=============================================================================
+//=============================================================================
+/// Gap kept between the capsule and what it touches, so a move along a surface doesn't start inside it.
+const float KINEMATIC_SKIN_WIDTH = 0.02f;
+/// Most collide and slide iterations per step.
+const unsigned KINEMATIC_MAX_SLIDES = 3;
+
+//=============================================================================
+// closest blocking hit of a capsule sweep: skips the character's own body,
+// triggers, and surfaces the capsule moves away from
+//=============================================================================
+struct KinematicSweepCallback : public btCollisionWorld::ClosestConvexResultCallback
+{
+    KinematicSweepCallback(const btCollisionObject *ownObject, const btVector3 &from, const btVector3 &to) :
+        btCollisionWorld::ClosestConvexResultCallback(from, to),
+        ownObject_(ownObject)
+    {
+    }
+
+    virtual bool needsCollision(btBroadphaseProxy* proxy0) const
+    {
+        const btCollisionObject *object = (const btCollisionObject*)proxy0->m_clientObject;
+
+        if (object == ownObject_ || (object->getCollisionFlags() & btCollisionObject::CF_NO_CONTACT_RESPONSE))
+            return false;
+
+        return btCollisionWorld::ClosestConvexResultCallback::needsCollision(proxy0);
+    }
+
+    virtual btScalar addSingleResult(btCollisionWorld::LocalConvexResult& convexResult, bool normalInWorldSpace)
+    {
+        const btVector3 normal = normalInWorldSpace ? convexResult.m_hitNormalLocal :
+            convexResult.m_hitCollisionObject->getWorldTransform().getBasis() * convexResult.m_hitNormalLocal;
+
+        if (normal.dot(m_convexToWorld - m_convexFromWorld) > btScalar(0.0f))
+            return btScalar(1.0f);
+
+        return btCollisionWorld::ClosestConvexResultCallback::addSingleResult(convexResult, normalInWorldSpace);
+    }
+
+    const btCollisionObject *ownObject_;
+};
+
+//=============================================================================
+//=============================================================================
+KinematicCapsule::KinematicCapsule(PhysicsWorld *physicsWorld, RigidBody *body, CollisionShape *shape) :
+    physicsWorld_(physicsWorld),
+    body_(body),
+    shape_(shape)
+{
+}
+
+void KinematicCapsule::Move(KinematicCapsuleState &state, float timeStep, float stepDownHeight, float slopeLimit) const
+{
+    const float minGroundY = Cos(slopeLimit);
+    const bool wasOnGround = state.onGround_;
+
+    if (!wasOnGround)
+    {
+        state.velocity_ += physicsWorld_->GetGravity() * timeStep;
+    }
+
+    state.onGround_ = false;
+
+    // collide and slide
+    Vector3 remaining = state.velocity_ * timeStep;
+
+    for (unsigned i = 0; i < KINEMATIC_MAX_SLIDES && remaining.LengthSquared() > M_EPSILON * M_EPSILON; ++i)
+    {
+        float fraction;
+        Vector3 normal;
+
+        if (!Sweep(state.position_, state.position_ + remaining, fraction, normal))
+        {
+            state.position_ += remaining;
+            break;
+        }
+
+        // advance to a skin width short of the surface
+        const float length = remaining.Length();
+        const float travel = Max(fraction * length - KINEMATIC_SKIN_WIDTH, 0.0f);
+        state.position_ += remaining * (travel / length);
+        remaining *= 1.0f - travel / length;
+
+        if (normal.y_ >= minGroundY)
+        {
+            state.onGround_ = true;
+            state.groundNormal_ = normal;
+        }
+        else if (normal.y_ > 0.0f)
+        {
+            // too steep to stand on: slide along it like a wall, without climbing
+            normal = Vector3(normal.x_, 0.0f, normal.z_).Normalized();
+        }
+
+        // drop the motion into the surface
+        remaining -= normal * remaining.DotProduct(normal);
+
+        const float intoSurface = state.velocity_.DotProduct(normal);
+        if (intoSurface < 0.0f)
+            state.velocity_ -= normal * intoSurface;
+    }
+
+    // step down: follow the ground over small drops and down slopes instead of launching off them
+    if (!state.onGround_ && wasOnGround && state.velocity_.y_ <= 0.0f)
+    {
+        const float distance = stepDownHeight + KINEMATIC_SKIN_WIDTH;
+        float fraction;
+        Vector3 normal;
+
+        if (Sweep(state.position_, state.position_ + Vector3::DOWN * distance, fraction, normal) && normal.y_ >= minGroundY)
+        {
+            state.position_ += Vector3::DOWN * Max(fraction * distance - KINEMATIC_SKIN_WIDTH, 0.0f);
+            state.onGround_ = true;
+            state.groundNormal_ = normal;
+        }
+    }
+
+    if (state.onGround_ && state.velocity_.y_ < 0.0f)
+    {
+        state.velocity_.y_ = 0.0f;
+    }
+}
+
+bool KinematicCapsule::Sweep(const Vector3 &from, const Vector3 &to, float &fraction, Vector3 &normal) const
+{
+    btCollisionShape *shape = shape_->GetCollisionShape();
+
+    if (!shape || !shape->isConvex())
+    {
+        return false;
+    }
+
+    // shape transform: node position plus the shape offset, as in the body's compound shape
+    Node *node = shape_->GetNode();
+    const Quaternion nodeRotation = node->GetWorldRotation();
+    const Vector3 offset = nodeRotation * (node->GetWorldScale() * shape_->GetPosition());
+    const btQuaternion rotation = ToBtQuaternion(nodeRotation * shape_->GetRotation());
+    const btTransform fromTrans(rotation, ToBtVector3(from + offset));
+    const btTransform toTrans(rotation, ToBtVector3(to + offset));
+
+    KinematicSweepCallback callback(body_->GetBody(), fromTrans.getOrigin(), toTrans.getOrigin());
+    callback.m_collisionFilterGroup = (short)body_->GetCollisionLayer();
+    callback.m_collisionFilterMask = (short)body_->GetCollisionMask();
+
+    physicsWorld_->GetWorld()->convexSweepTest(static_cast<btConvexShape*>(shape), fromTrans, toTrans, callback);
+
+    if (!callback.hasHit())
+    {
+        return false;
+    }
+
+    fraction = callback.m_closestHitFraction;
+    normal = ToVector3(callback.m_hitNormalWorld).Normalized();
+    return true;
+}
@@ -0,0 +1,70 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#pragma once
+
+#include <Urho3D/Math/Vector3.h>
+
+using namespace Urho3D;
+namespace Urho3D
+{
+class CollisionShape;
+class PhysicsWorld;
+class RigidBody;
+}
+
+//=============================================================================
+// state the kinematic capsule carries from step to step
+//=============================================================================
+struct KinematicCapsuleState
+{
+    Vector3 position_;
+    Vector3 velocity_;
+    Vector3 groundNormal_;
+    bool onGround_;
+};
+
+//=============================================================================
+// kinematic character movement: sweeps the body's capsule shape through the
+// physics world and slides along what it hits, instead of letting the solver
+// push a dynamic body around. Keeps contact with the ground over drops up to
+// the step down height, stands only on surfaces within the slope limit and
+// reports its own ground state, so it needs no contact events.
+//=============================================================================
+class KinematicCapsule
+{
+public:
+    /// Construct for a body and its capsule shape.
+    KinematicCapsule(PhysicsWorld *physicsWorld, RigidBody *body, CollisionShape *shape);
+
+    /// Move one step: gravity while airborne, then collide and slide, then step down. Node position is state.position_.
+    void Move(KinematicCapsuleState &state, float timeStep, float stepDownHeight, float slopeLimit) const;
+
+private:
+    /// Sweep the capsule from one node position to another. Return true and the hit fraction and normal if it hit something.
+    bool Sweep(const Vector3 &from, const Vector3 &to, float &fraction, Vector3 &normal) const;
+
+    PhysicsWorld *physicsWorld_;
+    RigidBody *body_;
+    CollisionShape *shape_;
+};
@@ -0,0 +1,362 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Core/CoreEvents.h>
+#include <Urho3D/Core/WorkQueue.h>
+#include <Urho3D/Physics/CollisionShape.h>
+#include <Urho3D/Physics/PhysicsUtils.h>
+#include <Urho3D/Physics/PhysicsWorld.h>
+#include <Urho3D/Physics/RigidBody.h>
+#include <Urho3D/Scene/Scene.h>
+
+#include <Bullet/BulletCollision/BroadphaseCollision/btBroadphaseInterface.h>
+#include <Bullet/BulletCollision/CollisionShapes/btConvexShape.h>
+#include <Bullet/BulletDynamics/Dynamics/btDiscreteDynamicsWorld.h>
+
+#include "MeleeSweep.h"
+#include "Character.h"
+#include "CollisionLayer.h"
+
+#include <Urho3D/DebugNew.h>
+//=============================================================================
+//=============================================================================
+/// Sweeps per work item. Fewer sweeps are cast on the main thread.
+const unsigned MELEE_SWEEP_WORK_BATCH = 16;
+/// Largest blade rotation, in degrees, covered by one sub-step.
+const float MELEE_SWEEP_SUBSTEP_ANGLE = 15.0f;
+/// Most sub-steps per blade and frame.
+const unsigned MELEE_SWEEP_MAX_SUBSTEPS = 8;
+
+//=============================================================================
+//=============================================================================
+unsigned GetMeleeSweepSubSteps(const Quaternion &fromRotation, const Quaternion &toRotation)
+{
+    // enough sub-steps that none rotates the blade more than MELEE_SWEEP_SUBSTEP_ANGLE
+    const Quaternion delta = toRotation * fromRotation.Inverse();
+    const float angle = 2.0f * Acos(Min(Abs(delta.w_), 1.0f));
+
+    return Clamp((unsigned)ceilf(angle / MELEE_SWEEP_SUBSTEP_ANGLE), 1u, MELEE_SWEEP_MAX_SUBSTEPS);
+}
+
+//=============================================================================
+// collects every object a sweep touches, not only the closest one
+//=============================================================================
+struct MeleeSweepResultCallback : public btCollisionWorld::ConvexResultCallback
+{
+    MeleeSweepResultCallback(const btCollisionObject *ownObject, unsigned &numHits, RigidBody **hits, unsigned maxHits) :
+        ownObject_(ownObject),
+        numHits_(numHits),
+        hits_(hits),
+        maxHits_(maxHits)
+    {
+    }
+
+    virtual bool needsCollision(btBroadphaseProxy* proxy0) const
+    {
+        // the blade's own trigger body
+        if (proxy0->m_clientObject == ownObject_)
+            return false;
+
+        return btCollisionWorld::ConvexResultCallback::needsCollision(proxy0);
+    }
+
+    virtual btScalar addSingleResult(btCollisionWorld::LocalConvexResult& convexResult, bool normalInWorldSpace)
+    {
+        RigidBody *body = static_cast<RigidBody*>(convexResult.m_hitCollisionObject->getUserPointer());
+
+        for (unsigned i = 0; i < numHits_; ++i)
+        {
+            if (hits_[i] == body)
+                return m_closestHitFraction;
+        }
+
+        if (body && numHits_ < maxHits_)
+        {
+            hits_[numHits_++] = body;
+        }
+
+        // keep the closest hit fraction at 1, so the sweep reports every object along its whole length
+        return m_closestHitFraction;
+    }
+
+    const btCollisionObject *ownObject_;
+    unsigned &numHits_;
+    RigidBody **hits_;
+    unsigned maxHits_;
+};
+
+//=============================================================================
+// narrow phase of a convex sweep against the broadphase proxies overlapping
+// the sweep's bounding box, the same per-object test btCollisionWorld's
+// convexSweepTest makes. The box query keeps its traversal stack local, so
+// sweeps can be cast from several threads at once.
+//=============================================================================
+struct MeleeSweepTester : public btBroadphaseAabbCallback
+{
+    MeleeSweepTester(const btConvexShape *castShape, const btTransform &from, const btTransform &to, btCollisionWorld::ConvexResultCallback &resultCallback) :
+        castShape_(castShape),
+        from_(from),
+        to_(to),
+        resultCallback_(resultCallback)
+    {
+    }
+
+    virtual bool process(const btBroadphaseProxy* proxy)
+    {
+        btCollisionObject *collisionObject = (btCollisionObject*)proxy->m_clientObject;
+
+        if (resultCallback_.needsCollision(collisionObject->getBroadphaseHandle()))
+        {
+            btCollisionWorld::objectQuerySingle(castShape_, from_, to_, collisionObject, collisionObject->getCollisionShape(),
+                                                collisionObject->getWorldTransform(), resultCallback_, 0.0f);
+        }
+        return true;
+    }
+
+    const btConvexShape *castShape_;
+    const btTransform &from_;
+    const btTransform &to_;
+    btCollisionWorld::ConvexResultCallback &resultCallback_;
+};
+
+//=============================================================================
+//=============================================================================
+MeleeSweepSystem::MeleeSweepSystem(Context* context) :
+    Component(context)
+{
+}
+
+void MeleeSweepSystem::RegisterObject(Context* context)
+{
+    context->RegisterFactory<MeleeSweepSystem>();
+}
+
+void MeleeSweepSystem::OnSceneSet(Scene* scene)
+{
+    if (scene)
+        SubscribeToEvent(E_POSTRENDERUPDATE, URHO3D_HANDLER(MeleeSweepSystem, HandlePostRenderUpdate));
+    else
+        UnsubscribeFromEvent(E_POSTRENDERUPDATE);
+}
+
+void MeleeSweepSystem::AddCharacter(Character *character)
+{
+    if (!character)
+    {
+        return;
+    }
+
+    for (unsigned i = 0; i < blades_.Size(); ++i)
+    {
+        if (blades_[i].character_.Get() == character)
+            return;
+    }
+
+    Blade blade;
+    blade.character_ = character;
+    blade.hasPose_ = false;
+    blades_.Push(blade);
+}
+
+void MeleeSweepSystem::RemoveCharacter(Character *character)
+{
+    for (unsigned i = 0; i < blades_.Size(); ++i)
+    {
+        if (blades_[i].character_.Get() == character)
+        {
+            blades_.Erase(i);
+            return;
+        }
+    }
+}
+
+void MeleeSweepSystem::HandlePostRenderUpdate(StringHash eventType, VariantMap& eventData)
+{
+    PhysicsWorld *physicsWorld = GetScene()->GetComponent<PhysicsWorld>();
+
+    sweeps_.Clear();
+
+    if (!physicsWorld || !physicsWorld->GetWorld())
+    {
+        return;
+    }
+
+    // the bones have been posed for this frame: sweep the blades that can deal damage from their last pose
+    for (unsigned i = 0; i < blades_.Size();)
+    {
+        Blade &blade = blades_[i];
+        Character *character = blade.character_;
+        Node *weaponNode = character ? character->weaponNode_.Get() : NULL;
+
+        if (!weaponNode)
+        {
+            blades_.Erase(i);
+            continue;
+        }
+
+        // a parked character's blade starts over from its next pose
+        if (!character->IsEnabledEffective())
+        {
+            blade.hasPose_ = false;
+            ++i;
+            continue;
+        }
+
+        const Vector3 position = weaponNode->GetWorldPosition();
+        const Quaternion rotation = weaponNode->GetWorldRotation();
+
+        if (blade.hasPose_ && character->weaponDmgState_ == Character::WeaponDmg_ON)
+        {
+            AddSweeps(i, weaponNode, position, rotation);
+        }
+
+        blade.position_ = position;
+        blade.rotation_ = rotation;
+        blade.hasPose_ = true;
+        ++i;
+    }
+
+    const unsigned numSweeps = sweeps_.Size();
+
+    if (!numSweeps)
+    {
+        return;
+    }
+
+    WorkQueue *queue = GetSubsystem<WorkQueue>();
+
+    if (!queue || !queue->GetNumThreads() || numSweeps <= MELEE_SWEEP_WORK_BATCH)
+    {
+        CastSweeps(0, numSweeps);
+    }
+    else
+    {
+        for (unsigned begin = 0; begin < numSweeps; begin += MELEE_SWEEP_WORK_BATCH)
+        {
+            SharedPtr<WorkItem> item = queue->GetFreeItem();
+            item->priority_ = M_MAX_UNSIGNED;
+            item->workFunction_ = CastSweepsWork;
+            item->aux_ = this;
+            item->start_ = (void*)(size_t)begin;
+            item->end_ = (void*)(size_t)Min(begin + MELEE_SWEEP_WORK_BATCH, numSweeps);
+            queue->AddWorkItem(item);
+        }
+
+        queue->Complete(M_MAX_UNSIGNED);
+    }
+
+    // damage events on the main thread, in blade and sub-step order
+    for (unsigned i = 0; i < numSweeps; ++i)
+    {
+        const Sweep &sweep = sweeps_[i];
+        Character *character = blades_[sweep.blade_].character_;
+
+        for (unsigned j = 0; character && j < sweep.numHits_; ++j)
+        {
+            character->RegisterWeaponHit(sweep.hits_[j]->GetNode(), sweep.toPosition_, (sweep.toPosition_ - sweep.fromPosition_).Normalized());
+        }
+    }
+}
+
+void MeleeSweepSystem::AddSweeps(unsigned blade, Node *weaponNode, const Vector3 &position, const Quaternion &rotation)
+{
+    CollisionShape *shape = weaponNode->GetComponent<CollisionShape>();
+    RigidBody *body = weaponNode->GetComponent<RigidBody>();
+    btCollisionShape *btShape = shape ? shape->GetCollisionShape() : NULL;
+
+    if (!btShape || !btShape->isConvex())
+    {
+        return;
+    }
+
+    const Blade &previous = blades_[blade];
+
+    const unsigned numSubSteps = GetMeleeSweepSubSteps(previous.rotation_, rotation);
+
+    // the box is offset from the hilt, same as its child transform in the body's compound shape
+    const Vector3 offsetPosition = weaponNode->GetWorldScale() * shape->GetPosition();
+    const Quaternion &offsetRotation = shape->GetRotation();
+
+    Vector3 fromPosition = previous.position_;
+    Quaternion fromRotation = previous.rotation_;
+
+    for (unsigned i = 1; i <= numSubSteps; ++i)
+    {
+        const float t = (float)i / (float)numSubSteps;
+        const Vector3 toPosition = previous.position_.Lerp(position, t);
+        const Quaternion toRotation = previous.rotation_.Slerp(rotation, t);
+
+        Sweep sweep;
+        sweep.blade_ = blade;
+        sweep.shape_ = static_cast<btConvexShape*>(btShape);
+        sweep.ownObject_ = body ? body->GetBody() : NULL;
+        sweep.collisionLayer_ = body ? body->GetCollisionLayer() : (unsigned)ColLayer_Weapon;
+        // static objects never take damage, like on the trigger path: leave the level geometry out of the casts
+        sweep.collisionMask_ = (body ? body->GetCollisionMask() : (unsigned)ColMask_Weapon) & ~ColLayer_Static;
+        sweep.fromPosition_ = fromPosition + fromRotation * offsetPosition;
+        sweep.fromRotation_ = fromRotation * offsetRotation;
+        sweep.toPosition_ = toPosition + toRotation * offsetPosition;
+        sweep.toRotation_ = toRotation * offsetRotation;
+        sweep.numHits_ = 0;
+        sweeps_.Push(sweep);
+
+        fromPosition = toPosition;
+        fromRotation = toRotation;
+    }
+}
+
+void MeleeSweepSystem::CastSweeps(unsigned begin, unsigned end)
+{
+    btDiscreteDynamicsWorld *world = GetScene()->GetComponent<PhysicsWorld>()->GetWorld();
+    btBroadphaseInterface *broadphase = world->getBroadphase();
+
+    for (unsigned i = begin; i < end; ++i)
+    {
+        Sweep &sweep = sweeps_[i];
+
+        const btTransform from(ToBtQuaternion(sweep.fromRotation_), ToBtVector3(sweep.fromPosition_));
+        const btTransform to(ToBtQuaternion(sweep.toRotation_), ToBtVector3(sweep.toPosition_));
+
+        MeleeSweepResultCallback resultCallback(sweep.ownObject_, sweep.numHits_, sweep.hits_, MAX_SWEEP_HITS);
+        resultCallback.m_collisionFilterGroup = (short)sweep.collisionLayer_;
+        resultCallback.m_collisionFilterMask = (short)sweep.collisionMask_;
+
+        // the box at both ends of the sub-step bounds the sweep
+        btVector3 aabbMin, aabbMax, toMin, toMax;
+        sweep.shape_->getAabb(from, aabbMin, aabbMax);
+        sweep.shape_->getAabb(to, toMin, toMax);
+        aabbMin.setMin(toMin);
+        aabbMax.setMax(toMax);
+
+        MeleeSweepTester tester(sweep.shape_, from, to, resultCallback);
+        broadphase->aabbTest(aabbMin, aabbMax, tester);
+    }
+}
+
+void MeleeSweepSystem::CastSweepsWork(const WorkItem* item, unsigned threadIndex)
+{
+    MeleeSweepSystem *system = static_cast<MeleeSweepSystem*>(item->aux_);
+
+    system->CastSweeps((unsigned)(size_t)item->start_, (unsigned)(size_t)item->end_);
+}
@@ -0,0 +1,111 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#pragma once
+
+#include <Urho3D/Scene/Component.h>
+
+using namespace Urho3D;
+namespace Urho3D
+{
+class RigidBody;
+struct WorkItem;
+}
+
+class Character;
+class btCollisionObject;
+class btConvexShape;
+
+/// Return the number of sub-steps a blade sweep between two rotations is split into.
+unsigned GetMeleeSweepSubSteps(const Quaternion &fromRotation, const Quaternion &toRotation);
+
+//=============================================================================
+// swept melee hit detection. Once per frame, after the animation has posed
+// the bones, every blade inside its weaponDmgON..weaponDmgOFF window is swept
+// from its previous pose to the current one as a series of convex casts of
+// its collision box. The sweep is split into sub-steps interpolated around the
+// blade's hilt, so a fast swing follows its arc instead of the chord, and the
+// casts of all blades are resolved together on the work queue.
+//
+// Hits don't depend on the physics steps, so fast swings don't tunnel through
+// thin targets and the physics rate can be lowered without losing hits.
+// Characters register their blade when the scene has this component, and
+// their weapon trigger body then no longer reports collisions.
+//=============================================================================
+class MeleeSweepSystem : public Component
+{
+    URHO3D_OBJECT(MeleeSweepSystem, Component);
+
+public:
+    /// Construct.
+    MeleeSweepSystem(Context* context);
+
+    /// Register object factory.
+    static void RegisterObject(Context* context);
+
+    /// Add a character's blade.
+    void AddCharacter(Character *character);
+    /// Remove a character's blade.
+    void RemoveCharacter(Character *character);
+
+protected:
+    /// Handle scene being assigned.
+    virtual void OnSceneSet(Scene* scene);
+
+private:
+    /// Most targets one sub-step sweep reports.
+    static const unsigned MAX_SWEEP_HITS = 4;
+
+    /// Blade pose of the previous frame.
+    struct Blade
+    {
+        WeakPtr<Character> character_;
+        Vector3 position_;
+        Quaternion rotation_;
+        bool hasPose_;
+    };
+
+    /// One sub-step convex cast, resolved on a worker thread.
+    struct Sweep
+    {
+        unsigned blade_;
+        btConvexShape *shape_;
+        btCollisionObject *ownObject_;
+        unsigned collisionLayer_;
+        unsigned collisionMask_;
+        Vector3 fromPosition_;
+        Quaternion fromRotation_;
+        Vector3 toPosition_;
+        Quaternion toRotation_;
+        unsigned numHits_;
+        RigidBody *hits_[MAX_SWEEP_HITS];
+    };
+
+    void HandlePostRenderUpdate(StringHash eventType, VariantMap& eventData);
+    void AddSweeps(unsigned blade, Node *weaponNode, const Vector3 &position, const Quaternion &rotation);
+    void CastSweeps(unsigned begin, unsigned end);
+    static void CastSweepsWork(const WorkItem* item, unsigned threadIndex);
+
+    Vector<Blade> blades_;
+    PODVector<Sweep> sweeps_;
+};
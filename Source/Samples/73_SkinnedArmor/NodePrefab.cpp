@@ -0,0 +1,304 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/IO/Log.h>
+#include <Urho3D/Resource/ResourceCache.h>
+#include <Urho3D/Resource/XMLFile.h>
+#include <Urho3D/Scene/Component.h>
+
+#include "NodePrefab.h"
+
+#include <Urho3D/DebugNew.h>
+//=============================================================================
+//=============================================================================
+NodePrefab::NodePrefab(Context* context) :
+    Resource(context)
+{
+}
+
+NodePrefab::~NodePrefab()
+{
+}
+
+void NodePrefab::RegisterObject(Context* context)
+{
+    context->RegisterFactory<NodePrefab>();
+}
+
+bool NodePrefab::BeginLoad(Deserializer& source)
+{
+    SharedPtr<XMLFile> xmlFile(new XMLFile(context_));
+
+    if (!xmlFile->Load(source))
+    {
+        return false;
+    }
+
+    XMLElement rootElem = xmlFile->GetRoot("node");
+
+    if (!rootElem)
+    {
+        URHO3D_LOGERROR("NodePrefab: no root node in " + GetName());
+        return false;
+    }
+
+    rootName_.Clear();
+    nodes_.Clear();
+    components_.Clear();
+    attributes_.Clear();
+    resources_.Clear();
+
+    for (XMLElement attrElem = rootElem.GetChild("attribute"); attrElem; attrElem = attrElem.GetNext("attribute"))
+    {
+        if (attrElem.GetAttribute("name") == "Name")
+        {
+            rootName_ = attrElem.GetAttribute("value");
+        }
+    }
+
+    for (XMLElement childElem = rootElem.GetChild("node"); childElem; childElem = childElem.GetNext("node"))
+    {
+        if (!ParseNode(childElem, M_MAX_UNSIGNED))
+        {
+            return false;
+        }
+    }
+
+    // queue the referenced resources when loading in the background
+    if (GetAsyncLoadState() == ASYNC_LOADING)
+    {
+        ResourceCache* cache = GetSubsystem<ResourceCache>();
+
+        for (unsigned i = 0; i < attributes_.Size(); ++i)
+        {
+            const Variant &value = attributes_[i].value_;
+
+            if (value.GetType() == VAR_RESOURCEREF && !value.GetResourceRef().name_.Empty())
+            {
+                cache->BackgroundLoadResource(value.GetResourceRef().type_, value.GetResourceRef().name_, true, this);
+            }
+            else if (value.GetType() == VAR_RESOURCEREFLIST)
+            {
+                const ResourceRefList &refList = value.GetResourceRefList();
+
+                for (unsigned j = 0; j < refList.names_.Size(); ++j)
+                {
+                    if (!refList.names_[j].Empty())
+                        cache->BackgroundLoadResource(refList.type_, refList.names_[j], true, this);
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+bool NodePrefab::ParseNode(const XMLElement &nodeElem, unsigned parent)
+{
+    PrefabNode node;
+    node.parent_ = parent;
+    node.firstAttribute_ = attributes_.Size();
+    node.numAttributes_ = ParseAttributes(nodeElem, Node::GetTypeStatic());
+    node.firstComponent_ = components_.Size();
+
+    for (XMLElement compElem = nodeElem.GetChild("component"); compElem; compElem = compElem.GetNext("component"))
+    {
+        const String typeName = compElem.GetAttribute("type");
+        PrefabComponent component;
+        component.type_ = StringHash(typeName);
+
+        if (!context_->GetFactories().Contains(component.type_))
+        {
+            URHO3D_LOGERROR("NodePrefab: unknown component type " + typeName + " in " + GetName());
+            return false;
+        }
+
+        component.firstAttribute_ = attributes_.Size();
+        component.numAttributes_ = ParseAttributes(compElem, component.type_);
+        components_.Push(component);
+    }
+
+    node.numComponents_ = components_.Size() - node.firstComponent_;
+
+    const unsigned index = nodes_.Size();
+    nodes_.Push(node);
+
+    for (XMLElement childElem = nodeElem.GetChild("node"); childElem; childElem = childElem.GetNext("node"))
+    {
+        if (!ParseNode(childElem, index))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+unsigned NodePrefab::ParseAttributes(const XMLElement &element, StringHash type)
+{
+    const Vector<AttributeInfo> *attributes = context_->GetAttributes(type);
+    unsigned numAttributes = 0;
+
+    if (!attributes)
+    {
+        return 0;
+    }
+
+    for (XMLElement attrElem = element.GetChild("attribute"); attrElem; attrElem = attrElem.GetNext("attribute"))
+    {
+        const String name = attrElem.GetAttribute("name");
+        unsigned index = M_MAX_UNSIGNED;
+
+        for (unsigned i = 0; i < attributes->Size(); ++i)
+        {
+            if ((attributes->At(i).mode_ & AM_FILE) && !attributes->At(i).name_.Compare(name, true))
+            {
+                index = i;
+                break;
+            }
+        }
+
+        if (index == M_MAX_UNSIGNED)
+        {
+            URHO3D_LOGWARNING("NodePrefab: unknown attribute " + name + " in " + GetName());
+            continue;
+        }
+
+        // same value conversion as Serializable::LoadXML()
+        const AttributeInfo &attr = attributes->At(index);
+        PrefabAttribute prefabAttr;
+        prefabAttr.index_ = index;
+
+        if (attr.enumNames_)
+        {
+            const String value = attrElem.GetAttribute("value");
+            int enumValue = -1;
+
+            for (int i = 0; attr.enumNames_[i]; ++i)
+            {
+                if (!value.Compare(attr.enumNames_[i], false))
+                {
+                    enumValue = i;
+                    break;
+                }
+            }
+
+            if (enumValue < 0)
+            {
+                URHO3D_LOGWARNING("NodePrefab: unknown enum value " + value + " of attribute " + name + " in " + GetName());
+                continue;
+            }
+
+            prefabAttr.value_ = enumValue;
+        }
+        else
+        {
+            prefabAttr.value_ = attrElem.GetVariantValue(attr.type_);
+        }
+
+        attributes_.Push(prefabAttr);
+        ++numAttributes;
+    }
+
+    return numAttributes;
+}
+
+bool NodePrefab::EndLoad()
+{
+    ResourceCache* cache = GetSubsystem<ResourceCache>();
+
+    // hold the referenced resources so instances only look them up
+    for (unsigned i = 0; i < attributes_.Size(); ++i)
+    {
+        const Variant &value = attributes_[i].value_;
+
+        if (value.GetType() == VAR_RESOURCEREF && !value.GetResourceRef().name_.Empty())
+        {
+            Resource *resource = cache->GetResource(value.GetResourceRef().type_, value.GetResourceRef().name_);
+
+            if (resource)
+                resources_.Push(SharedPtr<Resource>(resource));
+        }
+        else if (value.GetType() == VAR_RESOURCEREFLIST)
+        {
+            const ResourceRefList &refList = value.GetResourceRefList();
+
+            for (unsigned j = 0; j < refList.names_.Size(); ++j)
+            {
+                Resource *resource = refList.names_[j].Empty() ? NULL : cache->GetResource(refList.type_, refList.names_[j]);
+
+                if (resource)
+                    resources_.Push(SharedPtr<Resource>(resource));
+            }
+        }
+    }
+
+    SetMemoryUse(sizeof(NodePrefab) + nodes_.Size() * sizeof(PrefabNode) + components_.Size() * sizeof(PrefabComponent) +
+                 attributes_.Size() * sizeof(PrefabAttribute));
+
+    return true;
+}
+
+Node* NodePrefab::Instantiate(Node *parent, CreateMode mode)
+{
+    if (!parent || nodes_.Empty())
+    {
+        return NULL;
+    }
+
+    instanceNodes_.Resize(nodes_.Size());
+
+    for (unsigned i = 0; i < nodes_.Size(); ++i)
+    {
+        const PrefabNode &prefabNode = nodes_[i];
+        Node *nodeParent = prefabNode.parent_ == M_MAX_UNSIGNED ? parent : instanceNodes_[prefabNode.parent_];
+        Node *node = nodeParent->CreateChild(String::EMPTY, mode);
+
+        instanceNodes_[i] = node;
+        SetAttributes(node, prefabNode.firstAttribute_, prefabNode.numAttributes_);
+
+        for (unsigned j = 0; j < prefabNode.numComponents_; ++j)
+        {
+            const PrefabComponent &prefabComponent = components_[prefabNode.firstComponent_ + j];
+            Component *component = node->CreateComponent(prefabComponent.type_, mode);
+
+            // no ID references to resolve, so the attributes apply right away
+            if (component)
+            {
+                SetAttributes(component, prefabComponent.firstAttribute_, prefabComponent.numAttributes_);
+                component->ApplyAttributes();
+            }
+        }
+    }
+
+    return instanceNodes_[0];
+}
+
+void NodePrefab::SetAttributes(Serializable *serializable, unsigned firstAttribute, unsigned numAttributes) const
+{
+    for (unsigned i = firstAttribute; i < firstAttribute + numAttributes; ++i)
+    {
+        serializable->SetAttribute(attributes_[i].index_, attributes_[i].value_);
+    }
+}
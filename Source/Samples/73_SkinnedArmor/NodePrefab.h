@@ -0,0 +1,111 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#pragma once
+
+#include <Urho3D/Resource/Resource.h>
+#include <Urho3D/Scene/Node.h>
+
+using namespace Urho3D;
+namespace Urho3D
+{
+class XMLElement;
+}
+
+//=============================================================================
+// node hierarchy template loaded from a node XML file, e.g. BackLocator.xml.
+// The file's root node is not instantiated: its name is the mount point, and
+// its child hierarchy is instantiated under that node, e.g. a skeleton bone.
+//
+// Loading parses the attributes once into values by attribute index and
+// holds the referenced resources, so instantiating only creates the nodes
+// and components and sets their attributes. Node and component references
+// by ID are not supported.
+//=============================================================================
+class NodePrefab : public Resource
+{
+    URHO3D_OBJECT(NodePrefab, Resource);
+
+public:
+    /// Construct.
+    NodePrefab(Context* context);
+    virtual ~NodePrefab();
+
+    /// Register object factory.
+    static void RegisterObject(Context* context);
+
+    /// Load resource from stream. May be called from a worker thread. Return true if successful.
+    virtual bool BeginLoad(Deserializer& source);
+    /// Finish resource loading. Always called from the main thread. Return true if successful.
+    virtual bool EndLoad();
+
+    /// Instantiate the root's child hierarchy under a parent node. Return the first top-level node created.
+    Node* Instantiate(Node *parent, CreateMode mode = REPLICATED);
+    /// Return the root node's name, the mount point the hierarchy is instantiated under.
+    const String& GetRootName() const { return rootName_; }
+    /// Return number of template nodes, the root excluded.
+    unsigned GetNumNodes() const { return nodes_.Size(); }
+
+private:
+    struct PrefabAttribute
+    {
+        unsigned index_;
+        Variant  value_;
+    };
+
+    struct PrefabComponent
+    {
+        StringHash type_;
+        unsigned   firstAttribute_;
+        unsigned   numAttributes_;
+    };
+
+    struct PrefabNode
+    {
+        /// Index of the parent template node, M_MAX_UNSIGNED for children of the root.
+        unsigned parent_;
+        unsigned firstComponent_;
+        unsigned numComponents_;
+        unsigned firstAttribute_;
+        unsigned numAttributes_;
+    };
+
+    /// Append a node element's hierarchy depth first.
+    bool ParseNode(const XMLElement &nodeElem, unsigned parent);
+    /// Append an element's attributes for an object type. Return the number appended.
+    unsigned ParseAttributes(const XMLElement &element, StringHash type);
+    /// Set an object's attributes from the template.
+    void SetAttributes(Serializable *serializable, unsigned firstAttribute, unsigned numAttributes) const;
+
+    String rootName_;
+
+    // template nodes depth first, each node's components contiguous, each object's attributes contiguous
+    PODVector<PrefabNode>      nodes_;
+    PODVector<PrefabComponent> components_;
+    Vector<PrefabAttribute>    attributes_;
+
+    /// Resources referenced by the attributes, kept loaded.
+    Vector<SharedPtr<Resource> > resources_;
+    /// Nodes of the instance being created, indexed like the template nodes.
+    PODVector<Node*> instanceNodes_;
+};
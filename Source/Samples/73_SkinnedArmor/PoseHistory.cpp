@@ -0,0 +1,588 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Graphics/AnimatedModel.h>
+#include <Urho3D/Physics/CollisionShape.h>
+#include <Urho3D/Physics/PhysicsEvents.h>
+#include <Urho3D/Physics/PhysicsUtils.h>
+#include <Urho3D/Physics/PhysicsWorld.h>
+#include <Urho3D/Scene/Scene.h>
+
+#include <Bullet/BulletCollision/CollisionDispatch/btCollisionWorld.h>
+#include <Bullet/BulletCollision/CollisionShapes/btBoxShape.h>
+
+#include "PoseHistory.h"
+#include "AnimationSetController.h"
+#include "Character.h"
+#include "MeleeSweep.h"
+
+#include <Urho3D/DebugNew.h>
+//=============================================================================
+//=============================================================================
+/// Largest hitbox node distance from the character's root, quantized positions are clamped to it.
+const float POSE_POSITION_RANGE = 4.0f;
+/// The three smallest components of a unit quaternion are within +-1/sqrt(2).
+const float POSE_ROTATION_SCALE = 1.41421356f;
+
+static short QuantizeSnorm(float value)
+{
+    return (short)Clamp((int)floorf(value * 32767.0f + 0.5f), -32767, 32767);
+}
+
+static float DequantizeSnorm(short value)
+{
+    return value * (1.0f / 32767.0f);
+}
+
+static void EncodeSample(const Vector3 &offset, const Quaternion &rotation, PoseSample &dest)
+{
+    for (unsigned i = 0; i < 3; ++i)
+    {
+        dest.position_[i] = QuantizeSnorm(offset.Data()[i] / POSE_POSITION_RANGE);
+    }
+
+    // smallest three: drop the largest component, and flip the sign so it is positive and can be restored
+    const float *components = rotation.Data();
+    unsigned largest = 0;
+
+    for (unsigned i = 1; i < 4; ++i)
+    {
+        if (Abs(components[i]) > Abs(components[largest]))
+            largest = i;
+    }
+
+    const float sign = components[largest] < 0.0f ? -1.0f : 1.0f;
+
+    for (unsigned i = 0, j = 0; i < 4; ++i)
+    {
+        if (i != largest)
+            dest.rotation_[j++] = QuantizeSnorm(components[i] * sign * POSE_ROTATION_SCALE);
+    }
+
+    dest.largest_ = (unsigned char)largest;
+    dest.padding_ = 0;
+}
+
+static void DecodeSample(const PoseSample &sample, Vector3 &offset, Quaternion &rotation)
+{
+    offset = Vector3(DequantizeSnorm(sample.position_[0]), DequantizeSnorm(sample.position_[1]), DequantizeSnorm(sample.position_[2])) * POSE_POSITION_RANGE;
+
+    float components[4];
+    float sumSquares = 0.0f;
+
+    for (unsigned i = 0, j = 0; i < 4; ++i)
+    {
+        if (i != sample.largest_)
+        {
+            components[i] = DequantizeSnorm(sample.rotation_[j++]) / POSE_ROTATION_SCALE;
+            sumSquares += components[i] * components[i];
+        }
+    }
+
+    components[sample.largest_] = sqrtf(Max(1.0f - sumSquares, 0.0f));
+    rotation = Quaternion(components).Normalized();
+}
+
+//=============================================================================
+//=============================================================================
+PoseHistory::PoseHistory() :
+    bladeHitbox_(M_MAX_UNSIGNED),
+    head_(0),
+    numFrames_(0),
+    newestStep_(0)
+{
+}
+
+bool PoseHistory::Define(Node *rootNode, AnimatedModel *model, Node *weaponNode)
+{
+    rootNode_ = rootNode;
+    hitboxNodes_.Clear();
+    hitboxes_.Clear();
+    hitboxReach_.Clear();
+    bladeHitbox_ = M_MAX_UNSIGNED;
+
+    PoseHitbox hitbox;
+
+    if (model)
+    {
+        const Vector<Bone> &bones = model->GetSkeleton().GetBones();
+
+        for (unsigned i = 0; i < bones.Size(); ++i)
+        {
+            const Bone &bone = bones[i];
+
+            if (!bone.node_ || !(bone.collisionMask_ & BONECOLLISION_BOX) || !bone.boundingBox_.Defined())
+                continue;
+
+            const Vector3 scale = bone.node_->GetWorldScale();
+
+            hitbox.bone_ = i;
+            hitbox.center_ = scale * bone.boundingBox_.Center();
+            hitbox.rotation_ = Quaternion::IDENTITY;
+            hitbox.halfExtents_ = scale * bone.boundingBox_.HalfSize();
+
+            hitboxNodes_.Push(WeakPtr<Node>(bone.node_));
+            hitboxes_.Push(hitbox);
+        }
+    }
+
+    // the blade, same box the melee sweep casts
+    CollisionShape *shape = weaponNode ? weaponNode->GetComponent<CollisionShape>() : NULL;
+
+    if (shape && shape->GetShapeType() == SHAPE_BOX)
+    {
+        const Vector3 scale = weaponNode->GetWorldScale();
+
+        hitbox.bone_ = M_MAX_UNSIGNED;
+        hitbox.center_ = scale * shape->GetPosition();
+        hitbox.rotation_ = shape->GetRotation();
+        hitbox.halfExtents_ = scale * shape->GetSize() * 0.5f;
+
+        bladeHitbox_ = hitboxes_.Size();
+        hitboxNodes_.Push(WeakPtr<Node>(weaponNode));
+        hitboxes_.Push(hitbox);
+    }
+
+    for (unsigned i = 0; i < hitboxes_.Size(); ++i)
+    {
+        hitboxReach_.Push(hitboxes_[i].center_.Length() + hitboxes_[i].halfExtents_.Length());
+    }
+
+    frames_.Clear();
+    samples_.Clear();
+    Clear();
+
+    return !hitboxes_.Empty();
+}
+
+void PoseHistory::SetMemoryBudget(unsigned memoryBudget)
+{
+    const unsigned frameSize = sizeof(Frame) + hitboxes_.Size() * sizeof(PoseSample);
+    const unsigned capacity = Max(memoryBudget / frameSize, 2u);
+
+    frames_.Resize(capacity);
+    samples_.Resize(capacity * hitboxes_.Size());
+    Clear();
+}
+
+void PoseHistory::Clear()
+{
+    head_ = 0;
+    numFrames_ = 0;
+    newestStep_ = 0;
+}
+
+void PoseHistory::Record(unsigned step)
+{
+    if (frames_.Empty() || !rootNode_)
+    {
+        return;
+    }
+
+    // frames are found by their distance from the newest step: a skipped step starts over
+    if (numFrames_ && step != newestStep_ + 1)
+    {
+        Clear();
+    }
+
+    const unsigned numHitboxes = hitboxes_.Size();
+    const Vector3 rootPosition = rootNode_->GetWorldPosition();
+    Frame &frame = frames_[head_];
+    PoseSample *samples = &samples_[head_ * numHitboxes];
+    float radius = 0.0f;
+
+    for (unsigned i = 0; i < numHitboxes; ++i)
+    {
+        Node *node = hitboxNodes_[i];
+        const Vector3 offset = node ? node->GetWorldPosition() - rootPosition : Vector3::ZERO;
+        const Quaternion rotation = node ? node->GetWorldRotation() : Quaternion::IDENTITY;
+
+        EncodeSample(offset, rotation, samples[i]);
+        radius = Max(radius, offset.Length() + hitboxReach_[i]);
+    }
+
+    frame.step_ = step;
+    frame.rootPosition_ = rootPosition;
+    frame.radius_ = radius;
+
+    head_ = (head_ + 1) % frames_.Size();
+    numFrames_ = Min(numFrames_ + 1, frames_.Size());
+    newestStep_ = step;
+}
+
+unsigned PoseHistory::GetSlot(unsigned step) const
+{
+    if (!numFrames_ || step > newestStep_ || newestStep_ - step >= numFrames_)
+    {
+        return M_MAX_UNSIGNED;
+    }
+
+    const unsigned capacity = frames_.Size();
+
+    return (head_ + capacity - 1 - (newestStep_ - step)) % capacity;
+}
+
+void PoseHistory::Decode(unsigned slot, unsigned hitbox, Vector3 &position, Quaternion &rotation) const
+{
+    Vector3 offset;
+
+    DecodeSample(samples_[slot * hitboxes_.Size() + hitbox], offset, rotation);
+    position = frames_[slot].rootPosition_ + offset;
+}
+
+bool PoseHistory::GetTransform(unsigned hitbox, float step, Vector3 &position, Quaternion &rotation) const
+{
+    if (hitbox >= hitboxes_.Size() || step < 0.0f)
+    {
+        return false;
+    }
+
+    const unsigned step0 = (unsigned)step;
+    const float t = step - (float)step0;
+    const unsigned slot0 = GetSlot(step0);
+
+    if (slot0 == M_MAX_UNSIGNED)
+    {
+        return false;
+    }
+
+    Vector3 nodePosition;
+    Quaternion nodeRotation;
+    Decode(slot0, hitbox, nodePosition, nodeRotation);
+
+    // past the newest step the newest frame is used
+    const unsigned slot1 = t > 0.0f ? GetSlot(step0 + 1) : M_MAX_UNSIGNED;
+
+    if (slot1 != M_MAX_UNSIGNED)
+    {
+        Vector3 nextPosition;
+        Quaternion nextRotation;
+        Decode(slot1, hitbox, nextPosition, nextRotation);
+
+        nodePosition = nodePosition.Lerp(nextPosition, t);
+        nodeRotation = nodeRotation.Slerp(nextRotation, t);
+    }
+
+    const PoseHitbox &box = hitboxes_[hitbox];
+    position = nodePosition + nodeRotation * box.center_;
+    rotation = nodeRotation * box.rotation_;
+
+    return true;
+}
+
+bool PoseHistory::GetBounds(float step, Vector3 &rootPosition, float &radius) const
+{
+    if (step < 0.0f)
+    {
+        return false;
+    }
+
+    const unsigned step0 = (unsigned)step;
+    const unsigned slot0 = GetSlot(step0);
+
+    if (slot0 == M_MAX_UNSIGNED)
+    {
+        return false;
+    }
+
+    rootPosition = frames_[slot0].rootPosition_;
+    radius = frames_[slot0].radius_;
+
+    const unsigned slot1 = step > (float)step0 ? GetSlot(step0 + 1) : M_MAX_UNSIGNED;
+
+    if (slot1 != M_MAX_UNSIGNED)
+    {
+        // the interpolated pose lies within both frames' spheres, so the larger one grown by the root movement holds it
+        const Vector3 &nextPosition = frames_[slot1].rootPosition_;
+        radius = Max(radius, frames_[slot1].radius_) + (nextPosition - rootPosition).Length();
+    }
+
+    return true;
+}
+
+unsigned PoseHistory::GetMemoryUse() const
+{
+    return frames_.Size() * sizeof(Frame) + samples_.Size() * sizeof(PoseSample);
+}
+
+//=============================================================================
+//=============================================================================
+PoseHistorySystem::PoseHistorySystem(Context* context) :
+    Component(context),
+    memoryBudget_(POSE_HISTORY_DEFAULT_BUDGET),
+    step_(0),
+    timeStep_(0.0f)
+{
+}
+
+void PoseHistorySystem::RegisterObject(Context* context)
+{
+    context->RegisterFactory<PoseHistorySystem>();
+
+    URHO3D_ACCESSOR_ATTRIBUTE("Memory Budget", GetMemoryBudget, SetMemoryBudget, unsigned, POSE_HISTORY_DEFAULT_BUDGET, AM_DEFAULT);
+}
+
+void PoseHistorySystem::OnSceneSet(Scene* scene)
+{
+    PhysicsWorld *physicsWorld = scene ? scene->GetComponent<PhysicsWorld>() : NULL;
+
+    physicsWorld_ = physicsWorld;
+
+    if (physicsWorld)
+        SubscribeToEvent(physicsWorld, E_PHYSICSPOSTSTEP, URHO3D_HANDLER(PoseHistorySystem, HandlePhysicsPostStep));
+    else
+        UnsubscribeFromEvent(E_PHYSICSPOSTSTEP);
+}
+
+void PoseHistorySystem::AddCharacter(Character *character)
+{
+    if (!character || characters_.Contains(WeakPtr<Character>(character)))
+    {
+        return;
+    }
+
+    AnimatedModel *model = character->animCtrl_ ? character->animCtrl_->GetNode()->GetComponent<AnimatedModel>() : NULL;
+    SharedPtr<PoseHistory> history(new PoseHistory());
+
+    if (!history->Define(character->GetNode(), model, character->weaponNode_))
+    {
+        return;
+    }
+
+    history->SetMemoryBudget(memoryBudget_);
+
+    characters_.Push(WeakPtr<Character>(character));
+    histories_.Push(history);
+    RebuildSlots();
+}
+
+void PoseHistorySystem::RemoveCharacter(Character *character)
+{
+    HashMap<Character*, unsigned>::ConstIterator slot = slots_.Find(character);
+
+    if (slot != slots_.End())
+    {
+        characters_.Erase(slot->second_);
+        histories_.Erase(slot->second_);
+        RebuildSlots();
+    }
+}
+
+void PoseHistorySystem::RebuildSlots()
+{
+    // drop destroyed characters
+    for (unsigned i = 0; i < characters_.Size();)
+    {
+        if (characters_[i])
+        {
+            ++i;
+        }
+        else
+        {
+            characters_.Erase(i);
+            histories_.Erase(i);
+        }
+    }
+
+    slots_.Clear();
+
+    for (unsigned i = 0; i < characters_.Size(); ++i)
+    {
+        slots_[characters_[i].Get()] = i;
+    }
+}
+
+void PoseHistorySystem::SetMemoryBudget(unsigned memoryBudget)
+{
+    memoryBudget_ = memoryBudget;
+
+    for (unsigned i = 0; i < histories_.Size(); ++i)
+    {
+        histories_[i]->SetMemoryBudget(memoryBudget_);
+    }
+}
+
+PoseHistory* PoseHistorySystem::GetHistory(Character *character) const
+{
+    HashMap<Character*, unsigned>::ConstIterator slot = slots_.Find(character);
+
+    return slot != slots_.End() ? histories_[slot->second_].Get() : NULL;
+}
+
+bool PoseHistorySystem::GetBladePose(Character *character, float time, Vector3 &position, Quaternion &rotation) const
+{
+    PoseHistory *history = GetHistory(character);
+
+    if (!history || history->GetBladeHitbox() == M_MAX_UNSIGNED || timeStep_ <= 0.0f)
+    {
+        return false;
+    }
+
+    // the hitbox transform is the box's: take its offset back off for the hilt
+    const PoseHitbox &blade = history->GetHitbox(history->GetBladeHitbox());
+
+    if (!history->GetTransform(history->GetBladeHitbox(), time / timeStep_, position, rotation))
+    {
+        return false;
+    }
+
+    rotation = rotation * blade.rotation_.Inverse();
+    position -= rotation * blade.center_;
+
+    return true;
+}
+
+unsigned PoseHistorySystem::SweepAtTime(Character *attacker, const Vector3 &fromPosition, const Quaternion &fromRotation,
+                                        const Vector3 &toPosition, const Quaternion &toRotation, float time, PODVector<PoseHit> &hits) const
+{
+    Node *weaponNode = attacker ? attacker->weaponNode_.Get() : NULL;
+    CollisionShape *shape = weaponNode ? weaponNode->GetComponent<CollisionShape>() : NULL;
+    btCollisionShape *btShape = shape ? shape->GetCollisionShape() : NULL;
+
+    if (!btShape || !btShape->isConvex() || timeStep_ <= 0.0f)
+    {
+        return 0;
+    }
+
+    const btConvexShape *castShape = static_cast<btConvexShape*>(btShape);
+    const float step = time / timeStep_;
+    const unsigned numSubSteps = GetMeleeSweepSubSteps(fromRotation, toRotation);
+
+    // the box is offset from the hilt, same as in the melee sweep
+    const Vector3 offsetPosition = weaponNode->GetWorldScale() * shape->GetPosition();
+    const Quaternion &offsetRotation = shape->GetRotation();
+    const float bladeReach = offsetPosition.Length() + (weaponNode->GetWorldScale() * shape->GetSize()).Length() * 0.5f;
+
+    BoundingBox hiltBounds(fromPosition, fromPosition);
+    hiltBounds.Merge(toPosition);
+
+    const unsigned oldNumHits = hits.Size();
+    PODVector<Vector3> hitboxPositions;
+    PODVector<Quaternion> hitboxRotations;
+
+    for (unsigned i = 0; i < characters_.Size(); ++i)
+    {
+        Character *target = characters_[i];
+        const PoseHistory *history = histories_[i];
+        Vector3 rootPosition;
+        float radius;
+
+        if (!target || target == attacker || !history->GetBounds(step, rootPosition, radius))
+        {
+            continue;
+        }
+
+        // the target's bounding sphere against the hilt's path grown by the blade
+        const Vector3 closest(Clamp(rootPosition.x_, hiltBounds.min_.x_, hiltBounds.max_.x_),
+                              Clamp(rootPosition.y_, hiltBounds.min_.y_, hiltBounds.max_.y_),
+                              Clamp(rootPosition.z_, hiltBounds.min_.z_, hiltBounds.max_.z_));
+
+        if ((rootPosition - closest).Length() > radius + bladeReach)
+        {
+            continue;
+        }
+
+        const unsigned numHitboxes = history->GetNumHitboxes();
+        hitboxPositions.Resize(numHitboxes);
+        hitboxRotations.Resize(numHitboxes);
+
+        for (unsigned j = 0; j < numHitboxes; ++j)
+        {
+            history->GetTransform(j, step, hitboxPositions[j], hitboxRotations[j]);
+        }
+
+        // sub-step by sub-step, so the first hitbox the swing reaches is reported
+        bool hit = false;
+        Vector3 subFromPosition = fromPosition;
+        Quaternion subFromRotation = fromRotation;
+
+        for (unsigned j = 1; j <= numSubSteps && !hit; ++j)
+        {
+            const float t = (float)j / (float)numSubSteps;
+            const Vector3 subToPosition = fromPosition.Lerp(toPosition, t);
+            const Quaternion subToRotation = fromRotation.Slerp(toRotation, t);
+
+            const btTransform from(ToBtQuaternion(subFromRotation * offsetRotation), ToBtVector3(subFromPosition + subFromRotation * offsetPosition));
+            const btTransform to(ToBtQuaternion(subToRotation * offsetRotation), ToBtVector3(subToPosition + subToRotation * offsetPosition));
+
+            for (unsigned k = 0; k < numHitboxes && !hit; ++k)
+            {
+                // a target's own blade takes no damage
+                if (k == history->GetBladeHitbox())
+                    continue;
+
+                const btTransform hitboxTransform(ToBtQuaternion(hitboxRotations[k]), ToBtVector3(hitboxPositions[k]));
+                btBoxShape box(ToBtVector3(history->GetHitbox(k).halfExtents_));
+                btCollisionObject object;
+                object.setCollisionShape(&box);
+                object.setWorldTransform(hitboxTransform);
+
+                btCollisionWorld::ClosestConvexResultCallback resultCallback(from.getOrigin(), to.getOrigin());
+                btCollisionWorld::objectQuerySingle(castShape, from, to, &object, &box, hitboxTransform, resultCallback, 0.0f);
+
+                if (resultCallback.hasHit())
+                {
+                    PoseHit poseHit;
+                    poseHit.node_ = target->GetNode();
+                    poseHit.hitbox_ = k;
+                    poseHit.position_ = ToVector3(resultCallback.m_hitPointWorld);
+                    hits.Push(poseHit);
+                    hit = true;
+                }
+            }
+
+            subFromPosition = subToPosition;
+            subFromRotation = subToRotation;
+        }
+    }
+
+    return hits.Size() - oldNumHits;
+}
+
+void PoseHistorySystem::HandlePhysicsPostStep(StringHash eventType, VariantMap& eventData)
+{
+    using namespace PhysicsPostStep;
+
+    timeStep_ = eventData[P_TIMESTEP].GetFloat();
+    ++step_;
+
+    // reallocates only when a character was destroyed since the last step
+    for (unsigned i = 0; i < characters_.Size(); ++i)
+    {
+        if (!characters_[i])
+        {
+            RebuildSlots();
+            break;
+        }
+    }
+
+    // a parked character's past poses are no longer valid targets
+    for (unsigned i = 0; i < histories_.Size(); ++i)
+    {
+        if (characters_[i]->IsEnabledEffective())
+            histories_[i]->Record(step_);
+        else
+            histories_[i]->Clear();
+    }
+}
@@ -0,0 +1,209 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#pragma once
+
+#include <Urho3D/Container/HashMap.h>
+#include <Urho3D/Scene/Component.h>
+
+using namespace Urho3D;
+namespace Urho3D
+{
+class AnimatedModel;
+class PhysicsWorld;
+}
+
+class Character;
+
+/// Default ring buffer memory per character.
+const unsigned POSE_HISTORY_DEFAULT_BUDGET = 32 * 1024;
+
+//=============================================================================
+// a box hit volume in the space of the node that carries it: a skeleton
+// bone's bounding box, or the blade's collision box
+//=============================================================================
+struct PoseHitbox
+{
+    /// Skeleton bone index, or M_MAX_UNSIGNED for the blade.
+    unsigned bone_;
+    /// Box center and rotation relative to the node, scaled to world size.
+    Vector3 center_;
+    Quaternion rotation_;
+    Vector3 halfExtents_;
+};
+
+//=============================================================================
+// quantized node transform: position relative to the character's root in
+// 16-bit fixed point, rotation as the smallest three quaternion components
+//=============================================================================
+struct PoseSample
+{
+    short position_[3];
+    short rotation_[3];
+    /// Index of the omitted largest rotation component.
+    unsigned char largest_;
+    unsigned char padding_;
+};
+
+//=============================================================================
+// a hit found in a rewound sweep
+//=============================================================================
+struct PoseHit
+{
+    Node *node_;
+    /// Hitbox of the target's history that was hit.
+    unsigned hitbox_;
+    Vector3 position_;
+};
+
+//=============================================================================
+// fixed-size ring buffer of one character's hitbox poses, one frame per
+// physics step. Frames are recorded for consecutive steps, so the frame of a
+// step is found by its distance from the newest one without a search.
+//=============================================================================
+class PoseHistory : public RefCounted
+{
+public:
+    PoseHistory();
+
+    /// Collect the hitboxes: the skeleton bones with a bounding box, and the blade's collision box if there is a weapon node. Return false if there are none.
+    bool Define(Node *rootNode, AnimatedModel *model, Node *weaponNode);
+    /// Allocate as many frames as fit in a memory budget, at least two. Clears the history.
+    void SetMemoryBudget(unsigned memoryBudget);
+    /// Record the current pose as a physics step's frame.
+    void Record(unsigned step);
+    /// Clear the history.
+    void Clear();
+
+    /// Return a hitbox's world transform at a fractional step, interpolated between the frames around it. Return false if the step is outside the history.
+    bool GetTransform(unsigned hitbox, float step, Vector3 &position, Quaternion &rotation) const;
+    /// Return the root position and the radius around it that holds all hitboxes at a fractional step. Return false if the step is outside the history.
+    bool GetBounds(float step, Vector3 &rootPosition, float &radius) const;
+
+    /// Return number of hitboxes.
+    unsigned GetNumHitboxes() const { return hitboxes_.Size(); }
+    /// Return a hitbox.
+    const PoseHitbox& GetHitbox(unsigned index) const { return hitboxes_[index]; }
+    /// Return the blade's hitbox index, or M_MAX_UNSIGNED.
+    unsigned GetBladeHitbox() const { return bladeHitbox_; }
+    /// Return the number of recorded frames.
+    unsigned GetNumFrames() const { return numFrames_; }
+    /// Return the frame capacity.
+    unsigned GetCapacity() const { return frames_.Size(); }
+    /// Return the step of the newest frame.
+    unsigned GetNewestStep() const { return newestStep_; }
+    /// Return the ring buffer memory use in bytes.
+    unsigned GetMemoryUse() const;
+
+private:
+    struct Frame
+    {
+        unsigned step_;
+        Vector3 rootPosition_;
+        float radius_;
+    };
+
+    /// Return the ring buffer slot of a step, or M_MAX_UNSIGNED if it isn't recorded.
+    unsigned GetSlot(unsigned step) const;
+    void Decode(unsigned slot, unsigned hitbox, Vector3 &position, Quaternion &rotation) const;
+
+    WeakPtr<Node> rootNode_;
+    Vector<WeakPtr<Node> > hitboxNodes_;
+    PODVector<PoseHitbox> hitboxes_;
+    /// Largest hitbox center distance from its node plus half diagonal.
+    PODVector<float> hitboxReach_;
+    unsigned bladeHitbox_;
+
+    PODVector<Frame> frames_;
+    /// Frame after frame, one sample per hitbox.
+    PODVector<PoseSample> samples_;
+    unsigned head_;
+    unsigned numFrames_;
+    unsigned newestStep_;
+};
+
+//=============================================================================
+// pose history for lag-compensated hit validation. After every physics step
+// the hitboxes of all registered characters are recorded: the skeleton
+// bones' bounding boxes and the sword. Memory per character is bounded by a
+// budget that sets its ring buffer's frame count.
+//
+// A server validates an attacker's swing against the targets as the attacker
+// saw them: SweepAtTime casts the blade against every other character's
+// hitboxes rewound to a past time, interpolated between the recorded steps.
+// Rewound sweeps run on the main thread and don't touch the physics world.
+//=============================================================================
+class PoseHistorySystem : public Component
+{
+    URHO3D_OBJECT(PoseHistorySystem, Component);
+
+public:
+    /// Construct.
+    PoseHistorySystem(Context* context);
+
+    /// Register object factory and attributes.
+    static void RegisterObject(Context* context);
+
+    /// Add a character.
+    void AddCharacter(Character *character);
+    /// Remove a character.
+    void RemoveCharacter(Character *character);
+
+    /// Set ring buffer memory per character in bytes. Clears the histories.
+    void SetMemoryBudget(unsigned memoryBudget);
+    /// Return ring buffer memory per character in bytes.
+    unsigned GetMemoryBudget() const { return memoryBudget_; }
+
+    /// Return the history time of the newest recorded step.
+    float GetTime() const { return step_ * timeStep_; }
+    /// Return the length of a recorded step, 0 before the first one.
+    float GetTimeStep() const { return timeStep_; }
+    /// Return a character's history, or null.
+    PoseHistory* GetHistory(Character *character) const;
+    /// Return the blade's hilt pose of a character at a past time. Return false if the time is outside its history.
+    bool GetBladePose(Character *character, float time, Vector3 &position, Quaternion &rotation) const;
+
+    /// Sweep the attacker's blade from one hilt pose to another against the other characters' hitboxes at a past time.
+    /// Hits are appended to the list, at most one per target. Return the number of hits added.
+    unsigned SweepAtTime(Character *attacker, const Vector3 &fromPosition, const Quaternion &fromRotation,
+                         const Vector3 &toPosition, const Quaternion &toRotation, float time, PODVector<PoseHit> &hits) const;
+
+protected:
+    /// Handle scene being assigned.
+    virtual void OnSceneSet(Scene* scene);
+
+private:
+    void HandlePhysicsPostStep(StringHash eventType, VariantMap& eventData);
+    void RebuildSlots();
+
+    Vector<WeakPtr<Character> > characters_;
+    Vector<SharedPtr<PoseHistory> > histories_;
+    /// History index by character.
+    HashMap<Character*, unsigned> slots_;
+    unsigned memoryBudget_;
+    /// Physics steps recorded and their length.
+    unsigned step_;
+    float timeStep_;
+
+    WeakPtr<PhysicsWorld> physicsWorld_;
+};
@@ -0,0 +1,227 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Graphics/Geometry.h>
+#include <Urho3D/Graphics/IndexBuffer.h>
+#include <Urho3D/Graphics/VertexBuffer.h>
+#include <Urho3D/IO/Deserializer.h>
+#include <Urho3D/IO/FileSystem.h>
+#include <Urho3D/IO/Log.h>
+#include <Urho3D/IO/Serializer.h>
+
+#include "QuantizedModel.h"
+#include "GeometryUtils.h"
+
+#include <Urho3D/DebugNew.h>
+//=============================================================================
+//=============================================================================
+QuantizedModel::QuantizedModel(Context* context) :
+    Model(context)
+{
+}
+
+QuantizedModel::~QuantizedModel()
+{
+}
+
+void QuantizedModel::RegisterObject(Context* context)
+{
+    context->RegisterFactory<QuantizedModel>();
+}
+
+bool QuantizedModel::BeginLoad(Deserializer& source)
+{
+    if (source.ReadFileID() != "QMDL")
+    {
+        URHO3D_LOGERROR(source.GetName() + " is not a valid quantized model file");
+        return false;
+    }
+
+    loadBuffers_.Clear();
+    loadBuffers_.Resize(source.ReadUInt());
+
+    for (unsigned i = 0; i < loadBuffers_.Size(); ++i)
+    {
+        if (!loadBuffers_[i].Read(source))
+        {
+            URHO3D_LOGERROR("Corrupt quantized vertex buffer in " + source.GetName());
+            loadBuffers_.Clear();
+            return false;
+        }
+    }
+
+    // skeleton, index buffers and geometries follow as a regular model
+    return Model::BeginLoad(source);
+}
+
+bool QuantizedModel::EndLoad()
+{
+    if (!Model::EndLoad())
+    {
+        return false;
+    }
+
+    const Vector<SharedPtr<VertexBuffer> > emptyBuffers = GetVertexBuffers();
+
+    if (emptyBuffers.Size() != loadBuffers_.Size())
+    {
+        URHO3D_LOGERROR("Vertex buffer count mismatch in " + GetName());
+        loadBuffers_.Clear();
+        return false;
+    }
+
+    Vector<SharedPtr<VertexBuffer> > buffers;
+    unsigned memoryUse = GetMemoryUse();
+
+    for (unsigned i = 0; i < loadBuffers_.Size(); ++i)
+    {
+        PODVector<VertexElement> elements;
+        PODVector<unsigned char> data;
+
+        loadBuffers_[i].Decode(elements, data);
+
+        SharedPtr<VertexBuffer> buffer(new VertexBuffer(context_));
+        buffer->SetShadowed(true);
+        buffer->SetSize(loadBuffers_[i].vertexCount_, elements);
+
+        if (!data.Empty())
+        {
+            buffer->SetData(data.Buffer());
+        }
+
+        buffers.Push(buffer);
+        memoryUse += data.Size();
+    }
+
+    // point the geometries at the decoded buffers
+    for (unsigned i = 0; i < GetNumGeometries(); ++i)
+    {
+        for (unsigned j = 0; j < GetNumGeometryLodLevels(i); ++j)
+        {
+            Geometry* geometry = GetGeometry(i, j);
+
+            for (unsigned k = 0; k < geometry->GetNumVertexBuffers(); ++k)
+            {
+                const unsigned index = emptyBuffers.IndexOf(SharedPtr<VertexBuffer>(geometry->GetVertexBuffer(k)));
+
+                if (index < buffers.Size())
+                {
+                    geometry->SetVertexBuffer(k, buffers[index]);
+
+                    // the raw data used by CPU raycasts and occlusion still points at the empty buffer
+                    if (k == 0)
+                        geometry->SetRawVertexData(buffers[index]->GetShadowDataShared(), buffers[index]->GetElements());
+                }
+            }
+        }
+    }
+
+    SetModelBuffers(this);
+    SetMemoryUse(memoryUse);
+    loadBuffers_.Clear();
+
+    return true;
+}
+
+bool QuantizedModel::SaveQuantized(Model* model, const Vector<QuantizedVertexBuffer>& buffers, Serializer& dest)
+{
+    const Vector<SharedPtr<VertexBuffer> >& vertexBuffers = model->GetVertexBuffers();
+
+    if (model->GetNumMorphs() || buffers.Size() != vertexBuffers.Size())
+    {
+        return false;
+    }
+
+    // same model around empty vertex buffers of the source layouts
+    Context* context = model->GetContext();
+    SharedPtr<Model> shell(new Model(context));
+    Vector<SharedPtr<VertexBuffer> > emptyBuffers;
+    Vector<PODVector<unsigned> > boneMappings = model->GetGeometryBoneMappings();
+    PODVector<unsigned> morphRanges(vertexBuffers.Size());
+
+    for (unsigned i = 0; i < vertexBuffers.Size(); ++i)
+    {
+        SharedPtr<VertexBuffer> buffer(new VertexBuffer(context));
+        buffer->SetShadowed(true);
+        buffer->SetSize(0, vertexBuffers[i]->GetElements());
+        emptyBuffers.Push(buffer);
+        morphRanges[i] = 0;
+    }
+
+    shell->SetSkeleton(model->GetSkeleton());
+    shell->SetBoundingBox(model->GetBoundingBox());
+    shell->SetNumGeometries(model->GetNumGeometries());
+
+    for (unsigned i = 0; i < model->GetNumGeometries(); ++i)
+    {
+        shell->SetNumGeometryLodLevels(i, model->GetNumGeometryLodLevels(i));
+        shell->SetGeometryCenter(i, model->GetGeometryCenter(i));
+
+        for (unsigned j = 0; j < model->GetNumGeometryLodLevels(i); ++j)
+        {
+            Geometry* source = model->GetGeometry(i, j);
+
+            if (source->GetNumVertexBuffers() != 1)
+            {
+                return false;
+            }
+
+            const unsigned index = vertexBuffers.IndexOf(SharedPtr<VertexBuffer>(source->GetVertexBuffer(0)));
+
+            if (index >= emptyBuffers.Size())
+            {
+                return false;
+            }
+
+            SharedPtr<Geometry> geometry(new Geometry(context));
+            geometry->SetVertexBuffer(0, emptyBuffers[index]);
+            geometry->SetIndexBuffer(source->GetIndexBuffer());
+            geometry->SetDrawRange(source->GetPrimitiveType(), source->GetIndexStart(), source->GetIndexCount(),
+                                   source->GetVertexStart(), source->GetVertexCount(), false);
+            geometry->SetLodDistance(source->GetLodDistance());
+            shell->SetGeometry(i, j, geometry);
+        }
+    }
+
+    shell->SetGeometryBoneMappings(boneMappings);
+    shell->SetVertexBuffers(emptyBuffers, morphRanges, morphRanges);
+    shell->SetIndexBuffers(model->GetIndexBuffers());
+
+    bool success = dest.WriteFileID("QMDL");
+    success &= dest.WriteUInt(buffers.Size());
+
+    for (unsigned i = 0; i < buffers.Size(); ++i)
+    {
+        success &= buffers[i].Write(dest);
+    }
+
+    return success && shell->Save(dest);
+}
+
+//=============================================================================
+//=============================================================================
+StringHash GetModelResourceType(const String& name)
+{
+    return GetExtension(name) == ".qmdl" ? QuantizedModel::GetTypeStatic() : Model::GetTypeStatic();
+}
+
@@ -0,0 +1,63 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#pragma once
+
+#include <Urho3D/Graphics/Model.h>
+
+#include "VertexQuantizer.h"
+
+using namespace Urho3D;
+
+//=============================================================================
+// model loaded from a .qmdl file: quantized vertex buffers followed by a
+// regular model stream whose vertex buffers are empty. Loading decodes the
+// vertices into drawable buffers, see QuantizedVertexBuffer. Use it
+// wherever a Model is expected.
+//=============================================================================
+class QuantizedModel : public Model
+{
+    URHO3D_OBJECT(QuantizedModel, Model);
+
+public:
+    /// Construct.
+    QuantizedModel(Context* context);
+    /// Destruct.
+    virtual ~QuantizedModel();
+    /// Register object factory.
+    static void RegisterObject(Context* context);
+
+    /// Load resource from stream. May be called from a worker thread. Return true if successful.
+    virtual bool BeginLoad(Deserializer& source);
+    /// Finish resource loading. Always called from the main thread. Return true if successful.
+    virtual bool EndLoad();
+
+    /// Write a model with already quantized vertex buffers, one per model vertex buffer. Models with vertex morphs are not supported.
+    static bool SaveQuantized(Model* model, const Vector<QuantizedVertexBuffer>& buffers, Serializer& dest);
+
+private:
+    Vector<QuantizedVertexBuffer> loadBuffers_;
+};
+
+/// Return the model type matching a model resource name, QuantizedModel for .qmdl files.
+StringHash GetModelResourceType(const String& name);
+
@@ -0,0 +1,359 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include <Urho3D/Graphics/AnimatedModel.h>
+#include <Urho3D/Graphics/Model.h>
+#include <Urho3D/Scene/Node.h>
+
+#include "SkinnedHitMesh.h"
+#include "GeometryUtils.h"
+
+#ifdef URHO3D_SSE
+#include <xmmintrin.h>
+#endif
+
+// AVX is compiled per function and picked at runtime, the rest of the build stays at its SSE level
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#define SKINNING_AVX
+#define SKINNING_AVX_TARGET __attribute__((target("avx")))
+#include <immintrin.h>
+#elif defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+#define SKINNING_AVX
+#define SKINNING_AVX_TARGET
+#include <immintrin.h>
+#include <intrin.h>
+#endif
+
+#include <Urho3D/DebugNew.h>
+//=============================================================================
+//=============================================================================
+static void SkinVerticesScalar(const Vector4 *positions, const SkinWeights *weights, unsigned count,
+                               const Matrix3x4 *skinMatrices, Vector4 *dest)
+{
+    for (unsigned i = 0; i < count; ++i)
+    {
+        const SkinWeights &influence = weights[i];
+        const float *m0 = &skinMatrices[influence.bones_[0]].m00_;
+        const float *m1 = &skinMatrices[influence.bones_[1]].m00_;
+        const float *m2 = &skinMatrices[influence.bones_[2]].m00_;
+        const float *m3 = &skinMatrices[influence.bones_[3]].m00_;
+        const float w0 = influence.weights_[0];
+        const float w1 = influence.weights_[1];
+        const float w2 = influence.weights_[2];
+        const float w3 = influence.weights_[3];
+        float m[12];
+
+        for (unsigned j = 0; j < 12; ++j)
+        {
+            m[j] = m0[j] * w0 + m1[j] * w1 + m2[j] * w2 + m3[j] * w3;
+        }
+
+        const Vector4 &p = positions[i];
+
+        dest[i] = Vector4(m[0] * p.x_ + m[1] * p.y_ + m[2]  * p.z_ + m[3],
+                          m[4] * p.x_ + m[5] * p.y_ + m[6]  * p.z_ + m[7],
+                          m[8] * p.x_ + m[9] * p.y_ + m[10] * p.z_ + m[11],
+                          0.0f);
+    }
+}
+
+#ifdef URHO3D_SSE
+static void SkinVerticesSSE(const Vector4 *positions, const SkinWeights *weights, unsigned count,
+                            const Matrix3x4 *skinMatrices, Vector4 *dest)
+{
+    for (unsigned i = 0; i < count; ++i)
+    {
+        const SkinWeights &influence = weights[i];
+        __m128 row0 = _mm_setzero_ps();
+        __m128 row1 = _mm_setzero_ps();
+        __m128 row2 = _mm_setzero_ps();
+
+        for (unsigned k = 0; k < 4; ++k)
+        {
+            const float *m = &skinMatrices[influence.bones_[k]].m00_;
+            const __m128 weight = _mm_set1_ps(influence.weights_[k]);
+
+            row0 = _mm_add_ps(row0, _mm_mul_ps(_mm_loadu_ps(m), weight));
+            row1 = _mm_add_ps(row1, _mm_mul_ps(_mm_loadu_ps(m + 4), weight));
+            row2 = _mm_add_ps(row2, _mm_mul_ps(_mm_loadu_ps(m + 8), weight));
+        }
+
+        // rows times (x, y, z, 1), transposed so one add sums each row
+        const __m128 p = _mm_loadu_ps(&positions[i].x_);
+        __m128 x = _mm_mul_ps(row0, p);
+        __m128 y = _mm_mul_ps(row1, p);
+        __m128 z = _mm_mul_ps(row2, p);
+        __m128 w = _mm_setzero_ps();
+
+        _MM_TRANSPOSE4_PS(x, y, z, w);
+        _mm_storeu_ps(&dest[i].x_, _mm_add_ps(_mm_add_ps(x, y), _mm_add_ps(z, w)));
+    }
+}
+#endif
+
+#ifdef SKINNING_AVX
+SKINNING_AVX_TARGET static void SkinVerticesAVX(const Vector4 *positions, const SkinWeights *weights, unsigned count,
+                                                const Matrix3x4 *skinMatrices, Vector4 *dest)
+{
+    unsigned i = 0;
+
+    // two vertices per iteration, one per 128-bit lane
+    for (; i + 1 < count; i += 2)
+    {
+        const SkinWeights &a = weights[i];
+        const SkinWeights &b = weights[i + 1];
+        __m256 row0 = _mm256_setzero_ps();
+        __m256 row1 = _mm256_setzero_ps();
+        __m256 row2 = _mm256_setzero_ps();
+
+        for (unsigned k = 0; k < 4; ++k)
+        {
+            const float *ma = &skinMatrices[a.bones_[k]].m00_;
+            const float *mb = &skinMatrices[b.bones_[k]].m00_;
+            const __m256 weight = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_set1_ps(a.weights_[k])), _mm_set1_ps(b.weights_[k]), 1);
+
+            row0 = _mm256_add_ps(row0, _mm256_mul_ps(_mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(ma)), _mm_loadu_ps(mb), 1), weight));
+            row1 = _mm256_add_ps(row1, _mm256_mul_ps(_mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(ma + 4)), _mm_loadu_ps(mb + 4), 1), weight));
+            row2 = _mm256_add_ps(row2, _mm256_mul_ps(_mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(ma + 8)), _mm_loadu_ps(mb + 8), 1), weight));
+        }
+
+        const __m256 p = _mm256_loadu_ps(&positions[i].x_);
+        const __m256 x = _mm256_mul_ps(row0, p);
+        const __m256 y = _mm256_mul_ps(row1, p);
+        const __m256 z = _mm256_mul_ps(row2, p);
+
+        // per lane horizontal sums give (x, y, z, 0)
+        const __m256 xy = _mm256_hadd_ps(x, y);
+        const __m256 zw = _mm256_hadd_ps(z, _mm256_setzero_ps());
+        _mm256_storeu_ps(&dest[i].x_, _mm256_hadd_ps(xy, zw));
+    }
+
+    if (i < count)
+    {
+        SkinVerticesScalar(positions + i, weights + i, count - i, skinMatrices, dest + i);
+    }
+}
+#endif
+
+static bool HasAVX()
+{
+#if defined(SKINNING_AVX) && defined(__GNUC__)
+    return __builtin_cpu_supports("avx") != 0;
+#elif defined(SKINNING_AVX)
+    int info[4];
+    __cpuid(info, 1);
+
+    // AVX and OS support for saving the ymm registers
+    return (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && (_xgetbv(0) & 6) == 6;
+#else
+    return false;
+#endif
+}
+
+//=============================================================================
+//=============================================================================
+bool IsSkinningKernelSupported(SkinningKernel kernel)
+{
+    static const bool hasAVX = HasAVX();
+
+    switch (kernel)
+    {
+    case SK_SSE:
+#ifdef URHO3D_SSE
+        return true;
+#else
+        return false;
+#endif
+
+    case SK_AVX:
+        return hasAVX;
+
+    default:
+        return true;
+    }
+}
+
+const char* GetSkinningKernelName(SkinningKernel kernel)
+{
+    static const char* names[] = { "scalar", "sse", "avx", "best" };
+    return names[kernel];
+}
+
+void SkinVertices(SkinningKernel kernel, const Vector4 *positions, const SkinWeights *weights, unsigned count,
+                  const Matrix3x4 *skinMatrices, Vector4 *dest)
+{
+    if (kernel == SK_BEST)
+    {
+        kernel = IsSkinningKernelSupported(SK_AVX) ? SK_AVX : IsSkinningKernelSupported(SK_SSE) ? SK_SSE : SK_SCALAR;
+    }
+
+#ifdef SKINNING_AVX
+    if (kernel == SK_AVX && IsSkinningKernelSupported(SK_AVX))
+    {
+        SkinVerticesAVX(positions, weights, count, skinMatrices, dest);
+        return;
+    }
+#endif
+#ifdef URHO3D_SSE
+    if (kernel == SK_SSE)
+    {
+        SkinVerticesSSE(positions, weights, count, skinMatrices, dest);
+        return;
+    }
+#endif
+
+    SkinVerticesScalar(positions, weights, count, skinMatrices, dest);
+}
+
+//=============================================================================
+//=============================================================================
+SkinnedHitMesh::SkinnedHitMesh() :
+    numBones_(0)
+{
+}
+
+bool SkinnedHitMesh::Define(Model *model, unsigned lodLevel)
+{
+    const Vector<PODVector<unsigned> > &boneMappings = model->GetGeometryBoneMappings();
+
+    bindPositions_.Clear();
+    weights_.Clear();
+    indices_.Clear();
+    numBones_ = model->GetSkeleton().GetNumBones();
+
+    for (unsigned i = 0; i < model->GetNumGeometries(); ++i)
+    {
+        const unsigned numLods = model->GetNumGeometryLodLevels(i);
+        GeometryData data;
+
+        if (!numLods || !ExtractGeometryData(model->GetGeometry(i, Min(lodLevel, numLods - 1)),
+                                             i < boneMappings.Size() ? boneMappings[i] : PODVector<unsigned>(), data))
+        {
+            continue;
+        }
+
+        const unsigned weightsOffset = data.GetElementOffset(SEM_BLENDWEIGHTS);
+        const VertexElementType weightsType = data.GetElementType(SEM_BLENDWEIGHTS);
+        const unsigned indicesOffset = data.GetElementOffset(SEM_BLENDINDICES);
+
+        if (data.primitiveType_ != TRIANGLE_LIST || weightsOffset == M_MAX_UNSIGNED || indicesOffset == M_MAX_UNSIGNED)
+        {
+            continue;
+        }
+
+        const unsigned vertexStart = bindPositions_.Size();
+
+        for (unsigned j = 0; j < data.vertexCount_; ++j)
+        {
+            const unsigned char *blendIndices = data.GetVertex(j) + indicesOffset;
+            SkinWeights influence;
+
+            ReadBlendWeights(data.GetVertex(j) + weightsOffset, weightsType, influence.weights_);
+
+            for (unsigned k = 0; k < 4; ++k)
+            {
+                // unweighted slots may hold anything, point them at a valid bone
+                const unsigned bone = influence.weights_[k] > 0.0f ? data.GetGlobalBone(blendIndices[k]) : 0;
+
+                influence.bones_[k] = bone < numBones_ ? bone : 0;
+                influence.weights_[k] = bone < numBones_ ? influence.weights_[k] : 0.0f;
+            }
+
+            bindPositions_.Push(Vector4(data.GetPosition(j), 1.0f));
+            weights_.Push(influence);
+        }
+
+        for (unsigned j = 0; j < data.indices_.Size(); ++j)
+        {
+            indices_.Push(data.indices_[j] + vertexStart);
+        }
+    }
+
+    skinnedPositions_.Resize(bindPositions_.Size());
+    boundingBox_.Clear();
+
+    return !bindPositions_.Empty();
+}
+
+void SkinnedHitMesh::Update(AnimatedModel *animatedModel, SkinningKernel kernel)
+{
+    GetSkinMatrices(animatedModel, skinMatrices_);
+    Update(skinMatrices_, kernel);
+}
+
+void SkinnedHitMesh::Update(const PODVector<Matrix3x4> &skinMatrices, SkinningKernel kernel)
+{
+    if (bindPositions_.Empty() || skinMatrices.Size() < numBones_)
+    {
+        return;
+    }
+
+    SkinVertices(kernel, &bindPositions_[0], &weights_[0], bindPositions_.Size(), &skinMatrices[0], &skinnedPositions_[0]);
+
+    boundingBox_.Clear();
+
+    for (unsigned i = 0; i < skinnedPositions_.Size(); ++i)
+    {
+        boundingBox_.Merge(GetPosition(i));
+    }
+}
+
+float SkinnedHitMesh::Raycast(const Ray &ray, unsigned *triangle) const
+{
+    float closest = M_INFINITY;
+
+    if (indices_.Empty() || ray.HitDistance(boundingBox_) == M_INFINITY)
+    {
+        return closest;
+    }
+
+    for (unsigned i = 0; i + 2 < indices_.Size(); i += 3)
+    {
+        const float distance = ray.HitDistance(GetPosition(indices_[i]), GetPosition(indices_[i + 1]), GetPosition(indices_[i + 2]));
+
+        if (distance < closest)
+        {
+            closest = distance;
+
+            if (triangle)
+            {
+                *triangle = i / 3;
+            }
+        }
+    }
+
+    return closest;
+}
+
+void SkinnedHitMesh::GetSkinMatrices(AnimatedModel *animatedModel, PODVector<Matrix3x4> &dest)
+{
+    const Vector<Bone> &bones = animatedModel->GetSkeleton().GetBones();
+
+    dest.Resize(bones.Size());
+
+    for (unsigned i = 0; i < bones.Size(); ++i)
+    {
+        const Bone &bone = bones[i];
+        dest[i] = bone.node_ ? bone.node_->GetWorldTransform() * bone.offsetMatrix_ : Matrix3x4::IDENTITY;
+    }
+}
+
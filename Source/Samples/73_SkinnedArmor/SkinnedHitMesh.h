@@ -0,0 +1,111 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#pragma once
+
+#include <Urho3D/Container/RefCounted.h>
+#include <Urho3D/Math/BoundingBox.h>
+#include <Urho3D/Math/Matrix3x4.h>
+#include <Urho3D/Math/Ray.h>
+#include <Urho3D/Math/Vector4.h>
+
+using namespace Urho3D;
+namespace Urho3D
+{
+class AnimatedModel;
+class Model;
+}
+
+//=============================================================================
+//=============================================================================
+enum SkinningKernel
+{
+    SK_SCALAR = 0,
+    SK_SSE,
+    SK_AVX,
+    /// Fastest supported.
+    SK_BEST
+};
+
+//=============================================================================
+// four influences in skeleton bone indices
+//=============================================================================
+struct SkinWeights
+{
+    float    weights_[4];
+    unsigned bones_[4];
+};
+
+/// Return whether a kernel is compiled in and supported by the CPU.
+bool IsSkinningKernelSupported(SkinningKernel kernel);
+/// Return the kernel's name.
+const char* GetSkinningKernelName(SkinningKernel kernel);
+/// Skin bind pose positions (w = 1) into dest (w = 0). Falls back to scalar when the kernel isn't supported.
+void SkinVertices(SkinningKernel kernel, const Vector4 *positions, const SkinWeights *weights, unsigned count,
+                  const Matrix3x4 *skinMatrices, Vector4 *dest);
+
+//=============================================================================
+// CPU-skinned copy of a model's skinned geometries for exact hit tests where
+// nothing is rendered, e.g. on a headless server. Skin matrices are taken
+// from the AnimatedModel's bone nodes the way it would compute them for
+// rendering. Build it from a higher lod level for a decimated hit mesh.
+//=============================================================================
+class SkinnedHitMesh : public RefCounted
+{
+public:
+    SkinnedHitMesh();
+
+    /// Copy the skinned geometries of a model at a lod level (clamped per geometry). Return false if nothing is skinned.
+    bool Define(Model *model, unsigned lodLevel = 0);
+    /// Skin with the AnimatedModel's current pose into world space.
+    void Update(AnimatedModel *animatedModel, SkinningKernel kernel = SK_BEST);
+    /// Skin with explicit skin matrices, one per skeleton bone.
+    void Update(const PODVector<Matrix3x4> &skinMatrices, SkinningKernel kernel = SK_BEST);
+    /// Return distance to the closest front-facing triangle hit, or infinity. Optionally return the triangle index.
+    float Raycast(const Ray &ray, unsigned *triangle = NULL) const;
+
+    /// Return vertex count.
+    unsigned GetNumVertices() const { return bindPositions_.Size(); }
+    /// Return triangle count.
+    unsigned GetNumTriangles() const { return indices_.Size() / 3; }
+    /// Return bind pose positions.
+    const PODVector<Vector4>& GetBindPositions() const { return bindPositions_; }
+    /// Return bone influences.
+    const PODVector<SkinWeights>& GetSkinWeights() const { return weights_; }
+    /// Return skinned position.
+    Vector3 GetPosition(unsigned vertex) const { return Vector3(&skinnedPositions_[vertex].x_); }
+    /// Return bounds of the skinned positions.
+    const BoundingBox& GetBoundingBox() const { return boundingBox_; }
+
+    /// Compute world space skin matrices from an AnimatedModel's bones.
+    static void GetSkinMatrices(AnimatedModel *animatedModel, PODVector<Matrix3x4> &dest);
+
+private:
+    PODVector<Vector4>     bindPositions_;
+    PODVector<SkinWeights> weights_;
+    PODVector<unsigned>    indices_;
+    PODVector<Vector4>     skinnedPositions_;
+    PODVector<Matrix3x4>   skinMatrices_;
+    BoundingBox            boundingBox_;
+    unsigned               numBones_;
+};
+
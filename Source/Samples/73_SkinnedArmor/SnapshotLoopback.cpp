@@ -0,0 +1,250 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#include <Urho3D/Container/Sort.h>
+#include <Urho3D/Physics/PhysicsEvents.h>
+#include <Urho3D/Physics/PhysicsWorld.h>
+#include <Urho3D/Scene/Scene.h>
+
+#include "SnapshotLoopback.h"
+#include "Character.h"
+
+#include <Urho3D/DebugNew.h>
+//=============================================================================
+//=============================================================================
+static bool CompareEntries(const CharacterSnapshotEntry &lhs, const CharacterSnapshotEntry &rhs)
+{
+    return lhs.nodeId_ < rhs.nodeId_;
+}
+
+//=============================================================================
+//=============================================================================
+LoopbackChannel::LoopbackChannel(unsigned latency, unsigned dropInterval) :
+    latency_(latency),
+    dropInterval_(dropInterval),
+    numSent_(0),
+    numDropped_(0)
+{
+}
+
+void LoopbackChannel::Send(unsigned tick, const PODVector<unsigned char> &packet)
+{
+    ++numSent_;
+
+    if (dropInterval_ && numSent_ % dropInterval_ == 0)
+    {
+        ++numDropped_;
+        return;
+    }
+
+    Packet dest;
+    dest.arrivalTick_ = tick + latency_;
+    dest.data_ = packet;
+    packets_.Push(dest);
+}
+
+bool LoopbackChannel::Receive(unsigned tick, PODVector<unsigned char> &dest)
+{
+    // sent with a constant latency, so packets arrive in order
+    if (packets_.Empty() || packets_.Front().arrivalTick_ > tick)
+    {
+        return false;
+    }
+
+    dest = packets_.Front().data_;
+    packets_.Erase(0);
+
+    return true;
+}
+
+//=============================================================================
+//=============================================================================
+SnapshotLoopback::SnapshotLoopback(Context* context, Scene *scene, Character *replica, unsigned latency, unsigned dropInterval) :
+    Object(context),
+    scene_(scene),
+    replica_(replica),
+    encoder_(new SnapshotEncoder()),
+    decoder_(new SnapshotDecoder()),
+    toReceiver_(latency, dropInterval),
+    toSender_(latency, dropInterval),
+    tick_(0),
+    numTicks_(0),
+    numCharacterTicks_(0),
+    numBytes_(0),
+    numFullBytes_(0),
+    numDecoded_(0),
+    numRejected_(0),
+    numMismatches_(0),
+    numReplicaChecks_(0),
+    numReplicaMismatches_(0)
+{
+    sentFrames_.Resize(SNAPSHOT_HISTORY_SIZE);
+
+    SubscribeToEvent(scene->GetComponent<PhysicsWorld>(), E_PHYSICSPOSTSTEP, URHO3D_HANDLER(SnapshotLoopback, HandlePhysicsPostStep));
+}
+
+SnapshotLoopback::~SnapshotLoopback()
+{
+}
+
+void SnapshotLoopback::CaptureEntries()
+{
+    PODVector<Character*> characters;
+    scene_->GetComponents<Character>(characters, true);
+
+    entries_.Clear();
+
+    for (unsigned i = 0; i < characters.Size(); ++i)
+    {
+        // pooled characters are parked disabled, as is the replica
+        if (characters[i] == replica_ || !characters[i]->GetNode()->IsEnabled())
+            continue;
+
+        CharacterSnapshotEntry entry;
+        entry.nodeId_ = characters[i]->GetNode()->GetID();
+        entry.state_.Capture(characters[i]);
+        entries_.Push(entry);
+    }
+
+    Sort(entries_.Begin(), entries_.End(), CompareEntries);
+}
+
+void SnapshotLoopback::HandlePhysicsPostStep(StringHash eventType, VariantMap& eventData)
+{
+    if (!scene_)
+    {
+        return;
+    }
+
+    // the replica needs its components resolved by the delayed start, then leaves the scene's systems
+    if (replica_ && replica_->IsDelayedStartCalled() && replica_->GetNode()->IsEnabled())
+    {
+        replica_->GetNode()->SetDeepEnabled(false);
+    }
+
+    ++tick_;
+    CaptureEntries();
+
+    // sender: the same tick without a baseline, for comparison, then delta compressed
+    encoder_->Encode(tick_, entries_, packet_, false);
+    numFullBytes_ += packet_.Size();
+
+    encoder_->Encode(tick_, entries_, packet_);
+    numBytes_ += packet_.Size();
+    numCharacterTicks_ += entries_.Size();
+    ++numTicks_;
+
+    SnapshotFrame &sent = sentFrames_[tick_ % SNAPSHOT_HISTORY_SIZE];
+    sent.tick_ = tick_;
+    sent.entries_ = entries_;
+
+    toReceiver_.Send(tick_, packet_);
+
+    // receiver: decode what arrived, check it and acknowledge the latest tick
+    while (toReceiver_.Receive(tick_, packet_))
+    {
+        unsigned tick;
+
+        if (!decoder_->Decode(packet_, tick, decoded_))
+        {
+            ++numRejected_;
+            continue;
+        }
+
+        ++numDecoded_;
+
+        const SnapshotFrame &frame = sentFrames_[tick % SNAPSHOT_HISTORY_SIZE];
+
+        bool match = frame.tick_ == tick && frame.entries_.Size() == decoded_.Size();
+
+        for (unsigned i = 0; i < decoded_.Size() && match; ++i)
+        {
+            match = decoded_[i].nodeId_ == frame.entries_[i].nodeId_ && decoded_[i].state_ == frame.entries_[i].state_;
+        }
+
+        if (match)
+            CheckReplica(frame);
+        else
+            ++numMismatches_;
+
+        const unsigned ackTick = decoder_->GetLatestTick();
+        PODVector<unsigned char> ack(sizeof(unsigned));
+        memcpy(&ack[0], &ackTick, sizeof(unsigned));
+        toSender_.Send(tick_, ack);
+    }
+
+    // sender: take in the acknowledgements
+    while (toSender_.Receive(tick_, packet_))
+    {
+        if (packet_.Size() == sizeof(unsigned))
+        {
+            unsigned ackTick;
+            memcpy(&ackTick, &packet_[0], sizeof(unsigned));
+            encoder_->Acknowledge(ackTick);
+        }
+    }
+}
+
+void SnapshotLoopback::CheckReplica(const SnapshotFrame &frame)
+{
+    if (!replica_ || replica_->GetNode()->IsEnabled())
+    {
+        return;
+    }
+
+    // the sent entries are the source characters' captured state at the decoded tick
+    CharacterSnapshot replicated;
+
+    for (unsigned i = 0; i < decoded_.Size(); ++i)
+    {
+        decoded_[i].state_.Apply(replica_);
+        replicated.Capture(replica_);
+
+        ++numReplicaChecks_;
+
+        if (!frame.entries_[i].state_.IsReplicatedBy(replicated))
+            ++numReplicaMismatches_;
+    }
+}
+
+float SnapshotLoopback::GetBytesPerCharacter() const
+{
+    return numCharacterTicks_ ? (float)((double)numBytes_ / (double)numCharacterTicks_) : 0.0f;
+}
+
+float SnapshotLoopback::GetFullBytesPerCharacter() const
+{
+    return numCharacterTicks_ ? (float)((double)numFullBytes_ / (double)numCharacterTicks_) : 0.0f;
+}
+
+String SnapshotLoopback::GetCsvHeader()
+{
+    return "ticks,bytes_per_character_tick,full_bytes_per_character_tick,dropped,decoded,rejected,mismatches,replica_checks,replica_mismatches";
+}
+
+String SnapshotLoopback::GetCsvValues() const
+{
+    return String(numTicks_) + "," + String(GetBytesPerCharacter()) + "," + String(GetFullBytesPerCharacter()) + "," +
+           String(toReceiver_.GetNumDropped() + toSender_.GetNumDropped()) + "," + String(numDecoded_) + "," +
+           String(numRejected_) + "," + String(numMismatches_) + "," + String(numReplicaChecks_) + "," + String(numReplicaMismatches_);
+}
@@ -0,0 +1,131 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#pragma once
+
+#include <Urho3D/Core/Object.h>
+
+#include "CharacterSnapshot.h"
+
+using namespace Urho3D;
+namespace Urho3D
+{
+class Scene;
+}
+
+class Character;
+
+//=============================================================================
+// in-process stand-in for an unreliable network connection: a packet
+// arrives a fixed number of ticks after it is sent, and every dropInterval-th
+// packet is lost
+//=============================================================================
+class LoopbackChannel
+{
+public:
+    /// Construct. A drop interval of 0 loses nothing.
+    LoopbackChannel(unsigned latency, unsigned dropInterval);
+
+    /// Send a packet at a tick.
+    void Send(unsigned tick, const PODVector<unsigned char> &packet);
+    /// Receive the next packet that has arrived by a tick. Return false if there is none.
+    bool Receive(unsigned tick, PODVector<unsigned char> &dest);
+
+    /// Return number of packets lost.
+    unsigned GetNumDropped() const { return numDropped_; }
+
+private:
+    struct Packet
+    {
+        unsigned arrivalTick_;
+        PODVector<unsigned char> data_;
+    };
+
+    Vector<Packet> packets_;
+    unsigned latency_;
+    unsigned dropInterval_;
+    unsigned numSent_;
+    unsigned numDropped_;
+};
+
+//=============================================================================
+// replicates the scene's characters through a loopback connection after
+// every physics step: their snapshots are delta encoded, sent, decoded on
+// the other end and checked against what was sent, and the decoded ticks are
+// acknowledged back. Measures the bytes per character and tick, next to what
+// the same snapshots take without delta compression.
+//
+// With a replica character every decoded snapshot is also applied to it and
+// the replica's captured state is checked against the source character's
+// state at that tick. The replica is disabled once it has started, so it
+// stays out of the scene's systems, and is not replicated itself.
+//=============================================================================
+class SnapshotLoopback : public Object
+{
+    URHO3D_OBJECT(SnapshotLoopback, Object);
+
+public:
+    /// Construct with the replica character, optional, the one-way latency in physics steps and the packet loss interval.
+    SnapshotLoopback(Context* context, Scene *scene, Character *replica = NULL, unsigned latency = 3, unsigned dropInterval = 20);
+    virtual ~SnapshotLoopback();
+
+    /// Return number of replicated ticks.
+    unsigned GetNumTicks() const { return numTicks_; }
+    /// Return average delta compressed bytes per character and tick.
+    float GetBytesPerCharacter() const;
+    /// Return average bytes per character and tick without a baseline.
+    float GetFullBytesPerCharacter() const;
+    /// Return CSV header of the measurements.
+    static String GetCsvHeader();
+    /// Return the measurements as CSV values.
+    String GetCsvValues() const;
+
+private:
+    void HandlePhysicsPostStep(StringHash eventType, VariantMap& eventData);
+    void CaptureEntries();
+    void CheckReplica(const SnapshotFrame &frame);
+
+    WeakPtr<Scene> scene_;
+    WeakPtr<Character> replica_;
+    SharedPtr<SnapshotEncoder> encoder_;
+    SharedPtr<SnapshotDecoder> decoder_;
+    LoopbackChannel toReceiver_;
+    LoopbackChannel toSender_;
+
+    PODVector<CharacterSnapshotEntry> entries_;
+    /// Sent ticks to check the decoded ones against.
+    Vector<SnapshotFrame> sentFrames_;
+    PODVector<unsigned char> packet_;
+    PODVector<CharacterSnapshotEntry> decoded_;
+
+    unsigned tick_;
+    unsigned numTicks_;
+    unsigned long long numCharacterTicks_;
+    unsigned long long numBytes_;
+    unsigned long long numFullBytes_;
+    unsigned numDecoded_;
+    unsigned numRejected_;
+    unsigned numMismatches_;
+    unsigned numReplicaChecks_;
+    unsigned numReplicaMismatches_;
+};
@@ -0,0 +1,558 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include <Urho3D/Graphics/VertexBuffer.h>
+#include <Urho3D/IO/Deserializer.h>
+#include <Urho3D/IO/Serializer.h>
+#include <Urho3D/Math/BoundingBox.h>
+
+#include "VertexQuantizer.h"
+
+#include <Urho3D/DebugNew.h>
+//=============================================================================
+//=============================================================================
+static VertexElementType GetDecodedType(const VertexElement &element, QuantizedEncoding encoding)
+{
+    switch (encoding)
+    {
+    case QE_POSITION16:
+    case QE_OCTAHEDRAL16:
+        return TYPE_VECTOR3;
+
+    case QE_OCTAHEDRAL16_SIGN:
+        return TYPE_VECTOR4;
+
+    case QE_HALF2:
+        return TYPE_VECTOR2;
+
+    case QE_UNORM8X4:
+        return TYPE_UBYTE4_NORM;
+
+    default:
+        return element.type_;
+    }
+}
+
+static void UpdateElementOffsets(PODVector<VertexElement> &elements)
+{
+    unsigned offset = 0;
+
+    for (unsigned i = 0; i < elements.Size(); ++i)
+    {
+        elements[i].offset_ = offset;
+        offset += ELEMENT_TYPESIZES[elements[i].type_];
+    }
+}
+
+static short ToSnorm16(float value)
+{
+    return (short)floorf(Clamp(value, -1.0f, 1.0f) * 32767.0f + 0.5f);
+}
+
+//=============================================================================
+//=============================================================================
+unsigned GetEncodedSize(const VertexElement &element, QuantizedEncoding encoding)
+{
+    switch (encoding)
+    {
+    case QE_POSITION16:
+        return 3 * sizeof(unsigned short);
+
+    case QE_OCTAHEDRAL16:
+    case QE_OCTAHEDRAL16_SIGN:
+        return 2 * sizeof(short);
+
+    case QE_HALF2:
+        return 2 * sizeof(unsigned short);
+
+    case QE_UNORM8X4:
+        return 4;
+
+    default:
+        return ELEMENT_TYPESIZES[element.type_];
+    }
+}
+
+QuantizedEncoding GetEncoding(const VertexElement &element)
+{
+    if (element.perInstance_)
+    {
+        return QE_RAW;
+    }
+
+    switch (element.semantic_)
+    {
+    case SEM_POSITION:
+        return element.type_ == TYPE_VECTOR3 && element.index_ == 0 ? QE_POSITION16 : QE_RAW;
+
+    case SEM_NORMAL:
+        return element.type_ == TYPE_VECTOR3 ? QE_OCTAHEDRAL16 : QE_RAW;
+
+    case SEM_TANGENT:
+        return element.type_ == TYPE_VECTOR4 ? QE_OCTAHEDRAL16_SIGN : QE_RAW;
+
+    case SEM_TEXCOORD:
+        return element.type_ == TYPE_VECTOR2 ? QE_HALF2 : QE_RAW;
+
+    case SEM_BLENDWEIGHTS:
+        return element.type_ == TYPE_VECTOR4 ? QE_UNORM8X4 : QE_RAW;
+
+    default:
+        return QE_RAW;
+    }
+}
+
+unsigned short FloatToHalf(float value)
+{
+    unsigned bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    const unsigned sign = (bits >> 16) & 0x8000;
+    const int exponent = (int)((bits >> 23) & 0xff) - 127 + 15;
+    unsigned mantissa = bits & 0x7fffff;
+
+    if (exponent >= 31)
+    {
+        // overflow to infinity, keep nan a nan
+        return (unsigned short)(sign | 0x7c00 | (((bits >> 23) & 0xff) == 0xff && mantissa ? 0x200 : 0));
+    }
+    if (exponent <= 0)
+    {
+        if (exponent < -10)
+        {
+            return (unsigned short)sign;
+        }
+
+        // denormal, round to nearest
+        mantissa |= 0x800000;
+        const unsigned shift = (unsigned)(14 - exponent);
+        return (unsigned short)(sign | ((mantissa + (1 << (shift - 1))) >> shift));
+    }
+
+    // round to nearest, a carry into the exponent is still correct
+    return (unsigned short)(sign | (((unsigned)exponent << 10) + ((mantissa + 0x1000) >> 13)));
+}
+
+float HalfToFloat(unsigned short value)
+{
+    const unsigned sign = (unsigned)(value & 0x8000) << 16;
+    const unsigned exponent = (value >> 10) & 0x1f;
+    unsigned mantissa = value & 0x3ff;
+    unsigned bits;
+
+    if (exponent == 0)
+    {
+        if (mantissa == 0)
+        {
+            bits = sign;
+        }
+        else
+        {
+            // renormalize
+            int e = -1;
+
+            do
+            {
+                ++e;
+                mantissa <<= 1;
+            }
+            while (!(mantissa & 0x400));
+
+            bits = sign | ((unsigned)(127 - 15 - e) << 23) | ((mantissa & 0x3ff) << 13);
+        }
+    }
+    else if (exponent == 31)
+    {
+        bits = sign | 0x7f800000 | (mantissa << 13);
+    }
+    else
+    {
+        bits = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+    }
+
+    float result;
+    memcpy(&result, &bits, sizeof(result));
+    return result;
+}
+
+void EncodeOctahedral(const Vector3 &direction, short *dest)
+{
+    const float sum = Abs(direction.x_) + Abs(direction.y_) + Abs(direction.z_);
+
+    if (sum < M_EPSILON)
+    {
+        dest[0] = dest[1] = 0;
+        return;
+    }
+
+    float x = direction.x_ / sum;
+    float y = direction.y_ / sum;
+
+    // fold the lower hemisphere over the diagonals
+    if (direction.z_ < 0.0f)
+    {
+        const float foldedX = (1.0f - Abs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+        const float foldedY = (1.0f - Abs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+        x = foldedX;
+        y = foldedY;
+    }
+
+    dest[0] = ToSnorm16(x);
+    dest[1] = ToSnorm16(y);
+}
+
+Vector3 DecodeOctahedral(const short *src)
+{
+    Vector3 direction(Max(src[0] / 32767.0f, -1.0f), Max(src[1] / 32767.0f, -1.0f), 0.0f);
+    direction.z_ = 1.0f - Abs(direction.x_) - Abs(direction.y_);
+
+    if (direction.z_ < 0.0f)
+    {
+        const float x = (1.0f - Abs(direction.y_)) * (direction.x_ >= 0.0f ? 1.0f : -1.0f);
+        const float y = (1.0f - Abs(direction.x_)) * (direction.y_ >= 0.0f ? 1.0f : -1.0f);
+        direction.x_ = x;
+        direction.y_ = y;
+    }
+
+    return direction.Normalized();
+}
+
+//=============================================================================
+//=============================================================================
+bool QuantizedVertexBuffer::Encode(VertexBuffer *source)
+{
+    if (!source || !source->GetShadowData())
+    {
+        return false;
+    }
+
+    const unsigned char *sourceData = source->GetShadowData();
+    const unsigned sourceSize = source->GetVertexSize();
+
+    elements_ = source->GetElements();
+    vertexCount_ = source->GetVertexCount();
+    vertexSize_ = 0;
+    encodings_.Resize(elements_.Size());
+
+    unsigned positionOffset = M_MAX_UNSIGNED;
+
+    for (unsigned i = 0; i < elements_.Size(); ++i)
+    {
+        const QuantizedEncoding encoding = GetEncoding(elements_[i]);
+
+        encodings_[i] = (unsigned char)encoding;
+        vertexSize_ += GetEncodedSize(elements_[i], encoding);
+
+        if (encoding == QE_POSITION16)
+        {
+            positionOffset = elements_[i].offset_;
+        }
+    }
+
+    positionMin_ = positionMax_ = Vector3::ZERO;
+
+    if (positionOffset != M_MAX_UNSIGNED && vertexCount_)
+    {
+        BoundingBox bounds;
+
+        for (unsigned i = 0; i < vertexCount_; ++i)
+        {
+            bounds.Merge(*reinterpret_cast<const Vector3*>(sourceData + i * sourceSize + positionOffset));
+        }
+
+        positionMin_ = bounds.min_;
+        positionMax_ = bounds.max_;
+    }
+
+    const Vector3 extent = positionMax_ - positionMin_;
+
+    data_.Resize(vertexCount_ * vertexSize_);
+
+    for (unsigned i = 0; i < vertexCount_; ++i)
+    {
+        const unsigned char *src = sourceData + i * sourceSize;
+        unsigned char *dest = &data_[i * vertexSize_];
+
+        for (unsigned j = 0; j < elements_.Size(); ++j)
+        {
+            const VertexElement &element = elements_[j];
+            const QuantizedEncoding encoding = (QuantizedEncoding)encodings_[j];
+            const float *values = reinterpret_cast<const float*>(src + element.offset_);
+
+            switch (encoding)
+            {
+            case QE_POSITION16:
+                for (unsigned k = 0; k < 3; ++k)
+                {
+                    const float range = extent.Data()[k];
+                    const float t = range > 0.0f ? (values[k] - positionMin_.Data()[k]) / range : 0.0f;
+                    reinterpret_cast<unsigned short*>(dest)[k] = (unsigned short)floorf(Clamp(t, 0.0f, 1.0f) * 65535.0f + 0.5f);
+                }
+                break;
+
+            case QE_OCTAHEDRAL16:
+                EncodeOctahedral(Vector3(values), reinterpret_cast<short*>(dest));
+                break;
+
+            case QE_OCTAHEDRAL16_SIGN:
+                {
+                    short *encoded = reinterpret_cast<short*>(dest);
+                    EncodeOctahedral(Vector3(values), encoded);
+                    encoded[1] = (short)((encoded[1] & ~1) | (values[3] < 0.0f ? 1 : 0));
+                }
+                break;
+
+            case QE_HALF2:
+                reinterpret_cast<unsigned short*>(dest)[0] = FloatToHalf(values[0]);
+                reinterpret_cast<unsigned short*>(dest)[1] = FloatToHalf(values[1]);
+                break;
+
+            case QE_UNORM8X4:
+                {
+                    int quantized[4];
+                    int total = 0;
+                    unsigned largest = 0;
+                    float weightSum = 0.0f;
+
+                    for (unsigned k = 0; k < 4; ++k)
+                    {
+                        quantized[k] = (int)floorf(Clamp(values[k], 0.0f, 1.0f) * 255.0f + 0.5f);
+                        total += quantized[k];
+                        weightSum += values[k];
+                        largest = values[k] > values[largest] ? k : largest;
+                    }
+
+                    // keep normalized weights normalized, the rounding error goes to the largest one
+                    if (Abs(weightSum - 1.0f) < 0.01f)
+                    {
+                        quantized[largest] = Clamp(quantized[largest] + 255 - total, 0, 255);
+                    }
+
+                    for (unsigned k = 0; k < 4; ++k)
+                    {
+                        dest[k] = (unsigned char)quantized[k];
+                    }
+                }
+                break;
+
+            default:
+                memcpy(dest, src + element.offset_, ELEMENT_TYPESIZES[element.type_]);
+                break;
+            }
+
+            dest += GetEncodedSize(element, encoding);
+        }
+    }
+
+    return true;
+}
+
+void QuantizedVertexBuffer::Decode(PODVector<VertexElement> &elements, PODVector<unsigned char> &data) const
+{
+    elements.Resize(elements_.Size());
+
+    for (unsigned i = 0; i < elements_.Size(); ++i)
+    {
+        elements[i] = VertexElement(GetDecodedType(elements_[i], (QuantizedEncoding)encodings_[i]), elements_[i].semantic_,
+                                    elements_[i].index_, elements_[i].perInstance_);
+    }
+
+    UpdateElementOffsets(elements);
+
+    const unsigned decodedSize = GetDecodedVertexSize();
+    const Vector3 scale = (positionMax_ - positionMin_) / 65535.0f;
+
+    data.Resize(vertexCount_ * decodedSize);
+
+    for (unsigned i = 0; i < vertexCount_; ++i)
+    {
+        const unsigned char *src = &data_[i * vertexSize_];
+        unsigned char *vertex = &data[i * decodedSize];
+
+        for (unsigned j = 0; j < elements.Size(); ++j)
+        {
+            const QuantizedEncoding encoding = (QuantizedEncoding)encodings_[j];
+            float *values = reinterpret_cast<float*>(vertex + elements[j].offset_);
+
+            switch (encoding)
+            {
+            case QE_POSITION16:
+                for (unsigned k = 0; k < 3; ++k)
+                {
+                    values[k] = positionMin_.Data()[k] + reinterpret_cast<const unsigned short*>(src)[k] * scale.Data()[k];
+                }
+                break;
+
+            case QE_OCTAHEDRAL16:
+                *reinterpret_cast<Vector3*>(values) = DecodeOctahedral(reinterpret_cast<const short*>(src));
+                break;
+
+            case QE_OCTAHEDRAL16_SIGN:
+                {
+                    const short *encoded = reinterpret_cast<const short*>(src);
+                    const short direction[2] = { encoded[0], (short)(encoded[1] & ~1) };
+                    *reinterpret_cast<Vector3*>(values) = DecodeOctahedral(direction);
+                    values[3] = (encoded[1] & 1) ? -1.0f : 1.0f;
+                }
+                break;
+
+            case QE_HALF2:
+                values[0] = HalfToFloat(reinterpret_cast<const unsigned short*>(src)[0]);
+                values[1] = HalfToFloat(reinterpret_cast<const unsigned short*>(src)[1]);
+                break;
+
+            default:
+                // normalized weights keep their bytes
+                memcpy(vertex + elements[j].offset_, src, ELEMENT_TYPESIZES[elements[j].type_]);
+                break;
+            }
+
+            src += GetEncodedSize(elements_[j], encoding);
+        }
+    }
+}
+
+unsigned QuantizedVertexBuffer::GetDecodedVertexSize() const
+{
+    unsigned size = 0;
+
+    for (unsigned i = 0; i < elements_.Size(); ++i)
+    {
+        size += ELEMENT_TYPESIZES[GetDecodedType(elements_[i], (QuantizedEncoding)encodings_[i])];
+    }
+
+    return size;
+}
+
+void QuantizedVertexBuffer::MeasureError(VertexBuffer *source, QuantizationError &error) const
+{
+    PODVector<VertexElement> elements;
+    PODVector<unsigned char> data;
+
+    Decode(elements, data);
+
+    const unsigned char *sourceData = source->GetShadowData();
+    const unsigned sourceSize = source->GetVertexSize();
+    const unsigned decodedSize = GetDecodedVertexSize();
+
+    for (unsigned i = 0; i < vertexCount_; ++i)
+    {
+        for (unsigned j = 0; j < elements.Size(); ++j)
+        {
+            const float *original = reinterpret_cast<const float*>(sourceData + i * sourceSize + elements_[j].offset_);
+            const unsigned char *decoded = &data[i * decodedSize + elements[j].offset_];
+            const float *values = reinterpret_cast<const float*>(decoded);
+
+            switch (encodings_[j])
+            {
+            case QE_POSITION16:
+                error.position_ = Max(error.position_, (Vector3(values) - Vector3(original)).Length());
+                break;
+
+            case QE_OCTAHEDRAL16:
+            case QE_OCTAHEDRAL16_SIGN:
+                {
+                    const float angle = Acos(Clamp(Vector3(values).DotProduct(Vector3(original).Normalized()), -1.0f, 1.0f));
+                    float &target = encodings_[j] == QE_OCTAHEDRAL16 ? error.normal_ : error.tangent_;
+
+                    // a flipped bitangent sign counts as a full turn
+                    target = Max(target, encodings_[j] == QE_OCTAHEDRAL16_SIGN && (values[3] < 0.0f) != (original[3] < 0.0f) ? 180.0f : angle);
+                }
+                break;
+
+            case QE_HALF2:
+                error.texCoord_ = Max(error.texCoord_, Max(Abs(values[0] - original[0]), Abs(values[1] - original[1])));
+                break;
+
+            case QE_UNORM8X4:
+                for (unsigned k = 0; k < 4; ++k)
+                {
+                    error.blendWeight_ = Max(error.blendWeight_, Abs(decoded[k] / 255.0f - original[k]));
+                }
+                break;
+
+            default:
+                break;
+            }
+        }
+    }
+}
+
+bool QuantizedVertexBuffer::Write(Serializer &dest) const
+{
+    bool success = true;
+
+    success &= dest.WriteUInt(vertexCount_);
+    success &= dest.WriteUInt(elements_.Size());
+
+    for (unsigned i = 0; i < elements_.Size(); ++i)
+    {
+        success &= dest.WriteUByte((unsigned char)elements_[i].type_);
+        success &= dest.WriteUByte((unsigned char)elements_[i].semantic_);
+        success &= dest.WriteUByte(elements_[i].index_);
+        success &= dest.WriteUByte(encodings_[i]);
+    }
+
+    success &= dest.WriteVector3(positionMin_);
+    success &= dest.WriteVector3(positionMax_);
+    success &= dest.Write(data_.Buffer(), data_.Size()) == data_.Size();
+
+    return success;
+}
+
+bool QuantizedVertexBuffer::Read(Deserializer &source)
+{
+    vertexCount_ = source.ReadUInt();
+
+    const unsigned numElements = source.ReadUInt();
+
+    elements_.Resize(numElements);
+    encodings_.Resize(numElements);
+    vertexSize_ = 0;
+
+    for (unsigned i = 0; i < numElements; ++i)
+    {
+        const unsigned char type = source.ReadUByte();
+        const unsigned char semantic = source.ReadUByte();
+        const unsigned char index = source.ReadUByte();
+
+        encodings_[i] = source.ReadUByte();
+
+        if (type >= MAX_VERTEX_ELEMENT_TYPES || semantic >= MAX_VERTEX_ELEMENT_SEMANTICS || encodings_[i] > QE_UNORM8X4)
+        {
+            return false;
+        }
+
+        elements_[i] = VertexElement((VertexElementType)type, (VertexElementSemantic)semantic, index);
+        vertexSize_ += GetEncodedSize(elements_[i], (QuantizedEncoding)encodings_[i]);
+    }
+
+    UpdateElementOffsets(elements_);
+
+    positionMin_ = source.ReadVector3();
+    positionMax_ = source.ReadVector3();
+
+    data_.Resize(vertexCount_ * vertexSize_);
+
+    return source.Read(data_.Buffer(), data_.Size()) == data_.Size();
+}
+
@@ -0,0 +1,111 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#pragma once
+
+#include <Urho3D/Graphics/GraphicsDefs.h>
+#include <Urho3D/Math/Vector3.h>
+
+using namespace Urho3D;
+namespace Urho3D
+{
+class Deserializer;
+class Serializer;
+class VertexBuffer;
+}
+
+//=============================================================================
+//=============================================================================
+enum QuantizedEncoding
+{
+    /// Copied as is.
+    QE_RAW = 0,
+    /// 3 x 16-bit unorm relative to the buffer's position bounds.
+    QE_POSITION16,
+    /// Octahedral unit vector, 2 x 16-bit snorm.
+    QE_OCTAHEDRAL16,
+    /// Octahedral unit vector with the w sign in the lowest bit of y, for tangents.
+    QE_OCTAHEDRAL16_SIGN,
+    /// 2 x half float.
+    QE_HALF2,
+    /// 4 x 8-bit unorm, summing to 255 when the source weights sum to 1.
+    QE_UNORM8X4
+};
+
+//=============================================================================
+// largest differences between source and decoded vertices
+//=============================================================================
+struct QuantizationError
+{
+    QuantizationError() : position_(0.0f), normal_(0.0f), tangent_(0.0f), texCoord_(0.0f), blendWeight_(0.0f) {}
+
+    /// Model space distance.
+    float position_;
+    /// Angles in degrees.
+    float normal_;
+    float tangent_;
+    float texCoord_;
+    float blendWeight_;
+};
+
+//=============================================================================
+// vertex buffer stored in compact form. Elements keep the source layout and
+// each gets an encoding; decoding yields a layout the engine can draw, with
+// positions, normals, tangents and uvs back in floats and blend weights
+// left as normalized bytes.
+//=============================================================================
+struct QuantizedVertexBuffer
+{
+    QuantizedVertexBuffer() : vertexCount_(0), vertexSize_(0) {}
+
+    /// Quantize the shadow data of a vertex buffer.
+    bool Encode(VertexBuffer *source);
+    /// Decode into vertex data and the element layout it uses.
+    void Decode(PODVector<VertexElement> &elements, PODVector<unsigned char> &data) const;
+    /// Return the vertex size of the decoded layout.
+    unsigned GetDecodedVertexSize() const;
+    /// Decode and compare against the buffer it was encoded from, keeping the larger errors.
+    void MeasureError(VertexBuffer *source, QuantizationError &error) const;
+
+    bool Write(Serializer &dest) const;
+    bool Read(Deserializer &source);
+
+    PODVector<VertexElement> elements_;
+    PODVector<unsigned char> encodings_;
+    unsigned                 vertexCount_;
+    /// Quantized vertex size.
+    unsigned                 vertexSize_;
+    Vector3                  positionMin_;
+    Vector3                  positionMax_;
+    PODVector<unsigned char> data_;
+};
+
+/// Return quantized size of an element.
+unsigned GetEncodedSize(const VertexElement &element, QuantizedEncoding encoding);
+/// Return the encoding used for an element.
+QuantizedEncoding GetEncoding(const VertexElement &element);
+
+unsigned short FloatToHalf(float value);
+float HalfToFloat(unsigned short value);
+void EncodeOctahedral(const Vector3 &direction, short *dest);
+Vector3 DecodeOctahedral(const short *src);
+
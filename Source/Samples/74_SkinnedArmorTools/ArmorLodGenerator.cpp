@@ -0,0 +1,754 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include <Urho3D/Container/HashMap.h>
+#include <Urho3D/Container/Sort.h>
+#include <Urho3D/Graphics/Geometry.h>
+
+#include "ArmorLodGenerator.h"
+#include "GeometryUtils.h"
+
+#include <Urho3D/DebugNew.h>
+//=============================================================================
+//=============================================================================
+const unsigned MIN_LOD_TRIANGLES = 16;
+const float BORDER_WEIGHT = 10.0f;
+const float MIN_NORMAL_DOT = 0.25f;
+
+//=============================================================================
+//=============================================================================
+struct PositionKey
+{
+    PositionKey() {}
+    PositionKey(const Vector3 &position) : position_(position) {}
+
+    unsigned ToHash() const
+    {
+        const unsigned *data = reinterpret_cast<const unsigned*>(position_.Data());
+        return (data[0] * 73856093) ^ (data[1] * 19349663) ^ (data[2] * 83492791);
+    }
+
+    bool operator ==(const PositionKey &rhs) const { return position_ == rhs.position_; }
+
+    Vector3 position_;
+};
+
+//=============================================================================
+// quadric error of a set of planes
+//=============================================================================
+struct Quadric
+{
+    Quadric() : a00_(0.0), a01_(0.0), a02_(0.0), a11_(0.0), a12_(0.0), a22_(0.0), b0_(0.0), b1_(0.0), b2_(0.0), c_(0.0) {}
+
+    void AddPlane(const Vector3 &normal, float distance, float weight)
+    {
+        a00_ += weight * normal.x_ * normal.x_;
+        a01_ += weight * normal.x_ * normal.y_;
+        a02_ += weight * normal.x_ * normal.z_;
+        a11_ += weight * normal.y_ * normal.y_;
+        a12_ += weight * normal.y_ * normal.z_;
+        a22_ += weight * normal.z_ * normal.z_;
+        b0_  += weight * normal.x_ * distance;
+        b1_  += weight * normal.y_ * distance;
+        b2_  += weight * normal.z_ * distance;
+        c_   += weight * distance * distance;
+    }
+
+    void Add(const Quadric &rhs)
+    {
+        a00_ += rhs.a00_; a01_ += rhs.a01_; a02_ += rhs.a02_;
+        a11_ += rhs.a11_; a12_ += rhs.a12_; a22_ += rhs.a22_;
+        b0_  += rhs.b0_;  b1_  += rhs.b1_;  b2_  += rhs.b2_;
+        c_   += rhs.c_;
+    }
+
+    float Error(const Vector3 &p) const
+    {
+        const double x = p.x_, y = p.y_, z = p.z_;
+        const double error = a00_ * x * x + 2.0 * a01_ * x * y + 2.0 * a02_ * x * z +
+                             a11_ * y * y + 2.0 * a12_ * y * z + a22_ * z * z +
+                             2.0 * (b0_ * x + b1_ * y + b2_ * z) + c_;
+
+        return (float)Max(error, 0.0);
+    }
+
+    double a00_, a01_, a02_, a11_, a12_, a22_;
+    double b0_, b1_, b2_;
+    double c_;
+};
+
+//=============================================================================
+//=============================================================================
+struct Collapse
+{
+    unsigned from_;
+    unsigned to_;
+    float    cost_;
+};
+
+static bool CompareCollapses(const Collapse &lhs, const Collapse &rhs)
+{
+    return lhs.cost_ < rhs.cost_;
+}
+
+static unsigned long long EdgeKey(unsigned a, unsigned b)
+{
+    return a < b ? ((unsigned long long)a << 32) | b : ((unsigned long long)b << 32) | a;
+}
+
+static Vector3 ClosestPointOnTriangle(const Vector3 &p, const Vector3 &a, const Vector3 &b, const Vector3 &c)
+{
+    const Vector3 ab = b - a;
+    const Vector3 ac = c - a;
+    const Vector3 ap = p - a;
+    const float d1 = ab.DotProduct(ap);
+    const float d2 = ac.DotProduct(ap);
+
+    if (d1 <= 0.0f && d2 <= 0.0f)
+    {
+        return a;
+    }
+
+    const Vector3 bp = p - b;
+    const float d3 = ab.DotProduct(bp);
+    const float d4 = ac.DotProduct(bp);
+
+    if (d3 >= 0.0f && d4 <= d3)
+    {
+        return b;
+    }
+
+    const float vc = d1 * d4 - d3 * d2;
+
+    if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+    {
+        return a + ab * (d1 / (d1 - d3));
+    }
+
+    const Vector3 cp = p - c;
+    const float d5 = ab.DotProduct(cp);
+    const float d6 = ac.DotProduct(cp);
+
+    if (d6 >= 0.0f && d5 <= d6)
+    {
+        return c;
+    }
+
+    const float vb = d5 * d2 - d1 * d6;
+
+    if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+    {
+        return a + ac * (d2 / (d2 - d6));
+    }
+
+    const float va = d3 * d6 - d5 * d4;
+
+    if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f)
+    {
+        return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+    }
+
+    const float denom = 1.0f / (va + vb + vc);
+    return a + ab * (vb * denom) + ac * (vc * denom);
+}
+
+//=============================================================================
+// edge collapse simplifier over one triangle list. Vertices sharing a
+// position with another vertex (uv or normal seams) stay put, border
+// vertices only slide along the border.
+//=============================================================================
+class MeshSimplifier
+{
+public:
+    MeshSimplifier(const GeometryData &data) :
+        data_(data)
+    {
+        const unsigned numVertices = data_.vertexCount_;
+        HashMap<PositionKey, unsigned> positions;
+        PODVector<unsigned> groupSizes(numVertices);
+
+        reps_.Resize(numVertices);
+        seam_.Resize(numVertices);
+        border_.Resize(numVertices);
+        quadrics_.Resize(numVertices);
+
+        for (unsigned i = 0; i < numVertices; ++i)
+        {
+            HashMap<PositionKey, unsigned>::Iterator it = positions.Find(PositionKey(data_.GetPosition(i)));
+
+            if (it == positions.End())
+            {
+                it = positions.Insert(MakePair(PositionKey(data_.GetPosition(i)), i));
+            }
+
+            reps_[i] = it->second_;
+            groupSizes[i] = 0;
+            border_[i] = false;
+        }
+
+        for (unsigned i = 0; i < numVertices; ++i)
+        {
+            ++groupSizes[reps_[i]];
+        }
+        for (unsigned i = 0; i < numVertices; ++i)
+        {
+            seam_[i] = groupSizes[reps_[i]] > 1;
+        }
+
+        // face planes, weighted by area
+        HashMap<unsigned long long, unsigned> edgeCounts;
+        const PODVector<unsigned> &indices = data_.indices_;
+
+        for (unsigned i = 0; i + 2 < indices.Size(); i += 3)
+        {
+            const unsigned tri[3] = { reps_[indices[i]], reps_[indices[i + 1]], reps_[indices[i + 2]] };
+            const Vector3 &p0 = data_.GetPosition(tri[0]);
+            Vector3 normal = (data_.GetPosition(tri[1]) - p0).CrossProduct(data_.GetPosition(tri[2]) - p0);
+            const float area = normal.Length() * 0.5f;
+
+            if (area > M_EPSILON)
+            {
+                normal /= area * 2.0f;
+
+                for (unsigned k = 0; k < 3; ++k)
+                {
+                    quadrics_[tri[k]].AddPlane(normal, -normal.DotProduct(p0), area);
+                }
+            }
+
+            for (unsigned k = 0; k < 3; ++k)
+            {
+                ++edgeCounts[EdgeKey(tri[k], tri[(k + 1) % 3])];
+            }
+        }
+
+        // border planes perpendicular to the open edges keep the outline in place
+        for (unsigned i = 0; i + 2 < indices.Size(); i += 3)
+        {
+            const unsigned tri[3] = { reps_[indices[i]], reps_[indices[i + 1]], reps_[indices[i + 2]] };
+            const Vector3 &p0 = data_.GetPosition(tri[0]);
+            const Vector3 faceNormal = (data_.GetPosition(tri[1]) - p0).CrossProduct(data_.GetPosition(tri[2]) - p0).Normalized();
+
+            for (unsigned k = 0; k < 3; ++k)
+            {
+                const unsigned a = tri[k];
+                const unsigned b = tri[(k + 1) % 3];
+
+                if (edgeCounts[EdgeKey(a, b)] != 1)
+                {
+                    continue;
+                }
+
+                const Vector3 edge = data_.GetPosition(b) - data_.GetPosition(a);
+                const Vector3 normal = edge.CrossProduct(faceNormal).Normalized();
+                const float weight = edge.LengthSquared() * BORDER_WEIGHT;
+
+                quadrics_[a].AddPlane(normal, -normal.DotProduct(data_.GetPosition(a)), weight);
+                quadrics_[b].AddPlane(normal, -normal.DotProduct(data_.GetPosition(a)), weight);
+                border_[a] = true;
+                border_[b] = true;
+            }
+        }
+
+        // bone influences in skeleton indices
+        const unsigned weightsOffset = data_.GetElementOffset(SEM_BLENDWEIGHTS);
+        const VertexElementType weightsType = data_.GetElementType(SEM_BLENDWEIGHTS);
+        const unsigned indicesOffset = data_.GetElementOffset(SEM_BLENDINDICES);
+
+        if (weightsOffset != M_MAX_UNSIGNED && indicesOffset != M_MAX_UNSIGNED)
+        {
+            bones_.Resize(numVertices * 4);
+            weights_.Resize(numVertices * 4);
+
+            for (unsigned i = 0; i < numVertices; ++i)
+            {
+                float weights[4];
+                ReadBlendWeights(data_.GetVertex(i) + weightsOffset, weightsType, weights);
+                const unsigned char *blendIndices = data_.GetVertex(i) + indicesOffset;
+
+                for (unsigned j = 0; j < 4; ++j)
+                {
+                    bones_[i * 4 + j] = data_.GetGlobalBone(blendIndices[j]);
+                    weights_[i * 4 + j] = weights[j];
+                }
+            }
+        }
+    }
+
+    void Simplify(unsigned targetTriangles, float boneWeightPenalty, PODVector<unsigned> &indices) const
+    {
+        const unsigned numVertices = data_.vertexCount_;
+        PODVector<Quadric> quadrics(quadrics_);
+        PODVector<bool> deadTriangles(data_.indices_.Size() / 3);
+        PODVector<bool> locked(numVertices);
+        PODVector<unsigned> adjacencyStart(numVertices + 1);
+        PODVector<unsigned> adjacency;
+        PODVector<Collapse> collapses;
+        HashMap<unsigned long long, unsigned> edgeCounts;
+        unsigned numTriangles = deadTriangles.Size();
+
+        indices = data_.indices_;
+
+        for (unsigned i = 0; i < deadTriangles.Size(); ++i)
+        {
+            deadTriangles[i] = false;
+        }
+
+        // each pass collapses the cheapest edges whose neighbourhoods don't overlap
+        while (numTriangles > targetTriangles)
+        {
+            BuildAdjacency(indices, deadTriangles, adjacencyStart, adjacency);
+
+            edgeCounts.Clear();
+            collapses.Clear();
+
+            for (unsigned t = 0; t < deadTriangles.Size(); ++t)
+            {
+                if (!deadTriangles[t])
+                {
+                    for (unsigned k = 0; k < 3; ++k)
+                    {
+                        ++edgeCounts[EdgeKey(reps_[indices[t * 3 + k]], reps_[indices[t * 3 + (k + 1) % 3]])];
+                    }
+                }
+            }
+
+            for (unsigned t = 0; t < deadTriangles.Size(); ++t)
+            {
+                if (deadTriangles[t])
+                {
+                    continue;
+                }
+
+                for (unsigned k = 0; k < 6; ++k)
+                {
+                    const unsigned from = indices[t * 3 + k % 3];
+                    const unsigned to = indices[t * 3 + (k / 3 == 0 ? (k + 1) % 3 : (k + 2) % 3)];
+
+                    if (seam_[from] || reps_[from] == reps_[to])
+                    {
+                        continue;
+                    }
+                    if (border_[from] && edgeCounts[EdgeKey(reps_[from], reps_[to])] != 1)
+                    {
+                        continue;
+                    }
+
+                    const Vector3 &target = data_.GetPosition(to);
+                    Collapse collapse;
+                    collapse.from_ = from;
+                    collapse.to_ = to;
+                    collapse.cost_ = quadrics[from].Error(target) + quadrics[reps_[to]].Error(target) +
+                                     boneWeightPenalty * GetBoneDifference(from, to) * (target - data_.GetPosition(from)).LengthSquared();
+                    collapses.Push(collapse);
+                }
+            }
+
+            if (collapses.Empty())
+            {
+                break;
+            }
+
+            Sort(collapses.Begin(), collapses.End(), CompareCollapses);
+
+            for (unsigned i = 0; i < numVertices; ++i)
+            {
+                locked[i] = false;
+            }
+
+            unsigned numCollapsed = 0;
+
+            for (unsigned c = 0; c < collapses.Size() && numTriangles > targetTriangles; ++c)
+            {
+                const unsigned from = collapses[c].from_;
+                const unsigned to = collapses[c].to_;
+
+                if (locked[reps_[from]] || locked[reps_[to]] || FlipsTriangles(indices, deadTriangles, adjacencyStart, adjacency, from, to))
+                {
+                    continue;
+                }
+
+                for (unsigned a = adjacencyStart[from]; a < adjacencyStart[from + 1]; ++a)
+                {
+                    const unsigned t = adjacency[a];
+                    unsigned *tri = &indices[t * 3];
+
+                    for (unsigned k = 0; k < 3; ++k)
+                    {
+                        locked[reps_[tri[k]]] = true;
+
+                        if (tri[k] == from)
+                        {
+                            tri[k] = to;
+                        }
+                    }
+
+                    if (reps_[tri[0]] == reps_[tri[1]] || reps_[tri[1]] == reps_[tri[2]] || reps_[tri[2]] == reps_[tri[0]])
+                    {
+                        deadTriangles[t] = true;
+                        --numTriangles;
+                    }
+                }
+
+                quadrics[reps_[to]].Add(quadrics[from]);
+                ++numCollapsed;
+            }
+
+            if (numCollapsed == 0)
+            {
+                break;
+            }
+        }
+
+        // drop dead triangles
+        unsigned count = 0;
+
+        for (unsigned t = 0; t < deadTriangles.Size(); ++t)
+        {
+            if (!deadTriangles[t])
+            {
+                indices[count++] = indices[t * 3];
+                indices[count++] = indices[t * 3 + 1];
+                indices[count++] = indices[t * 3 + 2];
+            }
+        }
+
+        indices.Resize(count);
+    }
+
+private:
+    void BuildAdjacency(const PODVector<unsigned> &indices, const PODVector<bool> &deadTriangles,
+                        PODVector<unsigned> &adjacencyStart, PODVector<unsigned> &adjacency) const
+    {
+        for (unsigned i = 0; i < adjacencyStart.Size(); ++i)
+        {
+            adjacencyStart[i] = 0;
+        }
+
+        for (unsigned t = 0; t < deadTriangles.Size(); ++t)
+        {
+            if (!deadTriangles[t])
+            {
+                for (unsigned k = 0; k < 3; ++k)
+                {
+                    ++adjacencyStart[indices[t * 3 + k] + 1];
+                }
+            }
+        }
+
+        for (unsigned i = 1; i < adjacencyStart.Size(); ++i)
+        {
+            adjacencyStart[i] += adjacencyStart[i - 1];
+        }
+
+        PODVector<unsigned> fill(adjacencyStart);
+        adjacency.Resize(adjacencyStart.Back());
+
+        for (unsigned t = 0; t < deadTriangles.Size(); ++t)
+        {
+            if (!deadTriangles[t])
+            {
+                for (unsigned k = 0; k < 3; ++k)
+                {
+                    adjacency[fill[indices[t * 3 + k]]++] = t;
+                }
+            }
+        }
+    }
+
+    bool FlipsTriangles(const PODVector<unsigned> &indices, const PODVector<bool> &deadTriangles,
+                        const PODVector<unsigned> &adjacencyStart, const PODVector<unsigned> &adjacency,
+                        unsigned from, unsigned to) const
+    {
+        const Vector3 &target = data_.GetPosition(to);
+
+        for (unsigned a = adjacencyStart[from]; a < adjacencyStart[from + 1]; ++a)
+        {
+            const unsigned t = adjacency[a];
+            const unsigned *tri = &indices[t * 3];
+
+            if (deadTriangles[t] || reps_[tri[0]] == reps_[to] || reps_[tri[1]] == reps_[to] || reps_[tri[2]] == reps_[to])
+            {
+                continue;
+            }
+
+            Vector3 before[3];
+            Vector3 after[3];
+
+            for (unsigned k = 0; k < 3; ++k)
+            {
+                before[k] = data_.GetPosition(tri[k]);
+                after[k] = tri[k] == from ? target : before[k];
+            }
+
+            const Vector3 normalBefore = (before[1] - before[0]).CrossProduct(before[2] - before[0]);
+            const Vector3 normalAfter = (after[1] - after[0]).CrossProduct(after[2] - after[0]);
+
+            if (normalBefore.DotProduct(normalAfter) < MIN_NORMAL_DOT * normalBefore.Length() * normalAfter.Length())
+            {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    float GetBoneDifference(unsigned a, unsigned b) const
+    {
+        if (bones_.Empty())
+        {
+            return 0.0f;
+        }
+
+        // half the L1 distance of the weight vectors, 0 = same influences, 1 = disjoint
+        float difference = 0.0f;
+
+        for (unsigned i = 0; i < 4; ++i)
+        {
+            float other = 0.0f;
+
+            for (unsigned j = 0; j < 4; ++j)
+            {
+                if (bones_[b * 4 + j] == bones_[a * 4 + i])
+                {
+                    other += weights_[b * 4 + j];
+                }
+            }
+            difference += Abs(weights_[a * 4 + i] - other);
+        }
+        for (unsigned j = 0; j < 4; ++j)
+        {
+            bool shared = false;
+
+            for (unsigned i = 0; i < 4; ++i)
+            {
+                shared |= bones_[a * 4 + i] == bones_[b * 4 + j];
+            }
+            if (!shared)
+            {
+                difference += weights_[b * 4 + j];
+            }
+        }
+
+        return difference * 0.5f;
+    }
+
+    const GeometryData  &data_;
+    PODVector<unsigned> reps_;
+    PODVector<bool>     seam_;
+    PODVector<bool>     border_;
+    PODVector<Quadric>  quadrics_;
+    PODVector<unsigned> bones_;
+    PODVector<float>    weights_;
+};
+
+//=============================================================================
+//=============================================================================
+static float MeasureError(const GeometryData &source, const PODVector<unsigned> &lodIndices)
+{
+    PODVector<bool> visited(source.vertexCount_);
+    float maxDistanceSquared = 0.0f;
+
+    for (unsigned i = 0; i < visited.Size(); ++i)
+    {
+        visited[i] = false;
+    }
+
+    for (unsigned i = 0; i < source.indices_.Size(); ++i)
+    {
+        const unsigned vertex = source.indices_[i];
+
+        if (visited[vertex])
+        {
+            continue;
+        }
+        visited[vertex] = true;
+
+        const Vector3 &p = source.GetPosition(vertex);
+        float closest = M_INFINITY;
+
+        for (unsigned j = 0; j + 2 < lodIndices.Size() && closest > 0.0f; j += 3)
+        {
+            const Vector3 q = ClosestPointOnTriangle(p, source.GetPosition(lodIndices[j]), source.GetPosition(lodIndices[j + 1]),
+                                                     source.GetPosition(lodIndices[j + 2]));
+            closest = Min(closest, (q - p).LengthSquared());
+        }
+
+        maxDistanceSquared = Max(maxDistanceSquared, closest);
+    }
+
+    return sqrtf(maxDistanceSquared);
+}
+
+//=============================================================================
+//=============================================================================
+ArmorLodGenerator::ArmorLodGenerator() :
+    numLevels_(3),
+    reduction_(0.5f),
+    pixelError_(1.0f),
+    screenHeight_(1080.0f),
+    fov_(45.0f),
+    boneWeightPenalty_(1.0f)
+{
+}
+
+SharedPtr<Model> ArmorLodGenerator::Generate(Context *context, Model *model, Vector<PODVector<LodLevelStats> > &geometryStats) const
+{
+    const unsigned numGeometries = model->GetNumGeometries();
+    const Vector<PODVector<unsigned> > &boneMappings = model->GetGeometryBoneMappings();
+    Vector<Vector<GeometryData> > geometries(numGeometries);
+
+    geometryStats.Clear();
+    geometryStats.Resize(numGeometries);
+
+    for (unsigned i = 0; i < numGeometries; ++i)
+    {
+        GeometryData source;
+
+        if (!ExtractGeometryData(model->GetGeometry(i, 0), i < boneMappings.Size() ? boneMappings[i] : PODVector<unsigned>(), source))
+        {
+            return SharedPtr<Model>();
+        }
+
+        LodLevelStats stats;
+        stats.triangles_ = source.indices_.Size() / 3;
+        stats.vertices_ = source.vertexCount_;
+
+        source.lodDistance_ = 0.0f;
+        geometries[i].Push(source);
+        geometryStats[i].Push(stats);
+
+        if (source.primitiveType_ != TRIANGLE_LIST)
+        {
+            continue;
+        }
+
+        // every level starts from lod 0, so its error is measured against the original
+        MeshSimplifier simplifier(source);
+        float targetTriangles = (float)stats.triangles_;
+
+        for (unsigned level = 1; level <= numLevels_; ++level)
+        {
+            targetTriangles *= reduction_;
+
+            if (targetTriangles < MIN_LOD_TRIANGLES)
+            {
+                break;
+            }
+
+            GeometryData lod(source);
+            simplifier.Simplify((unsigned)targetTriangles, boneWeightPenalty_, lod.indices_);
+
+            const LodLevelStats &previous = geometryStats[i].Back();
+
+            if (lod.indices_.Size() / 3 >= previous.triangles_)
+            {
+                break;
+            }
+
+            LodLevelStats levelStats;
+            levelStats.maxError_ = MeasureError(source, lod.indices_);
+            levelStats.distance_ = Max(GetLodDistance(levelStats.maxError_), previous.distance_);
+
+            CompactVertices(lod);
+            lod.lodDistance_ = levelStats.distance_;
+            levelStats.triangles_ = lod.indices_.Size() / 3;
+            levelStats.vertices_ = lod.vertexCount_;
+
+            geometries[i].Push(lod);
+            geometryStats[i].Push(levelStats);
+        }
+    }
+
+    return CreateModel(context, model, geometries);
+}
+
+float ArmorLodGenerator::GetLodDistance(float error) const
+{
+    // projected size in pixels = error * screenHeight / (2 * distance * tan(fov / 2))
+    return error * screenHeight_ / (2.0f * Tan(fov_ * 0.5f) * Max(pixelError_, M_EPSILON));
+}
+
+bool ArmorLodGenerator::ValidateBoneWeights(Model *model, String &error)
+{
+    const unsigned numBones = model->GetSkeleton().GetNumBones();
+    const Vector<PODVector<unsigned> > &boneMappings = model->GetGeometryBoneMappings();
+
+    for (unsigned i = 0; i < model->GetNumGeometries(); ++i)
+    {
+        const PODVector<unsigned> &mapping = i < boneMappings.Size() ? boneMappings[i] : PODVector<unsigned>();
+
+        for (unsigned lod = 0; lod < model->GetNumGeometryLodLevels(i); ++lod)
+        {
+            GeometryData data;
+
+            if (!ExtractGeometryData(model->GetGeometry(i, lod), mapping, data))
+            {
+                error = "geometry " + String(i) + " lod " + String(lod) + " has no shadow data";
+                return false;
+            }
+
+            const unsigned weightsOffset = data.GetElementOffset(SEM_BLENDWEIGHTS);
+            const VertexElementType weightsType = data.GetElementType(SEM_BLENDWEIGHTS);
+            const unsigned indicesOffset = data.GetElementOffset(SEM_BLENDINDICES);
+
+            if (weightsOffset == M_MAX_UNSIGNED || indicesOffset == M_MAX_UNSIGNED)
+            {
+                continue;
+            }
+
+            for (unsigned j = 0; j < data.indices_.Size(); ++j)
+            {
+                const unsigned char *vertex = data.GetVertex(data.indices_[j]);
+                float weights[4];
+                ReadBlendWeights(vertex + weightsOffset, weightsType, weights);
+                const unsigned char *blendIndices = vertex + indicesOffset;
+                float totalWeight = 0.0f;
+
+                for (unsigned k = 0; k < 4; ++k)
+                {
+                    if (weights[k] <= 0.0f)
+                    {
+                        continue;
+                    }
+
+                    if ((!mapping.Empty() && blendIndices[k] >= mapping.Size()) || data.GetGlobalBone(blendIndices[k]) >= numBones)
+                    {
+                        error = "geometry " + String(i) + " lod " + String(lod) + " vertex " + String(data.indices_[j]) +
+                                " references bone index " + String(blendIndices[k]) + " out of range";
+                        return false;
+                    }
+                    totalWeight += weights[k];
+                }
+
+                if (totalWeight <= 0.0f)
+                {
+                    error = "geometry " + String(i) + " lod " + String(lod) + " vertex " + String(data.indices_[j]) + " has no weight";
+                    return false;
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
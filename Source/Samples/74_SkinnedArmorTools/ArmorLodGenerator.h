@@ -0,0 +1,81 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#pragma once
+
+#include <Urho3D/Graphics/Model.h>
+
+using namespace Urho3D;
+
+//=============================================================================
+//=============================================================================
+struct LodLevelStats
+{
+    LodLevelStats() : triangles_(0), vertices_(0), maxError_(0.0f), distance_(0.0f) {}
+
+    unsigned triangles_;
+    unsigned vertices_;
+    /// Largest distance of an original vertex from the level's surface, in model space.
+    float    maxError_;
+    float    distance_;
+};
+
+//=============================================================================
+// builds a lod chain for every geometry of a (skinned) model by collapsing
+// vertices onto neighbouring ones. Surviving vertices are copied unchanged,
+// so blend indices and weights stay valid; collapses across different bone
+// influences are penalized. Lod distances are set where the measured error
+// drops below the allowed pixel error on screen.
+//=============================================================================
+class ArmorLodGenerator
+{
+public:
+    ArmorLodGenerator();
+
+    /// Set the number of lod levels generated after lod 0.
+    void SetNumLevels(unsigned levels) { numLevels_ = levels; }
+    /// Set the triangle count ratio between consecutive levels.
+    void SetReduction(float ratio) { reduction_ = ratio; }
+    /// Set the allowed screen-space error in pixels.
+    void SetPixelError(float pixels) { pixelError_ = pixels; }
+    /// Set the screen height and vertical field of view the pixel error refers to.
+    void SetScreen(float height, float fov) { screenHeight_ = height; fov_ = fov; }
+    /// Set the cost scale for collapsing vertices with different bone weights.
+    void SetBoneWeightPenalty(float penalty) { boneWeightPenalty_ = penalty; }
+
+    /// Return a copy of the model with lod levels generated from each geometry's lod 0. Fills per-geometry level stats.
+    SharedPtr<Model> Generate(Context *context, Model *model, Vector<PODVector<LodLevelStats> > &geometryStats) const;
+    /// Return the lod distance where a model-space error projects to the allowed pixel error.
+    float GetLodDistance(float error) const;
+
+    /// Check that every referenced vertex of every lod level has in-range bone indices and positive total weight.
+    static bool ValidateBoneWeights(Model *model, String &error);
+
+private:
+    unsigned numLevels_;
+    float    reduction_;
+    float    pixelError_;
+    float    screenHeight_;
+    float    fov_;
+    float    boneWeightPenalty_;
+};
+
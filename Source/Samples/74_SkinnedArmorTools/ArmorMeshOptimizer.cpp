@@ -0,0 +1,511 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include <Urho3D/Container/Sort.h>
+#include <Urho3D/Graphics/Geometry.h>
+
+#include "ArmorMeshOptimizer.h"
+#include "GeometryUtils.h"
+
+#include <Urho3D/DebugNew.h>
+//=============================================================================
+//=============================================================================
+const unsigned FORSYTH_CACHE_SIZE = 32;
+const float FORSYTH_LAST_TRIANGLE_SCORE = 0.75f;
+const float FORSYTH_DECAY_POWER = 1.5f;
+const float FORSYTH_VALENCE_SCALE = 2.0f;
+const float FORSYTH_VALENCE_POWER = -0.5f;
+const unsigned FETCH_LINE_SIZE = 64;
+const unsigned FETCH_CACHE_LINES = 64;
+const unsigned MIN_CLUSTER_TRIANGLES = 8;
+
+//=============================================================================
+//=============================================================================
+struct ClusterOrder
+{
+    unsigned cluster_;
+    float    sortKey_;
+};
+
+static bool CompareClusters(const ClusterOrder &lhs, const ClusterOrder &rhs)
+{
+    return lhs.sortKey_ > rhs.sortKey_;
+}
+
+static float GetVertexScore(int cachePosition, unsigned remainingTriangles)
+{
+    if (remainingTriangles == 0)
+    {
+        return -1.0f;
+    }
+
+    float score = 0.0f;
+
+    if (cachePosition >= 0)
+    {
+        // the last triangle's vertices get a fixed score so the next one doesn't just reuse them
+        if (cachePosition < 3)
+        {
+            score = FORSYTH_LAST_TRIANGLE_SCORE;
+        }
+        else
+        {
+            score = powf(1.0f - (cachePosition - 3) / (float)(FORSYTH_CACHE_SIZE - 3), FORSYTH_DECAY_POWER);
+        }
+    }
+
+    // favour vertices with few triangles left to finish them off
+    return score + FORSYTH_VALENCE_SCALE * powf((float)remainingTriangles, FORSYTH_VALENCE_POWER);
+}
+
+//=============================================================================
+// FIFO cache simulation via timestamps
+//=============================================================================
+class FifoCache
+{
+public:
+    FifoCache(unsigned numEntries, unsigned cacheSize) :
+        timestamps_(numEntries),
+        time_(cacheSize + 1),
+        cacheSize_(cacheSize)
+    {
+        for (unsigned i = 0; i < numEntries; ++i)
+        {
+            timestamps_[i] = 0;
+        }
+    }
+
+    /// Touch an entry, return true on a miss.
+    bool Access(unsigned entry)
+    {
+        if (time_ - timestamps_[entry] > cacheSize_)
+        {
+            timestamps_[entry] = time_++;
+            return true;
+        }
+        return false;
+    }
+
+private:
+    PODVector<unsigned> timestamps_;
+    unsigned time_;
+    unsigned cacheSize_;
+};
+
+//=============================================================================
+//=============================================================================
+ArmorMeshOptimizer::ArmorMeshOptimizer() :
+    cacheSize_(16),
+    overdrawThreshold_(1.05f)
+{
+}
+
+SharedPtr<Model> ArmorMeshOptimizer::Optimize(Context *context, Model *model, PODVector<MeshOptimizeStats> &geometryStats) const
+{
+    if (model->GetNumMorphs())
+    {
+        return SharedPtr<Model>();
+    }
+
+    const unsigned numGeometries = model->GetNumGeometries();
+    const Vector<PODVector<unsigned> > &boneMappings = model->GetGeometryBoneMappings();
+    Vector<Vector<GeometryData> > geometries(numGeometries);
+
+    geometryStats.Clear();
+    geometryStats.Resize(numGeometries);
+
+    for (unsigned i = 0; i < numGeometries; ++i)
+    {
+        for (unsigned lod = 0; lod < model->GetNumGeometryLodLevels(i); ++lod)
+        {
+            GeometryData data;
+
+            if (!ExtractGeometryData(model->GetGeometry(i, lod), i < boneMappings.Size() ? boneMappings[i] : PODVector<unsigned>(), data))
+            {
+                return SharedPtr<Model>();
+            }
+
+            MeshOptimizeStats stats;
+            stats.triangles_ = data.indices_.Size() / 3;
+            stats.before_ = Analyze(data.indices_, data.vertexCount_, data.vertexSize_, cacheSize_);
+
+            if (data.primitiveType_ == TRIANGLE_LIST && stats.triangles_)
+            {
+                OptimizeVertexCache(data.indices_, data.vertexCount_);
+                OptimizeOverdraw(data.indices_, data);
+                CompactVertices(data);
+            }
+
+            stats.after_ = Analyze(data.indices_, data.vertexCount_, data.vertexSize_, cacheSize_);
+
+            if (lod == 0)
+            {
+                geometryStats[i] = stats;
+            }
+
+            geometries[i].Push(data);
+        }
+    }
+
+    return CreateModel(context, model, geometries);
+}
+
+void ArmorMeshOptimizer::OptimizeVertexCache(PODVector<unsigned> &indices, unsigned vertexCount)
+{
+    const unsigned numTriangles = indices.Size() / 3;
+
+    if (numTriangles < 2)
+    {
+        return;
+    }
+
+    // triangles per vertex; the live part of each list shrinks as triangles are emitted
+    PODVector<unsigned> adjacencyStart(vertexCount + 1);
+    PODVector<unsigned> remaining(vertexCount);
+    PODVector<unsigned> adjacency(numTriangles * 3);
+
+    for (unsigned i = 0; i <= vertexCount; ++i)
+    {
+        adjacencyStart[i] = 0;
+    }
+    for (unsigned i = 0; i < numTriangles * 3; ++i)
+    {
+        ++adjacencyStart[indices[i] + 1];
+    }
+    for (unsigned i = 0; i < vertexCount; ++i)
+    {
+        remaining[i] = adjacencyStart[i + 1];
+        adjacencyStart[i + 1] += adjacencyStart[i];
+    }
+
+    PODVector<unsigned> fill(adjacencyStart);
+
+    for (unsigned i = 0; i < numTriangles * 3; ++i)
+    {
+        adjacency[fill[indices[i]]++] = i / 3;
+    }
+
+    PODVector<int> cachePositions(vertexCount);
+    PODVector<float> vertexScores(vertexCount);
+    PODVector<float> triangleScores(numTriangles);
+    PODVector<bool> emitted(numTriangles);
+
+    for (unsigned i = 0; i < vertexCount; ++i)
+    {
+        cachePositions[i] = -1;
+        vertexScores[i] = GetVertexScore(-1, remaining[i]);
+    }
+
+    unsigned bestTriangle = 0;
+
+    for (unsigned i = 0; i < numTriangles; ++i)
+    {
+        emitted[i] = false;
+        triangleScores[i] = vertexScores[indices[i * 3]] + vertexScores[indices[i * 3 + 1]] + vertexScores[indices[i * 3 + 2]];
+
+        if (triangleScores[i] > triangleScores[bestTriangle])
+        {
+            bestTriangle = i;
+        }
+    }
+
+    PODVector<unsigned> output;
+    PODVector<unsigned> cache;
+    PODVector<unsigned> newCache;
+    unsigned cursor = 0;
+
+    output.Reserve(indices.Size());
+    cache.Reserve(FORSYTH_CACHE_SIZE + 3);
+    newCache.Reserve(FORSYTH_CACHE_SIZE + 3);
+
+    while (output.Size() < indices.Size())
+    {
+        // nothing in the cache has triangles left, take the next unemitted one
+        if (bestTriangle == M_MAX_UNSIGNED)
+        {
+            while (emitted[cursor])
+            {
+                ++cursor;
+            }
+            bestTriangle = cursor;
+        }
+
+        const unsigned *tri = &indices[bestTriangle * 3];
+        emitted[bestTriangle] = true;
+        newCache.Clear();
+
+        for (unsigned k = 0; k < 3; ++k)
+        {
+            const unsigned vertex = tri[k];
+            unsigned *begin = &adjacency[adjacencyStart[vertex]];
+
+            output.Push(vertex);
+            newCache.Push(vertex);
+
+            for (unsigned j = 0; j < remaining[vertex]; ++j)
+            {
+                if (begin[j] == bestTriangle)
+                {
+                    begin[j] = begin[remaining[vertex] - 1];
+                    --remaining[vertex];
+                    break;
+                }
+            }
+        }
+
+        for (unsigned i = 0; i < cache.Size(); ++i)
+        {
+            if (cache[i] != tri[0] && cache[i] != tri[1] && cache[i] != tri[2])
+            {
+                newCache.Push(cache[i]);
+            }
+        }
+
+        for (unsigned i = 0; i < newCache.Size(); ++i)
+        {
+            const unsigned vertex = newCache[i];
+            cachePositions[vertex] = i < FORSYTH_CACHE_SIZE ? (int)i : -1;
+            vertexScores[vertex] = GetVertexScore(cachePositions[vertex], remaining[vertex]);
+        }
+
+        // rescore the triangles around everything that moved, including vertices that fell out
+        bestTriangle = M_MAX_UNSIGNED;
+        float bestScore = -M_INFINITY;
+
+        for (unsigned i = 0; i < newCache.Size(); ++i)
+        {
+            const unsigned vertex = newCache[i];
+            const unsigned *begin = &adjacency[adjacencyStart[vertex]];
+
+            for (unsigned j = 0; j < remaining[vertex]; ++j)
+            {
+                const unsigned t = begin[j];
+                const float score = vertexScores[indices[t * 3]] + vertexScores[indices[t * 3 + 1]] + vertexScores[indices[t * 3 + 2]];
+
+                triangleScores[t] = score;
+
+                if (score > bestScore)
+                {
+                    bestScore = score;
+                    bestTriangle = t;
+                }
+            }
+        }
+
+        if (newCache.Size() > FORSYTH_CACHE_SIZE)
+        {
+            newCache.Resize(FORSYTH_CACHE_SIZE);
+        }
+        Swap(cache, newCache);
+    }
+
+    indices = output;
+}
+
+void ArmorMeshOptimizer::OptimizeOverdraw(PODVector<unsigned> &indices, const GeometryData &data) const
+{
+    const unsigned numTriangles = indices.Size() / 3;
+
+    if (numTriangles < MIN_CLUSTER_TRIANGLES * 2)
+    {
+        return;
+    }
+
+    // hard boundaries where the cache order starts over: all three vertices miss
+    FifoCache cache(data.vertexCount_, cacheSize_);
+    PODVector<unsigned> triangleMisses(numTriangles);
+    PODVector<unsigned> hardBoundaries;
+
+    for (unsigned t = 0; t < numTriangles; ++t)
+    {
+        unsigned misses = 0;
+
+        for (unsigned k = 0; k < 3; ++k)
+        {
+            misses += cache.Access(indices[t * 3 + k]) ? 1 : 0;
+        }
+
+        triangleMisses[t] = misses;
+
+        if (t == 0 || misses == 3)
+        {
+            hardBoundaries.Push(t);
+        }
+    }
+
+    hardBoundaries.Push(numTriangles);
+
+    // soft boundaries inside them wherever the cluster so far is about as cache friendly as the whole run
+    PODVector<unsigned> clusters;
+
+    for (unsigned i = 0; i + 1 < hardBoundaries.Size(); ++i)
+    {
+        const unsigned start = hardBoundaries[i];
+        const unsigned end = hardBoundaries[i + 1];
+        unsigned totalMisses = 0;
+
+        for (unsigned t = start; t < end; ++t)
+        {
+            totalMisses += triangleMisses[t];
+        }
+
+        const float runAcmr = (float)totalMisses / (end - start);
+        unsigned clusterStart = start;
+        unsigned clusterMisses = 0;
+
+        clusters.Push(start);
+
+        for (unsigned t = start; t + 1 < end; ++t)
+        {
+            const unsigned clusterTriangles = t + 1 - clusterStart;
+            clusterMisses += triangleMisses[t];
+
+            if (clusterTriangles >= MIN_CLUSTER_TRIANGLES && clusterMisses <= runAcmr * overdrawThreshold_ * clusterTriangles)
+            {
+                clusters.Push(t + 1);
+                clusterStart = t + 1;
+                clusterMisses = 0;
+            }
+        }
+    }
+
+    clusters.Push(numTriangles);
+
+    // mesh centroid, then each cluster's facing relative to it
+    Vector3 meshCentroid = Vector3::ZERO;
+    float meshArea = 0.0f;
+
+    for (unsigned t = 0; t < numTriangles; ++t)
+    {
+        const Vector3 &p0 = data.GetPosition(indices[t * 3]);
+        const Vector3 &p1 = data.GetPosition(indices[t * 3 + 1]);
+        const Vector3 &p2 = data.GetPosition(indices[t * 3 + 2]);
+        const float area = (p1 - p0).CrossProduct(p2 - p0).Length();
+
+        meshCentroid += (p0 + p1 + p2) * (area / 3.0f);
+        meshArea += area;
+    }
+
+    meshCentroid /= Max(meshArea, M_EPSILON);
+
+    PODVector<ClusterOrder> order(clusters.Size() - 1);
+
+    for (unsigned c = 0; c + 1 < clusters.Size(); ++c)
+    {
+        Vector3 centroid = Vector3::ZERO;
+        Vector3 normal = Vector3::ZERO;
+        float area = 0.0f;
+
+        for (unsigned t = clusters[c]; t < clusters[c + 1]; ++t)
+        {
+            const Vector3 &p0 = data.GetPosition(indices[t * 3]);
+            const Vector3 &p1 = data.GetPosition(indices[t * 3 + 1]);
+            const Vector3 &p2 = data.GetPosition(indices[t * 3 + 2]);
+            const Vector3 cross = (p1 - p0).CrossProduct(p2 - p0);
+            const float triangleArea = cross.Length();
+
+            centroid += (p0 + p1 + p2) * (triangleArea / 3.0f);
+            normal += cross;
+            area += triangleArea;
+        }
+
+        centroid /= Max(area, M_EPSILON);
+
+        order[c].cluster_ = c;
+        order[c].sortKey_ = (centroid - meshCentroid).DotProduct(normal.Normalized());
+    }
+
+    Sort(order.Begin(), order.End(), CompareClusters);
+
+    PODVector<unsigned> output;
+    output.Reserve(indices.Size());
+
+    for (unsigned i = 0; i < order.Size(); ++i)
+    {
+        const unsigned c = order[i].cluster_;
+
+        for (unsigned j = clusters[c] * 3; j < clusters[c + 1] * 3; ++j)
+        {
+            output.Push(indices[j]);
+        }
+    }
+
+    indices = output;
+}
+
+VertexCacheStats ArmorMeshOptimizer::Analyze(const PODVector<unsigned> &indices, unsigned vertexCount, unsigned vertexSize, unsigned cacheSize)
+{
+    VertexCacheStats stats;
+    const unsigned numTriangles = indices.Size() / 3;
+
+    if (!numTriangles || !vertexCount)
+    {
+        return stats;
+    }
+
+    const unsigned numLines = (vertexCount * vertexSize + FETCH_LINE_SIZE - 1) / FETCH_LINE_SIZE;
+    FifoCache vertexCache(vertexCount, cacheSize);
+    FifoCache lineCache(numLines, FETCH_CACHE_LINES);
+    PODVector<bool> referenced(vertexCount);
+    unsigned transformed = 0;
+    unsigned unique = 0;
+    unsigned fetchedBytes = 0;
+
+    for (unsigned i = 0; i < vertexCount; ++i)
+    {
+        referenced[i] = false;
+    }
+
+    for (unsigned i = 0; i < numTriangles * 3; ++i)
+    {
+        const unsigned vertex = indices[i];
+
+        if (!referenced[vertex])
+        {
+            referenced[vertex] = true;
+            ++unique;
+        }
+
+        if (!vertexCache.Access(vertex))
+        {
+            continue;
+        }
+
+        ++transformed;
+
+        // only transformed vertices are fetched
+        const unsigned firstLine = vertex * vertexSize / FETCH_LINE_SIZE;
+        const unsigned lastLine = ((vertex + 1) * vertexSize - 1) / FETCH_LINE_SIZE;
+
+        for (unsigned line = firstLine; line <= lastLine; ++line)
+        {
+            fetchedBytes += lineCache.Access(line) ? FETCH_LINE_SIZE : 0;
+        }
+    }
+
+    stats.acmr_ = (float)transformed / numTriangles;
+    stats.atvr_ = (float)transformed / unique;
+    stats.overfetch_ = (float)fetchedBytes / (unique * vertexSize);
+
+    return stats;
+}
+
@@ -0,0 +1,86 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#pragma once
+
+#include <Urho3D/Graphics/Model.h>
+
+using namespace Urho3D;
+
+struct GeometryData;
+
+//=============================================================================
+//=============================================================================
+struct VertexCacheStats
+{
+    VertexCacheStats() : acmr_(0.0f), atvr_(0.0f), overfetch_(0.0f) {}
+
+    /// Transformed vertices per triangle.
+    float acmr_;
+    /// Transformed vertices per referenced vertex, 1 is optimal.
+    float atvr_;
+    /// Vertex bytes fetched through 64-byte lines per referenced vertex byte, 1 is optimal.
+    float overfetch_;
+};
+
+//=============================================================================
+//=============================================================================
+struct MeshOptimizeStats
+{
+    MeshOptimizeStats() : triangles_(0) {}
+
+    unsigned         triangles_;
+    VertexCacheStats before_;
+    VertexCacheStats after_;
+};
+
+//=============================================================================
+// reorders triangles for the post-transform vertex cache (Forsyth), then
+// groups them into clusters sorted outside-in against overdraw, and finally
+// reorders vertices by first use for fetch locality. Cache behaviour is
+// measured with a FIFO cache, so no GPU is involved.
+//=============================================================================
+class ArmorMeshOptimizer
+{
+public:
+    ArmorMeshOptimizer();
+
+    /// Set the FIFO cache size used for the statistics and cluster boundaries.
+    void SetCacheSize(unsigned size) { cacheSize_ = size; }
+    /// Set how much worse than the cache order a cluster split for overdraw may make ACMR, 1.05 = 5%.
+    void SetOverdrawThreshold(float threshold) { overdrawThreshold_ = threshold; }
+
+    /// Return a copy of the model with every geometry lod optimized. Fills per-geometry lod 0 stats.
+    SharedPtr<Model> Optimize(Context *context, Model *model, PODVector<MeshOptimizeStats> &geometryStats) const;
+
+    /// Reorder triangles for vertex cache efficiency.
+    static void OptimizeVertexCache(PODVector<unsigned> &indices, unsigned vertexCount);
+    /// Reorder clusters of cache-ordered triangles so outer surfaces are drawn first.
+    void OptimizeOverdraw(PODVector<unsigned> &indices, const GeometryData &data) const;
+    /// Measure a triangle list with a FIFO cache.
+    static VertexCacheStats Analyze(const PODVector<unsigned> &indices, unsigned vertexCount, unsigned vertexSize, unsigned cacheSize);
+
+private:
+    unsigned cacheSize_;
+    float    overdrawThreshold_;
+};
+
@@ -0,0 +1,346 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#include <Urho3D/Graphics/Geometry.h>
+#include <Urho3D/Math/Ray.h>
+
+#include "ArmorOcclusionBaker.h"
+#include "GeometryUtils.h"
+
+#include <Urho3D/DebugNew.h>
+//=============================================================================
+//=============================================================================
+const unsigned MAX_GRID_DIM = 64;
+
+//=============================================================================
+// uniform grid over the armor triangles for short segment queries
+//=============================================================================
+class TriangleGrid
+{
+public:
+    void Build(const PODVector<Vector3> &vertices)
+    {
+        vertices_ = vertices;
+        bounds_.Clear();
+
+        for (unsigned i = 0; i < vertices_.Size(); ++i)
+        {
+            bounds_.Merge(vertices_[i]);
+        }
+
+        const unsigned numTriangles = vertices_.Size() / 3;
+        const Vector3 size = bounds_.Size();
+        const float maxSize = Max(Max(size.x_, size.y_), Max(size.z_, M_EPSILON));
+        const unsigned maxDim = Clamp((unsigned)(powf((float)numTriangles, 1.0f / 3.0f) * 2.0f), 1U, MAX_GRID_DIM);
+
+        for (unsigned i = 0; i < 3; ++i)
+        {
+            dims_[i] = Max(1U, (unsigned)(maxDim * size.Data()[i] / maxSize + 0.5f));
+            cellSize_[i] = Max(size.Data()[i] / dims_[i], M_EPSILON);
+        }
+
+        // count, then fill triangles per cell
+        cellStart_.Resize(dims_[0] * dims_[1] * dims_[2] + 1);
+
+        for (unsigned i = 0; i < cellStart_.Size(); ++i)
+        {
+            cellStart_[i] = 0;
+        }
+
+        for (unsigned pass = 0; pass < 2; ++pass)
+        {
+            PODVector<unsigned> fill;
+
+            if (pass == 1)
+            {
+                for (unsigned i = 1; i < cellStart_.Size(); ++i)
+                {
+                    cellStart_[i] += cellStart_[i - 1];
+                }
+                cellTriangles_.Resize(cellStart_.Back());
+                fill = cellStart_;
+            }
+
+            for (unsigned i = 0; i < numTriangles; ++i)
+            {
+                BoundingBox box;
+                box.Merge(vertices_[i * 3]);
+                box.Merge(vertices_[i * 3 + 1]);
+                box.Merge(vertices_[i * 3 + 2]);
+
+                unsigned lo[3], hi[3];
+                GetCellRange(box, lo, hi);
+
+                for (unsigned z = lo[2]; z <= hi[2]; ++z)
+                {
+                    for (unsigned y = lo[1]; y <= hi[1]; ++y)
+                    {
+                        for (unsigned x = lo[0]; x <= hi[0]; ++x)
+                        {
+                            const unsigned cell = (z * dims_[1] + y) * dims_[0] + x;
+
+                            if (pass == 0)
+                            {
+                                ++cellStart_[cell + 1];
+                            }
+                            else
+                            {
+                                cellTriangles_[fill[cell]++] = i;
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    bool SegmentHits(const Vector3 &start, const Vector3 &direction, float length) const
+    {
+        BoundingBox box;
+        box.Merge(start);
+        box.Merge(start + direction * length);
+
+        if (box.IsInside(bounds_) == OUTSIDE)
+        {
+            return false;
+        }
+
+        unsigned lo[3], hi[3];
+        GetCellRange(box, lo, hi);
+
+        const Ray ray(start, direction);
+
+        for (unsigned z = lo[2]; z <= hi[2]; ++z)
+        {
+            for (unsigned y = lo[1]; y <= hi[1]; ++y)
+            {
+                for (unsigned x = lo[0]; x <= hi[0]; ++x)
+                {
+                    const unsigned cell = (z * dims_[1] + y) * dims_[0] + x;
+
+                    for (unsigned i = cellStart_[cell]; i < cellStart_[cell + 1]; ++i)
+                    {
+                        const unsigned tri = cellTriangles_[i] * 3;
+                        const Vector3 &v0 = vertices_[tri];
+                        const Vector3 &v1 = vertices_[tri + 1];
+                        const Vector3 &v2 = vertices_[tri + 2];
+
+                        // Ray::HitDistance() culls back faces, armor is seen from inside
+                        if (ray.HitDistance(v0, v1, v2) <= length || ray.HitDistance(v0, v2, v1) <= length)
+                        {
+                            return true;
+                        }
+                    }
+                }
+            }
+        }
+
+        return false;
+    }
+
+private:
+    void GetCellRange(const BoundingBox &box, unsigned lo[3], unsigned hi[3]) const
+    {
+        for (unsigned i = 0; i < 3; ++i)
+        {
+            const float minCell = (box.min_.Data()[i] - bounds_.min_.Data()[i]) / cellSize_[i];
+            const float maxCell = (box.max_.Data()[i] - bounds_.min_.Data()[i]) / cellSize_[i];
+
+            lo[i] = (unsigned)Clamp((int)floorf(minCell), 0, (int)dims_[i] - 1);
+            hi[i] = (unsigned)Clamp((int)floorf(maxCell), 0, (int)dims_[i] - 1);
+        }
+    }
+
+    PODVector<Vector3>  vertices_;
+    BoundingBox         bounds_;
+    unsigned            dims_[3];
+    float               cellSize_[3];
+    PODVector<unsigned> cellStart_;
+    PODVector<unsigned> cellTriangles_;
+};
+
+//=============================================================================
+//=============================================================================
+ArmorOcclusionBaker::ArmorOcclusionBaker() :
+    maxDistance_(0.03f),
+    coneAngle_(30.0f)
+{
+}
+
+SharedPtr<Model> ArmorOcclusionBaker::Bake(Context *context, Model *baseModel, const PODVector<ArmorPiece> &pieces,
+                                           PODVector<OcclusionBakeStats> &slotStats) const
+{
+    const unsigned numSlots = baseModel->GetNumGeometries();
+    const Vector<PODVector<unsigned> > &baseMappings = baseModel->GetGeometryBoneMappings();
+
+    slotStats.Clear();
+    slotStats.Resize(numSlots);
+
+    // armor triangles in bind pose
+    PODVector<Vector3> armorVertices;
+    PODVector<bool> replaced(numSlots);
+
+    for (unsigned i = 0; i < numSlots; ++i)
+    {
+        replaced[i] = false;
+    }
+
+    for (unsigned i = 0; i < pieces.Size(); ++i)
+    {
+        const ArmorPiece &piece = pieces[i];
+        GeometryData data;
+
+        replaced[piece.slot_] = true;
+
+        if (!ExtractGeometryData(piece.model_->GetGeometry(piece.geometryIndex_, 0), PODVector<unsigned>(), data) ||
+            data.primitiveType_ != TRIANGLE_LIST)
+        {
+            return SharedPtr<Model>();
+        }
+
+        for (unsigned j = 0; j < data.indices_.Size(); ++j)
+        {
+            armorVertices.Push(data.GetPosition(data.indices_[j]));
+        }
+    }
+
+    TriangleGrid grid;
+    grid.Build(armorVertices);
+
+    const Vector3 modelSize = baseModel->GetBoundingBox().Size();
+    const float scale = Max(Max(modelSize.x_, modelSize.y_), modelSize.z_);
+    const float maxDistance = maxDistance_ * scale;
+    const float offset = 1e-4f * scale;
+    const float coneCos = Cos(coneAngle_);
+    const float coneSin = Sin(coneAngle_);
+
+    Vector<Vector<GeometryData> > geometries(numSlots);
+
+    for (unsigned slot = 0; slot < numSlots; ++slot)
+    {
+        const PODVector<unsigned> &mapping = slot < baseMappings.Size() ? baseMappings[slot] : PODVector<unsigned>();
+
+        for (unsigned lod = 0; lod < baseModel->GetNumGeometryLodLevels(slot); ++lod)
+        {
+            GeometryData data;
+
+            if (!ExtractGeometryData(baseModel->GetGeometry(slot, lod), mapping, data))
+            {
+                return SharedPtr<Model>();
+            }
+
+            OcclusionBakeStats stats;
+            stats.trianglesBefore_ = data.indices_.Size() / 3;
+            stats.verticesBefore_ = data.vertexCount_;
+
+            if (!replaced[slot] && data.primitiveType_ == TRIANGLE_LIST)
+            {
+                const unsigned normalOffset = data.GetElementOffset(SEM_NORMAL);
+                PODVector<unsigned> kept;
+
+                for (unsigned i = 0; i + 2 < data.indices_.Size(); i += 3)
+                {
+                    const unsigned *tri = &data.indices_[i];
+                    const Vector3 &v0 = data.GetPosition(tri[0]);
+                    const Vector3 &v1 = data.GetPosition(tri[1]);
+                    const Vector3 &v2 = data.GetPosition(tri[2]);
+
+                    Vector3 normal = (v1 - v0).CrossProduct(v2 - v0);
+                    bool covered = normal.LengthSquared() > M_EPSILON * M_EPSILON;
+
+                    if (covered)
+                    {
+                        normal.Normalize();
+
+                        // outwards according to the vertex normals when present
+                        if (normalOffset != M_MAX_UNSIGNED)
+                        {
+                            Vector3 vertexNormals = Vector3::ZERO;
+
+                            for (unsigned k = 0; k < 3; ++k)
+                            {
+                                vertexNormals += *reinterpret_cast<const Vector3*>(data.GetVertex(tri[k]) + normalOffset);
+                            }
+                            if (normal.DotProduct(vertexNormals) < 0.0f)
+                            {
+                                normal = -normal;
+                            }
+                        }
+
+                        const Vector3 tangent = normal.CrossProduct(Abs(normal.y_) < 0.9f ? Vector3::UP : Vector3::RIGHT).Normalized();
+                        const Vector3 bitangent = normal.CrossProduct(tangent);
+                        const Vector3 directions[5] =
+                        {
+                            normal,
+                            normal * coneCos + tangent * coneSin,
+                            normal * coneCos - tangent * coneSin,
+                            normal * coneCos + bitangent * coneSin,
+                            normal * coneCos - bitangent * coneSin
+                        };
+
+                        const Vector3 center = (v0 + v1 + v2) / 3.0f;
+                        const Vector3 samples[4] =
+                        {
+                            center,
+                            v0.Lerp(center, 0.1f),
+                            v1.Lerp(center, 0.1f),
+                            v2.Lerp(center, 0.1f)
+                        };
+
+                        for (unsigned s = 0; covered && s < 4; ++s)
+                        {
+                            const Vector3 start = samples[s] + normal * offset;
+
+                            for (unsigned d = 0; covered && d < 5; ++d)
+                            {
+                                const float length = d == 0 ? maxDistance : maxDistance / coneCos;
+                                covered = grid.SegmentHits(start, directions[d], length);
+                            }
+                        }
+                    }
+
+                    if (!covered)
+                    {
+                        kept.Push(tri[0]);
+                        kept.Push(tri[1]);
+                        kept.Push(tri[2]);
+                    }
+                }
+
+                data.indices_ = kept;
+                stats.trianglesRemoved_ = stats.trianglesBefore_ - data.indices_.Size() / 3;
+                stats.verticesRemoved_ = CompactVertices(data);
+            }
+
+            if (lod == 0)
+            {
+                slotStats[slot] = stats;
+            }
+
+            geometries[slot].Push(data);
+        }
+    }
+
+    return CreateModel(context, baseModel, geometries);
+}
+
@@ -0,0 +1,68 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#pragma once
+
+#include <Urho3D/Graphics/Model.h>
+
+#include "ArmorModelCache.h"
+
+using namespace Urho3D;
+
+//=============================================================================
+//=============================================================================
+struct OcclusionBakeStats
+{
+    OcclusionBakeStats() : trianglesBefore_(0), trianglesRemoved_(0), verticesBefore_(0), verticesRemoved_(0) {}
+
+    unsigned trianglesBefore_;
+    unsigned trianglesRemoved_;
+    unsigned verticesBefore_;
+    unsigned verticesRemoved_;
+};
+
+//=============================================================================
+// removes base model triangles that an armor set fully covers in bind pose.
+// A triangle counts as covered when rays cast outwards from its corners and
+// center, along its normal and tilted around it, all hit armor within the
+// max distance.
+//=============================================================================
+class ArmorOcclusionBaker
+{
+public:
+    ArmorOcclusionBaker();
+
+    /// Set how far outside the body the armor may sit, as a fraction of the model's height.
+    void SetMaxDistance(float fraction) { maxDistance_ = fraction; }
+    /// Set the cone half-angle of the tilted rays in degrees.
+    void SetConeAngle(float degrees) { coneAngle_ = degrees; }
+
+    /// Return a copy of the base model with covered triangles of the unreplaced slots removed. Fills per-slot stats.
+    SharedPtr<Model> Bake(Context *context, Model *baseModel, const PODVector<ArmorPiece> &pieces,
+                          PODVector<OcclusionBakeStats> &slotStats) const;
+
+private:
+    float maxDistance_;
+    float coneAngle_;
+};
+
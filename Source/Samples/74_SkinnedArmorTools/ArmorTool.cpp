@@ -0,0 +1,596 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#include <Urho3D/Core/ProcessUtils.h>
+#include <Urho3D/Engine/Engine.h>
+#include <Urho3D/Graphics/Geometry.h>
+#include <Urho3D/Graphics/Material.h>
+#include <Urho3D/Graphics/Model.h>
+#include <Urho3D/Graphics/VertexBuffer.h>
+#include <Urho3D/IO/File.h>
+#include <Urho3D/IO/FileSystem.h>
+#include <Urho3D/Resource/ResourceCache.h>
+#include <Urho3D/Resource/XMLFile.h>
+#include <Urho3D/Scene/Scene.h>
+
+#include "ArmorTool.h"
+#include "ArmorGeometryMerger.h"
+#include "ArmorLoadout.h"
+#include "ArmorLodGenerator.h"
+#include "ArmorMeshOptimizer.h"
+#include "ArmorModelCache.h"
+#include "ArmorOcclusionBaker.h"
+#include "BinaryScene.h"
+#include "QuantizedModel.h"
+
+#include <Urho3D/DebugNew.h>
+//=============================================================================
+//=============================================================================
+URHO3D_DEFINE_APPLICATION_MAIN(ArmorTool)
+
+//=============================================================================
+//=============================================================================
+ArmorTool::ArmorTool(Context* context) :
+    Application(context)
+{
+    ArmorLoadout::RegisterObject(context);
+    QuantizedModel::RegisterObject(context);
+    context->RegisterSubsystem(new ArmorModelCache(context));
+}
+
+void ArmorTool::Setup()
+{
+    engineParameters_["LogName"]  = GetSubsystem<FileSystem>()->GetProgramDir() + "skinnedArmorTools.log";
+    engineParameters_["Headless"] = true;
+    engineParameters_["Sound"]    = false;
+
+    // engine options start with a dash, the rest is the command
+    const Vector<String> &arguments = GetArguments();
+
+    for (unsigned i = 0; i < arguments.Size(); ++i)
+    {
+        if (!arguments[i].StartsWith("-"))
+        {
+            arguments_.Push(arguments[i]);
+        }
+    }
+}
+
+void ArmorTool::Start()
+{
+    if (arguments_.Empty())
+    {
+        PrintUsage();
+        ErrorExit();
+        return;
+    }
+
+    const String command = arguments_[0].ToLower();
+    Vector<String> args;
+    bool success = false;
+
+    for (unsigned i = 1; i < arguments_.Size(); ++i)
+    {
+        args.Push(arguments_[i]);
+    }
+
+    if (command == "merge")
+    {
+        success = RunMerge(args);
+    }
+    else if (command == "hsr")
+    {
+        success = RunOcclusionBake(args);
+    }
+    else if (command == "lod")
+    {
+        success = RunLodGeneration(args);
+    }
+    else if (command == "quantize")
+    {
+        success = RunQuantize(args);
+    }
+    else if (command == "optimize")
+    {
+        success = RunOptimize(args);
+    }
+    else if (command == "scene")
+    {
+        success = RunSceneConvert(args);
+    }
+    else
+    {
+        PrintUsage();
+    }
+
+    if (success)
+    {
+        engine_->Exit();
+    }
+    else
+    {
+        ErrorExit();
+    }
+}
+
+void ArmorTool::PrintUsage()
+{
+    PrintLine("Usage: 74_SkinnedArmorTools <command> [arguments]\n"
+              "\n"
+              "Commands:\n"
+              "  merge <loadout.xml>   merge same-material geometries of the loadout's model,\n"
+              "                        report batch counts and validate the merged bone mappings\n"
+              "  hsr <loadout.xml> <output.mdl> [maxDistance] [coneAngle]\n"
+              "                        remove base model triangles hidden under the loadout's armor\n"
+              "                        and write the trimmed model. maxDistance is a fraction of the\n"
+              "                        model size (default 0.03), coneAngle in degrees (default 30)\n"
+              "  lod <input.mdl> <output.mdl> [levels] [pixelError]\n"
+              "                        generate lod levels for every geometry, keeping the skinning,\n"
+              "                        with distances where the error drops below pixelError on a\n"
+              "                        1080 pixel high screen at 45 degree fov (defaults 3 and 1.0)\n"
+              "  quantize <input.mdl> <output.qmdl>\n"
+              "                        write the model with quantized vertices, report the memory\n"
+              "                        reduction and the largest reconstruction errors\n"
+              "  optimize <input.mdl> <output.mdl> [cacheSize]\n"
+              "                        reorder triangles and vertices for the vertex cache, overdraw\n"
+              "                        and fetch locality, report ACMR/ATVR before and after for a\n"
+              "                        FIFO cache of cacheSize entries (default 16)\n"
+              "  scene <input.xml> <output.bscn>\n"
+              "                        convert an XML scene to the binary scene format and check that\n"
+              "                        it loads back with the same nodes and components\n"
+              "\n"
+              "Resource names are relative to the resource paths, e.g. SkinnedArmor/XMLData/MariaLoadout.xml");
+}
+
+bool ArmorTool::RunMerge(const Vector<String> &args)
+{
+    if (args.Size() < 1)
+    {
+        PrintUsage();
+        return false;
+    }
+
+    ArmorLoadout *loadout = GetSubsystem<ResourceCache>()->GetResource<ArmorLoadout>(args[0]);
+
+    if (!loadout)
+    {
+        return false;
+    }
+
+    Model *composed = GetSubsystem<ArmorModelCache>()->GetComposedModel(loadout->GetBaseModel(), loadout->GetPieces());
+    Vector<SharedPtr<Material> > mergedMaterials;
+    GeometryMergeStats stats;
+
+    SharedPtr<Model> merged = ArmorGeometryMerger::MergeByMaterial(context_, composed, loadout->GetSlotMaterials(), mergedMaterials, stats);
+
+    PrintLine("loadout:         " + args[0]);
+    PrintLine("batches before:  " + String(stats.batchesBefore_));
+    PrintLine("batches after:   " + String(stats.batchesAfter_));
+    PrintLine("merged groups:   " + String(stats.mergedGroups_));
+    PrintLine("copied vertices: " + String(stats.copiedVertices_));
+
+    const Vector<PODVector<unsigned> > &boneMappings = merged->GetGeometryBoneMappings();
+
+    for (unsigned i = 0; i < merged->GetNumGeometries(); ++i)
+    {
+        Geometry *geometry = merged->GetGeometry(i, 0);
+        Material *material = mergedMaterials[i];
+
+        PrintLine("  geometry " + String(i) + ": " + String(geometry->GetIndexCount() / 3) + " triangles, " +
+                  String(i < boneMappings.Size() ? boneMappings[i].Size() : 0) + " mapped bones (0 = skeleton indices), " +
+                  (material ? material->GetName() : String("<no material>")));
+    }
+
+    String error;
+
+    if (!ArmorGeometryMerger::ValidateMerge(composed, merged, error))
+    {
+        PrintLine("bone mapping check: FAILED, " + error, true);
+        return false;
+    }
+
+    PrintLine("bone mapping check: OK");
+
+    return true;
+}
+
+bool ArmorTool::RunOcclusionBake(const Vector<String> &args)
+{
+    if (args.Size() < 2)
+    {
+        PrintUsage();
+        return false;
+    }
+
+    ArmorLoadout *loadout = GetSubsystem<ResourceCache>()->GetResource<ArmorLoadout>(args[0]);
+
+    if (!loadout)
+    {
+        return false;
+    }
+
+    ArmorOcclusionBaker baker;
+
+    if (args.Size() > 2)
+    {
+        baker.SetMaxDistance(ToFloat(args[2]));
+    }
+    if (args.Size() > 3)
+    {
+        baker.SetConeAngle(ToFloat(args[3]));
+    }
+
+    Model *baseModel = loadout->GetBaseModel();
+    PODVector<OcclusionBakeStats> slotStats;
+    SharedPtr<Model> baked = baker.Bake(context_, baseModel, loadout->GetPieces(), slotStats);
+
+    if (!baked)
+    {
+        PrintLine("base and armor models need shadowed triangle list geometry", true);
+        return false;
+    }
+
+    File file(context_, args[1], FILE_WRITE);
+
+    if (!file.IsOpen() || !baked->Save(file))
+    {
+        PrintLine("could not write " + args[1], true);
+        return false;
+    }
+
+    OcclusionBakeStats total;
+
+    PrintLine("loadout:    " + args[0]);
+    PrintLine("base model: " + baseModel->GetName());
+
+    for (unsigned i = 0; i < slotStats.Size(); ++i)
+    {
+        const OcclusionBakeStats &stats = slotStats[i];
+
+        PrintLine("  slot " + String(i) + ": " + String(stats.trianglesRemoved_) + "/" + String(stats.trianglesBefore_) +
+                  " triangles, " + String(stats.verticesRemoved_) + "/" + String(stats.verticesBefore_) + " vertices removed");
+
+        total.trianglesBefore_ += stats.trianglesBefore_;
+        total.trianglesRemoved_ += stats.trianglesRemoved_;
+        total.verticesBefore_ += stats.verticesBefore_;
+        total.verticesRemoved_ += stats.verticesRemoved_;
+    }
+
+    PrintLine("triangles removed: " + String(total.trianglesRemoved_) + "/" + String(total.trianglesBefore_));
+    PrintLine("vertices removed:  " + String(total.verticesRemoved_) + "/" + String(total.verticesBefore_));
+    PrintLine("written:           " + args[1]);
+
+    return true;
+}
+
+bool ArmorTool::RunLodGeneration(const Vector<String> &args)
+{
+    if (args.Size() < 2)
+    {
+        PrintUsage();
+        return false;
+    }
+
+    Model *model = GetSubsystem<ResourceCache>()->GetResource<Model>(args[0]);
+
+    if (!model)
+    {
+        return false;
+    }
+
+    ArmorLodGenerator generator;
+
+    if (args.Size() > 2)
+    {
+        generator.SetNumLevels(ToUInt(args[2]));
+    }
+    if (args.Size() > 3)
+    {
+        generator.SetPixelError(ToFloat(args[3]));
+    }
+
+    Vector<PODVector<LodLevelStats> > geometryStats;
+    SharedPtr<Model> generated = generator.Generate(context_, model, geometryStats);
+
+    if (!generated)
+    {
+        PrintLine("model needs shadowed geometry with positions first in a single vertex buffer", true);
+        return false;
+    }
+
+    PrintLine("model: " + args[0]);
+
+    for (unsigned i = 0; i < geometryStats.Size(); ++i)
+    {
+        PrintLine("  geometry " + String(i) + ":");
+
+        for (unsigned j = 0; j < geometryStats[i].Size(); ++j)
+        {
+            const LodLevelStats &stats = geometryStats[i][j];
+
+            PrintLine("    lod " + String(j) + ": " + String(stats.triangles_) + " triangles, " + String(stats.vertices_) +
+                      " vertices, max error " + String(stats.maxError_) + ", distance " + String(stats.distance_));
+        }
+    }
+
+    String error;
+
+    if (!ArmorLodGenerator::ValidateBoneWeights(generated, error))
+    {
+        PrintLine("bone weights check: FAILED, " + error, true);
+        return false;
+    }
+
+    PrintLine("bone weights check: OK");
+
+    File file(context_, args[1], FILE_WRITE);
+
+    if (!file.IsOpen() || !generated->Save(file))
+    {
+        PrintLine("could not write " + args[1], true);
+        return false;
+    }
+
+    PrintLine("written: " + args[1]);
+
+    return true;
+}
+
+bool ArmorTool::RunQuantize(const Vector<String> &args)
+{
+    if (args.Size() < 2)
+    {
+        PrintUsage();
+        return false;
+    }
+
+    Model *model = GetSubsystem<ResourceCache>()->GetResource<Model>(args[0]);
+
+    if (!model)
+    {
+        return false;
+    }
+
+    const Vector<SharedPtr<VertexBuffer> > &vertexBuffers = model->GetVertexBuffers();
+    Vector<QuantizedVertexBuffer> buffers(vertexBuffers.Size());
+    QuantizationError error;
+    unsigned floatSize = 0;
+    unsigned quantizedSize = 0;
+    unsigned decodedSize = 0;
+
+    PrintLine("model: " + args[0]);
+
+    for (unsigned i = 0; i < vertexBuffers.Size(); ++i)
+    {
+        VertexBuffer *buffer = vertexBuffers[i];
+
+        if (!buffers[i].Encode(buffer))
+        {
+            PrintLine("vertex buffer " + String(i) + " has no shadow data", true);
+            return false;
+        }
+
+        buffers[i].MeasureError(buffer, error);
+
+        floatSize += buffer->GetVertexCount() * buffer->GetVertexSize();
+        quantizedSize += buffers[i].data_.Size();
+        decodedSize += buffers[i].vertexCount_ * buffers[i].GetDecodedVertexSize();
+
+        PrintLine("  vertex buffer " + String(i) + ": " + String(buffer->GetVertexCount()) + " vertices, " +
+                  String(buffer->GetVertexSize()) + " -> " + String(buffers[i].vertexSize_) + " bytes per vertex on disk, " +
+                  String(buffers[i].GetDecodedVertexSize()) + " after load");
+    }
+
+    File file(context_, args[1], FILE_WRITE);
+
+    if (!file.IsOpen() || !QuantizedModel::SaveQuantized(model, buffers, file))
+    {
+        PrintLine("could not write " + args[1] + ", models with vertex morphs or several vertex buffers per geometry are not supported", true);
+        return false;
+    }
+
+    file.Close();
+
+    // load it back the way the game does
+    SharedPtr<QuantizedModel> loaded(new QuantizedModel(context_));
+    File input(context_, args[1]);
+
+    if (!loaded->Load(input) || loaded->GetNumGeometries() != model->GetNumGeometries())
+    {
+        PrintLine("reload check: FAILED", true);
+        return false;
+    }
+
+    const float boundsSize = model->GetBoundingBox().Size().Length();
+    const float reduction = floatSize ? 100.0f * (1.0f - (float)quantizedSize / floatSize) : 0.0f;
+
+    PrintLine("vertex memory float:       " + String(floatSize) + " bytes");
+    PrintLine("vertex memory quantized:   " + String(quantizedSize) + " bytes, " + String(reduction) + "% less");
+    PrintLine("vertex memory after load:  " + String(decodedSize) + " bytes");
+    PrintLine("max position error:        " + String(error.position_) + " (" +
+              String(boundsSize > 0.0f ? 100.0f * error.position_ / boundsSize : 0.0f) + "% of the bounds diagonal)");
+    PrintLine("max normal error:          " + String(error.normal_) + " degrees");
+    PrintLine("max tangent error:         " + String(error.tangent_) + " degrees");
+    PrintLine("max uv error:              " + String(error.texCoord_));
+    PrintLine("max blend weight error:    " + String(error.blendWeight_));
+    PrintLine("reload check: OK");
+    PrintLine("written: " + args[1]);
+
+    return true;
+}
+
+bool ArmorTool::RunOptimize(const Vector<String> &args)
+{
+    if (args.Size() < 2)
+    {
+        PrintUsage();
+        return false;
+    }
+
+    Model *model = GetSubsystem<ResourceCache>()->GetResource<Model>(args[0]);
+
+    if (!model)
+    {
+        return false;
+    }
+
+    ArmorMeshOptimizer optimizer;
+
+    if (args.Size() > 2)
+    {
+        optimizer.SetCacheSize(Max(ToUInt(args[2]), 3U));
+    }
+
+    PODVector<MeshOptimizeStats> geometryStats;
+    SharedPtr<Model> optimized = optimizer.Optimize(context_, model, geometryStats);
+
+    if (!optimized)
+    {
+        PrintLine("model needs shadowed geometry with positions first in a single vertex buffer and no vertex morphs", true);
+        return false;
+    }
+
+    MeshOptimizeStats total;
+
+    PrintLine("model: " + args[0]);
+    PrintLine("  geometry: triangles, ACMR before -> after, ATVR before -> after, overfetch before -> after");
+
+    for (unsigned i = 0; i < geometryStats.Size(); ++i)
+    {
+        const MeshOptimizeStats &stats = geometryStats[i];
+
+        PrintLine("  " + String(i) + ": " + String(stats.triangles_) + ", " +
+                  String(stats.before_.acmr_) + " -> " + String(stats.after_.acmr_) + ", " +
+                  String(stats.before_.atvr_) + " -> " + String(stats.after_.atvr_) + ", " +
+                  String(stats.before_.overfetch_) + " -> " + String(stats.after_.overfetch_));
+
+        // triangle weighted averages
+        total.triangles_ += stats.triangles_;
+        total.before_.acmr_ += stats.before_.acmr_ * stats.triangles_;
+        total.after_.acmr_ += stats.after_.acmr_ * stats.triangles_;
+        total.before_.atvr_ += stats.before_.atvr_ * stats.triangles_;
+        total.after_.atvr_ += stats.after_.atvr_ * stats.triangles_;
+    }
+
+    if (total.triangles_)
+    {
+        PrintLine("ACMR: " + String(total.before_.acmr_ / total.triangles_) + " -> " + String(total.after_.acmr_ / total.triangles_));
+        PrintLine("ATVR: " + String(total.before_.atvr_ / total.triangles_) + " -> " + String(total.after_.atvr_ / total.triangles_));
+    }
+
+    File file(context_, args[1], FILE_WRITE);
+
+    if (!file.IsOpen() || !optimized->Save(file))
+    {
+        PrintLine("could not write " + args[1], true);
+        return false;
+    }
+
+    PrintLine("written: " + args[1]);
+
+    return true;
+}
+
+
+
+bool ArmorTool::RunSceneConvert(const Vector<String> &args)
+{
+    if (args.Size() < 2)
+    {
+        PrintUsage();
+        return false;
+    }
+
+    ResourceCache *cache = GetSubsystem<ResourceCache>();
+    XMLFile *xmlScene = cache->GetResource<XMLFile>(args[0]);
+
+    if (!xmlScene)
+    {
+        return false;
+    }
+
+    SharedPtr<Scene> scene(new Scene(context_));
+
+    if (!scene->LoadXML(xmlScene->GetRoot()))
+    {
+        PrintLine("could not load " + args[0], true);
+        return false;
+    }
+
+    SharedPtr<BinaryScene> binaryScene(new BinaryScene(context_));
+    File file(context_, args[1], FILE_WRITE);
+
+    if (!file.IsOpen() || !binaryScene->Save(scene, file))
+    {
+        PrintLine("could not write " + args[1], true);
+        return false;
+    }
+
+    const unsigned binarySize = file.GetSize();
+    file.Close();
+
+    // load it back the way the game does and compare the content
+    SharedPtr<Scene> loaded(new Scene(context_));
+    PODVector<Node*> nodes;
+    PODVector<Node*> loadedNodes;
+
+    scene->GetChildren(nodes, true);
+
+    if (!binaryScene->Load(loaded, args[1]))
+    {
+        PrintLine("reload check: FAILED", true);
+        return false;
+    }
+
+    loaded->GetChildren(loadedNodes, true);
+    unsigned numComponents = scene->GetNumComponents();
+    bool match = nodes.Size() == loadedNodes.Size() && loaded->GetNumComponents() == numComponents;
+
+    for (unsigned i = 0; match && i < nodes.Size(); ++i)
+    {
+        match = nodes[i]->GetID() == loadedNodes[i]->GetID() && nodes[i]->GetName() == loadedNodes[i]->GetName() &&
+                nodes[i]->GetNumComponents() == loadedNodes[i]->GetNumComponents() &&
+                nodes[i]->GetTransform().Equals(loadedNodes[i]->GetTransform());
+        numComponents += nodes[i]->GetNumComponents();
+    }
+
+    const String xmlFileName = cache->GetResourceFileName(args[0]);
+    const unsigned xmlSize = xmlFileName.Empty() ? 0 : File(context_, xmlFileName).GetSize();
+
+    PrintLine("scene: " + args[0]);
+    PrintLine("nodes:       " + String(nodes.Size()));
+    PrintLine("components:  " + String(numComponents));
+    PrintLine("xml size:    " + String(xmlSize) + " bytes");
+    PrintLine("binary size: " + String(binarySize) + " bytes");
+
+    if (!match)
+    {
+        PrintLine("reload check: FAILED", true);
+        return false;
+    }
+
+    PrintLine("reload check: OK");
+    PrintLine("written: " + args[1]);
+
+    return true;
+}
@@ -0,0 +1,64 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#pragma once
+
+#include <Urho3D/Engine/Application.h>
+
+using namespace Urho3D;
+
+//=============================================================================
+// headless command-line tool for the skinned armor assets. Runs one command
+// per invocation and exits:
+//
+//   74_SkinnedArmorTools merge <loadout.xml>
+//   74_SkinnedArmorTools hsr <loadout.xml> <output.mdl> [maxDistance] [coneAngle]
+//   74_SkinnedArmorTools lod <input.mdl> <output.mdl> [levels] [pixelError]
+//   74_SkinnedArmorTools quantize <input.mdl> <output.qmdl>
+//   74_SkinnedArmorTools optimize <input.mdl> <output.mdl> [cacheSize]
+//   74_SkinnedArmorTools scene <input.xml> <output.bscn>
+//=============================================================================
+class ArmorTool : public Application
+{
+    URHO3D_OBJECT(ArmorTool, Application);
+
+public:
+    /// Construct.
+    ArmorTool(Context* context);
+
+    virtual void Setup();
+    virtual void Start();
+
+private:
+    void PrintUsage();
+    bool RunMerge(const Vector<String> &args);
+    bool RunOcclusionBake(const Vector<String> &args);
+    bool RunLodGeneration(const Vector<String> &args);
+    bool RunQuantize(const Vector<String> &args);
+    bool RunOptimize(const Vector<String> &args);
+    bool RunSceneConvert(const Vector<String> &args);
+
+    /// Positional command-line arguments, engine options removed.
+    Vector<String> arguments_;
+};
+
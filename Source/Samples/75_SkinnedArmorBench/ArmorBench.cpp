@@ -0,0 +1,772 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include <Urho3D/Core/ProcessUtils.h>
+#include <Urho3D/Core/Timer.h>
+#include <Urho3D/Engine/Engine.h>
+#include <Urho3D/Graphics/AnimatedModel.h>
+#include <Urho3D/Graphics/AnimationController.h>
+#include <Urho3D/Graphics/Material.h>
+#include <Urho3D/Graphics/Model.h>
+#include <Urho3D/Graphics/Octree.h>
+#include <Urho3D/IO/File.h>
+#include <Urho3D/IO/FileSystem.h>
+#include <Urho3D/Resource/ResourceCache.h>
+#include <Urho3D/Resource/XMLFile.h>
+#include <Urho3D/Scene/Scene.h>
+
+#include "AnimationSet.h"
+#include "AnimationSetController.h"
+#include "ArmorBench.h"
+#include "ArmorLoadout.h"
+#include "ArmorModelCache.h"
+#include "BinaryScene.h"
+#include "HitRegistry.h"
+#include "QuantizedModel.h"
+#include "SkinnedHitMesh.h"
+
+#include <Urho3D/DebugNew.h>
+//=============================================================================
+//=============================================================================
+URHO3D_DEFINE_APPLICATION_MAIN(ArmorBench)
+
+const char* BENCH_LOADOUT = "SkinnedArmor/XMLData/MariaLoadout.xml";
+const char* BENCH_BASE_MODEL = "SkinnedArmor/Girlbot/Girlbot.mdl";
+const char* BENCH_ARMOR_MODEL = "SkinnedArmor/Maria/Armor.mdl";
+const char* BENCH_ARMOR_MATERIAL = "SkinnedArmor/Maria/Materials/MariaMat1.xml";
+const char* BENCH_ANIMATIONS[] =
+{
+    "SkinnedArmor/Girlbot/Girlbot_Idle.ani",
+    "SkinnedArmor/Girlbot/Girlbot_Run.ani",
+    "SkinnedArmor/Girlbot/Girlbot_SlashCombo1.ani",
+    "SkinnedArmor/Girlbot/Girlbot_EquipIdleLY.ani"
+};
+const unsigned NUM_BENCH_ANIMATIONS = sizeof(BENCH_ANIMATIONS) / sizeof(BENCH_ANIMATIONS[0]);
+const unsigned BENCH_CHARACTER_COUNTS[] = { 1, 10, 50, 100, 250, 500, 1000 };
+const float BENCH_TIMESTEP = 1.0f / 60.0f;
+const unsigned BENCH_WARMUP_FRAMES = 10;
+const char* BENCH_ANIMATION_SET = "SkinnedArmor/XMLData/GirlbotAnimations.xml";
+
+// the clip references of a character tick, as literal paths the way Character used to pass them, and as set clip names
+const char* BENCH_TICK_PATHS[] =
+{
+    "SkinnedArmor/Girlbot/Girlbot_Run.ani",
+    "SkinnedArmor/Girlbot/Girlbot_Idle.ani",
+    "SkinnedArmor/Girlbot/Girlbot_EquipIdleLY.ani",
+    "SkinnedArmor/Girlbot/Girlbot_JumpStart.ani"
+};
+const char* BENCH_TICK_CLIPS[] = { "Run", "Idle", "EquipIdle", "JumpStart" };
+const unsigned BENCH_TICK_CALLS = 5;
+
+// brawl hit registration: contacts per attacker and frame, reported from a window of nearby targets, and swing length
+const unsigned BENCH_CONTACTS_PER_FRAME = 8;
+const unsigned BENCH_CONTACT_SPREAD = 64;
+const unsigned BENCH_SWING_FRAMES = 30;
+
+// scene load: the level, whose top-level nodes are cloned to scale it up, and the clones' spacing
+const char* BENCH_SCENE = "SkinnedArmor/Scene/LevelScene.xml";
+const float BENCH_SCENE_COPY_SPACING = 100.0f;
+
+//=============================================================================
+// the per-hit damage event Character used to send, one VariantMap per hit
+//=============================================================================
+URHO3D_EVENT(E_BENCHWEAPONDMG, BenchWeaponDmg)
+{
+    URHO3D_PARAM(P_NODE, Node);
+}
+
+static inline unsigned NextRandom(unsigned &seed)
+{
+    seed = seed * 1664525u + 1013904223u;
+    return seed >> 8;
+}
+
+//=============================================================================
+// one character tick's controller calls: the ground locomotion branch of
+// Character::FixedUpdate plus the equipped weapon layer poll. Clip is a
+// resource path for AnimationController and a handle for AnimationSetController.
+//=============================================================================
+template <class Controller, class Clip> static void TickController(Controller *animCtrl, const Clip *clips, unsigned tick)
+{
+    const Clip &run = clips[0];
+    const Clip &idle = clips[1];
+    const Clip &equipIdle = clips[2];
+    const Clip &jumpStart = clips[3];
+
+    animCtrl->PlayExclusive((tick / 60) & 1 ? idle : run, 0, true, 0.2f);
+    animCtrl->SetSpeed(run, 1.5f);
+    animCtrl->Play(equipIdle, 1, true, 0.1f);
+    animCtrl->IsAtEnd(equipIdle);
+    animCtrl->IsAtEnd(jumpStart);
+}
+
+//=============================================================================
+//=============================================================================
+ArmorBench::ArmorBench(Context* context) :
+    Application(context),
+    benchHits_(0),
+    benchEvents_(0)
+{
+    ArmorLoadout::RegisterObject(context);
+    AnimationSet::RegisterObject(context);
+    AnimationSetController::RegisterObject(context);
+    QuantizedModel::RegisterObject(context);
+    HitRegistry::RegisterObject(context);
+    context->RegisterSubsystem(new ArmorModelCache(context));
+}
+
+void ArmorBench::Setup()
+{
+    engineParameters_["LogName"]  = GetSubsystem<FileSystem>()->GetProgramDir() + "skinnedArmorBench.log";
+    engineParameters_["Headless"] = true;
+    engineParameters_["Sound"]    = false;
+
+    // engine options start with a dash, the rest is the command
+    const Vector<String> &arguments = GetArguments();
+
+    for (unsigned i = 0; i < arguments.Size(); ++i)
+    {
+        if (!arguments[i].StartsWith("-"))
+        {
+            arguments_.Push(arguments[i]);
+        }
+    }
+}
+
+void ArmorBench::Start()
+{
+    if (arguments_.Empty())
+    {
+        PrintUsage();
+        ErrorExit();
+        return;
+    }
+
+    const String command = arguments_[0].ToLower();
+    Vector<String> args;
+    bool success = false;
+
+    for (unsigned i = 1; i < arguments_.Size(); ++i)
+    {
+        args.Push(arguments_[i]);
+    }
+
+    if (command == "skinning")
+    {
+        success = RunSkinning(args);
+    }
+    else if (command == "animation")
+    {
+        success = RunAnimation(args);
+    }
+    else if (command == "animationtick")
+    {
+        success = RunAnimationTick(args);
+    }
+    else if (command == "hitregistry")
+    {
+        success = RunHitRegistry(args);
+    }
+    else if (command == "sceneload")
+    {
+        success = RunSceneLoad(args);
+    }
+    else
+    {
+        PrintUsage();
+    }
+
+    if (success)
+    {
+        engine_->Exit();
+    }
+    else
+    {
+        ErrorExit();
+    }
+}
+
+void ArmorBench::PrintUsage()
+{
+    PrintLine("Usage: 75_SkinnedArmorBench <benchmark> [arguments]\n"
+              "\n"
+              "Benchmarks:\n"
+              "  skinning [iterations] [lodLevel]\n"
+              "                        CPU skin the armored character's hit mesh with each supported\n"
+              "                        kernel, report vertices per second (defaults 200 and 0)\n"
+              "  animation [maxCharacters] [frames]\n"
+              "                        animate 1 to maxCharacters characters with the armor as geometry\n"
+              "                        and as a second AnimatedModel, report per-frame animation update\n"
+              "                        and bone matrix time and memory (defaults 1000 and 120)\n"
+              "  animationtick [characters] [ticks]\n"
+              "                        time a character tick's animation controller calls with resource\n"
+              "                        paths and with animation set handles (defaults 100 and 1000)\n"
+              "  hitregistry [attackers] [targets] [frames]\n"
+              "                        register a brawl's weapon contacts with per-attacker recipient lists\n"
+              "                        and an event per hit, and with the HitRegistry's recipient sets and\n"
+              "                        one batch per frame (defaults 100, 500 and 600)\n"
+              "  sceneload [copies] [iterations]\n"
+              "                        load LevelScene.xml scaled up to copies of its nodes from XML and\n"
+              "                        from the binary scene format, report load times (defaults 100 and 10)\n"
+              "\n"
+              "Results are printed as CSV with a header line.");
+}
+
+bool ArmorBench::RunSkinning(const Vector<String> &args)
+{
+    const unsigned iterations = Max(args.Size() > 0 ? ToUInt(args[0]) : 200U, 1U);
+    const unsigned lodLevel = args.Size() > 1 ? ToUInt(args[1]) : 0;
+
+    ArmorLoadout *loadout = GetSubsystem<ResourceCache>()->GetResource<ArmorLoadout>(BENCH_LOADOUT);
+
+    if (!loadout)
+    {
+        return false;
+    }
+
+    SkinnedHitMesh hitMesh;
+
+    if (!hitMesh.Define(loadout->GetModel(), lodLevel))
+    {
+        PrintLine("loadout model has no skinned geometry", true);
+        return false;
+    }
+
+    // a fixed pseudo-random pose, bind pose would make every matrix identity
+    const unsigned numBones = loadout->GetModel()->GetSkeleton().GetNumBones();
+    PODVector<Matrix3x4> skinMatrices(numBones);
+
+    SetRandomSeed(1);
+
+    for (unsigned i = 0; i < numBones; ++i)
+    {
+        skinMatrices[i] = Matrix3x4(Vector3(Random(-0.1f, 0.1f), Random(-0.1f, 0.1f), Random(-0.1f, 0.1f)),
+                                    Quaternion(Random(-30.0f, 30.0f), Random(-30.0f, 30.0f), Random(-30.0f, 30.0f)), 1.0f);
+    }
+
+    // time the kernels alone on the hit mesh's data
+    const PODVector<Vector4> &positions = hitMesh.GetBindPositions();
+    const PODVector<SkinWeights> &weights = hitMesh.GetSkinWeights();
+    const unsigned numVertices = positions.Size();
+    PODVector<Vector4> reference(numVertices);
+    PODVector<Vector4> skinned(numVertices);
+
+    SkinVertices(SK_SCALAR, &positions[0], &weights[0], numVertices, &skinMatrices[0], &reference[0]);
+
+    PrintLine("kernel,vertices,iterations,seconds,vertices_per_second,max_error");
+
+    HiresTimer timer;
+    const SkinningKernel kernels[] = { SK_SCALAR, SK_SSE, SK_AVX };
+
+    for (unsigned k = 0; k < 3; ++k)
+    {
+        if (!IsSkinningKernelSupported(kernels[k]))
+        {
+            continue;
+        }
+
+        // warm up caches
+        SkinVertices(kernels[k], &positions[0], &weights[0], numVertices, &skinMatrices[0], &skinned[0]);
+
+        timer.Reset();
+
+        for (unsigned i = 0; i < iterations; ++i)
+        {
+            SkinVertices(kernels[k], &positions[0], &weights[0], numVertices, &skinMatrices[0], &skinned[0]);
+        }
+
+        const double seconds = timer.GetUSec(false) / 1000000.0;
+        float maxError = 0.0f;
+
+        for (unsigned i = 0; i < numVertices; ++i)
+        {
+            maxError = Max(maxError, (Vector3(&skinned[i].x_) - Vector3(&reference[i].x_)).Length());
+        }
+
+        PrintLine(String(GetSkinningKernelName(kernels[k])) + "," + String(numVertices) + "," + String(iterations) + "," +
+                  String(seconds) + "," + String(seconds > 0.0 ? numVertices * (double)iterations / seconds : 0.0) + "," +
+                  String(maxError));
+    }
+
+    return true;
+}
+
+bool ArmorBench::RunAnimation(const Vector<String> &args)
+{
+    const unsigned maxCharacters = args.Size() > 0 ? ToUInt(args[0]) : 1000;
+    const unsigned frames = Max(args.Size() > 1 ? ToUInt(args[1]) : 120U, 1U);
+
+    if (!GetSubsystem<ResourceCache>()->GetResource<ArmorLoadout>(BENCH_LOADOUT))
+    {
+        return false;
+    }
+
+    PrintLine("config,characters,animated_models,skinned_bones,frames,animation_ms_per_frame,bone_matrix_ms_per_frame,memory_bytes");
+
+    for (unsigned i = 0; i < sizeof(BENCH_CHARACTER_COUNTS) / sizeof(BENCH_CHARACTER_COUNTS[0]); ++i)
+    {
+        if (BENCH_CHARACTER_COUNTS[i] > maxCharacters)
+        {
+            break;
+        }
+
+        RunAnimationConfig(BENCH_CHARACTER_COUNTS[i], frames, false);
+        RunAnimationConfig(BENCH_CHARACTER_COUNTS[i], frames, true);
+    }
+
+    return true;
+}
+
+void ArmorBench::RunAnimationConfig(unsigned numCharacters, unsigned frames, bool separateArmor)
+{
+    ResourceCache* cache = GetSubsystem<ResourceCache>();
+    ArmorLoadout *loadout = cache->GetResource<ArmorLoadout>(BENCH_LOADOUT);
+    Model *baseModel = cache->GetResource<Model>(BENCH_BASE_MODEL);
+    Model *armorModel = cache->GetResource<Model>(BENCH_ARMOR_MODEL);
+    Material *armorMaterial = cache->GetResource<Material>(BENCH_ARMOR_MATERIAL);
+
+    SharedPtr<Scene> scene(new Scene(context_));
+    Octree *octree = scene->CreateComponent<Octree>();
+    PODVector<AnimatedModel*> animatedModels;
+    const unsigned gridSize = (unsigned)ceilf(sqrtf((float)numCharacters));
+
+    for (unsigned i = 0; i < numCharacters; ++i)
+    {
+        Node *node = scene->CreateChild("Character");
+        node->SetPosition(Vector3((float)(i % gridSize) * 2.0f, 0.0f, (float)(i / gridSize) * 2.0f));
+
+        Node *adjustNode = node->CreateChild("AdjNode");
+        adjustNode->SetRotation(Quaternion(180, Vector3(0,1,0)));
+
+        AnimatedModel *animatedModel = adjustNode->CreateComponent<AnimatedModel>();
+
+        if (separateArmor)
+        {
+            // the alternative: armor in its own AnimatedModel, following the first one's bones
+            animatedModel->SetModel(baseModel);
+            AnimatedModel *armor = adjustNode->CreateComponent<AnimatedModel>();
+            armor->SetModel(armorModel);
+            armor->SetMaterial(armorMaterial);
+            animatedModels.Push(animatedModel);
+            animatedModels.Push(armor);
+        }
+        else
+        {
+            loadout->Apply(animatedModel);
+            animatedModels.Push(animatedModel);
+        }
+
+        // spread clips and phases so the characters don't all sample the same keys
+        AnimationController *animCtrl = adjustNode->CreateComponent<AnimationController>();
+        const String animation = BENCH_ANIMATIONS[i % NUM_BENCH_ANIMATIONS];
+        animCtrl->PlayExclusive(animation, 0, true, 0.0f);
+        animCtrl->SetTime(animation, (i * 0.37f));
+    }
+
+    PODVector<Matrix3x4> skinMatrices;
+    HiresTimer timer;
+    long long animationUSec = 0;
+    long long boneMatrixUSec = 0;
+    unsigned skinnedBones = 0;
+    FrameInfo frame;
+
+    frame.timeStep_ = BENCH_TIMESTEP;
+    frame.camera_ = NULL;
+
+    for (unsigned f = 0; f < BENCH_WARMUP_FRAMES + frames; ++f)
+    {
+        const bool measure = f >= BENCH_WARMUP_FRAMES;
+        frame.frameNumber_ = f + 1;
+
+        // animation: controller time advance, then the drawables apply their states to the bone nodes
+        timer.Reset();
+        scene->Update(BENCH_TIMESTEP);
+        octree->Update(frame);
+
+        if (measure)
+        {
+            animationUSec += timer.GetUSec(false);
+        }
+
+        // bone matrices: what each AnimatedModel computes for skinning when rendered
+        timer.Reset();
+        skinnedBones = 0;
+
+        for (unsigned i = 0; i < animatedModels.Size(); ++i)
+        {
+            SkinnedHitMesh::GetSkinMatrices(animatedModels[i], skinMatrices);
+            skinnedBones += skinMatrices.Size();
+        }
+
+        if (measure)
+        {
+            boneMatrixUSec += timer.GetUSec(false);
+        }
+    }
+
+    // estimate: per AnimatedModel its bones and skin matrices, plus the models used once
+    unsigned memoryUse = 0;
+
+    for (unsigned i = 0; i < animatedModels.Size(); ++i)
+    {
+        const unsigned numBones = animatedModels[i]->GetSkeleton().GetNumBones();
+        memoryUse += sizeof(AnimatedModel) + numBones * (sizeof(Bone) + sizeof(Matrix3x4));
+    }
+
+    memoryUse += separateArmor ? baseModel->GetMemoryUse() + armorModel->GetMemoryUse() : loadout->GetModel()->GetMemoryUse();
+
+    PrintLine(String(separateArmor ? "animatedmodel" : "geometry") + "," + String(numCharacters) + "," + String(animatedModels.Size()) + "," +
+              String(skinnedBones) + "," + String(frames) + "," + String(animationUSec / 1000.0 / frames) + "," +
+              String(boneMatrixUSec / 1000.0 / frames) + "," + String(memoryUse));
+}
+
+bool ArmorBench::RunAnimationTick(const Vector<String> &args)
+{
+    const unsigned numCharacters = Max(args.Size() > 0 ? ToUInt(args[0]) : 100U, 1U);
+    const unsigned ticks = Max(args.Size() > 1 ? ToUInt(args[1]) : 1000U, 1U);
+
+    if (!GetSubsystem<ResourceCache>()->GetResource<AnimationSet>(BENCH_ANIMATION_SET))
+    {
+        return false;
+    }
+
+    PrintLine("controller,characters,ticks,calls_per_tick,call_ns_per_character_tick,update_ns_per_character_tick");
+
+    RunAnimationTickConfig(numCharacters, ticks, false);
+    RunAnimationTickConfig(numCharacters, ticks, true);
+
+    return true;
+}
+
+void ArmorBench::RunAnimationTickConfig(unsigned numCharacters, unsigned ticks, bool handles)
+{
+    ResourceCache* cache = GetSubsystem<ResourceCache>();
+    AnimationSet *animationSet = cache->GetResource<AnimationSet>(BENCH_ANIMATION_SET);
+    Model *baseModel = cache->GetResource<Model>(BENCH_BASE_MODEL);
+
+    SharedPtr<Scene> scene(new Scene(context_));
+    PODVector<AnimationController*> controllers;
+    PODVector<AnimationSetController*> setControllers;
+    unsigned clipHandles[4];
+
+    for (unsigned i = 0; i < 4; ++i)
+    {
+        clipHandles[i] = animationSet->GetHandle(BENCH_TICK_CLIPS[i]);
+    }
+
+    // no octree: only the controllers are timed, not applying the poses
+    for (unsigned i = 0; i < numCharacters; ++i)
+    {
+        Node *node = scene->CreateChild("Character");
+        AnimatedModel *animatedModel = node->CreateComponent<AnimatedModel>();
+        animatedModel->SetModel(baseModel);
+
+        if (handles)
+        {
+            AnimationSetController *animCtrl = node->CreateComponent<AnimationSetController>();
+            animCtrl->SetAnimationSet(animationSet);
+            setControllers.Push(animCtrl);
+        }
+        else
+        {
+            controllers.Push(node->CreateComponent<AnimationController>());
+        }
+    }
+
+    HiresTimer timer;
+    long long callUSec = 0;
+    long long updateUSec = 0;
+
+    for (unsigned t = 0; t < BENCH_WARMUP_FRAMES + ticks; ++t)
+    {
+        const bool measure = t >= BENCH_WARMUP_FRAMES;
+
+        timer.Reset();
+
+        for (unsigned i = 0; i < numCharacters; ++i)
+        {
+            if (handles)
+            {
+                TickController(setControllers[i], clipHandles, t);
+            }
+            else
+            {
+                TickController(controllers[i], BENCH_TICK_PATHS, t);
+            }
+        }
+
+        if (measure)
+        {
+            callUSec += timer.GetUSec(false);
+        }
+
+        // controller updates run on the scene post-update
+        timer.Reset();
+        scene->Update(BENCH_TIMESTEP);
+
+        if (measure)
+        {
+            updateUSec += timer.GetUSec(false);
+        }
+    }
+
+    const double characterTicks = (double)numCharacters * ticks;
+
+    PrintLine(String(handles ? "handles" : "paths") + "," + String(numCharacters) + "," + String(ticks) + "," +
+              String(BENCH_TICK_CALLS) + "," + String(callUSec * 1000.0 / characterTicks) + "," +
+              String(updateUSec * 1000.0 / characterTicks));
+}
+
+bool ArmorBench::RunHitRegistry(const Vector<String> &args)
+{
+    const unsigned numAttackers = Max(args.Size() > 0 ? ToUInt(args[0]) : 100U, 1U);
+    const unsigned numTargets = Max(args.Size() > 1 ? ToUInt(args[1]) : 500U, 1U);
+    const unsigned frames = Max(args.Size() > 2 ? ToUInt(args[2]) : 600U, 1U);
+
+    SubscribeToEvent(E_BENCHWEAPONDMG, URHO3D_HANDLER(ArmorBench, HandleBenchWeaponDmg));
+    SubscribeToEvent(E_WEAPONHITS, URHO3D_HANDLER(ArmorBench, HandleWeaponHits));
+
+    PrintLine("registration,attackers,targets,frames,contacts,hits,events,ns_per_contact");
+
+    RunHitRegistryConfig(numAttackers, numTargets, frames, false);
+    RunHitRegistryConfig(numAttackers, numTargets, frames, true);
+
+    UnsubscribeFromEvent(E_BENCHWEAPONDMG);
+    UnsubscribeFromEvent(E_WEAPONHITS);
+
+    return true;
+}
+
+void ArmorBench::RunHitRegistryConfig(unsigned numAttackers, unsigned numTargets, unsigned frames, bool registry)
+{
+    SharedPtr<Scene> scene(new Scene(context_));
+    HitRegistry *hitRegistry = scene->CreateComponent<HitRegistry>(LOCAL);
+    PODVector<Node*> targets;
+    Vector<Vector<Node*> > recipientLists(numAttackers);
+
+    for (unsigned i = 0; i < numAttackers; ++i)
+    {
+        hitRegistry->AddAttacker(scene->CreateChild("Attacker"));
+    }
+
+    for (unsigned i = 0; i < numTargets; ++i)
+    {
+        targets.Push(scene->CreateChild("Target"));
+    }
+
+    // both configurations see the same contacts
+    unsigned seed = 1;
+    unsigned contacts = 0;
+    HiresTimer timer;
+    long long registerUSec = 0;
+
+    benchHits_ = 0;
+    benchEvents_ = 0;
+
+    for (unsigned f = 0; f < BENCH_WARMUP_FRAMES + frames; ++f)
+    {
+        const bool measure = f >= BENCH_WARMUP_FRAMES;
+
+        if (f == BENCH_WARMUP_FRAMES)
+        {
+            benchHits_ = 0;
+            benchEvents_ = 0;
+        }
+
+        timer.Reset();
+
+        for (unsigned a = 0; a < numAttackers; ++a)
+        {
+            // staggered swings, each one clears the attacker's recipients
+            if ((f + a * 7) % BENCH_SWING_FRAMES == 0)
+            {
+                if (registry)
+                    hitRegistry->BeginSwing(a);
+                else
+                    recipientLists[a].Clear();
+            }
+
+            for (unsigned c = 0; c < BENCH_CONTACTS_PER_FRAME; ++c)
+            {
+                Node *target = targets[(a * 5 + NextRandom(seed) % BENCH_CONTACT_SPREAD) % numTargets];
+
+                if (registry)
+                {
+                    hitRegistry->RegisterHit(a, target, Vector3::ZERO, Vector3::ZERO);
+                }
+                else if (!recipientLists[a].Contains(target))
+                {
+                    // the way Character::HandleWeaponCollision registered hits
+                    recipientLists[a].Push(target);
+
+                    using namespace BenchWeaponDmg;
+
+                    VariantMap& eventData = GetEventDataMap();
+                    eventData[P_NODE] = target;
+                    SendEvent(E_BENCHWEAPONDMG, eventData);
+                }
+            }
+        }
+
+        if (registry)
+        {
+            hitRegistry->SendHits();
+        }
+
+        if (measure)
+        {
+            registerUSec += timer.GetUSec(false);
+            contacts += numAttackers * BENCH_CONTACTS_PER_FRAME;
+        }
+    }
+
+    PrintLine(String(registry ? "registry" : "lists") + "," + String(numAttackers) + "," + String(numTargets) + "," + String(frames) + "," +
+              String(contacts) + "," + String(benchHits_) + "," + String(benchEvents_) + "," +
+              String(registerUSec * 1000.0 / contacts));
+}
+
+void ArmorBench::HandleBenchWeaponDmg(StringHash eventType, VariantMap& eventData)
+{
+    using namespace BenchWeaponDmg;
+
+    if (eventData[P_NODE].GetPtr())
+    {
+        ++benchHits_;
+    }
+    ++benchEvents_;
+}
+
+void ArmorBench::HandleWeaponHits(StringHash eventType, VariantMap& eventData)
+{
+    using namespace WeaponHits;
+
+    benchHits_ += eventData[P_NUMHITS].GetUInt();
+    ++benchEvents_;
+}
+
+bool ArmorBench::RunSceneLoad(const Vector<String> &args)
+{
+    const unsigned copies = Max(args.Size() > 0 ? ToUInt(args[0]) : 100U, 1U);
+    const unsigned iterations = Max(args.Size() > 1 ? ToUInt(args[1]) : 10U, 1U);
+
+    XMLFile *xmlLevel = GetSubsystem<ResourceCache>()->GetResource<XMLFile>(BENCH_SCENE);
+
+    if (!xmlLevel)
+    {
+        return false;
+    }
+
+    // scale the level up by cloning its nodes side by side
+    SharedPtr<Scene> scene(new Scene(context_));
+    scene->LoadXML(xmlLevel->GetRoot());
+
+    Vector<SharedPtr<Node> > levelNodes = scene->GetChildren();
+
+    for (unsigned c = 1; c < copies; ++c)
+    {
+        for (unsigned i = 0; i < levelNodes.Size(); ++i)
+        {
+            Node *clone = levelNodes[i]->Clone();
+            clone->Translate(Vector3((float)c * BENCH_SCENE_COPY_SPACING, 0.0f, 0.0f), TS_WORLD);
+        }
+    }
+
+    // write both formats next to the executable, the way the game would find them on disk
+    const String fileBase = GetSubsystem<FileSystem>()->GetProgramDir() + "sceneload";
+    const String xmlFileName = fileBase + ".xml";
+    const String binaryFileName = fileBase + ".bscn";
+    SharedPtr<BinaryScene> binaryScene(new BinaryScene(context_));
+    {
+        File xmlFile(context_, xmlFileName, FILE_WRITE);
+        File binaryFile(context_, binaryFileName, FILE_WRITE);
+
+        if (!xmlFile.IsOpen() || !scene->SaveXML(xmlFile) || !binaryFile.IsOpen() || !binaryScene->Save(scene, binaryFile))
+        {
+            PrintLine("could not write " + fileBase, true);
+            return false;
+        }
+    }
+
+    PODVector<Node*> nodes;
+    scene->GetChildren(nodes, true);
+
+    PrintLine("format,copies,nodes,file_bytes,iterations,first_load_ms,avg_load_ms,min_load_ms");
+
+    // the referenced models are cached by the setup load above, so both formats time the scene alone
+    for (unsigned binary = 0; binary < 2; ++binary)
+    {
+        const String &fileName = binary ? binaryFileName : xmlFileName;
+        SharedPtr<Scene> loaded(new Scene(context_));
+        HiresTimer timer;
+        long long firstUSec = 0;
+        long long totalUSec = 0;
+        long long minUSec = M_MAX_INT;
+
+        for (unsigned i = 0; i < iterations; ++i)
+        {
+            timer.Reset();
+
+            if (binary)
+            {
+                binaryScene->Load(loaded, fileName);
+            }
+            else
+            {
+                // what CharacterDemo::CreateScene did: parse the file, then load the scene from the document
+                File file(context_, fileName);
+                SharedPtr<XMLFile> xmlFile(new XMLFile(context_));
+
+                if (xmlFile->Load(file))
+                {
+                    loaded->LoadXML(xmlFile->GetRoot());
+                }
+            }
+
+            const long long usec = timer.GetUSec(false);
+
+            if (i == 0)
+            {
+                firstUSec = usec;
+            }
+            totalUSec += usec;
+            minUSec = Min(minUSec, usec);
+        }
+
+        PODVector<Node*> loadedNodes;
+        loaded->GetChildren(loadedNodes, true);
+
+        if (loadedNodes.Size() != nodes.Size())
+        {
+            PrintLine(fileName + " loaded " + String(loadedNodes.Size()) + " of " + String(nodes.Size()) + " nodes", true);
+            return false;
+        }
+
+        PrintLine(String(binary ? "binary" : "xml") + "," + String(copies) + "," + String(nodes.Size()) + "," +
+                  String(File(context_, fileName).GetSize()) + "," + String(iterations) + "," + String(firstUSec / 1000.0) + "," +
+                  String(totalUSec / 1000.0 / iterations) + "," + String(minUSec / 1000.0));
+    }
+
+    GetSubsystem<FileSystem>()->Delete(xmlFileName);
+    GetSubsystem<FileSystem>()->Delete(binaryFileName);
+
+    return true;
+}
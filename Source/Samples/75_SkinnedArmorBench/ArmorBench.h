@@ -0,0 +1,70 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#pragma once
+
+#include <Urho3D/Engine/Application.h>
+
+using namespace Urho3D;
+
+//=============================================================================
+// headless benchmarks for the skinned armor code. Runs one benchmark per
+// invocation and prints its results as CSV on stdout:
+//
+//   75_SkinnedArmorBench skinning [iterations] [lodLevel]
+//   75_SkinnedArmorBench animation [maxCharacters] [frames]
+//   75_SkinnedArmorBench animationtick [characters] [ticks]
+//   75_SkinnedArmorBench hitregistry [attackers] [targets] [frames]
+//   75_SkinnedArmorBench sceneload [copies] [iterations]
+//=============================================================================
+class ArmorBench : public Application
+{
+    URHO3D_OBJECT(ArmorBench, Application);
+
+public:
+    /// Construct.
+    ArmorBench(Context* context);
+
+    virtual void Setup();
+    virtual void Start();
+
+private:
+    void PrintUsage();
+    bool RunSkinning(const Vector<String> &args);
+    bool RunAnimation(const Vector<String> &args);
+    void RunAnimationConfig(unsigned numCharacters, unsigned frames, bool separateArmor);
+    bool RunAnimationTick(const Vector<String> &args);
+    void RunAnimationTickConfig(unsigned numCharacters, unsigned ticks, bool handles);
+    bool RunHitRegistry(const Vector<String> &args);
+    void RunHitRegistryConfig(unsigned numAttackers, unsigned numTargets, unsigned frames, bool registry);
+    bool RunSceneLoad(const Vector<String> &args);
+    void HandleBenchWeaponDmg(StringHash eventType, VariantMap& eventData);
+    void HandleWeaponHits(StringHash eventType, VariantMap& eventData);
+
+    /// Positional command-line arguments, engine options removed.
+    Vector<String> arguments_;
+
+    // hit registration benchmark: hits and events received
+    unsigned benchHits_;
+    unsigned benchEvents_;
+};
+